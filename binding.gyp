@@ -9,13 +9,33 @@
                 'src/error.cc',
                 'src/oid.cc',
                 'src/reference.cc',
+                'src/ref_watcher.cc',
                 'src/repo.cc',
                 'src/revwalk.cc',
                 'src/signature.cc',
                 'src/tree.cc',
                 'src/tree_entry.cc',
+                'src/tree_builder.cc',
                 'src/diff_list.cc',
+                'src/diff_cache.cc',
+                'src/diff_signature.cc',
+                'src/index.cc',
+                'src/status.cc',
+                'src/blame.cc',
+                'src/pack_writer.cc',
+                'src/pack_builder.cc',
+                'src/indexer.cc',
+                'src/commit_graph.cc',
+                'src/bitmap_index.cc',
                 'src/threads.cc',
+                'src/functions/arena.cc',
+                'src/functions/bitmap.cc',
+                'src/functions/bloom.cc',
+                'src/functions/file.cc',
+                'src/functions/graph.cc',
+                'src/functions/history.cc',
+                'src/functions/pack.cc',
+                'src/functions/sha1.cc',
                 'src/functions/string.cc',
                 'src/functions/utilities.cc'
             ],
@@ -27,7 +47,8 @@
 
             'libraries': [
                 '-L<!(pwd)/vendor/libgit2/build',
-                '-lgit2'
+                '-lgit2',
+                '-lz'
             ],
 
             'cflags': [
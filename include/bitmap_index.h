@@ -0,0 +1,135 @@
+/*
+ * Copyright 2013, Tim Branyen @tbranyen <tim@tabdeveloper.com>
+ * @author Michael Robinson @codeofinterest <mike@pagesofinterest.net>
+ *
+ * Dual licensed under the MIT and GPL licenses.
+ */
+
+#ifndef GITBITMAPINDEX_H
+#define GITBITMAPINDEX_H
+
+#include <v8.h>
+#include <node.h>
+#include <string>
+#include <vector>
+
+#include "git2.h"
+
+#include "repo.h"
+#include "error.h"
+
+using namespace node;
+using namespace v8;
+
+class Bitset;
+class ReachabilityBitmaps;
+
+/**
+ * Writes reachability bitmaps for selected commits and answers object set
+ * queries with them: the objects reachable from the included commits but
+ * not the excluded ones are the OR of their bitmaps, AND-NOT the OR of the
+ * excluded ones', so only commits above the nearest bitmaps are read.
+ */
+class GitBitmapIndex : public ObjectWrap {
+  public:
+
+    static Persistent<Function> constructor_template;
+
+    /**
+     * Objects handed to JS at a time by objects.
+     */
+    static const size_t OBJECTS_BATCH_SIZE = 1000;
+
+    static void Initialize(Handle<v8::Object> target);
+
+  protected:
+    GitBitmapIndex() {}
+    ~GitBitmapIndex() {}
+
+    static Handle<Value> New(const Arguments& args);
+
+    static Handle<Value> Write(const Arguments& args);
+    static void WriteWork(uv_work_t *req);
+    static void WriteAfterWork(uv_work_t *req);
+
+    static Handle<Value> Count(const Arguments& args);
+    static void CountWork(uv_work_t *req);
+    static void CountAfterWork(uv_work_t *req);
+
+    static Handle<Value> Objects(const Arguments& args);
+    static void ObjectsWork(void *payload);
+    static void ObjectsWorkSendBatch(uv_async_t *handle, int status /*UNUSED*/);
+    static void ObjectsWorkSendEnd(uv_async_t *handle, int status /*UNUSED*/);
+    static void ObjectsFree(uv_handle_t *handle);
+
+  private:
+
+    struct WriteBaton {
+      uv_work_t request;
+      const git_error* error;
+
+      git_repository* rawRepo;
+      unsigned int interval;
+
+      size_t objects;
+      size_t bitmaps;
+      std::string path;
+
+      Persistent<Function> callback;
+    };
+
+    /**
+     * Object counts of a selection, by type.
+     */
+    struct Counts {
+      size_t objects;
+      size_t commits;
+      size_t trees;
+      size_t blobs;
+      size_t walked;
+      bool bitmaps;
+    };
+
+    struct CountBaton {
+      uv_work_t request;
+      const git_error* error;
+
+      git_repository* rawRepo;
+      std::vector<std::string> include;
+      std::vector<std::string> exclude;
+
+      Counts counts;
+
+      Persistent<Function> callback;
+    };
+
+    struct ObjectsBaton {
+      uv_thread_t threadId;
+      uv_mutex_t mutex;
+      uv_async_t asyncBatch;
+      uv_async_t asyncEnd;
+
+      ThreadError error;
+
+      std::string repoPath;
+      std::vector<std::string> include;
+      std::vector<std::string> exclude;
+
+      /**
+       * Guarded by mutex.
+       */
+      std::vector<git_oid> pending;
+
+      Counts counts;
+
+      Persistent<Function> batchCallback;
+      Persistent<Function> endCallback;
+    };
+
+    static int Select(git_repository* repo, const std::vector<std::string>& include,
+                      const std::vector<std::string>& exclude, ReachabilityBitmaps& bitmaps,
+                      Bitset& out, Counts& counts);
+    static Handle<Value> CountsToJS(const Counts& counts);
+};
+
+#endif
@@ -0,0 +1,135 @@
+/*
+ * Copyright 2013, Tim Branyen @tbranyen <tim@tabdeveloper.com>
+ * @author Michael Robinson @codeofinterest <mike@pagesofinterest.net>
+ *
+ * Dual licensed under the MIT and GPL licenses.
+ */
+
+#ifndef BLAME_H
+#define BLAME_H
+
+#include <v8.h>
+#include <node.h>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+
+#include "git2.h"
+
+#include "repo.h"
+#include "error.h"
+#include "functions/file.h"
+
+using namespace node;
+using namespace v8;
+
+/**
+ * Attributes every line of a file to the commit that last changed it. Lines
+ * are passed from each commit to its parents through zero context blob
+ * diffs, newest commit first, and hunks are sent to JS as soon as their
+ * commit is known, so the most recently changed lines arrive first.
+ */
+class GitBlame : public ObjectWrap {
+  public:
+
+    static Persistent<Function> constructor_template;
+
+    static void Initialize(Handle<v8::Object> target);
+
+  protected:
+    GitBlame() {}
+    ~GitBlame() {}
+
+    static Handle<Value> New(const Arguments& args);
+
+    static Handle<Value> File(const Arguments& args);
+    static void FileWork(void *payload);
+    static void FileWorkSendHunks(uv_async_t *handle, int status /*UNUSED*/);
+    static void FileWorkSendEnd(uv_async_t *handle, int status /*UNUSED*/);
+    static void FileFree(uv_handle_t *handle);
+
+  private:
+
+    /**
+     * A run of consecutive lines, 1-based. finalStart is the line in the
+     * blamed revision, sourceStart the same line in the suspect's blob.
+     */
+    struct LineRange {
+      size_t finalStart;
+      size_t sourceStart;
+      size_t count;
+    };
+
+    /**
+     * A commit still holding lines that may have come from its parents.
+     */
+    struct Suspect {
+      git_oid commit;
+      git_oid blob;
+      git_time_t time;
+      std::vector<LineRange> ranges;
+    };
+
+    typedef std::map<git_oid, Suspect, OidLess> SuspectMap;
+
+    /**
+     * Suspects by commit time, so the newest is always processed first.
+     */
+    typedef std::multimap<git_time_t, git_oid> SuspectQueue;
+
+    struct BlameHunk {
+      git_oid commit;
+      size_t finalStart;
+      size_t sourceStart;
+      size_t count;
+      bool boundary;
+      std::string authorName;
+      std::string authorEmail;
+      git_time_t authorTime;
+    };
+
+    struct FileBaton {
+      uv_thread_t threadId;
+      uv_mutex_t mutex;
+      uv_async_t asyncHunks;
+      uv_async_t asyncEnd;
+
+      ThreadError error;
+
+      std::string repoPath;
+      std::string path;
+      std::string newest;
+      std::string oldest;
+      bool firstParent;
+      size_t minLine;
+      size_t maxLine;
+
+      /**
+       * Commits between oldest and newest; suspects outside it are boundaries.
+       */
+      bool limited;
+      std::set<git_oid, OidLess> range;
+
+      std::vector<BlameHunk> hunks;
+      size_t totalLines;
+      size_t attributedLines;
+
+      Persistent<Function> hunksCallback;
+      Persistent<Function> endCallback;
+    };
+
+    static int BlobAtPath(git_repository* repo, git_commit* commit, const std::string& path,
+                          git_oid* blob, bool& found);
+    static int PassToParent(git_repository* repo, const git_oid& parentBlob, const git_oid& blob,
+                            std::vector<LineRange>& ranges, std::vector<LineRange>& passed);
+    static void Enqueue(SuspectMap& suspects, SuspectQueue& queue, git_commit* commit,
+                        const git_oid& blob, const std::vector<LineRange>& ranges);
+    static int BlameFileCallback(const git_diff_delta *delta, float progress, void *payload);
+    static int BlameHunkCallback(const git_diff_delta *delta, const git_diff_range *range,
+                                 const char *header, size_t header_len, void *payload);
+    static bool FinalStartLess(const LineRange& a, const LineRange& b);
+    static void Attribute(FileBaton* baton, git_commit* commit, std::vector<LineRange>& ranges, bool boundary);
+};
+
+#endif
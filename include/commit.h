@@ -7,6 +7,7 @@
 
 #include <v8.h>
 #include <node.h>
+#include <string>
 #include <vector>
 
 #include "git2.h"
@@ -81,6 +82,14 @@ class GitCommit : public ObjectWrap {
     static void ParentsWork(uv_work_t* req);
     static void ParentsAfterWork(uv_work_t* req);
 
+    /**
+     * Write a commit from a tree oid, parent oids and signatures, and
+     * optionally move a ref to it, without touching the index or workdir.
+     */
+    static Handle<Value> Create(const Arguments& args);
+    static void CreateWork(uv_work_t* req);
+    static void CreateAfterWork(uv_work_t* req);
+
   private:
     git_commit* commit;
     git_oid* oid;
@@ -159,4 +168,36 @@ class GitCommit : public ObjectWrap {
 
       Persistent<Function> callback;
     };
+
+    /**
+     * A signature as passed from JS; without a time it is stamped with the
+     * time the commit is written.
+     */
+    struct SignatureFields {
+      std::string name;
+      std::string email;
+      bool hasTime;
+      git_time_t time;
+      int offset;
+    };
+
+    struct CreateBaton {
+      uv_work_t request;
+      const git_error* error;
+
+      git_repository* rawRepo;
+      git_oid tree;
+      std::vector<git_oid> parents;
+      SignatureFields author;
+      SignatureFields committer;
+      std::string message;
+      std::string updateRef;
+
+      git_oid rawOid;
+
+      Persistent<Function> callback;
+    };
+
+    static bool SignatureFromValue(Handle<Value> value, SignatureFields& fields);
+    static int CreateSignature(git_signature** out, const SignatureFields& fields);
 };
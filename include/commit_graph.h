@@ -0,0 +1,83 @@
+/*
+ * Copyright 2013, Tim Branyen @tbranyen <tim@tabdeveloper.com>
+ * @author Michael Robinson @codeofinterest <mike@pagesofinterest.net>
+ *
+ * Dual licensed under the MIT and GPL licenses.
+ */
+
+#ifndef GITCOMMITGRAPH_H
+#define GITCOMMITGRAPH_H
+
+#include <v8.h>
+#include <node.h>
+#include <string>
+
+#include "git2.h"
+
+#include "repo.h"
+
+using namespace node;
+using namespace v8;
+
+/**
+ * Writes the repository's commit-graph file. Once it exists, RevWalk's
+ * commits, mergeBase and isAncestor read commits from it instead of
+ * parsing them from the object database. Also writes the changed-path
+ * filters that let path-limited walks skip commits without loading trees.
+ */
+class GitCommitGraph : public ObjectWrap {
+  public:
+
+    static Persistent<Function> constructor_template;
+
+    /**
+     * Default number of threads diffing commits for new filters.
+     */
+    static const int BLOOM_DEFAULT_THREADS = 4;
+
+    static void Initialize(Handle<v8::Object> target);
+
+  protected:
+    GitCommitGraph() {}
+    ~GitCommitGraph() {}
+
+    static Handle<Value> New(const Arguments& args);
+
+    static Handle<Value> Write(const Arguments& args);
+    static void WriteWork(uv_work_t *req);
+    static void WriteAfterWork(uv_work_t *req);
+
+    static Handle<Value> WriteBloom(const Arguments& args);
+    static void WriteBloomWork(uv_work_t *req);
+    static void WriteBloomAfterWork(uv_work_t *req);
+
+  private:
+
+    struct WriteBaton {
+      uv_work_t request;
+      const git_error* error;
+
+      git_repository* rawRepo;
+
+      size_t commits;
+      std::string path;
+
+      Persistent<Function> callback;
+    };
+
+    struct WriteBloomBaton {
+      uv_work_t request;
+      const git_error* error;
+
+      git_repository* rawRepo;
+      int threads;
+
+      size_t added;
+      size_t commits;
+      std::string path;
+
+      Persistent<Function> callback;
+    };
+};
+
+#endif
@@ -0,0 +1,100 @@
+/*
+ * Copyright 2013, Tim Branyen @tbranyen <tim@tabdeveloper.com>
+ * @author Michael Robinson @codeofinterest <mike@pagesofinterest.net>
+ *
+ * Dual licensed under the MIT and GPL licenses.
+ */
+
+#ifndef DIFF_CACHE_H
+#define DIFF_CACHE_H
+
+#include <v8.h>
+#include <node.h>
+#include <string>
+#include <list>
+#include <map>
+
+#include "git2.h"
+
+using namespace node;
+using namespace v8;
+
+/**
+ * Process wide LRU cache of formatted tree-to-tree diffs. Trees are
+ * immutable, so a diff is fully identified by both tree oids and the diff
+ * options. Entries are the unified patch, bounded by total bytes in memory;
+ * when a spill directory is configured, evicted entries are written there
+ * and read back on a later miss. Disabled until a memory limit is set.
+ *
+ * The static methods are safe to call from any thread.
+ */
+class GitDiffCache : public ObjectWrap {
+  public:
+
+    static Persistent<Function> constructor_template;
+
+    struct Key {
+      git_oid oldTree;
+      git_oid newTree;
+      uint64_t optionsHash;
+
+      bool operator<(const Key& other) const;
+    };
+
+    static void Initialize(Handle<v8::Object> target);
+
+    static bool Enabled();
+    /**
+     * Copy the cached patch for key into patch. Returns false on a miss.
+     */
+    static bool Get(const Key& key, std::string& patch);
+    static void Put(const Key& key, const char* patch, size_t length);
+
+  protected:
+    GitDiffCache() {}
+    ~GitDiffCache() {}
+
+    static Handle<Value> New(const Arguments& args);
+    static Handle<Value> Configure(const Arguments& args);
+    static Handle<Value> Stats(const Arguments& args);
+    static Handle<Value> Clear(const Arguments& args);
+
+  private:
+
+    struct Entry {
+      Key key;
+      std::string patch;
+      /**
+       * Spill directory already holding this patch, if any, so an entry
+       * read back from disk is not written again when it is evicted.
+       */
+      std::string spilledTo;
+    };
+
+    typedef std::list<Entry> EntryList;
+
+    static void Insert(const Key& key, const char* patch, size_t length, const std::string& spilledTo);
+
+    static std::string SpillPath(const std::string& directory, const Key& key);
+    static void Spill(const std::string& directory, const Entry& entry);
+    static bool Unspill(const std::string& directory, const Key& key, std::string& patch);
+    /**
+     * Drop least recently used entries until the cache fits in maxBytes,
+     * moving them into evicted. Must hold the lock.
+     */
+    static void Evict(EntryList& evicted);
+
+    static uv_mutex_t mutex;
+    static EntryList entries;
+    static std::map<Key, EntryList::iterator> index;
+    static size_t maxBytes;
+    static size_t currentBytes;
+    static std::string spillDirectory;
+
+    static uint64_t hits;
+    static uint64_t diskHits;
+    static uint64_t misses;
+    static uint64_t evictions;
+};
+
+#endif
@@ -8,13 +8,17 @@
 #include <v8.h>
 #include <node.h>
 #include <vector>
+#include <deque>
 #include <string>
-#include <map>
 
 #include "git2.h"
 
 #include "repo.h"
 #include "oid.h"
+#include "error.h"
+#include "diff_signature.h"
+#include "diff_cache.h"
+#include "functions/arena.h"
 
 using namespace node;
 using namespace v8;
@@ -27,12 +31,62 @@ class GitDiffList : public ObjectWrap {
 
     static Persistent<Function> constructor_template;
 
-    static const int WALK_DELTA_SEND_THRESHHOLD = 10;
+    /**
+     * Maximum number of completed file deltas allowed to wait for the main
+     * thread before the walk thread blocks.
+     */
+    static const int WALK_MAX_PENDING_DELTAS = 32;
+
+    /**
+     * Maximum number of full patch chunks allowed to wait for the main
+     * thread before the patch thread blocks.
+     */
+    static const int PATCH_MAX_PENDING_CHUNKS = 8;
+
+    /**
+     * Default chunk size for streamed patches.
+     */
+    static const size_t PATCH_DEFAULT_CHUNK_SIZE = 64 * 1024;
 
     static void Initialize (Handle<v8::Object> target);
 
+    /**
+     * Default number of threads used to compute similarity signatures.
+     */
+    static const int FIND_SIMILAR_THREADS = 4;
+
     git_diff_list* GetValue();
     void SetValue(git_diff_list* diffList);
+    git_repository* GetRepo();
+    void SetRepo(git_repository* repo);
+
+    /**
+     * git_diff_options plus the storage its pathspec points into, so it can
+     * be filled on the main thread and used from a worker.
+     */
+    struct DiffOptions {
+      git_diff_options raw;
+      std::vector<std::string> pathspec;
+      std::vector<char* > pathspecPointers;
+    };
+
+    /**
+     * Fill options from a JS options object: pathspec, contextLines,
+     * interhunkLines, ignoreWhitespace, ignoreWhitespaceChange,
+     * ignoreWhitespaceEol, maxSize, forceText, forceBinary, reverse and
+     * algorithm.
+     * Returns false (leaving an exception message in error) on bad input.
+     */
+    static bool ParseOptions(Handle<Value> value, DiffOptions& options, std::string& error);
+    /**
+     * Point options.raw.pathspec at options.pathspec. Call after the struct
+     * has reached its final address.
+     */
+    static void PrepareOptions(DiffOptions& options);
+    /**
+     * Hash of every option that affects the diff's output, for cache keys.
+     */
+    static uint64_t HashOptions(const DiffOptions& options);
 
   protected:
     GitDiffList() {}
@@ -45,6 +99,91 @@ class GitDiffList : public ObjectWrap {
     static void TreeToTreeWork(uv_work_t *req);
     static void TreeToTreeAfterWork(uv_work_t *req);
 
+    /**
+     * Count added and deleted lines per file on the worker, without copying
+     * any line content. Results come back as typed arrays in diff order.
+     */
+    static Handle<Value> Stats(const Arguments& args);
+    static void StatsWork(uv_work_t *req);
+    static int StatsWorkFile(const git_diff_delta *delta, float progress,
+                             void *payload);
+    static int StatsWorkData(const git_diff_delta *delta, const git_diff_range *range,
+                             char line_origin, const char *content, size_t content_len,
+                             void *payload);
+    static void StatsAfterWork(uv_work_t *req);
+
+    /**
+     * Collect path, status, oid and mode for every delta without generating
+     * patches, so no blob content is ever loaded.
+     */
+    static Handle<Value> NameStatus(const Arguments& args);
+    static void NameStatusWork(uv_work_t *req);
+    static void NameStatusAfterWork(uv_work_t *req);
+
+    /**
+     * Diff a commit's tree against the repository index, i.e. what is
+     * staged.
+     */
+    static Handle<Value> TreeToIndex(const Arguments& args);
+    static void TreeToIndexWork(uv_work_t *req);
+
+    /**
+     * Diff the repository index against the working directory, i.e. what
+     * is not staged.
+     */
+    static Handle<Value> IndexToWorkdir(const Arguments& args);
+    static void IndexToWorkdirWork(uv_work_t *req);
+
+    static void IndexDiffAfterWork(uv_work_t *req);
+
+    /**
+     * Diff two blobs, or a blob against the content of a Buffer, without
+     * resolving any commit or tree. Hunks are returned directly; no diff
+     * list is produced.
+     */
+    static Handle<Value> Blobs(const Arguments& args);
+    static Handle<Value> BlobToBuffer(const Arguments& args);
+    static void BlobDiffWork(uv_work_t *req);
+    static int BlobDiffWorkFile(const git_diff_delta *delta, float progress, void *payload);
+    static int BlobDiffWorkHunk(const git_diff_delta *delta, const git_diff_range *range,
+                                const char *header, size_t header_len, void *payload);
+    static int BlobDiffWorkData(const git_diff_delta *delta, const git_diff_range *range,
+                                char line_origin, const char *content, size_t content_len,
+                                void *payload);
+    static void BlobDiffAfterWork(uv_work_t *req);
+
+    /**
+     * Detect renames and copies in place. Signatures for every candidate
+     * blob are computed up front across several threads, so libgit2's
+     * pairwise comparison only has to compare precomputed signatures.
+     */
+    static Handle<Value> FindSimilar(const Arguments& args);
+    static void FindSimilarWork(uv_work_t *req);
+    static void FindSimilarAfterWork(uv_work_t *req);
+
+    /**
+     * Format the whole diff as a unified patch into a single Buffer.
+     */
+    static Handle<Value> ToPatch(const Arguments& args);
+    static void ToPatchWork(uv_work_t *req);
+    static void ToPatchAfterWork(uv_work_t *req);
+    static int ToPatchWorkData(const git_diff_delta *delta, const git_diff_range *range,
+                               char line_origin, const char *content, size_t content_len,
+                               void *payload);
+
+    /**
+     * Format the diff as a unified patch on a thread, handing it to JS in
+     * Buffers of roughly chunkSize bytes as they fill up.
+     */
+    static Handle<Value> ToPatchStream(const Arguments& args);
+    static void ToPatchStreamWork(void *payload);
+    static int ToPatchStreamWorkData(const git_diff_delta *delta, const git_diff_range *range,
+                                     char line_origin, const char *content, size_t content_len,
+                                     void *payload);
+    static void ToPatchStreamSendChunk(uv_async_t *handle, int status /*UNUSED*/);
+    static void ToPatchStreamSendEnd(uv_async_t *handle, int status /*UNUSED*/);
+    static void ToPatchStreamFree(uv_handle_t *handle);
+
     /**
      * Walk the current git_diff_list
      */
@@ -61,18 +200,34 @@ class GitDiffList : public ObjectWrap {
                              size_t content_len,          /** number of bytes of diff data */
                              void *payload);              /** user reference data */
     /**
-     * Called when WalkWorkFile reaches its cache
-     * thresholds. Passes data back to main thread
+     * Marks the delta currently being walked as complete and hands it to
+     * the main thread, blocking while WALK_MAX_PENDING_DELTAS are queued.
+     */
+    static void WalkWorkCompleteFile(void *payload);
+    /**
+     * Passes every completed delta, in diff order, back to the main thread.
      *
      * @param payload The WalkBaton
      */
     static void WalkWorkSendFile(uv_async_t *handle, int status /*UNUSED*/);
+    /**
+     * Passes every completed hunk, in diff order, back to the main thread.
+     * Always runs before the file containing the hunks is sent.
+     */
     static void WalkWorkSendHunk(uv_async_t *handle, int status /*UNUSED*/);
-    static void WalkWorkSendData(uv_async_t *handle, int status /*UNUSED*/);
     static void WalkWorkSendEnd(uv_async_t *handle, int status /*UNUSED*/);
+    static void WalkFree(uv_handle_t *handle);
 
   private:
     git_diff_list* diffList;
+    git_repository* repo;
+
+    /**
+     * Set for diffs of two trees with unmodified deltas, which are the
+     * only ones whose output is fully determined by their inputs.
+     */
+    bool hasCacheKey;
+    GitDiffCache::Key cacheKey;
 
     struct TreeToTreeBaton {
       uv_work_t request;
@@ -84,40 +239,247 @@ class GitDiffList : public ObjectWrap {
       std::string oldSha;
       git_oid newOid;
       std::string newSha;
+      DiffOptions options;
+      GitDiffCache::Key cacheKey;
 
       git_diff_list* rawDiffList;
 
       Persistent<Function> callback;
     };
 
-    struct DeltaContent {
-      git_diff_range *range;
-      char lineOrigin;
-      size_t contentLength;
+    struct IndexDiffBaton {
+      uv_work_t request;
+      const git_error* error;
+
+      GitDiffList *diffList;
+      git_repository* repo;
+      bool hasOld;
+      git_oid oldOid;
+      std::string oldSha;
+      DiffOptions options;
+
+      git_diff_list* rawDiffList;
+
+      Persistent<Function> callback;
+    };
+
+    struct BlobHunk {
+      git_diff_range range;
+      std::string header;
       std::string content;
+      std::string lineOrigins;
+      std::vector<uint32_t> lineLengths;
+    };
+
+    struct BlobDiffBaton {
+      uv_work_t request;
+      const git_error* error;
+
+      git_repository* repo;
+      bool hasOld;
+      git_oid oldOid;
+      std::string oldSha;
+      bool hasNew;
+      git_oid newOid;
+      std::string newSha;
+      DiffOptions options;
+
+      /**
+       * For BlobToBuffer the new side is the Buffer's memory, kept alive
+       * by the persistent handle until the diff is done.
+       */
+      bool toBuffer;
+      Persistent<Object> buffer;
+      const char* bufferData;
+      size_t bufferLength;
+
+      git_delta_t status;
+      bool binary;
+      size_t additions;
+      size_t deletions;
+      std::vector<BlobHunk> hunks;
+
+      Persistent<Function> callback;
+    };
+
+    struct FindSimilarBaton {
+      uv_work_t request;
+      const git_error* error;
+
+      GitDiffList* diffList;
+      git_diff_list* rawDiffList;
+      git_repository* repo;
+
+      git_diff_find_options options;
+      int threads;
+
+      Persistent<Function> callback;
+    };
+
+    struct StatsBaton {
+      uv_work_t request;
+      const git_error* error;
+
+      GitDiffList* diffList;
+      git_diff_list* rawDiffList;
+
+      std::vector<std::string> paths;
+      std::vector<uint32_t> additions;
+      std::vector<uint32_t> deletions;
+      uint32_t totalAdditions;
+      uint32_t totalDeletions;
+
+      Persistent<Function> callback;
+    };
+
+    struct NameStatusBaton {
+      uv_work_t request;
+      const git_error* error;
+
+      GitDiffList* diffList;
+      git_diff_list* rawDiffList;
+
+      std::vector<std::string> oldPaths;
+      std::vector<std::string> newPaths;
+      std::vector<uint8_t> statuses;
+      std::vector<uint16_t> oldModes;
+      std::vector<uint16_t> newModes;
+      std::vector<git_oid> oldOids;
+      std::vector<git_oid> newOids;
+
+      Persistent<Function> callback;
+    };
+
+    /**
+     * Growable byte buffer whose memory is handed to a node Buffer without
+     * copying once it is complete.
+     */
+    struct PatchChunk {
+      char* data;
+      size_t length;
+      size_t capacity;
+    };
+
+    static bool AppendPatchChunk(PatchChunk& chunk, const char* content, size_t length);
+    static Local<Object> PatchChunkToBuffer(PatchChunk& chunk);
+    static void FreePatchChunk(char* data, void* hint);
+
+    struct ToPatchBaton {
+      uv_work_t request;
+      const git_error* error;
+
+      GitDiffList* diffList;
+      git_diff_list* rawDiffList;
+      PatchChunk patch;
+      bool cacheable;
+      GitDiffCache::Key cacheKey;
+
+      Persistent<Function> callback;
+    };
+
+    struct ToPatchStreamBaton {
+      uv_thread_t threadId;
+      uv_mutex_t mutex;
+      uv_sem_t pendingSlots;
+      uv_async_t asyncChunk;
+      uv_async_t asyncEnd;
+
+      ThreadError error;
+
+      GitDiffList* diffList;
+      git_diff_list* rawDiffList;
+      size_t chunkSize;
+
+      /**
+       * Chunk being filled by the patch thread, and full chunks waiting to
+       * be sent. Only completedChunks is shared, under the mutex.
+       */
+      PatchChunk current;
+      std::vector<PatchChunk> completedChunks;
+
+      Persistent<Function> chunkCallback;
+      Persistent<Function> endCallback;
+    };
+
+    /**
+     * One hunk and all of its lines, allocated from the walk's arenas. Line
+     * text is stored back to back in content, with one origin character and
+     * one length per line.
+     */
+    struct Hunk {
+      const char* oldPath;
+      const char* newPath;
+      git_diff_range range;
+      const char* header;
+      size_t headerLength;
+      char* content;
+      size_t contentLength;
+      char* lineOrigins;
+      uint32_t* lineLengths;
+      size_t lineCount;
+      Hunk* next;
     };
 
     struct Delta {
-      git_diff_delta *raw;
-      std::vector<DeltaContent* > contents;
+      git_diff_delta raw;
+      Hunk* firstHunk;
+      Hunk* lastHunk;
+    };
+
+    /**
+     * Scratch memory for one stretch of a walk: deltas, hunks and line
+     * lengths; headers and line text; line origins. Each hunk's text,
+     * origins and lengths grow at the end of their own arena, so appending
+     * a line almost never copies. Only the walk thread allocates.
+     * endDelta is one past the last delta whose memory lives here.
+     */
+    struct WalkArenas {
+      Arena recordArena;
+      Arena textArena;
+      Arena originArena;
+      size_t endDelta;
     };
 
     struct WalkBaton {
       uv_thread_t threadId;
       uv_mutex_t mutex;
+      uv_sem_t pendingSlots;
       uv_async_t asyncFile;
       uv_async_t asyncHunk;
-      uv_async_t asyncData;
       uv_async_t asyncEnd;
 
-      const git_error* error;
+      ThreadError error;
+
+      /**
+       * Deltas indexed by their position in the diff. Entries below
+       * completedDeltas are finished and may be read by the main thread.
+       * Entries below sentDeltas may already be freed.
+       */
+      std::vector<Delta* > fileDeltas;
+      size_t completedDeltas;
+      size_t sentDeltas;
+
+      /**
+       * Hunks of every delta in diff order. Entries below completedHunks
+       * may be read by the main thread.
+       */
+      std::vector<Hunk* > hunks;
+      size_t completedHunks;
+      size_t sentHunks;
 
-      std::map<std::string, Delta* > fileDeltas;
+      /**
+       * arenas is what the walk thread allocates from. Whenever a file is
+       * completed and the set has grown past a block, it is moved to
+       * retiredArenas, under the mutex, and a fresh set is started. The
+       * main thread frees retired sets once their deltas are sent.
+       */
+      WalkArenas* arenas;
+      std::deque<WalkArenas* > retiredArenas;
 
+      GitDiffList* diffList;
       git_diff_list* rawDiffList;
       Persistent<Function> fileCallback;
       Persistent<Function> hunkCallback;
-      Persistent<Function> lineCallback;
       Persistent<Function> endCallback;
     };
 };
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2013, Tim Branyen @tbranyen <tim@tabdeveloper.com>
+ * @author Michael Robinson @codeofinterest <mike@pagesofinterest.net>
+ *
+ * Dual licensed under the MIT and GPL licenses.
+ */
+
+#ifndef DIFF_SIGNATURE_H
+#define DIFF_SIGNATURE_H
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include "git2.h"
+
+#include "functions/file.h"
+
+/**
+ * Content signature used for rename and copy detection. Content is split
+ * into lines (or 64 byte chunks for long lines), each chunk is hashed, and
+ * the signature keeps the number of bytes seen per hash. Two signatures are
+ * compared by the bytes they have in common, the same estimate git uses.
+ */
+class DiffSignature {
+  public:
+    typedef std::map<git_oid, DiffSignature*, OidLess> Cache;
+
+    static DiffSignature* FromBuffer(const char* buffer, size_t length);
+
+    /**
+     * Compute signatures for every blob in oids, spread across threads
+     * worker threads that each open their own handle on the repository at
+     * path. Fills cache; returns GIT_OK or sets a libgit2 error.
+     */
+    static int ComputeAll(const std::string& path, const std::vector<git_oid>& oids,
+                          int threads, Cache& cache);
+
+    static void FreeAll(Cache& cache);
+
+    /**
+     * Similarity score between 0 and 100.
+     */
+    int Similarity(const DiffSignature& other) const;
+
+    /**
+     * Signatures owned by a Cache are freed with it, not by libgit2.
+     */
+    bool cached;
+
+    /**
+     * Callbacks for git_diff_similarity_metric. The payload is a Cache.
+     */
+    static int MetricFileSignature(void **out, const git_diff_file *file,
+                                   const char *fullpath, void *payload);
+    static int MetricBufferSignature(void **out, const git_diff_file *file,
+                                     const char *buffer, size_t length, void *payload);
+    static void MetricFreeSignature(void *signature, void *payload);
+    static int MetricSimilarity(int *score, void *signatureA, void *signatureB,
+                                void *payload);
+
+  private:
+    DiffSignature() : cached(false), totalBytes(0) {}
+
+    static void ComputeWork(void *payload);
+
+    std::vector<std::pair<uint32_t, uint32_t> > chunks;
+    size_t totalBytes;
+};
+
+#endif
@@ -9,6 +9,7 @@
 #define ERROR_H
 
 #include <node.h>
+#include <string>
 
 #include "git2.h"
 
@@ -36,4 +37,31 @@ class GitError : public ObjectWrap {
     static Handle<Value> New(const Arguments& args);
 };
 
+/**
+ * A libgit2 error copied off the thread that raised it. giterr_last() points
+ * into thread-local storage that is freed when a uv_thread exits, so workers
+ * on their own thread keep this instead of the pointer.
+ */
+class ThreadError {
+  public:
+    ThreadError() : isSet(false), klass(0) {}
+
+    /**
+     * Copy giterr_last(); call it on the thread that failed.
+     */
+    void Capture();
+    bool IsSet() const { return isSet; }
+    const std::string& Message() const { return message; }
+
+    /**
+     * Build the JS error; call it on the main thread.
+     */
+    Local<Object> Wrap() const;
+
+  private:
+    bool isSet;
+    int klass;
+    std::string message;
+};
+
 #endif
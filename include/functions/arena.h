@@ -0,0 +1,54 @@
+#include <stddef.h>
+#include <vector>
+
+#ifndef ARENA_FUNCTIONS
+#define ARENA_FUNCTIONS
+
+/**
+ * Bump allocator for scratch data that lives exactly as long as one
+ * operation. Allocations are never freed individually; every block is
+ * released at once when the arena is destroyed. Not thread safe: one
+ * thread allocates, others may only read what it handed out.
+ */
+class Arena {
+  public:
+    static const size_t BLOCK_SIZE = 64 * 1024;
+
+    Arena();
+    ~Arena();
+
+    /**
+     * size bytes aligned for any scalar type, or NULL when out of memory.
+     */
+    void* Allocate(size_t size);
+
+    /**
+     * Grow data, the most recent allocation of size bytes, by additional
+     * bytes. Grows in place when the block has room, otherwise moves the
+     * data to a fresh block. Returns the (possibly new) start of data, or
+     * NULL when out of memory, in which case data is left untouched.
+     */
+    void* Extend(void* data, size_t size, size_t additional);
+
+    /**
+     * Bytes handed out so far, including alignment padding.
+     */
+    size_t BytesAllocated() const;
+
+  private:
+    struct Block {
+      char* data;
+      size_t used;
+      size_t capacity;
+    };
+
+    Arena(const Arena&);
+    Arena& operator=(const Arena&);
+
+    bool AddBlock(size_t minimum);
+
+    std::vector<Block> blocks;
+    char* lastAllocation;
+};
+
+#endif
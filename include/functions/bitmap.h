@@ -0,0 +1,146 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "git2.h"
+#include "file.h"
+
+#ifndef BITMAP_FUNCTIONS
+#define BITMAP_FUNCTIONS
+
+/**
+ * An uncompressed bitmap with one bit per object position. It grows as
+ * bits past the end are set; bits past the end read as zero.
+ */
+class Bitset {
+  public:
+    void Set(size_t bit);
+    bool Get(size_t bit) const;
+
+    void Or(const Bitset& other);
+    void AndNot(const Bitset& other);
+
+    size_t Count() const;
+
+    /**
+     * Bits set in both this and mask.
+     */
+    size_t CountAnd(const Bitset& mask) const;
+
+    std::vector<uint64_t> words;
+};
+
+/**
+ * Serialize bits (the first bitSize of them) as an EWAH bitmap, in the
+ * layout git uses for .bitmap files: bit count, word count, words and the
+ * position of the last run-length word, all big-endian.
+ */
+void ewahCompress(const Bitset& bits, uint32_t bitSize, std::vector<unsigned char>& out);
+
+/**
+ * Decompress the EWAH bitmap at data into out. Returns false when it does
+ * not fit in length bytes or is malformed; used is set to the bytes read.
+ */
+bool ewahExpand(const unsigned char* data, size_t length, Bitset& out, size_t* used);
+
+/**
+ * Reachability bitmaps (objects/info/reachability.bitmap) for selected
+ * commits: every object is numbered, oldest history first so the bitmaps
+ * of related commits share long compressible runs, and each selected
+ * commit stores an EWAH bitmap of every object reachable from it. Objects
+ * the file does not know yet (made after it was written) are numbered
+ * past the end as they are found.
+ */
+class ReachabilityBitmaps {
+  public:
+    enum ObjectType {
+      TYPE_COMMIT = 0,
+      TYPE_TREE = 1,
+      TYPE_BLOB = 2,
+      TYPE_COUNT = 3
+    };
+
+    /**
+     * Commits between bitmaps along the history, by default.
+     */
+    static const unsigned int DEFAULT_INTERVAL = 100;
+
+    ReachabilityBitmaps();
+    ~ReachabilityBitmaps();
+
+    /**
+     * Map the bitmaps of the repository at repoPath. Returns GIT_OK with
+     * no bitmaps when the file does not exist, and an error when it exists
+     * but is not valid.
+     */
+    int Open(const std::string& repoPath);
+    void Close();
+
+    static std::string Path(const std::string& repoPath);
+
+    /**
+     * Objects numbered by the file; Known also counts ones found since.
+     */
+    uint32_t Count() const;
+    size_t Known() const;
+
+    uint32_t Bitmaps() const;
+
+    bool Find(const git_oid* oid, uint32_t* position) const;
+    void Oid(uint32_t position, git_oid* out) const;
+
+    /**
+     * Every known object of type.
+     */
+    void TypeMask(ObjectType type, Bitset& out) const;
+
+    /**
+     * Set out to every object reachable from tips (commits). Commits with
+     * a bitmap are OR-ed in whole; only commits above them are read and
+     * their trees walked, stopping at trees already set.
+     */
+    int Reachable(git_repository* repo, const std::vector<git_oid>& tips, Bitset& out);
+
+    /**
+     * Commits read from the object database by Reachable so far, because
+     * no bitmap covered them.
+     */
+    size_t Walked() const;
+
+    /**
+     * Write bitmaps for every reference tip and every interval-th commit
+     * of the history (0 for tips only), replacing the repository's file.
+     * objects and bitmaps are set to the numbers written.
+     */
+    static int Write(git_repository* repo, unsigned int interval, size_t* objects, size_t* bitmaps);
+
+  private:
+    uint32_t FindOrAdd(const git_oid* oid, ObjectType type);
+    bool Bitmap(uint32_t position, Bitset& out) const;
+    int MarkTree(git_repository* repo, const git_oid* treeOid, Bitset& out);
+
+    const unsigned char* map;
+    size_t mapLength;
+    uint32_t count;
+    uint32_t bitmapCount;
+    const unsigned char* fanout;
+    const unsigned char* oids;
+    const unsigned char* sortedPositions;
+    const unsigned char* positionIndexes;
+    const unsigned char* bitmapTable;
+    Bitset types[TYPE_COUNT];
+
+    std::vector<git_oid> extras;
+    std::map<git_oid, uint32_t, OidLess> extraPositions;
+
+    /**
+     * Bitmaps computed by Write, by commit position.
+     */
+    std::map<uint32_t, std::vector<unsigned char> > built;
+
+    size_t walked;
+};
+
+#endif
@@ -0,0 +1,92 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "git2.h"
+
+#ifndef BLOOM_FUNCTIONS
+#define BLOOM_FUNCTIONS
+
+/**
+ * The bit positions a path sets in a changed-path filter, hashed once and
+ * tested against as many filters as needed.
+ */
+class BloomKey {
+  public:
+    static const unsigned int HASH_COUNT = 7;
+
+    explicit BloomKey(const std::string& path);
+
+    uint32_t hashes[HASH_COUNT];
+};
+
+/**
+ * Changed-path Bloom filters (objects/info/commit-graph.bloom), kept next
+ * to the commit-graph: for each commit, a filter of the paths its diff
+ * against its first parent touches, and of their leading directories.
+ * Filters are keyed by oid rather than graph position, so commits made
+ * after the graph can be filtered too and the graph can be rewritten
+ * without invalidating them.
+ */
+class BloomFilters {
+  public:
+    static const uint32_t BITS_PER_ENTRY = 10;
+
+    /**
+     * Commits touching more paths than this get a filter that matches
+     * everything.
+     */
+    static const size_t MAX_CHANGED_PATHS = 512;
+
+    BloomFilters();
+    ~BloomFilters();
+
+    /**
+     * Map the filters of the repository at repoPath. Returns GIT_OK with
+     * no filters when the file does not exist, and an error when it
+     * exists but is not valid.
+     */
+    int Open(const std::string& repoPath);
+    void Close();
+
+    static std::string Path(const std::string& repoPath);
+
+    uint32_t Count() const;
+    bool Find(const git_oid* oid, uint32_t* position) const;
+    void Oid(uint32_t position, git_oid* out) const;
+
+    /**
+     * Whether the commit at position may have changed any of the paths
+     * keys were made from. False means it definitely did not.
+     */
+    bool MayChange(uint32_t position, const std::vector<BloomKey>& keys) const;
+
+    /**
+     * Diff commit against its first parent and build its filter.
+     */
+    static int Compute(git_repository* repo, const git_oid* commit, std::vector<unsigned char>& filter);
+
+    /**
+     * Add filters for every commit reachable from a reference or HEAD that
+     * does not have one yet, diffing on threads threads, and replace the
+     * repository's file. Commits with a filter are assumed to have
+     * filtered ancestors, so the walk for new commits stops at them.
+     * added is set to the number of new filters and commits to the total.
+     */
+    static int Write(git_repository* repo, int threads, size_t* added, size_t* commits);
+
+  private:
+    bool Filter(uint32_t position, const unsigned char** filter, size_t* length) const;
+
+    const unsigned char* map;
+    size_t mapLength;
+    uint32_t count;
+    const unsigned char* fanout;
+    const unsigned char* oids;
+    const unsigned char* ends;
+    const unsigned char* data;
+    size_t dataLength;
+};
+
+#endif
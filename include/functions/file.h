@@ -0,0 +1,74 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "git2.h"
+
+#ifndef FILE_FUNCTIONS
+#define FILE_FUNCTIONS
+
+/**
+ * Orders oids bytewise, for sets and maps keyed by oid.
+ */
+struct OidLess {
+  bool operator()(const git_oid& a, const git_oid& b) const {
+    return git_oid_cmp(&a, &b) < 0;
+  }
+};
+
+/**
+ * Matches equal oids, for std::unique over oids sorted by OidLess.
+ */
+struct OidEqual {
+  bool operator()(const git_oid& a, const git_oid& b) const {
+    return git_oid_cmp(&a, &b) == 0;
+  }
+};
+
+/**
+ * Orders positions in oids by the oid at each position.
+ */
+struct PositionOidLess {
+  const std::vector<git_oid>* oids;
+
+  bool operator()(uint32_t a, uint32_t b) const {
+    return git_oid_cmp(&(*oids)[a], &(*oids)[b]) < 0;
+  }
+};
+
+/**
+ * Big-endian integers, as used by pack indexes and the files next to them.
+ */
+uint32_t getBigEndian32(const unsigned char* in);
+uint64_t getBigEndian64(const unsigned char* in);
+void putBigEndian32(std::vector<unsigned char>& out, uint32_t value);
+void putBigEndian64(std::vector<unsigned char>& out, uint64_t value);
+
+/**
+ * Whether a 256 entry fanout table, the big-endian running counts of oids
+ * by first byte, never decreases and ends at count, so every range it
+ * gives lies within the count oids it indexes.
+ */
+bool fanoutValid(const unsigned char* fanout, uint32_t count);
+
+/**
+ * Append the SHA-1 of bytes, the trailer that ends pack indexes and the
+ * files next to them.
+ */
+void appendChecksum(std::vector<unsigned char>& bytes);
+
+/**
+ * Set a GITERR_OS error for action on path, with errno's description.
+ */
+void setOsError(const std::string& action, const std::string& path);
+
+/**
+ * Replace the file at path with bytes, read only. Readers may have the
+ * old file mapped, so the bytes go to a temporary file that is renamed
+ * over it rather than written in place. Returns GIT_OK, or -1 with the
+ * error set and path untouched.
+ */
+int writeFileAtomically(const std::string& path, const std::vector<unsigned char>& bytes);
+
+#endif
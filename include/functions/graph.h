@@ -0,0 +1,137 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "git2.h"
+#include "file.h"
+
+#ifndef GRAPH_FUNCTIONS
+#define GRAPH_FUNCTIONS
+
+/**
+ * A read-only commit-graph file (objects/info/commit-graph, format 1 as
+ * written by `git commit-graph write`): commits sorted by oid with their
+ * tree, parents as positions, commit time and generation number, all in
+ * fixed-width rows that are read straight from the mapping.
+ */
+class CommitGraph {
+  public:
+    static const uint32_t NO_POSITION = 0xffffffff;
+
+    /**
+     * Generations are capped here by the file format.
+     */
+    static const uint32_t GENERATION_MAX = 0x3fffffff;
+
+    CommitGraph();
+    ~CommitGraph();
+
+    /**
+     * Map the graph of the repository at repoPath. Returns GIT_OK with an
+     * empty graph when the file does not exist, and an error when it
+     * exists but is not a valid graph.
+     */
+    int Open(const std::string& repoPath);
+    void Close();
+
+    static std::string Path(const std::string& repoPath);
+
+    uint32_t Count() const;
+    bool Find(const git_oid* oid, uint32_t* position) const;
+    void Oid(uint32_t position, git_oid* out) const;
+    void Tree(uint32_t position, git_oid* out) const;
+    void Parents(uint32_t position, std::vector<uint32_t>& out) const;
+    uint64_t Time(uint32_t position) const;
+    uint32_t Generation(uint32_t position) const;
+
+    /**
+     * Write the graph of every commit reachable from a reference or HEAD,
+     * replacing the repository's graph. commits is set to the number
+     * written.
+     */
+    static int Write(git_repository* repo, size_t* commits);
+
+  private:
+    const unsigned char* map;
+    size_t mapLength;
+    uint32_t count;
+    const unsigned char* fanout;
+    const unsigned char* oids;
+    const unsigned char* data;
+    const unsigned char* edges;
+    size_t edgeCount;
+};
+
+/**
+ * Commits numbered densely for the walks below: positions in the graph
+ * first, then commits read from the object database because they were
+ * made after the graph was written. Finding one of those also reads its
+ * ancestors down to the graph, so every known commit has an exact
+ * generation and parents that are known too.
+ */
+class CommitNodes {
+  public:
+    CommitNodes(git_repository* repo, const CommitGraph& graph);
+
+    int Find(const git_oid* oid, uint32_t* id);
+
+    uint32_t Count() const;
+
+    /**
+     * Commits read from the object database so far.
+     */
+    size_t Loaded() const;
+
+    void Oid(uint32_t id, git_oid* out) const;
+    void Parents(uint32_t id, std::vector<uint32_t>& out) const;
+    uint64_t Time(uint32_t id) const;
+    uint32_t Generation(uint32_t id) const;
+
+  private:
+    struct Extra {
+      git_oid oid;
+      uint64_t time;
+      uint32_t generation;
+      std::vector<uint32_t> parents;
+    };
+
+    git_repository* repo;
+    const CommitGraph& graph;
+    std::vector<Extra> extras;
+    std::map<git_oid, uint32_t, OidLess> extraIds;
+};
+
+/**
+ * The commits HEAD and every reference peel to, skipping references to
+ * anything else.
+ */
+int commitTips(git_repository* repo, std::vector<git_oid>& tips);
+
+/**
+ * Commits reachable from include but not from exclude, in the order a
+ * libgit2 revwalk with sorting (GIT_SORT_*) would give.
+ */
+void commitRange(CommitNodes& nodes, const std::vector<uint32_t>& include,
+                 const std::vector<uint32_t>& exclude, unsigned int sorting,
+                 std::vector<uint32_t>& out);
+
+/**
+ * A best common ancestor of one and two. Returns false when they have
+ * none.
+ */
+bool commitMergeBase(CommitNodes& nodes, uint32_t one, uint32_t two, uint32_t* base);
+
+/**
+ * Whether ancestor is descendant or one of its ancestors.
+ */
+bool commitIsAncestor(CommitNodes& nodes, uint32_t ancestor, uint32_t descendant);
+
+/**
+ * commitIsAncestor for repositories without a graph: walks the object
+ * database from descendant, not past commits dated before ancestor.
+ */
+int commitReachable(git_repository* repo, const git_oid* ancestor, const git_oid* descendant, bool* found);
+
+#endif
@@ -0,0 +1,75 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "git2.h"
+
+#ifndef HISTORY_FUNCTIONS
+#define HISTORY_FUNCTIONS
+
+class CommitGraph;
+
+/**
+ * A cached walk (objects/info/history/<tip>-<sorting>): the commits a
+ * walk from tip gives, in walk order, followed by their indexes sorted by
+ * oid so membership is a binary search of the mapping. A commit's history
+ * never changes, so a walk from a descendant of a cached tip is the
+ * commits the cached walk lacks followed by the cached walk.
+ */
+class HistoryCache {
+  public:
+    HistoryCache();
+    ~HistoryCache();
+
+    /**
+     * Whether walks sorted by sorting (GIT_SORT_*) are cached: only
+     * topological ones that are not reversed, the only orders new commits
+     * can be put in front of.
+     */
+    static bool Cacheable(unsigned int sorting);
+
+    /**
+     * Map the cached walk from tip. Returns GIT_OK with no commits when
+     * there is none, and an error when the file is not valid.
+     */
+    int Open(const std::string& repoPath, const git_oid* tip, unsigned int sorting);
+    void Close();
+
+    static std::string Path(const std::string& repoPath, const git_oid* tip, unsigned int sorting);
+
+    /**
+     * Commits in the cached walk; the first is its tip.
+     */
+    uint32_t Count() const;
+    void Oid(uint32_t index, git_oid* out) const;
+    bool Contains(const git_oid* oid) const;
+
+    /**
+     * Open the cached walk from the nearest cached ancestor of tip, if
+     * any, and set fresh to the commits reachable from tip that it lacks:
+     * children before their parents, otherwise newest first. Commits in
+     * graph are read from it; loaded is increased by the ones read from
+     * the object database instead.
+     */
+    int Extend(git_repository* repo, const CommitGraph& graph, const git_oid* tip, unsigned int sorting,
+               std::vector<git_oid>& fresh, size_t* loaded);
+
+    /**
+     * Cache the walk from fresh[0]: fresh followed by the commits of this
+     * walk, replacing any cached walk from that tip.
+     */
+    int Write(const std::string& repoPath, unsigned int sorting, const std::vector<git_oid>& fresh) const;
+
+    static void Remove(const std::string& repoPath, const git_oid* tip, unsigned int sorting);
+
+  private:
+    const unsigned char* map;
+    size_t mapLength;
+    uint32_t count;
+    const unsigned char* fanout;
+    const unsigned char* oids;
+    const unsigned char* sortedIndexes;
+};
+
+#endif
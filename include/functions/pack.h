@@ -0,0 +1,43 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "git2.h"
+
+#ifndef PACK_FUNCTIONS
+#define PACK_FUNCTIONS
+
+/**
+ * Where an object sits in a packfile, as recorded in the pack's .idx.
+ */
+struct PackIndexEntry {
+  git_oid oid;
+  uint32_t crc;
+  uint64_t offset;
+};
+
+/**
+ * The 12 byte pack header for objectCount objects.
+ */
+void packHeader(unsigned char out[12], uint32_t objectCount);
+
+/**
+ * Encode the type and inflated size that start a pack entry. out must hold
+ * at least 10 bytes; returns the number used.
+ */
+size_t packEntryHeader(unsigned char* out, git_otype type, size_t size);
+
+/**
+ * Serialize a version 2 .idx for entries (sorted in place by oid) of the
+ * pack whose trailer is packChecksum, including the index's own trailer.
+ */
+void packIndex(std::vector<PackIndexEntry>& entries, const unsigned char packChecksum[20],
+               std::vector<unsigned char>& out);
+
+/**
+ * write(2) until length bytes are written. Returns false on error with
+ * errno set.
+ */
+bool writeFully(int fd, const void* data, size_t length);
+
+#endif
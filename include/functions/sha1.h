@@ -0,0 +1,33 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef SHA1_FUNCTIONS
+#define SHA1_FUNCTIONS
+
+/**
+ * Incremental SHA-1 for checksumming the files git writes itself (pack and
+ * index trailers). Object ids should still come from git_odb_hash.
+ */
+class Sha1 {
+  public:
+    static const size_t DIGEST_SIZE = 20;
+
+    Sha1();
+
+    void Update(const void* data, size_t length);
+
+    /**
+     * Write the digest to out. The context must not be updated afterwards.
+     */
+    void Final(unsigned char out[DIGEST_SIZE]);
+
+  private:
+    void Transform(const unsigned char block[64]);
+
+    uint32_t state[5];
+    uint64_t length;
+    unsigned char buffer[64];
+    size_t buffered;
+};
+
+#endif
@@ -12,4 +12,12 @@ using namespace v8;
 
 bool success(const git_error* error, Persistent<Function> callback);
 
+/**
+ * Create a typed array (e.g. "Uint32Array") of length elements via the global
+ * constructor and copy elementSize * length bytes of data into its backing
+ * store in one pass.
+ */
+Local<Object> createTypedArray(const char* constructorName, const void* data,
+                               size_t length, size_t elementSize);
+
 #endif
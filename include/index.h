@@ -1,5 +1,5 @@
-/**
- * Copyright (c) 2011, Tim Branyen @tbranyen <tim@tabdeveloper.com>
+/*
+ * Copyright 2013, Tim Branyen @tbranyen <tim@tabdeveloper.com>
  * @author Michael Robinson @codeofinterest <mike@pagesofinterest.net>
  *
  * Dual licensed under the MIT and GPL licenses.
@@ -8,51 +8,157 @@
 #ifndef INDEX_H
 #define INDEX_H
 
+#include <v8.h>
 #include <node.h>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
 
 #include "git2.h"
 
+#include "repo.h"
+
 using namespace node;
+using namespace v8;
 
 /**
- * Class: GitIndex
- *   Wrapper for libgit2 git_error.
+ * A repository's index. The index file is memory mapped
+ * and parsed straight into one array per field plus a table of paths, so
+ * reading it costs a handful of allocations however many entries it has.
  */
 class GitIndex : public ObjectWrap {
   public:
+
+    static Persistent<Function> constructor_template;
+
     /**
-     * Variable: constructor_template
-     *   Used to create Node.js constructor.
+     * Default number of threads hashing files for addAll.
      */
-    static v8::Persistent<v8::FunctionTemplate> constructor_template;
+    static const int ADD_ALL_DEFAULT_THREADS = 4;
+
     /**
-     * Function: Initialize
-     *   Used to intialize the EventEmitter from Node.js
-     *
-     * Parameters:
-     *   target - v8::Object the Node.js global module object
+     * Number of files a hashing thread claims at once.
      */
-    static void Initialize(v8::Handle<v8::Object> target);
+    static const size_t ADD_ALL_BATCH_SIZE = 64;
+
+    static void Initialize(Handle<v8::Object> target);
 
-  protected:
     /**
-     * Constructor: GitIndex
+     * Entries in index order (by path, then stage). Path i is the bytes
+     * from pathOffsets[i] to pathOffsets[i + 1] - 1 of pathTable; each path
+     * is followed by a NUL.
      */
-    GitIndex() {};
+    struct Columns {
+      uint32_t version;
+      size_t count;
+      std::vector<char> pathTable;
+      std::vector<uint32_t> pathOffsets;
+      std::vector<unsigned char> oids;
+      std::vector<uint32_t> modes;
+      std::vector<uint8_t> stages;
+      std::vector<uint32_t> sizes;
+      std::vector<uint32_t> mtimeSeconds;
+      std::vector<uint32_t> mtimeNanoseconds;
+      std::vector<uint32_t> ctimeSeconds;
+      std::vector<uint32_t> ctimeNanoseconds;
+      std::vector<uint32_t> inodes;
+    };
+
     /**
-     * Deconstructor: GitIndex
+     * Read the index file at path into columns. A missing file is an empty
+     * index. Returns GIT_OK or sets a libgit2 error.
      */
-    ~GitIndex() {};
+    static int ReadFile(const std::string& path, Columns& columns);
+
     /**
-     * Function: New
-     *
-     * Parameters:
-     *   args v8::Arguments function call
-     *
-     * Returns:
-     *   v8::Object args.This()
+     * Position of the first entry for path, or -1. Binary search, since
+     * entries are sorted.
      */
-    static v8::Handle<v8::Value> New(const v8::Arguments& args);
+    static int Find(const Columns& columns, const char* path, size_t length);
+
+  protected:
+    GitIndex() {}
+    ~GitIndex() {}
+
+    static Handle<Value> New(const Arguments& args);
+
+    static Handle<Value> Read(const Arguments& args);
+    static void ReadWork(uv_work_t *req);
+    static void ReadAfterWork(uv_work_t *req);
+
+    /**
+     * Stage every file matching pathspecs, like `git add --all`: stat the
+     * working directory, skip files whose stat data matches the index,
+     * write blobs for the rest on several threads, and write the index
+     * once.
+     */
+    static Handle<Value> AddAll(const Arguments& args);
+    static void AddAllWork(uv_work_t *req);
+    static void AddAllWorkHash(void *payload);
+    static void AddAllAfterWork(uv_work_t *req);
+
+    static Handle<Value> FindPath(const Arguments& args);
+    static Handle<Value> EntryCount(const Arguments& args);
+
+  private:
+    static int Parse(const unsigned char* data, size_t length, Columns& columns);
+    static Local<Object> ColumnsToObject(const Columns& columns);
+
+    Columns columns;
+
+    /**
+     * A working directory file that has to be written as a blob.
+     */
+    struct AddCandidate {
+      std::string path;
+      struct stat st;
+      git_oid oid;
+    };
+
+    struct AddAllBaton {
+      uv_work_t request;
+      uv_mutex_t mutex;
+
+      const git_error* error;
+      std::string workerError;
+
+      GitIndex* index;
+      std::string repoPath;
+      std::string workdir;
+      std::vector<std::string> pathspecs;
+      int threads;
+
+      git_time_t indexMtimeSeconds;
+      unsigned int indexMtimeNanoseconds;
+
+      std::vector<AddCandidate> candidates;
+      size_t nextCandidate;
+      size_t scanned;
+      size_t unchanged;
+      size_t removed;
+
+      Columns columns;
+
+      Persistent<Function> callback;
+    };
+
+    static bool MatchesPathspec(const std::vector<std::string>& pathspecs, const std::string& path);
+    static bool MayMatchBelow(const std::vector<std::string>& pathspecs, const std::string& directory);
+    static bool HasTrackedBelow(git_index* index, const std::string& directory);
+    static bool StatMatches(AddAllBaton* baton, const git_index_entry* entry, const struct stat& st);
+    static int AddAllWalk(AddAllBaton* baton, git_repository* repo, git_index* index,
+                          std::vector<bool>& seen, const std::string& directory);
+
+    struct ReadBaton {
+      uv_work_t request;
+      const git_error* error;
+
+      GitIndex* index;
+      std::string path;
+      Columns columns;
+
+      Persistent<Function> callback;
+    };
 };
 
 #endif
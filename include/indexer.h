@@ -0,0 +1,169 @@
+/*
+ * Copyright 2013, Tim Branyen @tbranyen <tim@tabdeveloper.com>
+ * @author Michael Robinson @codeofinterest <mike@pagesofinterest.net>
+ *
+ * Dual licensed under the MIT and GPL licenses.
+ */
+
+#ifndef INDEXER_H
+#define INDEXER_H
+
+#include <v8.h>
+#include <node.h>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "git2.h"
+
+#include "repo.h"
+#include "error.h"
+#include "functions/pack.h"
+
+using namespace node;
+using namespace v8;
+
+/**
+ * Verifies objects instead of trusting them. indexPack is `git index-pack`:
+ * one pass finds where each entry of a .pack starts and ends, then delta
+ * families are resolved and hashed on several threads and the .idx is
+ * written. fsck rehashes every object in the repository on several
+ * threads. Both can check that every object a commit, tree or tag refers
+ * to exists.
+ */
+class GitIndexer : public ObjectWrap {
+  public:
+
+    static Persistent<Function> constructor_template;
+
+    static const int DEFAULT_THREADS = 4;
+
+    /**
+     * Objects processed between two progress events.
+     */
+    static const size_t PROGRESS_INTERVAL = 1000;
+
+    /**
+     * Bytes inflated at a time when an entry is only measured.
+     */
+    static const size_t INFLATE_CHUNK_SIZE = 16384;
+
+    static void Initialize(Handle<v8::Object> target);
+
+  protected:
+    GitIndexer() {}
+    ~GitIndexer() {}
+
+    static Handle<Value> New(const Arguments& args);
+
+    static Handle<Value> IndexPack(const Arguments& args);
+    static void IndexPackWork(void *payload);
+    static void IndexPackWorkResolve(void *payload);
+
+    static Handle<Value> Fsck(const Arguments& args);
+    static void FsckWork(void *payload);
+    static void FsckWorkHash(void *payload);
+
+    static void VerifyWorkSendProgress(uv_async_t *handle, int status /*UNUSED*/);
+    static void VerifyWorkSendEnd(uv_async_t *handle, int status /*UNUSED*/);
+    static void VerifyFree(uv_handle_t *handle);
+
+  private:
+
+    /**
+     * One entry of a packfile. Deltas name their base by offset or oid;
+     * type becomes the base's type once resolved.
+     */
+    struct PackEntry {
+      uint64_t offset;
+      uint64_t dataOffset;
+      uint64_t end;
+      size_t size;
+      git_otype packType;
+      uint64_t baseOffset;
+      git_oid baseOid;
+
+      git_otype type;
+      git_oid oid;
+      uint32_t crc;
+      bool resolved;
+      bool corrupt;
+    };
+
+    struct Problem {
+      bool hasOid;
+      git_oid oid;
+      bool hasOffset;
+      uint64_t offset;
+      std::string reason;
+    };
+
+    struct VerifyBaton {
+      uv_thread_t threadId;
+      uv_mutex_t mutex;
+      uv_async_t asyncProgress;
+      uv_async_t asyncEnd;
+
+      ThreadError error;
+
+      std::string repoPath;
+      std::string packPath;
+      int threads;
+      bool connectivity;
+      bool install;
+
+      /**
+       * Guarded by mutex.
+       */
+      std::string stage;
+      size_t processed;
+      size_t total;
+      size_t nextWork;
+      std::vector<Problem> corrupt;
+      std::vector<git_oid> references;
+
+      /**
+       * indexPack: the mapped pack, its entries in pack order and the
+       * delta edges (base entry or base oid, child entry) sorted by base.
+       */
+      const unsigned char* pack;
+      size_t packLength;
+      std::vector<PackEntry> entries;
+      std::vector<size_t> roots;
+      std::vector<std::pair<size_t, size_t> > offsetChildren;
+      std::vector<std::pair<git_oid, size_t> > oidChildren;
+
+      /**
+       * fsck: every object in the object database.
+       */
+      std::vector<git_oid> oids;
+
+      size_t objects;
+      size_t deltas;
+      std::string sha;
+      std::string indexPath;
+      std::vector<git_oid> missing;
+
+      Persistent<Function> progressCallback;
+      Persistent<Function> endCallback;
+    };
+
+    static VerifyBaton* NewBaton(git_repository* repo, const std::string& packPath, Local<Object> options,
+                                 Local<Value> progressCallback, Local<Value> endCallback);
+    static void Progress(VerifyBaton* baton, const char* stage, size_t total, size_t increment);
+    static void AddCorrupt(VerifyBaton* baton, const git_oid* oid, const PackEntry* entry, const std::string& reason);
+    static void CollectReferences(git_otype type, const unsigned char* data, size_t length,
+                                  std::vector<git_oid>& references);
+    static void CheckConnectivity(VerifyBaton* baton, const std::vector<git_oid>& known, git_odb* odb);
+    static void RunWorkers(VerifyBaton* baton, void (*work)(void *));
+
+    static bool ParseEntry(VerifyBaton* baton, uint64_t offset, PackEntry& entry, std::string& reason);
+    static bool Inflate(const VerifyBaton* baton, const PackEntry& entry, std::vector<unsigned char>* out,
+                        uint64_t* end);
+    static bool ApplyDelta(const std::vector<unsigned char>& base, const std::vector<unsigned char>& delta,
+                           std::vector<unsigned char>& out);
+    static void ResolveFamily(VerifyBaton* baton, size_t index, std::vector<unsigned char>& data,
+                              std::vector<git_oid>& references);
+};
+
+#endif
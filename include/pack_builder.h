@@ -0,0 +1,125 @@
+/*
+ * Copyright 2013, Tim Branyen @tbranyen <tim@tabdeveloper.com>
+ * @author Michael Robinson @codeofinterest <mike@pagesofinterest.net>
+ *
+ * Dual licensed under the MIT and GPL licenses.
+ */
+
+#ifndef PACK_BUILDER_H
+#define PACK_BUILDER_H
+
+#include <v8.h>
+#include <node.h>
+#include <string>
+#include <vector>
+#include <set>
+
+#include "git2.h"
+
+#include "repo.h"
+#include "error.h"
+#include "functions/file.h"
+
+using namespace node;
+using namespace v8;
+
+/**
+ * Generates a packfile, like `git pack-objects --revs`: enumerates every
+ * object reachable from the included commits but not from the excluded
+ * ones, then lets libgit2's packbuilder search for deltas on several
+ * threads. The pack is streamed to JS in chunks or written to a file.
+ */
+class GitPackBuilder : public ObjectWrap {
+  public:
+
+    static Persistent<Function> constructor_template;
+
+    /**
+     * Pack bytes gathered before a chunk is handed to JS.
+     */
+    static const size_t CHUNK_SIZE = 256 * 1024;
+
+    /**
+     * Maximum number of streamed chunks allowed to wait for the main
+     * thread before the build thread blocks.
+     */
+    static const int MAX_PENDING_CHUNKS = 8;
+
+    /**
+     * Objects counted between two progress events.
+     */
+    static const size_t PROGRESS_INTERVAL = 1000;
+
+    static void Initialize(Handle<v8::Object> target);
+
+    /**
+     * Resolve a revision to the commit it peels to.
+     */
+    static int ResolveCommit(git_repository* repo, const std::string& spec, git_oid* oid);
+
+  protected:
+    GitPackBuilder() {}
+    ~GitPackBuilder() {}
+
+    static Handle<Value> New(const Arguments& args);
+
+    static Handle<Value> Build(const Arguments& args);
+    static void BuildWork(void *payload);
+    static void BuildWorkSendProgress(uv_async_t *handle, int status /*UNUSED*/);
+    static void BuildWorkSendData(uv_async_t *handle, int status /*UNUSED*/);
+    static void BuildWorkSendEnd(uv_async_t *handle, int status /*UNUSED*/);
+    static void BuildFree(uv_handle_t *handle);
+
+  private:
+
+    typedef std::set<git_oid, OidLess> OidSet;
+
+    struct BuildBaton {
+      uv_thread_t threadId;
+      uv_mutex_t mutex;
+      uv_sem_t pendingSlots;
+      uv_async_t asyncProgress;
+      uv_async_t asyncData;
+      uv_async_t asyncEnd;
+
+      ThreadError error;
+
+      std::string repoPath;
+      std::vector<std::string> include;
+      std::vector<std::string> exclude;
+      unsigned int threads;
+      std::string path;
+
+      /**
+       * Guarded by mutex.
+       */
+      std::string stage;
+      size_t objects;
+      uint64_t bytes;
+      std::vector<std::vector<char> > chunks;
+
+      /**
+       * Only touched by the build thread.
+       */
+      git_packbuilder* packbuilder;
+      git_repository* repo;
+      OidSet seen;
+      std::vector<char> pending;
+      int fd;
+
+      uint32_t objectCount;
+      uint32_t written;
+
+      Persistent<Function> progressCallback;
+      Persistent<Function> dataCallback;
+      Persistent<Function> endCallback;
+    };
+
+    static int MarkTree(BuildBaton* baton, const git_oid* treeOid);
+    static int InsertTree(BuildBaton* baton, const git_oid* treeOid);
+    static void Progress(BuildBaton* baton, const char* stage, bool force);
+    static int FlushChunk(BuildBaton* baton);
+    static int WriteCallback(void *data, size_t size, void *payload);
+};
+
+#endif
@@ -0,0 +1,143 @@
+/*
+ * Copyright 2013, Tim Branyen @tbranyen <tim@tabdeveloper.com>
+ * @author Michael Robinson @codeofinterest <mike@pagesofinterest.net>
+ *
+ * Dual licensed under the MIT and GPL licenses.
+ */
+
+#ifndef PACK_WRITER_H
+#define PACK_WRITER_H
+
+#include <v8.h>
+#include <node.h>
+#include <string>
+#include <vector>
+#include <set>
+
+#include "git2.h"
+
+#include "repo.h"
+#include "functions/pack.h"
+#include "functions/file.h"
+
+using namespace node;
+using namespace v8;
+
+/**
+ * A bulk import session, in the style of `git fast-import`. Objects are
+ * appended to one temporary packfile instead of becoming loose files;
+ * hashing and compression run on several threads. Nothing is visible to
+ * the repository until commit, which writes the .idx and moves both files
+ * into objects/pack.
+ */
+class GitPackWriter : public ObjectWrap {
+  public:
+
+    static Persistent<Function> constructor_template;
+
+    static const int DEFAULT_THREADS = 4;
+
+    static void Initialize(Handle<v8::Object> target);
+
+  protected:
+    GitPackWriter();
+    ~GitPackWriter();
+
+    static Handle<Value> New(const Arguments& args);
+
+    static Handle<Value> Begin(const Arguments& args);
+    static void BeginWork(uv_work_t *req);
+    static void BeginAfterWork(uv_work_t *req);
+
+    /**
+     * Append a batch of objects. Only one batch may be in flight at a time.
+     * A failed write abandons the pack.
+     */
+    static Handle<Value> Write(const Arguments& args);
+    static void WriteWork(uv_work_t *req);
+    static void WriteWorkDeflate(void *payload);
+    static void WriteAfterWork(uv_work_t *req);
+
+    static Handle<Value> Commit(const Arguments& args);
+    static void CommitWork(uv_work_t *req);
+    static void CommitAfterWork(uv_work_t *req);
+
+    static Handle<Value> Abort(const Arguments& args);
+    static void AbortWork(uv_work_t *req);
+    static void AbortAfterWork(uv_work_t *req);
+
+  private:
+
+    /**
+     * Session state, only touched by the one operation in flight.
+     */
+    git_repository* repo;
+    std::string packDirectory;
+    std::string tempPath;
+    int fd;
+    uint64_t offset;
+    int threads;
+    int level;
+    bool busy;
+    std::vector<PackIndexEntry> entries;
+    std::set<git_oid, OidLess> written;
+
+    void Close();
+
+    struct PackObject {
+      git_otype type;
+      const char* data;
+      size_t length;
+
+      git_oid oid;
+      std::vector<unsigned char> deflated;
+    };
+
+    struct BeginBaton {
+      uv_work_t request;
+      const git_error* error;
+
+      GitPackWriter* writer;
+      std::string repoPath;
+
+      Persistent<Function> callback;
+    };
+
+    struct WriteBaton {
+      uv_work_t request;
+      uv_mutex_t mutex;
+      const git_error* error;
+      std::string workerError;
+
+      GitPackWriter* writer;
+      std::vector<PackObject> objects;
+      size_t nextObject;
+      size_t existing;
+
+      Persistent<Array> buffers;
+      Persistent<Function> callback;
+    };
+
+    struct CommitBaton {
+      uv_work_t request;
+      const git_error* error;
+
+      GitPackWriter* writer;
+      size_t objectCount;
+      std::string sha;
+      std::string packPath;
+      std::string indexPath;
+
+      Persistent<Function> callback;
+    };
+
+    struct AbortBaton {
+      uv_work_t request;
+
+      GitPackWriter* writer;
+
+      Persistent<Function> callback;
+    };
+};
+
+#endif
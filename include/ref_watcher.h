@@ -0,0 +1,106 @@
+/*
+ * Copyright 2013, Tim Branyen @tbranyen <tim@tabdeveloper.com>
+ * @author Michael Robinson @codeofinterest <mike@pagesofinterest.net>
+ *
+ * Dual licensed under the MIT and GPL licenses.
+ */
+
+#ifndef REF_WATCHER_H
+#define REF_WATCHER_H
+
+#include <v8.h>
+#include <node.h>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "git2.h"
+
+#include "repo.h"
+#include "error.h"
+
+using namespace node;
+using namespace v8;
+
+/**
+ * Watches a repository's refs/, packed-refs and HEAD and pushes
+ * (name, oldOid, newOid) change events to JS. Uses inotify on Linux and
+ * falls back to periodic polling elsewhere.
+ */
+class GitRefWatcher : public ObjectWrap {
+  public:
+
+    static Persistent<Function> constructor_template;
+
+    /**
+     * Filesystem events arriving within this window of each other are
+     * coalesced into a single snapshot comparison.
+     */
+    static const int COALESCE_MILLISECONDS = 50;
+
+    /**
+     * A burst that never goes quiet is still snapshotted this long after
+     * its first event, so a steady stream of writes cannot hold changes
+     * back.
+     */
+    static const int COALESCE_MAX_MILLISECONDS = 500;
+
+    /**
+     * Snapshot interval for platforms without inotify.
+     */
+    static const int POLL_MILLISECONDS = 1000;
+
+    static void Initialize(Handle<v8::Object> target);
+
+  protected:
+    GitRefWatcher() {}
+    ~GitRefWatcher() {}
+
+    static Handle<Value> New(const Arguments& args);
+
+    static Handle<Value> Start(const Arguments& args);
+    static void StartWork(void *payload);
+    static void StartWorkSendChanges(uv_async_t *handle, int status /*UNUSED*/);
+    static void StartWorkSendEnd(uv_async_t *handle, int status /*UNUSED*/);
+    static void FreeBaton(uv_handle_t *handle);
+
+    static Handle<Value> Stop(const Arguments& args);
+
+  private:
+
+    struct RefChange {
+      std::string name;
+      bool hadOld;
+      git_oid oldOid;
+      bool hasNew;
+      git_oid newOid;
+    };
+
+    typedef std::map<std::string, git_oid> RefSnapshot;
+
+    static int Snapshot(const std::string& path, RefSnapshot& refs);
+    static void Compare(const RefSnapshot& before, const RefSnapshot& after,
+                        std::vector<RefChange>& changes);
+
+    struct WatchBaton {
+      uv_thread_t threadId;
+      uv_mutex_t mutex;
+      uv_async_t asyncChanges;
+      uv_async_t asyncEnd;
+
+      ThreadError error;
+
+      GitRefWatcher* watcher;
+      std::string path;
+      int stopPipe[2];
+
+      std::vector<RefChange> changes;
+
+      Persistent<Function> changeCallback;
+      Persistent<Function> endCallback;
+    };
+
+    WatchBaton* baton;
+};
+
+#endif
@@ -11,6 +11,7 @@
 #include <v8.h>
 #include <node.h>
 #include <string>
+#include <vector>
 
 #include "git2.h"
 
@@ -42,6 +43,15 @@ class GitReference : public ObjectWrap {
     static void LookupWork(uv_work_t* req);
     static void LookupAfterWork(uv_work_t* req);
 
+    /**
+     * Apply a batch of create/update/delete operations atomically. Every
+     * affected ref (and packed-refs, when deleting) is locked up front, the
+     * expected old values are verified, and only then are the new values
+     * committed, so packed-refs is rewritten at most once per batch.
+     */
+    static Handle<Value> Transaction(const Arguments& args);
+    static void TransactionWork(uv_work_t* req);
+    static void TransactionAfterWork(uv_work_t* req);
 
   private:
     git_reference *ref;
@@ -58,6 +68,36 @@ class GitReference : public ObjectWrap {
       Persistent<Function> callback;
     };
 
+    struct TransactionUpdate {
+      std::string name;
+      std::string oldSha;
+      std::string newSha;
+
+      bool checkOld;
+      bool mustNotExist;
+      bool isDelete;
+      git_oid oldOid;
+      git_oid newOid;
+
+      /**
+       * locked stays set from taking the lock until it is committed or
+       * removed; lockFd is only open until the value is staged.
+       */
+      std::string lockPath;
+      int lockFd;
+      bool locked;
+    };
+
+    struct TransactionBaton {
+      uv_work_t request;
+      const git_error* error;
+
+      git_repository* rawRepo;
+      std::vector<TransactionUpdate> updates;
+
+      Persistent<Function> callback;
+    };
+
     struct OidBaton {
       uv_work_t request;
       const git_error* error;
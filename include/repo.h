@@ -28,7 +28,7 @@ class GitRepo : public ObjectWrap {
     void Free();
 
   protected:
-    GitRepo() {}
+    GitRepo() : repo(NULL) {}
     ~GitRepo() {}
     static Handle<Value> New(const Arguments& args);
 
@@ -37,6 +37,7 @@ class GitRepo : public ObjectWrap {
     static void OpenAfterWork(uv_work_t* req);
 
     static Handle<Value> Free(const Arguments& args);
+    static Handle<Value> Path(const Arguments& args);
 
     static Handle<Value> Init(const Arguments& args);
     static void InitWork(uv_work_t* req);
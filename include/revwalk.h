@@ -9,17 +9,47 @@
 
 #include <v8.h>
 #include <node.h>
+#include <string>
+#include <deque>
+#include <vector>
 
 #include "git2.h"
 
 #include "repo.h"
+#include "error.h"
 
 using namespace node;
 using namespace v8;
 
+class BloomFilters;
+class BloomKey;
+class CommitGraph;
+
 class GitRevWalk : public ObjectWrap {
   public:
     static Persistent<Function> constructor_template;
+
+    /**
+     * Default number of threads diffing commits for churn.
+     */
+    static const int CHURN_DEFAULT_THREADS = 4;
+
+    /**
+     * Maximum number of commits walked but not yet handed to JS. Bounds both
+     * the diffs in flight and the records buffered for in-order delivery.
+     */
+    static const int CHURN_MAX_IN_FLIGHT = 64;
+
+    /**
+     * Commits handed to JS at a time by commits.
+     */
+    static const size_t COMMITS_BATCH_SIZE = 1000;
+
+    /**
+     * Batches commits may have walked but not yet handed to JS.
+     */
+    static const int COMMITS_MAX_IN_FLIGHT = 4;
+
     static void Initialize(Handle<v8::Object> target);
 
     git_revwalk* GetValue();
@@ -50,6 +80,40 @@ class GitRevWalk : public ObjectWrap {
 
     static Handle<Value> Sorting(const Arguments& args);
 
+    /**
+     * Walk a range and diff every commit against its first parent on a pool
+     * of threads, streaming per-commit line counts back in walk order.
+     */
+    static Handle<Value> Churn(const Arguments& args);
+    static void ChurnWork(void *payload);
+    static void ChurnWorkDiff(void *payload);
+    static int ChurnWorkFile(const git_diff_delta *delta, float progress, void *payload);
+    static int ChurnWorkData(const git_diff_delta *delta, const git_diff_range *range,
+                             char line_origin, const char *content, size_t content_len,
+                             void *payload);
+    static void ChurnWorkSendRecords(uv_async_t *handle, int status /*UNUSED*/);
+    static void ChurnWorkSendEnd(uv_async_t *handle, int status /*UNUSED*/);
+    static void ChurnFree(uv_handle_t *handle);
+
+    /**
+     * Walk a range on its own thread, from the history cache or the
+     * commit-graph when the repository has one, streaming oids back in
+     * batches.
+     */
+    static Handle<Value> Commits(const Arguments& args);
+    static void CommitsWork(void *payload);
+    static void CommitsWorkSendBatch(uv_async_t *handle, int status /*UNUSED*/);
+    static void CommitsWorkSendEnd(uv_async_t *handle, int status /*UNUSED*/);
+    static void CommitsFree(uv_handle_t *handle);
+
+    static Handle<Value> MergeBase(const Arguments& args);
+    static void MergeBaseWork(uv_work_t *req);
+    static void MergeBaseAfterWork(uv_work_t *req);
+
+    static Handle<Value> IsAncestor(const Arguments& args);
+    static void IsAncestorWork(uv_work_t *req);
+    static void IsAncestorAfterWork(uv_work_t *req);
+
   private:
     git_revwalk* revwalk;
     git_repository* repo;
@@ -75,6 +139,121 @@ class GitRevWalk : public ObjectWrap {
       Persistent<Function> callback;
     };
 
+    struct ChurnRecord {
+      git_oid oid;
+      unsigned int parentCount;
+      size_t files;
+      size_t additions;
+      size_t deletions;
+      bool done;
+    };
+
+    struct ChurnBaton {
+      uv_thread_t threadId;
+      uv_mutex_t mutex;
+      uv_cond_t queued;
+      uv_sem_t inFlight;
+      uv_async_t asyncRecords;
+      uv_async_t asyncEnd;
+
+      ThreadError error;
+      std::string workerError;
+
+      GitRevWalk* revwalk;
+      std::string repoPath;
+      std::string range;
+      unsigned int sorting;
+      int threads;
+
+      /**
+       * Records in walk order. The walk thread appends, diff threads fill
+       * them in, and the main thread pops finished records off the front.
+       * pendingBase is the walk position of the front record.
+       */
+      std::deque<ChurnRecord> pending;
+      size_t pendingBase;
+      size_t walked;
+      size_t nextToDiff;
+      size_t sent;
+      bool walkDone;
+      bool aborted;
+
+      Persistent<Function> recordsCallback;
+      Persistent<Function> endCallback;
+    };
+
+    struct CommitsBaton {
+      uv_thread_t threadId;
+      uv_mutex_t mutex;
+      uv_async_t asyncBatch;
+      uv_async_t asyncEnd;
+      uv_sem_t inFlight;
+
+      ThreadError error;
+
+      GitRevWalk* revwalk;
+      std::string repoPath;
+      std::string range;
+      unsigned int sorting;
+
+      /**
+       * When not empty, only commits whose diff against their first parent
+       * touches one of these are sent.
+       */
+      std::vector<std::string> paths;
+
+      /**
+       * Whether walks from a single tip go through the history cache.
+       */
+      bool cache;
+
+      /**
+       * Guarded by mutex.
+       */
+      std::vector<git_oid> pending;
+      int pendingBatches;
+
+      size_t sent;
+      bool graph;
+      size_t loaded;
+      size_t cached;
+      size_t filtered;
+      size_t diffed;
+
+      Persistent<Function> batchCallback;
+      Persistent<Function> endCallback;
+    };
+
+    /**
+     * Shared by mergeBase and isAncestor; found is whether there is a
+     * merge base, or whether one is an ancestor of two.
+     */
+    struct AncestryBaton {
+      uv_work_t request;
+      const git_error* error;
+
+      GitRevWalk* revwalk;
+      git_repository* rawRepo;
+      git_oid one;
+      git_oid two;
+
+      bool found;
+      git_oid base;
+
+      Persistent<Function> callback;
+    };
+
+    static int CommitsWorkCached(CommitsBaton* baton, git_repository* repo, const CommitGraph& graph,
+                                 const git_oid* tip, const BloomFilters& filters,
+                                 const std::vector<BloomKey>& keys);
+    static int CommitsWorkLimit(CommitsBaton* baton, git_repository* repo, const BloomFilters& filters,
+                                const std::vector<BloomKey>& keys, std::vector<git_oid>& batch);
+    static void CommitsWorkSend(CommitsBaton* baton, const std::vector<git_oid>& batch);
+    static int ResolveRange(git_repository* repo, const std::string& range,
+                            std::vector<git_oid>& include, std::vector<git_oid>& exclude);
+    static Handle<Value> QueueAncestry(const Arguments& args, const char* oneName, const char* twoName,
+                                       uv_work_cb work, uv_after_work_cb afterWork);
+
     struct NextBaton {
       uv_work_t request;
 
@@ -0,0 +1,118 @@
+/*
+ * Copyright 2013, Tim Branyen @tbranyen <tim@tabdeveloper.com>
+ * @author Michael Robinson @codeofinterest <mike@pagesofinterest.net>
+ *
+ * Dual licensed under the MIT and GPL licenses.
+ */
+
+#ifndef STATUS_H
+#define STATUS_H
+
+#include <v8.h>
+#include <node.h>
+#include <string>
+#include <vector>
+
+#include "git2.h"
+
+#include "repo.h"
+
+using namespace node;
+using namespace v8;
+
+/**
+ * Computes what is staged, what is modified in the working directory and
+ * what is untracked. Index entries are lstat'ed, and hashed only when their
+ * stat data cannot be trusted, across several threads.
+ */
+class GitStatus : public ObjectWrap {
+  public:
+
+    static Persistent<Function> constructor_template;
+
+    /**
+     * Default number of threads used to stat and hash the working directory.
+     */
+    static const int DEFAULT_THREADS = 4;
+
+    /**
+     * Number of index entries a thread claims at once.
+     */
+    static const size_t BATCH_SIZE = 256;
+
+    static void Initialize(Handle<v8::Object> target);
+
+  protected:
+    GitStatus() {}
+    ~GitStatus() {}
+
+    static Handle<Value> New(const Arguments& args);
+
+    static Handle<Value> Scan(const Arguments& args);
+    static void ScanWork(uv_work_t *req);
+    static void ScanWorkEntries(void *payload);
+    static void ScanWorkSendProgress(uv_async_t *handle, int status /*UNUSED*/);
+    static void ScanAfterWork(uv_work_t *req);
+    static void ScanFree(uv_handle_t *handle);
+
+  private:
+
+    /**
+     * The parts of a git_index_entry needed to decide whether a file changed.
+     */
+    struct Entry {
+      std::string path;
+      git_oid oid;
+      unsigned int mode;
+      unsigned int ino;
+      uint32_t fileSize;
+      git_time_t mtimeSeconds;
+      unsigned int mtimeNanoseconds;
+      git_time_t ctimeSeconds;
+      bool conflicted;
+
+      /**
+       * Written by exactly one worker thread.
+       */
+      git_delta_t status;
+    };
+
+    struct ScanBaton {
+      uv_work_t request;
+      uv_async_t asyncProgress;
+      uv_mutex_t mutex;
+
+      const git_error* error;
+      std::string workerError;
+
+      std::string repoPath;
+      std::string workdir;
+      bool includeUntracked;
+      bool recurseUntracked;
+      int threads;
+
+      git_time_t indexMtimeSeconds;
+      unsigned int indexMtimeNanoseconds;
+
+      std::vector<Entry> entries;
+      size_t nextEntry;
+      size_t processedEntries;
+      size_t hashedEntries;
+
+      std::vector<std::string> stagedPaths;
+      std::vector<uint8_t> stagedStatuses;
+      std::vector<std::string> untrackedPaths;
+
+      Persistent<Function> progressCallback;
+      Persistent<Function> callback;
+    };
+
+    static int ScanStaged(ScanBaton* baton, git_repository* repo, git_index* index);
+    static git_delta_t CheckEntry(ScanBaton* baton, git_repository* repo, const Entry& entry, bool& hashed);
+    static int ScanUntracked(ScanBaton* baton, git_repository* repo,
+                             const std::vector<std::string>& trackedPaths, const std::string& directory);
+    static int HasUntrackedContent(ScanBaton* baton, git_repository* repo,
+                                   const std::string& directory, bool& found);
+};
+
+#endif
@@ -0,0 +1,85 @@
+/*
+ * Copyright 2013, Tim Branyen @tbranyen <tim@tabdeveloper.com>
+ * @author Michael Robinson @codeofinterest <mike@pagesofinterest.net>
+ *
+ * Dual licensed under the MIT and GPL licenses.
+ */
+
+#ifndef GITTREEBUILDER_H
+#define GITTREEBUILDER_H
+
+#include <v8.h>
+#include <node.h>
+#include <string>
+#include <vector>
+
+#include "git2.h"
+
+#include "repo.h"
+
+using namespace node;
+using namespace v8;
+
+/**
+ * Builds nested trees from a flat list of path updates applied over a base
+ * tree. Only the trees on the path to an update are rebuilt and written;
+ * every other subtree is carried over from the base by oid.
+ */
+class GitTreeBuilder : public ObjectWrap {
+  public:
+
+    static Persistent<Function> constructor_template;
+
+    static void Initialize(Handle<v8::Object> target);
+
+    /**
+     * Parse an Oid object or a 40 character SHA into oid. Returns false if
+     * value is neither.
+     */
+    static bool OidFromValue(Handle<Value> value, git_oid* oid);
+
+  protected:
+    GitTreeBuilder() {}
+    ~GitTreeBuilder() {}
+
+    static Handle<Value> New(const Arguments& args);
+
+    static Handle<Value> Write(const Arguments& args);
+    static void WriteWork(uv_work_t *req);
+    static void WriteAfterWork(uv_work_t *req);
+
+  private:
+
+    /**
+     * A blob, link, submodule or tree to place at path, or a removal.
+     */
+    struct TreeUpdate {
+      std::string path;
+      git_oid oid;
+      git_filemode_t mode;
+      bool remove;
+    };
+
+    struct WriteBaton {
+      uv_work_t request;
+      const git_error* error;
+
+      git_repository* rawRepo;
+      bool hasBase;
+      git_oid base;
+      std::vector<TreeUpdate> updates;
+
+      git_oid rawOid;
+      size_t written;
+
+      Persistent<Function> callback;
+    };
+
+    static bool UpdatePathLess(const TreeUpdate& a, const TreeUpdate& b);
+    static bool ValidPath(const std::string& path);
+    static int CountEntry(const git_tree_entry* entry, void* payload);
+    static int WriteLevel(WriteBaton* baton, const git_tree* base, size_t begin, size_t end,
+                          size_t prefixLength, git_oid* out, bool& empty);
+};
+
+#endif
@@ -1,5 +1,6 @@
 var git = require( '../' ),
   success = require('./utilities').success,
+  rawOid = require('./utilities').rawOid,
   events = require('events');
 
 /**
@@ -354,4 +355,66 @@ Commit.prototype.parentsDiffTrees = function(callback) {
   });
 };
 
+/**
+ * Write a commit from a tree and parents, like `git commit-tree`. Nothing
+ * but updateRef is touched, so the index and working directory stay as
+ * they are.
+ *
+ * @param {git.raw.Repo} rawRepo Raw repository object.
+ * @param {CommitCreateOptions} options
+ * @param {Commit~createCallback} callback
+ */
+Commit.create = function(rawRepo, options, callback) {
+  /**
+   * @callback Commit~createCallback Callback executed once the commit is written.
+   * @param {GitError|null} error An Error or null if successful.
+   * @param {Oid|null} oid The new commit.
+   */
+  var rawOptions = {
+    tree: rawOid(options.tree),
+    parents: (options.parents || []).map(rawOid),
+    author: options.author,
+    committer: options.committer,
+    message: options.message,
+    updateRef: options.updateRef
+  };
+  (new git.raw.Commit()).create(rawRepo, rawOptions, function commitCreate(error, oid) {
+    if (success(error, callback)) {
+      callback(null, new git.oid(oid));
+    }
+  });
+};
+
 exports.commit = Commit;
+
+/**
+ * @namespace
+ * @property {String} name
+ * @property {String} email
+ * @property {Integer} [time = now] Seconds since the epoch
+ * @property {Integer} [offset = 0] Timezone offset in minutes
+ */
+var CommitSignature = {
+  name: String,
+  email: String,
+  time: Number,
+  offset: Number
+};
+
+/**
+ * @namespace
+ * @property {Oid|git.raw.Oid|String} tree
+ * @property {Array} [parents = []] Oids or SHAs, first parent first
+ * @property {CommitSignature} author
+ * @property {CommitSignature} [committer = author]
+ * @property {String} message
+ * @property {String} [updateRef] Ref to point at the new commit, e.g. 'HEAD'
+ */
+var CommitCreateOptions = {
+  tree: String,
+  parents: Array,
+  author: CommitSignature,
+  committer: CommitSignature,
+  message: String,
+  updateRef: String
+};
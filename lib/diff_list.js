@@ -1,4 +1,5 @@
 var git = require('../'),
+    success = require('./utilities').success,
     events = require('events');
 
 /**
@@ -57,8 +58,51 @@ DiffList.prototype.lineOriginTypes = {
 };
 
 /**
- * Walk the current diff list tree.
+ * Split packed hunks into the per-line objects of FileDelta.content.
+ */
+var hunkLines = function(hunks) {
+  var lines = [];
+  hunks.forEach(function(hunk) {
+    // lineLengths count bytes, so split the UTF-8 encoding of content
+    var bytes = new Buffer(hunk.content, 'utf8'),
+        offset = 0;
+    for (var i = 0; i < hunk.lineLengths.length; i++) {
+      var length = hunk.lineLengths[i];
+      lines.push({
+        range: hunk.range,
+        content: bytes.toString('utf8', offset, offset + length),
+        lineOrigin: hunk.lineOrigins.charAt(i),
+        contentLength: length
+      });
+      offset += length;
+    }
+  });
+  return lines;
+};
+
+/**
+ * Give fileDelta a content property that is built from its hunks the first
+ * time it is read, so lines only cross from C++ once, packed.
+ */
+var defineContent = function(fileDelta, hunks) {
+  var content = null;
+  Object.defineProperty(fileDelta, 'content', {
+    enumerable: true,
+    get: function() {
+      if (content === null) {
+        content = hunkLines(hunks);
+      }
+      return content;
+    }
+  });
+};
+
+/**
+ * Walk the current diff list tree. Hunks are emitted as soon as they are
+ * complete, so a file can be rendered progressively; deltas are emitted in
+ * diff order, each one after all of its hunks.
  *
+ * @fires DiffList#hunk
  * @fires DiffList#delta
  * @fires DiffList#end
  * 
@@ -67,13 +111,17 @@ DiffList.prototype.lineOriginTypes = {
 DiffList.prototype.walk = function() {
   var event = new events.EventEmitter(),
       allFileDeltas = [],
+      pendingHunks = [],
       self = this;
   
   self.rawDiffList.walk(function fileCallback(error, fileDeltas) {
     if (error) {
       event.emit('end', new git.error(error.message, error.code), null);
+      return;
     }
     fileDeltas.forEach(function(fileDelta) {
+      // A file's hunks always reach JS before the file itself
+      defineContent(fileDelta, pendingHunks.splice(0, fileDelta.hunkCount));
       /**
        * Delta event.
        *
@@ -85,10 +133,19 @@ DiffList.prototype.walk = function() {
       event.emit('delta', null, fileDelta);
       allFileDeltas.push(fileDelta);
     });
-  }, function hunkCallback(error, diffHunk) {
-    /** TO BE IMPLEMENTED */
-  }, function lineCallback(error, diffLine) {
-    /** TO BE IMPLEMENTED */
+  }, function hunkCallback(error, hunks) {
+    hunks.forEach(function(hunk) {
+      pendingHunks.push(hunk);
+      /**
+       * Hunk event.
+       *
+       * @event DiffList#hunk
+       *
+       * @param {GitError|null} error An error object if there was an issue, null otherwise.
+       * @param {DiffHunk} hunk The hunk, with all of its lines.
+       */
+      event.emit('hunk', null, hunk);
+    });
   }, function endCallback(error) {
     /**
      * End event.
@@ -104,16 +161,266 @@ DiffList.prototype.walk = function() {
   return event;
 };
 
-DiffList.prototype.treeToTree = function(oldSha, newSha, callback) {
+/**
+ * Count added and deleted lines per file without materializing any line
+ * objects. Per-file counts are typed arrays aligned with the paths array.
+ *
+ * @param {DiffList~statsCallback} callback
+ */
+DiffList.prototype.stats = function(callback) {
+  /**
+   * @callback DiffList~statsCallback Callback executed once the stats are computed.
+   * @param {GitError|null} error An Error or null if successful.
+   * @param {DiffStats|null} stats Aggregate and per-file line counts.
+   */
+  this.rawDiffList.stats(function diffListStats(error, stats) {
+    if (success(error, callback)) {
+      callback(null, stats);
+    }
+  });
+};
+
+/**
+ * List the changed files with their status, oids and modes. Only tree
+ * entries are compared: no blob is loaded and no patch is generated.
+ *
+ * @param {DiffList~nameStatusCallback} callback
+ */
+DiffList.prototype.nameStatus = function(callback) {
+  /**
+   * @callback DiffList~nameStatusCallback Callback executed once the deltas are read.
+   * @param {GitError|null} error An Error or null if successful.
+   * @param {NameStatus|null} nameStatus Per-file columns, in diff order.
+   */
+  this.rawDiffList.nameStatus(function diffListNameStatus(error, nameStatus) {
+    if (success(error, callback)) {
+      callback(null, nameStatus);
+    }
+  });
+};
+
+/**
+ * Format the diff as a unified patch, the same text `git diff` prints,
+ * in a single Buffer. Formatting happens off the main thread.
+ *
+ * @param {DiffList~toPatchCallback} callback
+ */
+DiffList.prototype.toPatch = function(callback) {
+  /**
+   * @callback DiffList~toPatchCallback Callback executed once the patch is formatted.
+   * @param {GitError|null} error An Error or null if successful.
+   * @param {Buffer|null} patch The unified patch.
+   */
+  this.rawDiffList.toPatch(function diffListToPatch(error, patch) {
+    if (success(error, callback)) {
+      callback(null, patch);
+    }
+  });
+};
+
+/**
+ * Stream the diff as a unified patch, in Buffers of roughly chunkSize
+ * bytes. Formatting pauses while too many chunks are waiting to be
+ * emitted, so memory stays bounded for huge diffs.
+ *
+ * @fires DiffList#data
+ * @fires DiffList#end
+ *
+ * @param {Integer} [chunkSize = 65536]
+ * @return {EventEmitter} diffListPatchEmitter
+ */
+DiffList.prototype.patchStream = function(chunkSize) {
+  var event = new events.EventEmitter();
+
+  this.rawDiffList.toPatchStream(chunkSize || 0, function chunkCallback(chunk) {
+    /**
+     * Data event.
+     *
+     * @event DiffList#data
+     *
+     * @param {Buffer} chunk The next piece of the patch.
+     */
+    event.emit('data', chunk);
+  }, function endCallback(error) {
+    event.emit('end', error ? new git.error(error.message, error.code) : null);
+  });
+
+  return event;
+};
+
+/**
+ * Rewrite the diff in place so renamed and copied files are paired up.
+ * Similarity signatures for every candidate blob are computed up front
+ * on several threads.
+ *
+ * @param {FindSimilarOptions} [options]
+ * @param {DiffList~findSimilarCallback} callback
+ */
+DiffList.prototype.findSimilar = function(options, callback) {
+  /**
+   * @callback DiffList~findSimilarCallback Callback executed once renames and copies are detected.
+   * @param {GitError|null} error An Error or null if successful.
+   * @param {DiffList|null} diffList This diff list.
+   */
+  if (typeof options === 'function') {
+    callback = options;
+    options = {};
+  }
   var self = this;
-  self.rawDiffList.treeToTree(self.rawRepo, oldSha, newSha, function(error, rawDifflist) {
+  self.rawDiffList.findSimilar(options || {}, function diffListFindSimilar(error) {
+    if (success(error, callback)) {
+      callback(null, self);
+    }
+  });
+};
+
+/**
+ * Diff the trees of two commits.
+ *
+ * @param {String|git.raw.Oid} oldSha
+ * @param {String|git.raw.Oid} newSha
+ * @param {DiffOptions} [options]
+ * @param {DiffList~treeToTreeCallback} callback
+ */
+DiffList.prototype.treeToTree = function(oldSha, newSha, options, callback) {
+  /**
+   * @callback DiffList~treeToTreeCallback Callback executed once the diff is computed.
+   * @param {GitError|null} error An Error or null if successful.
+   * @param {DiffList|null} diffList This diff list.
+   */
+  if (typeof options === 'function') {
+    callback = options;
+    options = {};
+  }
+  var self = this;
+  self.rawDiffList.treeToTree(self.rawRepo, oldSha, newSha, options || {}, function(error, rawDifflist) {
     if (error) {
       callback(new git.error(error.message, error.code), null);
       return;
     }
     self.rawDiffList = rawDifflist;
     callback(null, self);
-  });  
+  });
+};
+
+/**
+ * Diff a commit's tree against the index, i.e. what is staged. Pass null
+ * as the SHA to diff against an empty tree.
+ *
+ * @param {String|git.raw.Oid|null} oldSha
+ * @param {DiffOptions} [options]
+ * @param {DiffList~treeToTreeCallback} callback
+ */
+DiffList.prototype.treeToIndex = function(oldSha, options, callback) {
+  if (typeof options === 'function') {
+    callback = options;
+    options = {};
+  }
+  var self = this;
+  self.rawDiffList.treeToIndex(self.rawRepo, oldSha, options || {}, function(error, rawDifflist) {
+    if (success(error, callback)) {
+      self.rawDiffList = rawDifflist;
+      callback(null, self);
+    }
+  });
+};
+
+/**
+ * Diff the index against the working directory, i.e. what is not staged.
+ *
+ * @param {DiffOptions} [options]
+ * @param {DiffList~treeToTreeCallback} callback
+ */
+DiffList.prototype.indexToWorkdir = function(options, callback) {
+  if (typeof options === 'function') {
+    callback = options;
+    options = {};
+  }
+  var self = this;
+  self.rawDiffList.indexToWorkdir(self.rawRepo, options || {}, function(error, rawDifflist) {
+    if (success(error, callback)) {
+      self.rawDiffList = rawDifflist;
+      callback(null, self);
+    }
+  });
+};
+
+/**
+ * Diff two blobs directly, without resolving commits or trees. Pass null
+ * for either side to diff against nothing.
+ *
+ * @param {String|git.raw.Oid|null} oldSha
+ * @param {String|git.raw.Oid|null} newSha
+ * @param {DiffOptions} [options]
+ * @param {DiffList~blobsCallback} callback
+ */
+DiffList.prototype.blobs = function(oldSha, newSha, options, callback) {
+  /**
+   * @callback DiffList~blobsCallback Callback executed once the diff is computed.
+   * @param {GitError|null} error An Error or null if successful.
+   * @param {BlobDiff|null} diff The changes between the two sides.
+   */
+  if (typeof options === 'function') {
+    callback = options;
+    options = {};
+  }
+  this.rawDiffList.blobs(this.rawRepo, oldSha, newSha, options || {}, function diffListBlobs(error, diff) {
+    if (success(error, callback)) {
+      callback(null, diff);
+    }
+  });
+};
+
+/**
+ * Diff a blob against the content of a Buffer, e.g. an uploaded file
+ * against its version in history. The Buffer is read in place and must
+ * not be modified until the callback runs.
+ *
+ * @param {String|git.raw.Oid|null} oldSha
+ * @param {Buffer} buffer
+ * @param {DiffOptions} [options]
+ * @param {DiffList~blobsCallback} callback
+ */
+DiffList.prototype.blobToBuffer = function(oldSha, buffer, options, callback) {
+  if (typeof options === 'function') {
+    callback = options;
+    options = {};
+  }
+  this.rawDiffList.blobToBuffer(this.rawRepo, oldSha, buffer, options || {}, function diffListBlobToBuffer(error, diff) {
+    if (success(error, callback)) {
+      callback(null, diff);
+    }
+  });
+};
+
+var rawDiffCache = new git.raw.DiffCache();
+
+/**
+ * Process wide cache of formatted tree-to-tree diffs, keyed by both tree
+ * oids and the diff options. Used by toPatch; disabled until configured.
+ *
+ * @namespace
+ */
+DiffList.cache = {
+  /**
+   * @param {DiffCacheOptions} options
+   */
+  configure: function(options) {
+    rawDiffCache.configure(options);
+  },
+  /**
+   * @return {DiffCacheStats}
+   */
+  stats: function() {
+    return rawDiffCache.stats();
+  },
+  /**
+   * Drop every in-memory entry and reset the counters. Spilled files are
+   * left in place.
+   */
+  clear: function() {
+    rawDiffCache.clear();
+  }
 };
 
 exports.diffList = DiffList;
@@ -124,7 +431,7 @@ exports.diffList = DiffList;
  * @property {String} oldFile.path The path to the old file, relative to the repository 
  * @property {Object} newFile Contains details for the new file state
  * @property {String} newFile.path The path to the new file, relative to the repository
- * @property {Object[]} content Array of context & differences 
+ * @property {Object[]} content Array of context & differences, built from the file's hunks when first read
  * @property {Object} content[].range 
  * @property {Object} content[].range.old
  * @property {Integer} content[].range.old.start
@@ -163,3 +470,184 @@ var FileDelta = {
   ],
   status: Number
 };
+
+/**
+ * @namespace
+ * @property {Object} oldFile
+ * @property {String} oldFile.path The path to the old file, relative to the repository
+ * @property {Object} newFile
+ * @property {String} newFile.path The path to the new file, relative to the repository
+ * @property {String} header The hunk header, e.g. '@@ -1,3 +1,3 @@'
+ * @property {Object} range
+ * @property {Object} range.old
+ * @property {Integer} range.old.start
+ * @property {Integer} range.old.lines
+ * @property {Object} range.new
+ * @property {Integer} range.new.start
+ * @property {Integer} range.new.lines
+ * @property {String} content Every line of the hunk, back to back
+ * @property {String} lineOrigins One DiffList.lineOriginTypes character per line
+ * @property {Uint32Array} lineLengths Length in bytes of each line within content's UTF-8 encoding
+ */
+var DiffHunk = {
+  oldFile: {
+    path: String
+  },
+  newFile: {
+    path: String
+  },
+  header: String,
+  range: {
+    old: {
+      start: Number,
+      lines: Number
+    },
+    'new': {
+      start: Number,
+      lines: Number
+    }
+  },
+  content: String,
+  lineOrigins: String,
+  lineLengths: Uint32Array
+};
+
+/**
+ * @namespace
+ * @property {Integer} status Delta type, see DiffList.deltaTypes
+ * @property {Boolean} binary Either side is binary; there are no hunks
+ * @property {Integer} additions Number of added lines
+ * @property {Integer} deletions Number of deleted lines
+ * @property {Object[]} hunks Hunks shaped like DiffHunk, without oldFile and newFile
+ */
+var BlobDiff = {
+  status: Number,
+  binary: Boolean,
+  additions: Number,
+  deletions: Number,
+  hunks: [Object]
+};
+
+/**
+ * @namespace
+ * @property {Integer} files Number of changed files
+ * @property {Integer} additions Total number of added lines
+ * @property {Integer} deletions Total number of deleted lines
+ * @property {String[]} paths New path of each changed file, in diff order
+ * @property {Uint32Array} fileAdditions Added lines per file, aligned with paths
+ * @property {Uint32Array} fileDeletions Deleted lines per file, aligned with paths
+ */
+var DiffStats = {
+  files: Number,
+  additions: Number,
+  deletions: Number,
+  paths: [String],
+  fileAdditions: Uint32Array,
+  fileDeletions: Uint32Array
+};
+
+/**
+ * @namespace
+ * @property {String[]} oldPaths Path of each file before the change
+ * @property {String[]} newPaths Path of each file after the change
+ * @property {String[]} oldShas Blob SHA of each file before the change
+ * @property {String[]} newShas Blob SHA of each file after the change
+ * @property {Uint8Array} statuses Delta type of each file, see DiffList.deltaTypes
+ * @property {Uint16Array} oldModes File mode of each file before the change
+ * @property {Uint16Array} newModes File mode of each file after the change
+ */
+var NameStatus = {
+  oldPaths: [String],
+  newPaths: [String],
+  oldShas: [String],
+  newShas: [String],
+  statuses: Uint8Array,
+  oldModes: Uint16Array,
+  newModes: Uint16Array
+};
+
+/**
+ * @namespace
+ * @property {String|String[]} [pathspec] Only diff paths matching these fnmatch patterns
+ * @property {Integer} [contextLines = 3] Lines of context around each change
+ * @property {Integer} [interhunkLines = 0] Max unchanged lines between hunks before they are merged
+ * @property {Boolean} [ignoreWhitespace = false] Ignore all whitespace
+ * @property {Boolean} [ignoreWhitespaceChange = false] Ignore changes in amount of whitespace
+ * @property {Boolean} [ignoreWhitespaceEol = false] Ignore whitespace at end of line
+ * @property {Integer} [maxSize = 512MB] Blobs larger than this are treated as binary and never loaded
+ * @property {Boolean} [forceText = false] Treat every file as text
+ * @property {Boolean} [forceBinary = false] Treat every file as binary
+ * @property {Boolean} [reverse = false] Swap the old and new sides
+ * @property {String} [algorithm = 'myers'] Either myers or patience
+ */
+var DiffOptions = {
+  pathspec: [String],
+  contextLines: Number,
+  interhunkLines: Number,
+  ignoreWhitespace: Boolean,
+  ignoreWhitespaceChange: Boolean,
+  ignoreWhitespaceEol: Boolean,
+  maxSize: Number,
+  forceText: Boolean,
+  forceBinary: Boolean,
+  reverse: Boolean,
+  algorithm: String
+};
+
+/**
+ * @namespace
+ * @property {Boolean} [renames = true] Look for renames
+ * @property {Boolean} [copies = false] Look for copies from modified files
+ * @property {Boolean} [copiesFromUnmodified = false] Also consider unmodified files as copy sources
+ * @property {Boolean} [renamesFromRewrites = false] Allow rewritten files to be rename sources
+ * @property {Boolean} [breakRewrites = false] Split heavily rewritten files into a delete and an add
+ * @property {Integer} [renameThreshold = 50] Similarity required for a rename
+ * @property {Integer} [renameFromRewriteThreshold = 50] Similarity required for a rename from a rewrite
+ * @property {Integer} [copyThreshold = 50] Similarity required for a copy
+ * @property {Integer} [breakRewriteThreshold = 60] Similarity below which a modification is broken
+ * @property {Integer} [targetLimit = 200] Max number of candidate sources compared per file
+ * @property {Integer} [threads = 4] Threads used to compute similarity signatures
+ */
+var FindSimilarOptions = {
+  renames: Boolean,
+  copies: Boolean,
+  copiesFromUnmodified: Boolean,
+  renamesFromRewrites: Boolean,
+  breakRewrites: Boolean,
+  renameThreshold: Number,
+  renameFromRewriteThreshold: Number,
+  copyThreshold: Number,
+  breakRewriteThreshold: Number,
+  targetLimit: Number,
+  threads: Number
+};
+
+/**
+ * @namespace
+ * @property {Integer} [maxBytes] Memory budget for cached patches; 0 disables the memory tier
+ * @property {String|null} [spillDirectory] Directory evicted patches are written to, or null to disable
+ */
+var DiffCacheOptions = {
+  maxBytes: Number,
+  spillDirectory: String
+};
+
+/**
+ * @namespace
+ * @property {Integer} hits Lookups served from memory or disk
+ * @property {Integer} diskHits Lookups served from the spill directory
+ * @property {Integer} misses Lookups that had to compute the diff
+ * @property {Integer} evictions Entries dropped from memory
+ * @property {Integer} entries Entries in memory
+ * @property {Integer} bytes Bytes in memory
+ * @property {Integer} maxBytes The memory budget
+ */
+var DiffCacheStats = {
+  hits: Number,
+  diskHits: Number,
+  misses: Number,
+  evictions: Number,
+  entries: Number,
+  bytes: Number,
+  maxBytes: Number
+};
@@ -0,0 +1,203 @@
+var git = require('../'),
+    success = require('./utilities').success;
+
+/**
+ * Convenience index class. Entries are kept in the columnar form the raw
+ * index returns; paths and SHAs are only decoded when asked for.
+ *
+ * @constructor
+ * @param {git.raw.Repo} rawRepo
+ * @param {git.raw.Index} [rawIndex = new git.raw.Index()]
+ */
+var Index = function(rawRepo, rawIndex) {
+  if (!(rawRepo instanceof git.raw.Repo)) {
+    throw new git.error('First parameter for Index must be a raw repo');
+  }
+  this.rawRepo = rawRepo;
+
+  if (rawIndex instanceof git.raw.Index) {
+    this.rawIndex = rawIndex;
+  } else {
+    this.rawIndex = new git.raw.Index();
+  }
+  this.entries = null;
+};
+
+/**
+ * Read the repository's index file.
+ *
+ * @param {Index~readCallback} callback
+ */
+Index.prototype.read = function(callback) {
+  /**
+   * @callback Index~readCallback Callback executed once the index is read.
+   * @param {GitError|null} error An Error or null if successful.
+   * @param {Index|null} index This index.
+   */
+  var self = this;
+  self.rawIndex.read(self.rawRepo, function indexRead(error, entries) {
+    if (success(error, callback)) {
+      self.entries = entries;
+      callback(null, self);
+    }
+  });
+};
+
+/**
+ * Stage every file matching pathspecs, like `git add --all`. Files whose
+ * stat data matches the index are never read; the rest are written as
+ * blobs on several threads and the index is written once. Tracked files
+ * that no longer exist are removed. The entries are refreshed afterwards.
+ *
+ * @param {String[]} pathspecs Paths, directories or fnmatch patterns; empty or ['.'] for everything
+ * @param {AddAllOptions} [options]
+ * @param {Index~addAllCallback} callback
+ */
+Index.prototype.addAll = function(pathspecs, options, callback) {
+  /**
+   * @callback Index~addAllCallback Callback executed once the index is written.
+   * @param {GitError|null} error An Error or null if successful.
+   * @param {AddAllResult|null} result What was staged.
+   */
+  if (typeof options === 'function') {
+    callback = options;
+    options = {};
+  }
+  var self = this;
+  self.rawIndex.addAll(self.rawRepo, pathspecs, options || {}, function indexAddAll(error, result) {
+    if (success(error, callback)) {
+      self.entries = result.entries;
+      callback(null, result);
+    }
+  });
+};
+
+/**
+ * @return {Integer} Number of entries, counting each conflict stage.
+ */
+Index.prototype.count = function() {
+  return this.entries ? this.entries.count : 0;
+};
+
+/**
+ * Position of the first entry for path, or -1.
+ *
+ * @param {String} path
+ * @return {Integer}
+ */
+Index.prototype.find = function(path) {
+  return this.rawIndex.find(path);
+};
+
+/**
+ * @param {Integer} position
+ * @return {String}
+ */
+Index.prototype.path = function(position) {
+  var offsets = this.entries.pathOffsets;
+  return this.entries.pathTable.toString('utf8', offsets[position], offsets[position + 1] - 1);
+};
+
+/**
+ * @param {Integer} position
+ * @return {String}
+ */
+Index.prototype.sha = function(position) {
+  return this.entries.oids.toString('hex', position * 20, position * 20 + 20);
+};
+
+/**
+ * Decode one entry.
+ *
+ * @param {Integer} position
+ * @return {IndexEntry}
+ */
+Index.prototype.entry = function(position) {
+  var entries = this.entries;
+  return {
+    path: this.path(position),
+    sha: this.sha(position),
+    mode: entries.modes[position],
+    stage: entries.stages[position],
+    size: entries.sizes[position],
+    mtime: {
+      seconds: entries.mtimeSeconds[position],
+      nanoseconds: entries.mtimeNanoseconds[position]
+    }
+  };
+};
+
+exports.index = Index;
+
+/**
+ * @namespace
+ * @property {String} path
+ * @property {String} sha
+ * @property {Integer} mode
+ * @property {Integer} stage 0, or 1 to 3 for the sides of a conflict
+ * @property {Integer} size
+ * @property {Object} mtime
+ * @property {Integer} mtime.seconds
+ * @property {Integer} mtime.nanoseconds
+ */
+var IndexEntry = {
+  path: String,
+  sha: String,
+  mode: Number,
+  stage: Number,
+  size: Number,
+  mtime: {
+    seconds: Number,
+    nanoseconds: Number
+  }
+};
+
+/**
+ * @namespace
+ * @property {Integer} version Index file format version
+ * @property {Integer} count Number of entries
+ * @property {Buffer} pathTable Every path followed by a NUL, in index order
+ * @property {Uint32Array} pathOffsets Start of each path in pathTable, plus one final end offset
+ * @property {Buffer} oids 20 raw bytes per entry
+ * @property {Uint32Array} modes
+ * @property {Uint8Array} stages
+ * @property {Uint32Array} sizes
+ * @property {Uint32Array} mtimeSeconds
+ * @property {Uint32Array} mtimeNanoseconds
+ */
+var IndexEntries = {
+  version: Number,
+  count: Number,
+  pathTable: Buffer,
+  pathOffsets: Uint32Array,
+  oids: Buffer,
+  modes: Uint32Array,
+  stages: Uint8Array,
+  sizes: Uint32Array,
+  mtimeSeconds: Uint32Array,
+  mtimeNanoseconds: Uint32Array
+};
+
+/**
+ * @namespace
+ * @property {Integer} [threads = 4] Threads writing blobs
+ */
+var AddAllOptions = {
+  threads: Number
+};
+
+/**
+ * @namespace
+ * @property {Integer} scanned Working directory files matching the pathspecs
+ * @property {Integer} unchanged Files skipped because their stat data matched the index
+ * @property {Integer} added Files written as blobs and staged
+ * @property {Integer} removed Tracked files staged for removal
+ * @property {IndexEntries} entries The index as written
+ */
+var AddAllResult = {
+  scanned: Number,
+  unchanged: Number,
+  added: Number,
+  removed: Number,
+  entries: IndexEntries
+};
@@ -15,9 +15,13 @@ exports.repo = require('./repo.js').repo;
 exports.signature = require('./signature.js').signature;
 exports.oid = require('./oid.js').oid;
 exports.reference = require('./reference.js').reference;
+exports.transaction = require('./reference.js').transaction;
 exports.revwalk = require('./revwalk.js').revwalk;
 exports.commit = require('./commit.js').commit;
 exports.tree = require('./tree.js').tree;
+exports.treeBuilder = require('./tree_builder.js').treeBuilder;
+exports.index = require('./git_index.js').index;
+exports.packWriter = require('./pack_writer.js').packWriter;
 
 // Assign raw api to module
 try {
@@ -0,0 +1,127 @@
+var git = require('../'),
+    success = require('./utilities').success;
+
+/**
+ * Convenience bulk writer. Objects go into a single new packfile instead of
+ * loose files and become visible all at once on commit.
+ *
+ * @constructor
+ * @param {git.raw.Repo} rawRepo Raw repository object.
+ */
+var PackWriter = function(rawRepo) {
+  if (!(rawRepo instanceof git.raw.Repo)) {
+    throw new git.error('First parameter for PackWriter must be a raw repo');
+  }
+  this.rawRepo = rawRepo;
+  this.rawPackWriter = new git.raw.PackWriter();
+};
+
+/**
+ * Start a new pack.
+ *
+ * @param {PackWriterOptions} [options]
+ * @param {PackWriter~beginCallback} callback
+ */
+PackWriter.prototype.begin = function(options, callback) {
+  /**
+   * @callback PackWriter~beginCallback Callback executed once the temporary pack exists.
+   * @param {GitError|null} error An Error or null if successful.
+   * @param {PackWriter|null} writer This writer.
+   */
+  if (typeof options === 'function') {
+    callback = options;
+    options = {};
+  }
+  var self = this;
+  self.rawPackWriter.begin(self.rawRepo, options || {}, function packWriterBegin(error) {
+    if (success(error, callback)) {
+      callback(null, self);
+    }
+  });
+};
+
+/**
+ * Hash, compress and append a batch of objects. Objects already in the
+ * repository or in this pack are skipped. Wait for the callback before
+ * writing the next batch. If writing fails the pack is abandoned and a new
+ * one has to be begun.
+ *
+ * @param {PackObject[]} objects
+ * @param {PackWriter~writeCallback} callback
+ */
+PackWriter.prototype.write = function(objects, callback) {
+  /**
+   * @callback PackWriter~writeCallback Callback executed once the batch is appended.
+   * @param {GitError|null} error An Error or null if successful.
+   * @param {String[]|null} shas The id of each object, in the order given.
+   * @param {Integer} existing Objects skipped because they were already stored.
+   */
+  this.rawPackWriter.write(objects, function packWriterWrite(error, shas, existing) {
+    if (success(error, callback)) {
+      callback(null, shas, existing);
+    }
+  });
+};
+
+/**
+ * Finish the pack, write its index and move both into objects/pack.
+ *
+ * @param {PackWriter~commitCallback} callback
+ */
+PackWriter.prototype.commit = function(callback) {
+  /**
+   * @callback PackWriter~commitCallback Callback executed once the pack is in place.
+   * @param {GitError|null} error An Error or null if successful.
+   * @param {PackWriterResult|null} result
+   */
+  this.rawPackWriter.commit(function packWriterCommit(error, result) {
+    if (success(error, callback)) {
+      callback(null, result);
+    }
+  });
+};
+
+/**
+ * Drop the pack without making any of its objects visible.
+ *
+ * @param {Function} callback
+ */
+PackWriter.prototype.abort = function(callback) {
+  this.rawPackWriter.abort(callback);
+};
+
+exports.packWriter = PackWriter;
+
+/**
+ * @namespace
+ * @property {Integer} [threads = 4] Threads hashing and compressing objects
+ * @property {Integer} [level = -1] zlib compression level, -1 for zlib's default
+ */
+var PackWriterOptions = {
+  threads: Number,
+  level: Number
+};
+
+/**
+ * @namespace
+ * @property {String} type 'blob', 'tree', 'commit' or 'tag'
+ * @property {Buffer} data The object's contents, without a header
+ */
+var PackObject = {
+  type: String,
+  data: Buffer
+};
+
+/**
+ * @namespace
+ * @property {Integer} objects Objects in the pack; 0 means nothing was written
+ * @property {String} [sha] Pack checksum, as in pack-<sha>.pack
+ * @property {String} [packPath]
+ * @property {String} [indexPath]
+ */
+var PackWriterResult = {
+  objects: Number,
+  sha: String,
+  packPath: String,
+  indexPath: String
+};
@@ -61,4 +61,80 @@ Reference.prototype.oid = function(callback) {
   });
 };
 
+/**
+ * Queue of reference updates applied atomically by commit. Every ref is
+ * locked and checked against its expected old value before any of them is
+ * written, and packed-refs is rewritten at most once. Symbolic references
+ * such as HEAD are followed, so the update lands on the branch they point at.
+ *
+ * @constructor
+ * @param {git.raw.Repo} rawRepo
+ */
+var Transaction = function(rawRepo) {
+  if (!(rawRepo instanceof git.raw.Repo)) {
+    throw new git.error('First parameter for Transaction must be a raw repo');
+  }
+  this.rawRepo = rawRepo;
+  this.updates = [];
+};
+
+/**
+ * Queue creation of a reference that must not exist yet.
+ *
+ * @param {String} name Full reference name, e.g. 'refs/heads/master'
+ * @param {String} sha
+ * @return {Transaction}
+ */
+Transaction.prototype.create = function(name, sha) {
+  this.updates.push({ name: name, oldSha: null, newSha: sha });
+  return this;
+};
+
+/**
+ * Queue an update of a reference. If oldSha is given the reference must
+ * currently point at it.
+ *
+ * @param {String} name
+ * @param {String|undefined} oldSha Expected current value, or undefined to skip the check.
+ * @param {String} newSha
+ * @return {Transaction}
+ */
+Transaction.prototype.update = function(name, oldSha, newSha) {
+  this.updates.push({ name: name, oldSha: oldSha, newSha: newSha });
+  return this;
+};
+
+/**
+ * Queue deletion of a reference. If oldSha is given the reference must
+ * currently point at it.
+ *
+ * @param {String} name
+ * @param {String} [oldSha]
+ * @return {Transaction}
+ */
+Transaction.prototype.remove = function(name, oldSha) {
+  this.updates.push({ name: name, oldSha: oldSha, newSha: null });
+  return this;
+};
+
+/**
+ * Apply all queued updates, or none of them.
+ *
+ * @param {Transaction~commitCallback} callback
+ */
+Transaction.prototype.commit = function(callback) {
+  /**
+   * @callback Transaction~commitCallback Callback executed once the updates are applied.
+   * @param {GitError|null} error An Error or null if successful.
+   */
+  var updates = this.updates;
+  this.updates = [];
+  (new git.raw.Reference()).transaction(this.rawRepo, updates, function referenceTransaction(error) {
+    if (success(error, callback)) {
+      callback(null);
+    }
+  });
+};
+
 exports.reference = Reference;
+exports.transaction = Transaction;
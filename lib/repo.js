@@ -1,5 +1,7 @@
 var git = require('../'),
-    success = require('./utilities').success;
+    success = require('./utilities').success,
+    events = require('events'),
+    fs = require('fs');
 
 /**
  * Convenience repository class.
@@ -87,6 +89,451 @@ Repo.prototype.commit = function(sha, callback) {
   });
 };
 
+/**
+ * Watch the repository's refs and HEAD for changes. Bursts of filesystem
+ * activity (e.g. a push updating many refs) are coalesced into one 'change'
+ * event per ref that actually moved. Call stop() on the returned emitter to
+ * end the watch.
+ *
+ * @fires Repo#change
+ * @fires Repo#end
+ *
+ * @return {EventEmitter} refWatchEmitter
+ */
+Repo.prototype.watch = function() {
+  var event = new events.EventEmitter(),
+      rawWatcher = new git.raw.RefWatcher();
+
+  rawWatcher.start(this.rawRepo, function refWatcherChanges(error, changes) {
+    changes.forEach(function refWatcherChange(change) {
+      /**
+       * Change event.
+       *
+       * @event Repo#change
+       *
+       * @param {GitError|null} error An error object if there was an issue, null otherwise.
+       * @param {String} name Full name of the ref that changed, e.g. 'refs/heads/master'.
+       * @param {Oid|null} oldOid The previous target, or null if the ref was created.
+       * @param {Oid|null} newOid The new target, or null if the ref was deleted.
+       */
+      event.emit('change', null, change.name,
+        change.oldOid ? new git.oid(change.oldOid) : null,
+        change.newOid ? new git.oid(change.newOid) : null);
+    });
+  }, function refWatcherEnd(error) {
+    /**
+     * End event.
+     *
+     * @event Repo#end
+     *
+     * @param {GitError|null} error An error object if there was an issue, null otherwise.
+     */
+    event.emit('end', error ? new git.error(error.message, error.code) : null);
+  });
+
+  event.stop = function() {
+    rawWatcher.stop();
+  };
+
+  return event;
+};
+
+/**
+ * Compute what is staged, what is modified but not staged, and what is
+ * untracked, like `git status`. Index entries are checked on several
+ * threads and only hashed when their stat data cannot be trusted.
+ *
+ * @fires Repo#progress
+ * @fires Repo#end
+ *
+ * @param {StatusOptions} [options]
+ * @return {EventEmitter} statusEmitter
+ */
+Repo.prototype.status = function(options) {
+  var event = new events.EventEmitter();
+
+  (new git.raw.Status()).scan(this.rawRepo, options || {}, function statusProgress(processed, total) {
+    /**
+     * Progress event.
+     *
+     * @event Repo#progress
+     *
+     * @param {Integer} processed Index entries checked so far.
+     * @param {Integer} total Index entries to check.
+     */
+    event.emit('progress', processed, total);
+  }, function statusEnd(error, status) {
+    /**
+     * End event.
+     *
+     * @event Repo#end
+     *
+     * @param {GitError|null} error An error object if there was an issue, null otherwise.
+     * @param {RepoStatus|null} status The repository status.
+     */
+    event.emit('end', error ? new git.error(error.message, error.code) : null, status || null);
+  });
+
+  return event;
+};
+
+/**
+ * Read the repository's index.
+ *
+ * @param {Index~readCallback} callback
+ */
+Repo.prototype.index = function(callback) {
+  (new git.index(this.rawRepo)).read(callback);
+};
+
+/**
+ * Start a bulk import session that writes objects into one new packfile,
+ * like `git fast-import`.
+ *
+ * @param {PackWriterOptions} [options]
+ * @param {PackWriter~beginCallback} callback
+ */
+Repo.prototype.packWriter = function(options, callback) {
+  (new git.packWriter(this.rawRepo)).begin(options, callback);
+};
+
+/**
+ * Write the commit-graph file for every commit reachable from a reference,
+ * like `git commit-graph write --reachable`. RevWalk#commits, #mergeBase
+ * and #isAncestor use it once it exists; commits made afterwards are read
+ * from the object database until it is written again.
+ *
+ * @param {Repo~writeCommitGraphCallback} callback
+ */
+Repo.prototype.writeCommitGraph = function(callback) {
+  /**
+   * @callback Repo~writeCommitGraphCallback Callback executed when the graph is written.
+   * @param {GitError|null} error An Error or null if successful.
+   * @param {CommitGraphSummary|null} summary
+   */
+  (new git.raw.CommitGraph()).write(this.rawRepo, function commitGraphWrite(error, summary) {
+    if (success(error, callback)) {
+      callback(null, summary);
+    }
+  });
+};
+
+/**
+ * Add changed-path Bloom filters for every commit reachable from a
+ * reference that does not have one yet, next to the commit-graph.
+ * RevWalk#commits limited to paths skips commits whose filter rules the
+ * paths out without loading their trees. Call again as commits arrive;
+ * only the new ones are diffed.
+ *
+ * @param {BloomOptions} [options]
+ * @param {Repo~writeBloomFiltersCallback} callback
+ */
+Repo.prototype.writeBloomFilters = function(options, callback) {
+  if (typeof options === 'function') {
+    callback = options;
+    options = {};
+  }
+
+  /**
+   * @callback Repo~writeBloomFiltersCallback Callback executed when the filters are written.
+   * @param {GitError|null} error An Error or null if successful.
+   * @param {BloomSummary|null} summary
+   */
+  (new git.raw.CommitGraph()).writeBloom(this.rawRepo, options || {}, function commitGraphWriteBloom(error, summary) {
+    if (success(error, callback)) {
+      callback(null, summary);
+    }
+  });
+};
+
+/**
+ * Write reachability bitmaps for every reference tip and every
+ * options.interval-th commit of the history. Repo#countObjects and
+ * Repo#objects use them to answer without walking the history below the
+ * nearest bitmaps. The file is rewritten in full on each call.
+ *
+ * @param {BitmapOptions} [options]
+ * @param {Repo~writeBitmapsCallback} callback
+ */
+Repo.prototype.writeBitmaps = function(options, callback) {
+  if (typeof options === 'function') {
+    callback = options;
+    options = {};
+  }
+
+  /**
+   * @callback Repo~writeBitmapsCallback Callback executed when the bitmaps are written.
+   * @param {GitError|null} error An Error or null if successful.
+   * @param {BitmapSummary|null} summary
+   */
+  (new git.raw.BitmapIndex()).write(this.rawRepo, options || {}, function bitmapIndexWrite(error, summary) {
+    if (success(error, callback)) {
+      callback(null, summary);
+    }
+  });
+};
+
+/**
+ * Count the objects reachable from options.include but not from
+ * options.exclude, like `git rev-list --objects --count`.
+ *
+ * @param {ObjectSelection} options
+ * @param {Repo~countObjectsCallback} callback
+ */
+Repo.prototype.countObjects = function(options, callback) {
+  /**
+   * @callback Repo~countObjectsCallback Callback executed when the objects are counted.
+   * @param {GitError|null} error An Error or null if successful.
+   * @param {ObjectCounts|null} counts
+   */
+  (new git.raw.BitmapIndex()).count(this.rawRepo, options, function bitmapIndexCount(error, counts) {
+    if (success(error, callback)) {
+      callback(null, counts);
+    }
+  });
+};
+
+/**
+ * List the objects reachable from options.include but not from
+ * options.exclude, like `git rev-list --objects`, in batches.
+ *
+ * @fires Repo#objects
+ * @fires Repo#end
+ *
+ * @param {ObjectSelection} options
+ * @return {EventEmitter} objectsEmitter
+ */
+Repo.prototype.objects = function(options) {
+  var event = new events.EventEmitter();
+
+  (new git.raw.BitmapIndex()).objects(this.rawRepo, options, function bitmapIndexObjects(shas) {
+    /**
+     * Objects event.
+     *
+     * @event Repo#objects
+     *
+     * @param {String[]} shas The next batch of object shas.
+     */
+    event.emit('objects', shas);
+  }, function bitmapIndexObjectsEnd(error, counts) {
+    /**
+     * End event.
+     *
+     * @event Repo#end
+     *
+     * @param {GitError|null} error An error object if there was an issue, null otherwise.
+     * @param {ObjectCounts|null} counts
+     */
+    event.emit('end', error ? new git.error(error.message, error.code) : null, counts || null);
+  });
+
+  return event;
+};
+
+/**
+ * Generate a packfile holding every object reachable from options.include
+ * but not from options.exclude, like `git pack-objects --revs`. Deltas are
+ * searched on several threads. Without options.path the pack is emitted in
+ * chunks; with it, the pack is written to that file.
+ *
+ * @fires Repo#progress
+ * @fires Repo#data
+ * @fires Repo#end
+ *
+ * @param {PackOptions} options
+ * @return {EventEmitter} packEmitter
+ */
+Repo.prototype.pack = function(options) {
+  var event = new events.EventEmitter();
+
+  (new git.raw.PackBuilder()).build(this.rawRepo, options, function packProgress(progress) {
+    /**
+     * Progress event.
+     *
+     * @event Repo#progress
+     *
+     * @param {PackProgress} progress
+     */
+    event.emit('progress', progress);
+  }, function packData(data) {
+    /**
+     * Data event.
+     *
+     * @event Repo#data
+     *
+     * @param {Buffer} data The next chunk of the pack.
+     */
+    event.emit('data', data);
+  }, function packEnd(error, summary) {
+    /**
+     * End event.
+     *
+     * @event Repo#end
+     *
+     * @param {GitError|null} error An error object if there was an issue, null otherwise.
+     * @param {PackSummary|null} summary
+     */
+    event.emit('end', error ? new git.error(error.message, error.code) : null, summary || null);
+  });
+
+  return event;
+};
+
+/**
+ * Index and verify a packfile, like `git index-pack`. Delta families are
+ * resolved and hashed on several threads and the .idx is written next to
+ * the pack. A readable stream is first spooled into objects/pack and is
+ * installed there unless options.install is false.
+ *
+ * @fires Repo#progress
+ * @fires Repo#end
+ *
+ * @param {String|Stream} source Path of the .pack file or a stream of one
+ * @param {IndexPackOptions} [options]
+ * @return {EventEmitter} indexEmitter
+ */
+Repo.prototype.indexPack = function(source, options) {
+  var self = this,
+      event = new events.EventEmitter();
+  options = options || {};
+
+  var index = function(packPath, temporary) {
+    (new git.raw.Indexer()).indexPack(self.rawRepo, packPath, options, function indexProgress(progress) {
+      /**
+       * Progress event.
+       *
+       * @event Repo#progress
+       *
+       * @param {VerifyProgress} progress
+       */
+      event.emit('progress', progress);
+    }, function indexEnd(error, result) {
+      if (temporary && (error || !result.indexPath)) {
+        fs.unlink(packPath, function() {});
+      }
+      /**
+       * End event.
+       *
+       * @event Repo#end
+       *
+       * @param {GitError|null} error An error object if there was an issue, null otherwise.
+       * @param {VerifyResult|null} result
+       */
+      event.emit('end', error ? new git.error(error.message, error.code) : null, result || null);
+    });
+  };
+
+  if (typeof source === 'string') {
+    index(source, false);
+    return event;
+  }
+
+  if (options.install === undefined) {
+    options.install = true;
+  }
+  var packPath = self.rawRepo.path() + 'objects/pack/tmp_pack_' + process.pid + '_' +
+                 Date.now() + '_' + Math.floor(Math.random() * 0x100000000).toString(16),
+      spool = fs.createWriteStream(packPath, { mode: parseInt('0444', 8) }),
+      failed = false;
+  var fail = function(error) {
+    if (failed) {
+      return;
+    }
+    failed = true;
+    spool.destroy();
+    fs.unlink(packPath, function() {});
+    event.emit('end', new git.error(error.message), null);
+  };
+  source.on('error', fail);
+  spool.on('error', fail);
+  spool.on('close', function spoolClose() {
+    if (!failed) {
+      index(packPath, true);
+    }
+  });
+  source.pipe(spool);
+
+  return event;
+};
+
+/**
+ * Rehash every object in the repository on several threads, like
+ * `git fsck`, and check that everything a commit, tree or tag refers to
+ * exists.
+ *
+ * @fires Repo#progress
+ * @fires Repo#end
+ *
+ * @param {FsckOptions} [options]
+ * @return {EventEmitter} fsckEmitter
+ */
+Repo.prototype.fsck = function(options) {
+  var event = new events.EventEmitter();
+
+  (new git.raw.Indexer()).fsck(this.rawRepo, options || {}, function fsckProgress(progress) {
+    /**
+     * Progress event.
+     *
+     * @event Repo#progress
+     *
+     * @param {VerifyProgress} progress
+     */
+    event.emit('progress', progress);
+  }, function fsckEnd(error, result) {
+    /**
+     * End event.
+     *
+     * @event Repo#end
+     *
+     * @param {GitError|null} error An error object if there was an issue, null otherwise.
+     * @param {VerifyResult|null} result
+     */
+    event.emit('end', error ? new git.error(error.message, error.code) : null, result || null);
+  });
+
+  return event;
+};
+
+/**
+ * Attribute each line of a file to the commit that last changed it, like
+ * `git blame`. Runs on its own thread and emits hunks as soon as their
+ * commit is known, so recently changed lines arrive first. Renames are
+ * not followed.
+ *
+ * @fires Repo#hunks
+ * @fires Repo#end
+ *
+ * @param {String} path Path of the file relative to the repository root
+ * @param {BlameOptions} [options]
+ * @return {EventEmitter} blameEmitter
+ */
+Repo.prototype.blame = function(path, options) {
+  var event = new events.EventEmitter();
+
+  (new git.raw.Blame()).file(this.rawRepo, path, options || {}, function blameHunks(hunks) {
+    /**
+     * Hunks event.
+     *
+     * @event Repo#hunks
+     *
+     * @param {BlameHunk[]} hunks Newly attributed hunks, in no particular line order.
+     */
+    event.emit('hunks', hunks);
+  }, function blameEnd(error, summary) {
+    /**
+     * End event.
+     *
+     * @event Repo#end
+     *
+     * @param {GitError|null} error An error object if there was an issue, null otherwise.
+     * @param {Object|null} summary totalLines in the file and attributedLines emitted.
+     */
+    event.emit('end', error ? new git.error(error.message, error.code) : null, summary || null);
+  });
+
+  return event;
+};
+
 /**
  * Initialise a git repository at directory.
  *
@@ -130,3 +577,261 @@ exports.repo = function(directory, callback) {
   }
   repo.open(directory, callback);
 };
+
+/**
+ * @namespace
+ * @property {Boolean} [untracked = true] Look for untracked files
+ * @property {Boolean} [recurseUntracked = false] List files inside untracked directories instead of the directories
+ * @property {Integer} [threads = 4] Threads used to stat and hash the working directory
+ */
+var StatusOptions = {
+  untracked: Boolean,
+  recurseUntracked: Boolean,
+  threads: Number
+};
+
+/**
+ * @namespace
+ * @property {Object} staged Changes between HEAD and the index
+ * @property {String[]} staged.paths
+ * @property {Uint8Array} staged.statuses Delta type of each path, see DiffList.deltaTypes
+ * @property {Object} unstaged Changes between the index and the working directory
+ * @property {String[]} unstaged.paths
+ * @property {Uint8Array} unstaged.statuses Delta type of each path, see DiffList.deltaTypes
+ * @property {String[]} untracked Untracked files, and untracked directories ending in a slash
+ * @property {Integer} hashed Number of files whose content had to be hashed
+ */
+var RepoStatus = {
+  staged: {
+    paths: [String],
+    statuses: Uint8Array
+  },
+  unstaged: {
+    paths: [String],
+    statuses: Uint8Array
+  },
+  untracked: [String],
+  hashed: Number
+};
+
+/**
+ * @namespace
+ * @property {String} [newest = 'HEAD'] Revision to blame
+ * @property {String} [oldest] Stop at this commit; older lines are attributed to boundary commits
+ * @property {Boolean} [firstParent = false] Only follow the first parent of merges
+ * @property {Integer} [minLine = 1] First line to blame, 1-based
+ * @property {Integer} [maxLine] Last line to blame, inclusive; defaults to the end of the file
+ */
+var BlameOptions = {
+  newest: String,
+  oldest: String,
+  firstParent: Boolean,
+  minLine: Number,
+  maxLine: Number
+};
+
+/**
+ * @namespace
+ * @property {String} sha Commit the lines are attributed to
+ * @property {Integer} finalStartLine First line in the blamed revision, 1-based
+ * @property {Integer} originalStartLine First line in the file as of sha
+ * @property {Integer} lines Number of lines
+ * @property {Boolean} boundary True when sha is where the oldest limit stopped the search
+ * @property {Object} author
+ * @property {String} author.name
+ * @property {String} author.email
+ * @property {Integer} author.time Seconds since the epoch
+ */
+var BlameHunk = {
+  sha: String,
+  finalStartLine: Number,
+  originalStartLine: Number,
+  lines: Number,
+  boundary: Boolean,
+  author: {
+    name: String,
+    email: String,
+    time: Number
+  }
+};
+
+/**
+ * @namespace
+ * @property {String[]} include Commits, refs or revisions whose history is packed
+ * @property {String[]} [exclude] Commits, refs or revisions the receiver already has
+ * @property {Integer} [threads = 0] Delta search threads; 0 for one per CPU
+ * @property {String} [path] Write the pack to this file instead of emitting data
+ */
+var PackOptions = {
+  include: Array,
+  exclude: Array,
+  threads: Number,
+  path: String
+};
+
+/**
+ * @namespace
+ * @property {String} stage 'counting', 'compressing' or 'writing'
+ * @property {Integer} objects Objects counted so far
+ * @property {Integer} bytes Pack bytes written so far
+ */
+var PackProgress = {
+  stage: String,
+  objects: Number,
+  bytes: Number
+};
+
+/**
+ * @namespace
+ * @property {Integer} objects Objects in the pack
+ * @property {Integer} written Objects written
+ * @property {Integer} bytes Size of the pack
+ */
+var PackSummary = {
+  objects: Number,
+  written: Number,
+  bytes: Number
+};
+
+/**
+ * @namespace
+ * @property {Integer} commits Commits in the graph
+ * @property {String} path The graph file
+ */
+var CommitGraphSummary = {
+  commits: Number,
+  path: String
+};
+
+/**
+ * @namespace
+ * @property {Integer} [threads = 4] Threads used to diff new commits
+ */
+var BloomOptions = {
+  threads: Number
+};
+
+/**
+ * @namespace
+ * @property {Integer} added Commits filtered by this call
+ * @property {Integer} commits Commits with a filter
+ * @property {String} path The filter file
+ */
+var BloomSummary = {
+  added: Number,
+  commits: Number,
+  path: String
+};
+
+/**
+ * @namespace
+ * @property {Integer} [interval = 100] Commits between bitmaps; 0 for reference tips only
+ */
+var BitmapOptions = {
+  interval: Number
+};
+
+/**
+ * @namespace
+ * @property {Integer} objects Objects numbered in the file
+ * @property {Integer} bitmaps Commits with a bitmap
+ * @property {String} path The bitmap file
+ */
+var BitmapSummary = {
+  objects: Number,
+  bitmaps: Number,
+  path: String
+};
+
+/**
+ * @namespace
+ * @property {String[]} include Commits, refs or revisions whose objects are selected
+ * @property {String[]} [exclude] Commits, refs or revisions whose objects are left out
+ */
+var ObjectSelection = {
+  include: Array,
+  exclude: Array
+};
+
+/**
+ * @namespace
+ * @property {Integer} objects Objects selected
+ * @property {Integer} commits Commits among them
+ * @property {Integer} trees Trees among them
+ * @property {Integer} blobs Blobs among them
+ * @property {Integer} walked Commits read because no bitmap covered them
+ * @property {Boolean} bitmaps Whether the repository had bitmaps
+ */
+var ObjectCounts = {
+  objects: Number,
+  commits: Number,
+  trees: Number,
+  blobs: Number,
+  walked: Number,
+  bitmaps: Boolean
+};
+
+/**
+ * @namespace
+ * @property {Integer} [threads = 4] Worker threads
+ * @property {Boolean} [connectivity = true] Check that every referenced object exists
+ * @property {Boolean} [install = false] Move the pack and index into objects/pack once verified
+ */
+var IndexPackOptions = {
+  threads: Number,
+  connectivity: Boolean,
+  install: Boolean
+};
+
+/**
+ * @namespace
+ * @property {Integer} [threads = 4] Worker threads
+ * @property {Boolean} [connectivity = true] Check that every referenced object exists
+ */
+var FsckOptions = {
+  threads: Number,
+  connectivity: Boolean
+};
+
+/**
+ * @namespace
+ * @property {String} stage 'checksum', 'parsing', 'resolving', 'hashing' or 'connectivity'
+ * @property {Integer} processed Objects processed in this stage
+ * @property {Integer} total Objects in this stage
+ */
+var VerifyProgress = {
+  stage: String,
+  processed: Number,
+  total: Number
+};
+
+/**
+ * Corrupt and missing objects are reported rather than raised; only a pack
+ * that cannot be parsed at all ends in an error. indexPack writes no index
+ * unless both lists are empty.
+ *
+ * @namespace
+ * @property {Integer} objects Objects checked
+ * @property {Object[]} corrupt Objects that are unreadable or do not match their id
+ * @property {String|null} corrupt.sha
+ * @property {Integer|null} corrupt.offset Offset in the pack, for indexPack
+ * @property {String} corrupt.reason
+ * @property {String[]} missing Objects referred to but not present, including the bases of a thin pack
+ * @property {Integer} [deltas] Deltified entries in the pack, for indexPack
+ * @property {String} [packPath] Where the pack is now, for indexPack
+ * @property {String|null} [sha] Pack checksum, for indexPack
+ * @property {String|null} [indexPath] The written .idx, for indexPack
+ */
+var VerifyResult = {
+  objects: Number,
+  corrupt: [{
+    sha: String,
+    offset: Number,
+    reason: String
+  }],
+  missing: [String],
+  deltas: Number,
+  packPath: String,
+  sha: String,
+  indexPath: String
+};
@@ -1,5 +1,7 @@
 var git = require('../'),
-    success = require('./utilities').success;
+    events = require('events'),
+    success = require('./utilities').success,
+    rawOid = require('./utilities').rawOid;
 
 /**
  * Convenience revision walking class
@@ -87,4 +89,195 @@ RevWalk.prototype.walk = function(oid, callback) {
   });
 };
 
+/**
+ * Count files and lines changed by every commit in range, each commit
+ * against its first parent. Commits are diffed in parallel but records
+ * are emitted in walk order.
+ *
+ * @fires RevWalk#commit
+ * @fires RevWalk#end
+ *
+ * @param {String} range A revision ('master') or range ('v1.0..master')
+ * @param {ChurnOptions} [options]
+ * @return {EventEmitter} churnEmitter
+ */
+RevWalk.prototype.churn = function(range, options) {
+  var event = new events.EventEmitter();
+
+  this.rawRevWalk.churn(range, options || {}, function churnRecords(records) {
+    records.forEach(function churnRecord(record) {
+      /**
+       * Commit event.
+       *
+       * @event RevWalk#commit
+       *
+       * @param {ChurnRecord} record Changes made by one commit.
+       */
+      event.emit('commit', record);
+    });
+  }, function churnEnd(error, count) {
+    /**
+     * End event.
+     *
+     * @event RevWalk#end
+     *
+     * @param {GitError|null} error An error object if there was an issue, null otherwise.
+     * @param {Integer} count Number of commits emitted.
+     */
+    event.emit('end', error ? new git.error(error.message, error.code) : null, count);
+  });
+
+  return event;
+};
+
+/**
+ * Walk every commit in range on a separate thread. When the repository has
+ * a commit-graph (see Repo#writeCommitGraph) commits are read from it
+ * rather than parsed from the object database. With options.paths, only
+ * commits touching one of them are emitted, and changed-path filters (see
+ * Repo#writeBloomFilters) spare loading the trees of most that do not.
+ *
+ * With options.cache, a topological walk from a single revision is kept
+ * under objects/info/history. Walking the same tip again reads nothing
+ * from the object database. Walking a descendant reads only the commits
+ * since the nearest cached ancestor and emits them ahead of its walk.
+ * Cached walks are in a topological order, newest first where that
+ * leaves a choice, which may differ from libgit2's.
+ *
+ * The walk stays a few batches ahead of the commits events and waits for
+ * the event loop to catch up rather than buffering the whole history.
+ *
+ * @fires RevWalk#commits
+ * @fires RevWalk#end
+ *
+ * @param {String} range A revision ('master') or range ('v1.0..master')
+ * @param {CommitsOptions} [options]
+ * @return {EventEmitter} commitsEmitter
+ */
+RevWalk.prototype.commits = function(range, options) {
+  var event = new events.EventEmitter();
+
+  this.rawRevWalk.commits(range, options || {}, function commitsBatch(shas) {
+    /**
+     * Commits event.
+     *
+     * @event RevWalk#commits
+     *
+     * @param {String[]} shas The next commits in walk order.
+     */
+    event.emit('commits', shas);
+  }, function commitsEnd(error, summary) {
+    /**
+     * End event.
+     *
+     * @event RevWalk#end
+     *
+     * @param {GitError|null} error An error object if there was an issue, null otherwise.
+     * @param {CommitsSummary|null} summary
+     */
+    event.emit('end', error ? new git.error(error.message, error.code) : null, summary || null);
+  });
+
+  return event;
+};
+
+/**
+ * Find a best common ancestor of two commits, like `git merge-base`.
+ *
+ * @param {Oid|String} one
+ * @param {Oid|String} two
+ * @param {RevWalk~mergeBaseCallback} callback
+ */
+RevWalk.prototype.mergeBase = function(one, two, callback) {
+  /**
+   * @callback RevWalk~mergeBaseCallback Callback executed when the merge base is found.
+   * @param {GitError|null} error An Error or null if successful.
+   * @param {String|null} sha The merge base, or null if the commits share no history.
+   */
+  this.rawRevWalk.mergeBase(rawOid(one), rawOid(two), function revWalkMergeBase(error, sha) {
+    if (success(error, callback)) {
+      callback(null, sha);
+    }
+  });
+};
+
+/**
+ * Check whether ancestor is descendant or one of its ancestors, like
+ * `git merge-base --is-ancestor`. Without a commit-graph, history is
+ * walked from descendant and commits dated before ancestor are not
+ * followed.
+ *
+ * @param {Oid|String} ancestor
+ * @param {Oid|String} descendant
+ * @param {RevWalk~isAncestorCallback} callback
+ */
+RevWalk.prototype.isAncestor = function(ancestor, descendant, callback) {
+  /**
+   * @callback RevWalk~isAncestorCallback Callback executed when the answer is known.
+   * @param {GitError|null} error An Error or null if successful.
+   * @param {Boolean|null} isAncestor
+   */
+  this.rawRevWalk.isAncestor(rawOid(ancestor), rawOid(descendant), function revWalkIsAncestor(error, isAncestor) {
+    if (success(error, callback)) {
+      callback(null, isAncestor);
+    }
+  });
+};
+
 exports.revwalk = RevWalk;
+
+/**
+ * @namespace
+ * @property {Integer} [sorting = TOPOLOGICAL | TIME] libgit2 sort mode for the walk
+ * @property {Integer} [threads = 4] Threads used to diff commits
+ */
+var ChurnOptions = {
+  sorting: Number,
+  threads: Number
+};
+
+/**
+ * @namespace
+ * @property {String} sha The commit
+ * @property {Integer} parentCount Number of parents; only the first is diffed against
+ * @property {Integer} files Number of changed files
+ * @property {Integer} additions Added lines
+ * @property {Integer} deletions Deleted lines
+ */
+var ChurnRecord = {
+  sha: String,
+  parentCount: Number,
+  files: Number,
+  additions: Number,
+  deletions: Number
+};
+
+/**
+ * @namespace
+ * @property {Integer} [sorting = TOPOLOGICAL | TIME] libgit2 sort mode for the walk
+ * @property {String[]} [paths] Only emit commits whose diff against their first parent touches one of these
+ * @property {Boolean} [cache = false] Read and extend the history cache when walking a single revision topologically
+ */
+var CommitsOptions = {
+  sorting: Number,
+  paths: Array,
+  cache: Boolean
+};
+
+/**
+ * @namespace
+ * @property {Integer} count Number of commits emitted
+ * @property {Boolean} graph Whether the walk read the commit-graph
+ * @property {Integer} loaded Commits parsed from the object database
+ * @property {Integer} cached Commits taken from the history cache
+ * @property {Integer} filtered Commits ruled out by their changed-path filter
+ * @property {Integer} diffed Commits whose trees were diffed to check paths
+ */
+var CommitsSummary = {
+  count: Number,
+  graph: Boolean,
+  loaded: Number,
+  cached: Number,
+  filtered: Number,
+  diffed: Number
+};
@@ -0,0 +1,62 @@
+var git = require('../'),
+    success = require('./utilities').success,
+    rawOid = require('./utilities').rawOid;
+
+/**
+ * Convenience tree builder. Writes nested trees from a flat list of path
+ * updates without an index or working directory.
+ *
+ * @constructor
+ * @param {git.raw.Repo} rawRepo Raw repository object.
+ */
+var TreeBuilder = function(rawRepo) {
+  if (!(rawRepo instanceof git.raw.Repo)) {
+    throw new git.error('First parameter for TreeBuilder must be a raw repo');
+  }
+  this.rawRepo = rawRepo;
+  this.rawTreeBuilder = new git.raw.TreeBuilder();
+};
+
+/**
+ * Apply updates over base and write the resulting tree. Only the trees
+ * containing an updated path are written; every other subtree keeps its
+ * oid from base. Directories left empty are dropped.
+ *
+ * @param {Oid|git.raw.Oid|String|null} base Tree to start from, or null for an empty tree.
+ * @param {TreeUpdate[]} updates
+ * @param {TreeBuilder~writeCallback} callback
+ */
+TreeBuilder.prototype.write = function(base, updates, callback) {
+  /**
+   * @callback TreeBuilder~writeCallback Callback executed once the tree is written.
+   * @param {GitError|null} error An Error or null if successful.
+   * @param {Oid|null} oid The new root tree.
+   * @param {Integer} written Number of trees written, including the root.
+   */
+  var rawUpdates = updates.map(function(update) {
+    return {
+      path: update.path,
+      oid: rawOid(update.oid),
+      mode: update.mode
+    };
+  });
+  this.rawTreeBuilder.write(this.rawRepo, rawOid(base), rawUpdates, function treeBuilderWrite(error, oid, written) {
+    if (success(error, callback)) {
+      callback(null, new git.oid(oid), written);
+    }
+  });
+};
+
+exports.treeBuilder = TreeBuilder;
+
+/**
+ * @namespace
+ * @property {String} path Slash separated path from the root of the tree
+ * @property {Oid|git.raw.Oid|String|null} oid Object to place at path, or null to remove path
+ * @property {Integer} [mode = 0100644] File mode: 0100644, 0100755, 0120000, 0160000 or 040000
+ */
+var TreeUpdate = {
+  path: String,
+  oid: String,
+  mode: Number
+};
@@ -26,6 +26,22 @@ var utilities = {
       return false;
     }
     return true;
+  },
+
+  /**
+   * Unwrap a convenience Oid for the raw API. Raw Oids and SHAs pass
+   * through, undefined becomes null.
+   *
+   * @param  {Oid|git.raw.Oid|String|null} [oid]
+   *
+   * @return {git.raw.Oid|String|null}
+   */
+  rawOid: function(oid) {
+    if (oid instanceof git.oid) {
+      return oid.getRawOid();
+    }
+    return typeof oid === 'undefined' ? null : oid;
   }
 };
 exports.success = utilities.success;
+exports.rawOid = utilities.rawOid;
@@ -11,6 +11,7 @@
 #include "git2.h"
 
 #include "../include/reference.h"
+#include "../include/ref_watcher.h"
 #include "../include/signature.h"
 #include "../include/error.h"
 #include "../include/blob.h"
@@ -20,7 +21,17 @@
 #include "../include/revwalk.h"
 #include "../include/tree.h"
 #include "../include/tree_entry.h"
+#include "../include/tree_builder.h"
 #include "../include/diff_list.h"
+#include "../include/diff_cache.h"
+#include "../include/index.h"
+#include "../include/status.h"
+#include "../include/blame.h"
+#include "../include/pack_writer.h"
+#include "../include/pack_builder.h"
+#include "../include/indexer.h"
+#include "../include/commit_graph.h"
+#include "../include/bitmap_index.h"
 #include "../include/threads.h"
 
 extern "C" void init(Handle<v8::Object> target) {
@@ -29,6 +40,7 @@ extern "C" void init(Handle<v8::Object> target) {
   GitError::Initialize(target);
 
   GitReference::Initialize(target);
+  GitRefWatcher::Initialize(target);
   GitSignature::Initialize(target);
   GitBlob::Initialize(target);
   GitOid::Initialize(target);
@@ -38,8 +50,18 @@ extern "C" void init(Handle<v8::Object> target) {
 
   GitTree::Initialize(target);
   GitTreeEntry::Initialize(target);
+  GitTreeBuilder::Initialize(target);
 
   GitDiffList::Initialize(target);
+  GitDiffCache::Initialize(target);
+  GitIndex::Initialize(target);
+  GitStatus::Initialize(target);
+  GitBlame::Initialize(target);
+  GitPackWriter::Initialize(target);
+  GitPackBuilder::Initialize(target);
+  GitIndexer::Initialize(target);
+  GitCommitGraph::Initialize(target);
+  GitBitmapIndex::Initialize(target);
 
   GitThreads::Initialize(target);
 
@@ -0,0 +1,434 @@
+/*
+ * Copyright 2013, Tim Branyen @tbranyen <tim@tabdeveloper.com>
+ * @author Michael Robinson @codeofinterest <mike@pagesofinterest.net>
+ *
+ * Dual licensed under the MIT and GPL licenses.
+ */
+
+#include <v8.h>
+#include <node.h>
+
+#include "cvv8/v8-convert.hpp"
+#include "git2.h"
+
+#include "../include/repo.h"
+#include "../include/bitmap_index.h"
+#include "../include/pack_builder.h"
+#include "../include/error.h"
+
+#include "../include/functions/bitmap.h"
+#include "../include/functions/string.h"
+#include "../include/functions/utilities.h"
+
+using namespace v8;
+using namespace node;
+
+void GitBitmapIndex::Initialize(Handle<v8::Object> target) {
+  HandleScope scope;
+
+  Local<FunctionTemplate> tpl = FunctionTemplate::New(New);
+
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+  tpl->SetClassName(String::NewSymbol("BitmapIndex"));
+
+  NODE_SET_PROTOTYPE_METHOD(tpl, "write", Write);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "count", Count);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "objects", Objects);
+
+  constructor_template = Persistent<Function>::New(tpl->GetFunction());
+  target->Set(String::NewSymbol("BitmapIndex"), constructor_template);
+}
+
+Handle<Value> GitBitmapIndex::New(const Arguments& args) {
+  HandleScope scope;
+
+  GitBitmapIndex *index = new GitBitmapIndex();
+  index->Wrap(args.This());
+
+  return scope.Close(args.This());
+}
+
+static void stringsFromArray(Local<Value> value, std::vector<std::string>& out) {
+  if (!value->IsArray()) {
+    return;
+  }
+  Local<Array> array = Local<Array>::Cast(value);
+  for (uint32_t i = 0; i < array->Length(); i++) {
+    out.push_back(stringArgToString(array->Get(i)->ToString()));
+  }
+}
+
+/**
+ * Every object reachable from include but not from exclude, from the
+ * repository's bitmaps when it has them. A file that cannot be read is
+ * ignored and every commit is walked instead.
+ */
+int GitBitmapIndex::Select(git_repository* repo, const std::vector<std::string>& include,
+                           const std::vector<std::string>& exclude, ReachabilityBitmaps& bitmaps,
+                           Bitset& out, Counts& counts) {
+  if (bitmaps.Open(git_repository_path(repo)) != GIT_OK) {
+    giterr_clear();
+  }
+
+  std::vector<git_oid> tips[2];
+  for (size_t i = 0; i < include.size() + exclude.size(); i++) {
+    bool included = i < include.size();
+    git_oid oid;
+    int returnCode = GitPackBuilder::ResolveCommit(repo, included ? include[i] : exclude[i - include.size()], &oid);
+    if (returnCode != GIT_OK) {
+      return returnCode;
+    }
+    tips[included ? 0 : 1].push_back(oid);
+  }
+
+  int returnCode = bitmaps.Reachable(repo, tips[0], out);
+  if (returnCode == GIT_OK && !tips[1].empty()) {
+    Bitset excluded;
+    returnCode = bitmaps.Reachable(repo, tips[1], excluded);
+    out.AndNot(excluded);
+  }
+  if (returnCode != GIT_OK) {
+    return returnCode;
+  }
+
+  Bitset mask;
+  counts.objects = out.Count();
+  bitmaps.TypeMask(ReachabilityBitmaps::TYPE_COMMIT, mask);
+  counts.commits = out.CountAnd(mask);
+  bitmaps.TypeMask(ReachabilityBitmaps::TYPE_TREE, mask);
+  counts.trees = out.CountAnd(mask);
+  bitmaps.TypeMask(ReachabilityBitmaps::TYPE_BLOB, mask);
+  counts.blobs = out.CountAnd(mask);
+  counts.walked = bitmaps.Walked();
+  counts.bitmaps = bitmaps.Bitmaps() > 0;
+  return GIT_OK;
+}
+
+Handle<Value> GitBitmapIndex::CountsToJS(const Counts& counts) {
+  HandleScope scope;
+
+  Local<Object> result = Object::New();
+  result->Set(String::NewSymbol("objects"), Number::New((double)counts.objects));
+  result->Set(String::NewSymbol("commits"), Number::New((double)counts.commits));
+  result->Set(String::NewSymbol("trees"), Number::New((double)counts.trees));
+  result->Set(String::NewSymbol("blobs"), Number::New((double)counts.blobs));
+  result->Set(String::NewSymbol("walked"), Number::New((double)counts.walked));
+  result->Set(String::NewSymbol("bitmaps"), Boolean::New(counts.bitmaps));
+
+  return scope.Close(result);
+}
+
+Handle<Value> GitBitmapIndex::Write(const Arguments& args) {
+  HandleScope scope;
+
+  if(args.Length() == 0 || !args[0]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Repo is required and must be an Object.")));
+  }
+
+  if(args.Length() == 1 || !args[1]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Options are required and must be an Object.")));
+  }
+
+  if(args.Length() == 2 || !args[2]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Callback is required and must be a Function.")));
+  }
+
+  git_repository* repo = ObjectWrap::Unwrap<GitRepo>(args[0]->ToObject())->GetValue();
+  if (repo == NULL) {
+    return ThrowException(Exception::Error(String::New("Repo must be open.")));
+  }
+
+  WriteBaton* baton = new WriteBaton;
+  baton->request.data = baton;
+  baton->error = NULL;
+  baton->rawRepo = repo;
+
+  Local<Value> interval = args[1]->ToObject()->Get(String::NewSymbol("interval"));
+  baton->interval = interval->IsNumber() ? interval->Uint32Value() : ReachabilityBitmaps::DEFAULT_INTERVAL;
+
+  baton->objects = 0;
+  baton->bitmaps = 0;
+  baton->callback = Persistent<Function>::New(Local<Function>::Cast(args[2]));
+
+  uv_queue_work(uv_default_loop(), &baton->request, WriteWork, (uv_after_work_cb)WriteAfterWork);
+
+  return Undefined();
+}
+
+void GitBitmapIndex::WriteWork(uv_work_t *req) {
+  WriteBaton *baton = static_cast<WriteBaton *>(req->data);
+
+  int returnCode = ReachabilityBitmaps::Write(baton->rawRepo, baton->interval, &baton->objects, &baton->bitmaps);
+  if (returnCode != GIT_OK) {
+    baton->error = giterr_last();
+    return;
+  }
+  baton->path = ReachabilityBitmaps::Path(git_repository_path(baton->rawRepo));
+}
+
+void GitBitmapIndex::WriteAfterWork(uv_work_t *req) {
+  HandleScope scope;
+  WriteBaton *baton = static_cast<WriteBaton *>(req->data);
+
+  if (success(baton->error, baton->callback)) {
+    Local<Object> result = Object::New();
+    result->Set(String::NewSymbol("objects"), Number::New((double)baton->objects));
+    result->Set(String::NewSymbol("bitmaps"), Number::New((double)baton->bitmaps));
+    result->Set(String::NewSymbol("path"), String::New(baton->path.c_str()));
+
+    Handle<Value> argv[2] = {
+      Local<Value>::New(Null()),
+      result
+    };
+
+    TryCatch try_catch;
+    baton->callback->Call(Context::GetCurrent()->Global(), 2, argv);
+    if (try_catch.HasCaught()) {
+      node::FatalException(try_catch);
+    }
+  }
+
+  baton->callback.Dispose();
+  delete baton;
+}
+
+Handle<Value> GitBitmapIndex::Count(const Arguments& args) {
+  HandleScope scope;
+
+  if(args.Length() == 0 || !args[0]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Repo is required and must be an Object.")));
+  }
+
+  if(args.Length() == 1 || !args[1]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Options are required and must be an Object.")));
+  }
+
+  if(args.Length() == 2 || !args[2]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Callback is required and must be a Function.")));
+  }
+
+  git_repository* repo = ObjectWrap::Unwrap<GitRepo>(args[0]->ToObject())->GetValue();
+  if (repo == NULL) {
+    return ThrowException(Exception::Error(String::New("Repo must be open.")));
+  }
+
+  Local<Object> options = args[1]->ToObject();
+  std::vector<std::string> include;
+  stringsFromArray(options->Get(String::NewSymbol("include")), include);
+  if (include.empty()) {
+    return ThrowException(Exception::Error(String::New("At least one commit must be included.")));
+  }
+
+  CountBaton* baton = new CountBaton;
+  baton->request.data = baton;
+  baton->error = NULL;
+  baton->rawRepo = repo;
+  baton->include.swap(include);
+  stringsFromArray(options->Get(String::NewSymbol("exclude")), baton->exclude);
+  baton->callback = Persistent<Function>::New(Local<Function>::Cast(args[2]));
+
+  uv_queue_work(uv_default_loop(), &baton->request, CountWork, (uv_after_work_cb)CountAfterWork);
+
+  return Undefined();
+}
+
+void GitBitmapIndex::CountWork(uv_work_t *req) {
+  CountBaton *baton = static_cast<CountBaton *>(req->data);
+
+  ReachabilityBitmaps bitmaps;
+  Bitset selected;
+  int returnCode = Select(baton->rawRepo, baton->include, baton->exclude, bitmaps, selected, baton->counts);
+  if (returnCode != GIT_OK) {
+    baton->error = giterr_last();
+  }
+}
+
+void GitBitmapIndex::CountAfterWork(uv_work_t *req) {
+  HandleScope scope;
+  CountBaton *baton = static_cast<CountBaton *>(req->data);
+
+  if (success(baton->error, baton->callback)) {
+    Handle<Value> argv[2] = {
+      Local<Value>::New(Null()),
+      CountsToJS(baton->counts)
+    };
+
+    TryCatch try_catch;
+    baton->callback->Call(Context::GetCurrent()->Global(), 2, argv);
+    if (try_catch.HasCaught()) {
+      node::FatalException(try_catch);
+    }
+  }
+
+  baton->callback.Dispose();
+  delete baton;
+}
+
+Handle<Value> GitBitmapIndex::Objects(const Arguments& args) {
+  HandleScope scope;
+
+  if(args.Length() == 0 || !args[0]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Repo is required and must be an Object.")));
+  }
+
+  if(args.Length() == 1 || !args[1]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Options are required and must be an Object.")));
+  }
+
+  if(args.Length() == 2 || !args[2]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Batch callback is required and must be a Function.")));
+  }
+
+  if(args.Length() == 3 || !args[3]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("End callback is required and must be a Function.")));
+  }
+
+  git_repository* repo = ObjectWrap::Unwrap<GitRepo>(args[0]->ToObject())->GetValue();
+  if (repo == NULL) {
+    return ThrowException(Exception::Error(String::New("Repo must be open.")));
+  }
+
+  Local<Object> options = args[1]->ToObject();
+  std::vector<std::string> include;
+  stringsFromArray(options->Get(String::NewSymbol("include")), include);
+  if (include.empty()) {
+    return ThrowException(Exception::Error(String::New("At least one commit must be included.")));
+  }
+
+  ObjectsBaton* baton = new ObjectsBaton;
+  uv_async_init(uv_default_loop(), &baton->asyncBatch, ObjectsWorkSendBatch);
+  uv_async_init(uv_default_loop(), &baton->asyncEnd, ObjectsWorkSendEnd);
+  baton->asyncBatch.data = baton;
+  baton->asyncEnd.data = baton;
+  uv_mutex_init(&baton->mutex);
+
+  baton->repoPath = git_repository_path(repo);
+  baton->include.swap(include);
+  stringsFromArray(options->Get(String::NewSymbol("exclude")), baton->exclude);
+
+  baton->batchCallback = Persistent<Function>::New(Local<Function>::Cast(args[2]));
+  baton->endCallback = Persistent<Function>::New(Local<Function>::Cast(args[3]));
+
+  uv_thread_create(&baton->threadId, ObjectsWork, baton);
+
+  return Undefined();
+}
+
+void GitBitmapIndex::ObjectsWork(void *payload) {
+  ObjectsBaton* baton = static_cast<ObjectsBaton *>(payload);
+
+  git_repository* repo = NULL;
+  ReachabilityBitmaps bitmaps;
+  Bitset selected;
+  int returnCode = git_repository_open(&repo, baton->repoPath.c_str());
+  if (returnCode == GIT_OK) {
+    returnCode = Select(repo, baton->include, baton->exclude, bitmaps, selected, baton->counts);
+  }
+
+  if (returnCode == GIT_OK) {
+    std::vector<git_oid> batch;
+    for (size_t position = 0; position < bitmaps.Known(); position++) {
+      if (!selected.Get(position)) {
+        continue;
+      }
+      git_oid oid;
+      bitmaps.Oid(position, &oid);
+      batch.push_back(oid);
+      if (batch.size() == OBJECTS_BATCH_SIZE) {
+        uv_mutex_lock(&baton->mutex);
+        baton->pending.insert(baton->pending.end(), batch.begin(), batch.end());
+        uv_mutex_unlock(&baton->mutex);
+        uv_async_send(&baton->asyncBatch);
+        batch.clear();
+      }
+    }
+
+    uv_mutex_lock(&baton->mutex);
+    baton->pending.insert(baton->pending.end(), batch.begin(), batch.end());
+    uv_mutex_unlock(&baton->mutex);
+  } else {
+    baton->error.Capture();
+  }
+
+  bitmaps.Close();
+  git_repository_free(repo);
+
+  uv_async_send(&baton->asyncEnd);
+}
+
+void GitBitmapIndex::ObjectsWorkSendBatch(uv_async_t *handle, int status /*UNUSED*/) {
+  HandleScope scope;
+
+  ObjectsBaton* baton = static_cast<ObjectsBaton *>(handle->data);
+
+  std::vector<git_oid> batch;
+  uv_mutex_lock(&baton->mutex);
+  batch.swap(baton->pending);
+  uv_mutex_unlock(&baton->mutex);
+
+  if (batch.empty()) {
+    return;
+  }
+
+  std::vector<std::string> shas;
+  shas.reserve(batch.size());
+  for (size_t i = 0; i < batch.size(); i++) {
+    char sha[GIT_OID_HEXSZ + 1];
+    git_oid_fmt(sha, &batch[i]);
+    sha[GIT_OID_HEXSZ] = '\0';
+    shas.push_back(sha);
+  }
+
+  Handle<Value> argv[1] = {
+    cvv8::CastToJS(shas)
+  };
+
+  TryCatch try_catch;
+  baton->batchCallback->Call(Context::GetCurrent()->Global(), 1, argv);
+  if (try_catch.HasCaught()) {
+    node::FatalException(try_catch);
+  }
+}
+
+void GitBitmapIndex::ObjectsWorkSendEnd(uv_async_t *handle, int status /*UNUSED*/) {
+  HandleScope scope;
+
+  ObjectsBaton* baton = static_cast<ObjectsBaton *>(handle->data);
+
+  uv_thread_join(&baton->threadId);
+
+  // Async signals are coalesced and unordered between handles, so flush
+  // any batch whose signal has not been handled yet
+  if (!baton->error.IsSet()) {
+    ObjectsWorkSendBatch(&baton->asyncBatch, 0);
+  }
+
+  uv_mutex_destroy(&baton->mutex);
+  uv_close((uv_handle_t*) &baton->asyncBatch, NULL);
+  uv_close((uv_handle_t*) &baton->asyncEnd, ObjectsFree);
+
+  Handle<Value> argv[2];
+  if (baton->error.IsSet()) {
+    argv[0] = baton->error.Wrap();
+    argv[1] = Local<Value>::New(Null());
+  } else {
+    argv[0] = Local<Value>::New(Null());
+    argv[1] = CountsToJS(baton->counts);
+  }
+
+  TryCatch try_catch;
+  baton->endCallback->Call(Context::GetCurrent()->Global(), 2, argv);
+  if (try_catch.HasCaught()) {
+    node::FatalException(try_catch);
+  }
+}
+
+void GitBitmapIndex::ObjectsFree(uv_handle_t *handle) {
+  ObjectsBaton* baton = static_cast<ObjectsBaton *>(handle->data);
+
+  baton->batchCallback.Dispose();
+  baton->endCallback.Dispose();
+  delete baton;
+}
+
+Persistent<Function> GitBitmapIndex::constructor_template;
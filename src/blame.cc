@@ -0,0 +1,562 @@
+/*
+ * Copyright 2013, Tim Branyen @tbranyen <tim@tabdeveloper.com>
+ * @author Michael Robinson @codeofinterest <mike@pagesofinterest.net>
+ *
+ * Dual licensed under the MIT and GPL licenses.
+ */
+
+#include <v8.h>
+#include <node.h>
+#include <string.h>
+#include <algorithm>
+
+#include "cvv8/v8-convert.hpp"
+#include "git2.h"
+
+#include "../include/repo.h"
+#include "../include/blame.h"
+#include "../include/error.h"
+
+#include "../include/functions/string.h"
+#include "../include/functions/utilities.h"
+
+using namespace v8;
+using namespace node;
+
+/**
+ * Zero context hunks of one parent blob to child blob diff.
+ */
+struct BlameDiff {
+  std::vector<git_diff_range> hunks;
+  bool binary;
+};
+
+/**
+ * First line of the hunk in the new blob, and the line after it. Pure
+ * deletions report the line before them as new_start.
+ */
+static size_t NewBegin(const git_diff_range& range) {
+  return range.new_lines > 0 ? (size_t)range.new_start : (size_t)range.new_start + 1;
+}
+static size_t NewEnd(const git_diff_range& range) {
+  return NewBegin(range) + (size_t)range.new_lines;
+}
+static size_t OldEnd(const git_diff_range& range) {
+  size_t begin = range.old_lines > 0 ? (size_t)range.old_start : (size_t)range.old_start + 1;
+  return begin + (size_t)range.old_lines;
+}
+
+void GitBlame::Initialize(Handle<Object> target) {
+  HandleScope scope;
+
+  Local<FunctionTemplate> tpl = FunctionTemplate::New(New);
+
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+  tpl->SetClassName(String::NewSymbol("Blame"));
+
+  NODE_SET_PROTOTYPE_METHOD(tpl, "file", File);
+
+  constructor_template = Persistent<Function>::New(tpl->GetFunction());
+  target->Set(String::NewSymbol("Blame"), constructor_template);
+}
+
+Handle<Value> GitBlame::New(const Arguments& args) {
+  HandleScope scope;
+
+  GitBlame *blame = new GitBlame();
+  blame->Wrap(args.This());
+
+  return scope.Close(args.This());
+}
+
+Handle<Value> GitBlame::File(const Arguments& args) {
+  HandleScope scope;
+
+  if(args.Length() == 0 || !args[0]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Repo is required and must be an Object.")));
+  }
+
+  if(args.Length() == 1 || !args[1]->IsString()) {
+    return ThrowException(Exception::Error(String::New("Path is required and must be a String.")));
+  }
+
+  if(args.Length() == 2 || !args[2]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Options are required and must be an Object.")));
+  }
+
+  if(args.Length() == 3 || !args[3]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Hunks callback is required and must be a Function.")));
+  }
+
+  if(args.Length() == 4 || !args[4]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("End callback is required and must be a Function.")));
+  }
+
+  git_repository* repo = ObjectWrap::Unwrap<GitRepo>(args[0]->ToObject())->GetValue();
+  if (repo == NULL) {
+    return ThrowException(Exception::Error(String::New("Repo must be open.")));
+  }
+
+  FileBaton* baton = new FileBaton;
+  uv_async_init(uv_default_loop(), &baton->asyncHunks, FileWorkSendHunks);
+  uv_async_init(uv_default_loop(), &baton->asyncEnd, FileWorkSendEnd);
+  baton->asyncHunks.data = baton;
+  baton->asyncEnd.data = baton;
+  uv_mutex_init(&baton->mutex);
+
+  baton->repoPath = git_repository_path(repo);
+  baton->path = stringArgToString(args[1]->ToString());
+  baton->totalLines = 0;
+  baton->attributedLines = 0;
+
+  Local<Object> options = args[2]->ToObject();
+  Local<Value> newest = options->Get(String::NewSymbol("newest"));
+  baton->newest = newest->IsString() ? stringArgToString(newest->ToString()) : "HEAD";
+  Local<Value> oldest = options->Get(String::NewSymbol("oldest"));
+  baton->oldest = oldest->IsString() ? stringArgToString(oldest->ToString()) : "";
+  baton->limited = !baton->oldest.empty();
+  baton->firstParent = options->Get(String::NewSymbol("firstParent"))->BooleanValue();
+  Local<Value> minLine = options->Get(String::NewSymbol("minLine"));
+  baton->minLine = minLine->IsNumber() && minLine->IntegerValue() > 0 ? (size_t)minLine->IntegerValue() : 1;
+  Local<Value> maxLine = options->Get(String::NewSymbol("maxLine"));
+  baton->maxLine = maxLine->IsNumber() && maxLine->IntegerValue() > 0 ? (size_t)maxLine->IntegerValue() : 0;
+
+  baton->hunksCallback = Persistent<Function>::New(Local<Function>::Cast(args[3]));
+  baton->endCallback = Persistent<Function>::New(Local<Function>::Cast(args[4]));
+
+  uv_thread_create(&baton->threadId, FileWork, baton);
+
+  return Undefined();
+}
+void GitBlame::FileWork(void *payload) {
+  FileBaton* baton = static_cast<FileBaton *>(payload);
+
+  SuspectMap suspects;
+  SuspectQueue queue;
+  git_repository* repo = NULL;
+  git_commit* newest = NULL;
+  git_oid newestBlob;
+  bool found = false;
+
+  int returnCode = git_repository_open(&repo, baton->repoPath.c_str());
+  if (returnCode == GIT_OK) {
+    git_object* object = NULL;
+    git_object* peeled = NULL;
+    returnCode = git_revparse_single(&object, repo, baton->newest.c_str());
+    if (returnCode == GIT_OK) {
+      returnCode = git_object_peel(&peeled, object, GIT_OBJ_COMMIT);
+    }
+    if (returnCode == GIT_OK) {
+      returnCode = git_commit_lookup(&newest, repo, git_object_id(peeled));
+    }
+    git_object_free(peeled);
+    git_object_free(object);
+  }
+
+  if (returnCode == GIT_OK && baton->limited) {
+    // Everything reachable from newest but not from oldest gets blamed;
+    // lines surviving past that are attributed to the boundary commit
+    git_revwalk* walk = NULL;
+    git_object* oldest = NULL;
+    returnCode = git_revwalk_new(&walk, repo);
+    if (returnCode == GIT_OK) {
+      returnCode = git_revparse_single(&oldest, repo, baton->oldest.c_str());
+    }
+    if (returnCode == GIT_OK) {
+      returnCode = git_revwalk_push(walk, git_commit_id(newest));
+    }
+    if (returnCode == GIT_OK) {
+      returnCode = git_revwalk_hide(walk, git_object_id(oldest));
+    }
+    git_oid oid;
+    while (returnCode == GIT_OK && (returnCode = git_revwalk_next(&oid, walk)) == GIT_OK) {
+      baton->range.insert(oid);
+    }
+    if (returnCode == GIT_ITEROVER) {
+      returnCode = GIT_OK;
+    }
+    git_object_free(oldest);
+    git_revwalk_free(walk);
+  }
+
+  if (returnCode == GIT_OK) {
+    returnCode = BlobAtPath(repo, newest, baton->path, &newestBlob, found);
+    if (returnCode == GIT_OK && !found) {
+      giterr_set_str(GITERR_INVALID, "Path does not exist in the given revision");
+      returnCode = -1;
+    }
+  }
+
+  if (returnCode == GIT_OK) {
+    git_blob* blob = NULL;
+    returnCode = git_blob_lookup(&blob, repo, &newestBlob);
+    if (returnCode == GIT_OK) {
+      const char* content = (const char*)git_blob_rawcontent(blob);
+      size_t length = (size_t)git_blob_rawsize(blob);
+      size_t lines = 0;
+      for (size_t i = 0; i < length; i++) {
+        if (content[i] == '\n') {
+          lines++;
+        }
+      }
+      if (length > 0 && content[length - 1] != '\n') {
+        lines++;
+      }
+      baton->totalLines = lines;
+      git_blob_free(blob);
+    }
+  }
+
+  if (returnCode == GIT_OK && baton->totalLines > 0) {
+    size_t maxLine = baton->maxLine == 0 ? baton->totalLines : std::min(baton->maxLine, baton->totalLines);
+    if (baton->minLine > maxLine) {
+      giterr_set_str(GITERR_INVALID, "Line range is out of bounds");
+      returnCode = -1;
+    } else {
+      LineRange all = { baton->minLine, baton->minLine, maxLine - baton->minLine + 1 };
+      Enqueue(suspects, queue, newest, newestBlob, std::vector<LineRange>(1, all));
+    }
+  }
+
+  while (returnCode == GIT_OK && !queue.empty()) {
+    SuspectQueue::iterator next = --queue.end();
+    SuspectMap::iterator entry = suspects.find(next->second);
+    queue.erase(next);
+    Suspect suspect = entry->second;
+    suspects.erase(entry);
+
+    git_commit* commit = NULL;
+    returnCode = git_commit_lookup(&commit, repo, &suspect.commit);
+    if (returnCode != GIT_OK) {
+      break;
+    }
+
+    bool boundary = baton->limited && baton->range.count(suspect.commit) == 0;
+    unsigned int parentCount = boundary ? 0 : git_commit_parentcount(commit);
+    if (baton->firstParent && parentCount > 1) {
+      parentCount = 1;
+    }
+
+    std::vector<git_commit*> parents;
+    std::vector<git_oid> parentBlobs;
+    for (unsigned int i = 0; returnCode == GIT_OK && i < parentCount; i++) {
+      git_commit* parent = NULL;
+      git_oid parentBlob;
+      bool parentHasPath = false;
+      returnCode = git_commit_parent(&parent, commit, i);
+      if (returnCode == GIT_OK) {
+        returnCode = BlobAtPath(repo, parent, baton->path, &parentBlob, parentHasPath);
+      }
+      if (returnCode != GIT_OK || !parentHasPath) {
+        git_commit_free(parent);
+        continue;
+      }
+      if (git_oid_cmp(&parentBlob, &suspect.blob) == 0) {
+        // Unchanged through this parent, so it takes every line
+        Enqueue(suspects, queue, parent, parentBlob, suspect.ranges);
+        suspect.ranges.clear();
+        git_commit_free(parent);
+        break;
+      }
+      parents.push_back(parent);
+      parentBlobs.push_back(parentBlob);
+    }
+
+    for (size_t i = 0; returnCode == GIT_OK && i < parents.size() && !suspect.ranges.empty(); i++) {
+      std::vector<LineRange> passed;
+      returnCode = PassToParent(repo, parentBlobs[i], suspect.blob, suspect.ranges, passed);
+      if (returnCode == GIT_OK && !passed.empty()) {
+        Enqueue(suspects, queue, parents[i], parentBlobs[i], passed);
+      }
+    }
+
+    if (returnCode == GIT_OK && !suspect.ranges.empty()) {
+      Attribute(baton, commit, suspect.ranges, boundary);
+    }
+
+    for (size_t i = 0; i < parents.size(); i++) {
+      git_commit_free(parents[i]);
+    }
+    git_commit_free(commit);
+  }
+
+  if (returnCode != GIT_OK) {
+    baton->error.Capture();
+  }
+
+  git_commit_free(newest);
+  git_repository_free(repo);
+
+  uv_async_send(&baton->asyncEnd);
+}
+
+int GitBlame::BlobAtPath(git_repository* repo, git_commit* commit, const std::string& path,
+                         git_oid* blob, bool& found) {
+  git_tree* tree = NULL;
+  git_tree_entry* entry = NULL;
+
+  found = false;
+  int returnCode = git_commit_tree(&tree, commit);
+  if (returnCode != GIT_OK) {
+    return returnCode;
+  }
+
+  returnCode = git_tree_entry_bypath(&entry, tree, path.c_str());
+  if (returnCode == GIT_ENOTFOUND) {
+    giterr_clear();
+    returnCode = GIT_OK;
+  } else if (returnCode == GIT_OK) {
+    if (git_tree_entry_type(entry) == GIT_OBJ_BLOB) {
+      git_oid_cpy(blob, git_tree_entry_id(entry));
+      found = true;
+    }
+    git_tree_entry_free(entry);
+  }
+
+  git_tree_free(tree);
+  return returnCode;
+}
+
+/**
+ * Split ranges (lines of blob) into lines the parent already had, which
+ * are moved to passed renumbered to parentBlob, and lines the child
+ * changed, which stay in ranges.
+ */
+int GitBlame::PassToParent(git_repository* repo, const git_oid& parentBlob, const git_oid& blob,
+                           std::vector<LineRange>& ranges, std::vector<LineRange>& passed) {
+  git_blob* oldBlob = NULL;
+  git_blob* newBlob = NULL;
+  BlameDiff diff;
+  diff.binary = false;
+
+  int returnCode = git_blob_lookup(&oldBlob, repo, &parentBlob);
+  if (returnCode == GIT_OK) {
+    returnCode = git_blob_lookup(&newBlob, repo, &blob);
+  }
+  if (returnCode == GIT_OK) {
+    git_diff_options options = GIT_DIFF_OPTIONS_INIT;
+    options.context_lines = 0;
+    options.interhunk_lines = 0;
+    returnCode = git_diff_blobs(oldBlob, newBlob, &options, BlameFileCallback, BlameHunkCallback,
+                                NULL, &diff);
+  }
+  git_blob_free(newBlob);
+  git_blob_free(oldBlob);
+
+  // Binary content has no lines to carry over
+  if (returnCode != GIT_OK || diff.binary) {
+    return returnCode;
+  }
+
+  std::vector<LineRange> kept;
+  const std::vector<git_diff_range>& hunks = diff.hunks;
+  for (size_t i = 0; i < ranges.size(); i++) {
+    const LineRange& range = ranges[i];
+    size_t line = range.sourceStart;
+    size_t end = range.sourceStart + range.count;
+
+    // First hunk ending after line; hunks are in file order
+    size_t low = 0;
+    size_t high = hunks.size();
+    while (low < high) {
+      size_t middle = low + (high - low) / 2;
+      if (NewEnd(hunks[middle]) > line) {
+        high = middle;
+      } else {
+        low = middle + 1;
+      }
+    }
+    size_t hunk = low;
+
+    while (line < end) {
+      while (hunk < hunks.size() && NewEnd(hunks[hunk]) <= line) {
+        hunk++;
+      }
+
+      LineRange piece;
+      piece.finalStart = range.finalStart + (line - range.sourceStart);
+      if (hunk < hunks.size() && NewBegin(hunks[hunk]) <= line) {
+        size_t stop = std::min(end, NewEnd(hunks[hunk]));
+        piece.sourceStart = line;
+        piece.count = stop - line;
+        kept.push_back(piece);
+        line = stop;
+      } else {
+        size_t stop = hunk < hunks.size() ? std::min(end, NewBegin(hunks[hunk])) : end;
+        piece.sourceStart = hunk == 0 ? line : line - NewEnd(hunks[hunk - 1]) + OldEnd(hunks[hunk - 1]);
+        piece.count = stop - line;
+        passed.push_back(piece);
+        line = stop;
+      }
+    }
+  }
+
+  ranges.swap(kept);
+  return GIT_OK;
+}
+
+void GitBlame::Enqueue(SuspectMap& suspects, SuspectQueue& queue, git_commit* commit,
+                       const git_oid& blob, const std::vector<LineRange>& ranges) {
+  const git_oid* oid = git_commit_id(commit);
+  SuspectMap::iterator existing = suspects.find(*oid);
+  if (existing != suspects.end()) {
+    // Reached through more than one child
+    existing->second.ranges.insert(existing->second.ranges.end(), ranges.begin(), ranges.end());
+    return;
+  }
+
+  Suspect& suspect = suspects[*oid];
+  git_oid_cpy(&suspect.commit, oid);
+  git_oid_cpy(&suspect.blob, &blob);
+  suspect.time = git_commit_time(commit);
+  suspect.ranges = ranges;
+  queue.insert(std::make_pair(suspect.time, *oid));
+}
+
+int GitBlame::BlameFileCallback(const git_diff_delta *delta, float progress, void *payload) {
+  if (delta->flags & GIT_DIFF_FLAG_BINARY) {
+    static_cast<BlameDiff *>(payload)->binary = true;
+  }
+  return GIT_OK;
+}
+
+int GitBlame::BlameHunkCallback(const git_diff_delta *delta, const git_diff_range *range,
+                                const char *header, size_t header_len, void *payload) {
+  static_cast<BlameDiff *>(payload)->hunks.push_back(*range);
+  return GIT_OK;
+}
+
+bool GitBlame::FinalStartLess(const LineRange& a, const LineRange& b) {
+  return a.finalStart < b.finalStart;
+}
+
+/**
+ * Hand the lines left with commit to the main thread, merging runs that
+ * are contiguous in both the final and the original file.
+ */
+void GitBlame::Attribute(FileBaton* baton, git_commit* commit, std::vector<LineRange>& ranges, bool boundary) {
+  std::sort(ranges.begin(), ranges.end(), FinalStartLess);
+
+  const git_signature* author = git_commit_author(commit);
+  std::vector<BlameHunk> hunks;
+  size_t lines = 0;
+  for (size_t i = 0; i < ranges.size(); i++) {
+    if (!hunks.empty()) {
+      BlameHunk& last = hunks.back();
+      if (last.finalStart + last.count == ranges[i].finalStart &&
+          last.sourceStart + last.count == ranges[i].sourceStart) {
+        last.count += ranges[i].count;
+        lines += ranges[i].count;
+        continue;
+      }
+    }
+
+    BlameHunk hunk;
+    git_oid_cpy(&hunk.commit, git_commit_id(commit));
+    hunk.finalStart = ranges[i].finalStart;
+    hunk.sourceStart = ranges[i].sourceStart;
+    hunk.count = ranges[i].count;
+    hunk.boundary = boundary;
+    hunk.authorName = author->name;
+    hunk.authorEmail = author->email;
+    hunk.authorTime = author->when.time;
+    hunks.push_back(hunk);
+    lines += ranges[i].count;
+  }
+
+  uv_mutex_lock(&baton->mutex);
+  baton->hunks.insert(baton->hunks.end(), hunks.begin(), hunks.end());
+  baton->attributedLines += lines;
+  uv_mutex_unlock(&baton->mutex);
+
+  uv_async_send(&baton->asyncHunks);
+}
+
+void GitBlame::FileWorkSendHunks(uv_async_t *handle, int status /*UNUSED*/) {
+  HandleScope scope;
+
+  FileBaton* baton = static_cast<FileBaton *>(handle->data);
+
+  std::vector<BlameHunk> hunks;
+  uv_mutex_lock(&baton->mutex);
+  hunks.swap(baton->hunks);
+  uv_mutex_unlock(&baton->mutex);
+
+  if (hunks.empty()) {
+    return;
+  }
+
+  std::vector<Local<Object> > objects;
+  objects.reserve(hunks.size());
+  for (size_t i = 0; i < hunks.size(); i++) {
+    char sha[GIT_OID_HEXSZ + 1];
+    git_oid_fmt(sha, &hunks[i].commit);
+    sha[GIT_OID_HEXSZ] = '\0';
+
+    Local<Object> author = Object::New();
+    author->Set(String::NewSymbol("name"), String::New(hunks[i].authorName.c_str()));
+    author->Set(String::NewSymbol("email"), String::New(hunks[i].authorEmail.c_str()));
+    author->Set(String::NewSymbol("time"), Number::New((double)hunks[i].authorTime));
+
+    Local<Object> hunk = Object::New();
+    hunk->Set(String::NewSymbol("sha"), String::New(sha));
+    hunk->Set(String::NewSymbol("finalStartLine"), Number::New((double)hunks[i].finalStart));
+    hunk->Set(String::NewSymbol("originalStartLine"), Number::New((double)hunks[i].sourceStart));
+    hunk->Set(String::NewSymbol("lines"), Number::New((double)hunks[i].count));
+    hunk->Set(String::NewSymbol("boundary"), Boolean::New(hunks[i].boundary));
+    hunk->Set(String::NewSymbol("author"), author);
+    objects.push_back(hunk);
+  }
+
+  Handle<Value> argv[1] = {
+    cvv8::CastToJS(objects)
+  };
+
+  TryCatch try_catch;
+  baton->hunksCallback->Call(Context::GetCurrent()->Global(), 1, argv);
+  if (try_catch.HasCaught()) {
+    node::FatalException(try_catch);
+  }
+}
+void GitBlame::FileWorkSendEnd(uv_async_t *handle, int status /*UNUSED*/) {
+  HandleScope scope;
+
+  FileBaton* baton = static_cast<FileBaton *>(handle->data);
+
+  uv_thread_join(&baton->threadId);
+
+  // Async signals are coalesced and unordered between handles, so flush
+  // any hunks whose signal has not been handled yet
+  FileWorkSendHunks(&baton->asyncHunks, 0);
+
+  uv_mutex_destroy(&baton->mutex);
+  uv_close((uv_handle_t*) &baton->asyncHunks, NULL);
+  uv_close((uv_handle_t*) &baton->asyncEnd, FileFree);
+
+  Handle<Value> argv[2];
+  if (baton->error.IsSet()) {
+    argv[0] = baton->error.Wrap();
+    argv[1] = Local<Value>::New(Null());
+  } else {
+    Local<Object> summary = Object::New();
+    summary->Set(String::NewSymbol("totalLines"), Number::New((double)baton->totalLines));
+    summary->Set(String::NewSymbol("attributedLines"), Number::New((double)baton->attributedLines));
+    argv[0] = Local<Value>::New(Null());
+    argv[1] = summary;
+  }
+
+  TryCatch try_catch;
+  baton->endCallback->Call(Context::GetCurrent()->Global(), 2, argv);
+  if (try_catch.HasCaught()) {
+    node::FatalException(try_catch);
+  }
+}
+void GitBlame::FileFree(uv_handle_t *handle) {
+  FileBaton* baton = static_cast<FileBaton *>(handle->data);
+
+  baton->hunksCallback.Dispose();
+  baton->endCallback.Dispose();
+  delete baton;
+}
+
+Persistent<Function> GitBlame::constructor_template;
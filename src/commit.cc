@@ -18,6 +18,7 @@
 #include "../include/oid.h"
 #include "../include/tree.h"
 #include "../include/commit.h"
+#include "../include/tree_builder.h"
 #include "../include/error.h"
 
 #include "../include/functions/utilities.h"
@@ -44,6 +45,7 @@ void GitCommit::Initialize(Handle<Object> target) {
   NODE_SET_PROTOTYPE_METHOD(tpl, "committer", Committer);
   NODE_SET_PROTOTYPE_METHOD(tpl, "tree", Tree);
   NODE_SET_PROTOTYPE_METHOD(tpl, "parents", Parents);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "create", Create);
 
   NODE_SET_PROTOTYPE_METHOD(tpl, "free", Free);
 
@@ -484,4 +486,175 @@ void GitCommit::ParentsAfterWork(uv_work_t* req) {
   delete req;
 }
 
+bool GitCommit::SignatureFromValue(Handle<Value> value, SignatureFields& fields) {
+  if (!value->IsObject()) {
+    return false;
+  }
+  Local<Object> signature = value->ToObject();
+  Local<Value> name = signature->Get(String::NewSymbol("name"));
+  Local<Value> email = signature->Get(String::NewSymbol("email"));
+  if (!name->IsString() || !email->IsString()) {
+    return false;
+  }
+  fields.name = stringArgToString(name->ToString());
+  fields.email = stringArgToString(email->ToString());
+
+  Local<Value> time = signature->Get(String::NewSymbol("time"));
+  Local<Value> offset = signature->Get(String::NewSymbol("offset"));
+  fields.hasTime = time->IsNumber();
+  fields.time = fields.hasTime ? (git_time_t)time->IntegerValue() : 0;
+  fields.offset = offset->IsNumber() ? offset->Int32Value() : 0;
+  return true;
+}
+
+int GitCommit::CreateSignature(git_signature** out, const SignatureFields& fields) {
+  if (fields.hasTime) {
+    return git_signature_new(out, fields.name.c_str(), fields.email.c_str(), fields.time, fields.offset);
+  }
+  return git_signature_now(out, fields.name.c_str(), fields.email.c_str());
+}
+
+Handle<Value> GitCommit::Create(const Arguments& args) {
+  HandleScope scope;
+
+  if(args.Length() == 0 || !args[0]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Repo is required and must be an Object.")));
+  }
+
+  if(args.Length() == 1 || !args[1]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Options are required and must be an Object.")));
+  }
+
+  if(args.Length() == 2 || !args[2]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Callback is required and must be a Function.")));
+  }
+
+  git_repository* repo = ObjectWrap::Unwrap<GitRepo>(args[0]->ToObject())->GetValue();
+  if (repo == NULL) {
+    return ThrowException(Exception::Error(String::New("Repo must be open.")));
+  }
+
+  Local<Object> options = args[1]->ToObject();
+
+  git_oid tree;
+  if (!GitTreeBuilder::OidFromValue(options->Get(String::NewSymbol("tree")), &tree)) {
+    return ThrowException(Exception::Error(String::New("Tree is required and must be an Oid or a 40 character SHA.")));
+  }
+
+  std::vector<git_oid> parents;
+  Local<Value> parentsValue = options->Get(String::NewSymbol("parents"));
+  if (!parentsValue->IsUndefined()) {
+    if (!parentsValue->IsArray()) {
+      return ThrowException(Exception::Error(String::New("Parents must be an Array.")));
+    }
+    Local<Array> parentArray = Local<Array>::Cast(parentsValue);
+    for (uint32_t i = 0; i < parentArray->Length(); i++) {
+      git_oid parent;
+      if (!GitTreeBuilder::OidFromValue(parentArray->Get(i), &parent)) {
+        return ThrowException(Exception::Error(String::New("Each parent must be an Oid or a 40 character SHA.")));
+      }
+      parents.push_back(parent);
+    }
+  }
+
+  SignatureFields author;
+  if (!SignatureFromValue(options->Get(String::NewSymbol("author")), author)) {
+    return ThrowException(Exception::Error(String::New("Author is required and must be an Object with a name and an email.")));
+  }
+
+  SignatureFields committer = author;
+  Local<Value> committerValue = options->Get(String::NewSymbol("committer"));
+  if (!committerValue->IsUndefined() && !SignatureFromValue(committerValue, committer)) {
+    return ThrowException(Exception::Error(String::New("Committer must be an Object with a name and an email.")));
+  }
+
+  Local<Value> message = options->Get(String::NewSymbol("message"));
+  if (!message->IsString()) {
+    return ThrowException(Exception::Error(String::New("Message is required and must be a String.")));
+  }
+
+  Local<Value> updateRef = options->Get(String::NewSymbol("updateRef"));
+
+  CreateBaton* baton = new CreateBaton;
+  baton->request.data = baton;
+  baton->error = NULL;
+  baton->rawRepo = repo;
+  baton->tree = tree;
+  baton->parents.swap(parents);
+  baton->author = author;
+  baton->committer = committer;
+  baton->message = stringArgToString(message->ToString());
+  if (updateRef->IsString()) {
+    baton->updateRef = stringArgToString(updateRef->ToString());
+  }
+  baton->callback = Persistent<Function>::New(Local<Function>::Cast(args[2]));
+
+  uv_queue_work(uv_default_loop(), &baton->request, CreateWork, (uv_after_work_cb)CreateAfterWork);
+
+  return Undefined();
+}
+void GitCommit::CreateWork(uv_work_t* req) {
+  CreateBaton* baton = static_cast<CreateBaton*>(req->data);
+
+  git_tree* tree = NULL;
+  std::vector<const git_commit*> parents;
+  git_signature* author = NULL;
+  git_signature* committer = NULL;
+
+  int returnCode = git_tree_lookup(&tree, baton->rawRepo, &baton->tree);
+  for (size_t i = 0; returnCode == GIT_OK && i < baton->parents.size(); i++) {
+    git_commit* parent = NULL;
+    returnCode = git_commit_lookup(&parent, baton->rawRepo, &baton->parents[i]);
+    if (returnCode == GIT_OK) {
+      parents.push_back(parent);
+    }
+  }
+  if (returnCode == GIT_OK) {
+    returnCode = CreateSignature(&author, baton->author);
+  }
+  if (returnCode == GIT_OK) {
+    returnCode = CreateSignature(&committer, baton->committer);
+  }
+  if (returnCode == GIT_OK) {
+    returnCode = git_commit_create(&baton->rawOid, baton->rawRepo,
+                                   baton->updateRef.empty() ? NULL : baton->updateRef.c_str(),
+                                   author, committer, NULL, baton->message.c_str(), tree,
+                                   (int)parents.size(), parents.empty() ? NULL : &parents[0]);
+  }
+  if (returnCode != GIT_OK) {
+    baton->error = giterr_last();
+  }
+
+  git_signature_free(committer);
+  git_signature_free(author);
+  for (size_t i = 0; i < parents.size(); i++) {
+    git_commit_free(const_cast<git_commit*>(parents[i]));
+  }
+  git_tree_free(tree);
+}
+void GitCommit::CreateAfterWork(uv_work_t* req) {
+  HandleScope scope;
+  CreateBaton* baton = static_cast<CreateBaton*>(req->data);
+
+  if (success(baton->error, baton->callback)) {
+    Local<Object> oid = GitOid::constructor_template->NewInstance();
+    GitOid *oidInstance = ObjectWrap::Unwrap<GitOid>(oid);
+    oidInstance->SetValue(baton->rawOid);
+
+    Handle<Value> argv[2] = {
+      Local<Value>::New(Null()),
+      oid
+    };
+
+    TryCatch try_catch;
+    baton->callback->Call(Context::GetCurrent()->Global(), 2, argv);
+    if (try_catch.HasCaught()) {
+      node::FatalException(try_catch);
+    }
+  }
+
+  baton->callback.Dispose();
+  delete baton;
+}
+
 Persistent<Function> GitCommit::constructor_template;
@@ -0,0 +1,186 @@
+/*
+ * Copyright 2013, Tim Branyen @tbranyen <tim@tabdeveloper.com>
+ * @author Michael Robinson @codeofinterest <mike@pagesofinterest.net>
+ *
+ * Dual licensed under the MIT and GPL licenses.
+ */
+
+#include <v8.h>
+#include <node.h>
+
+#include "git2.h"
+
+#include "../include/repo.h"
+#include "../include/commit_graph.h"
+#include "../include/error.h"
+
+#include "../include/functions/bloom.h"
+#include "../include/functions/graph.h"
+#include "../include/functions/utilities.h"
+
+using namespace v8;
+using namespace node;
+
+void GitCommitGraph::Initialize(Handle<v8::Object> target) {
+  HandleScope scope;
+
+  Local<FunctionTemplate> tpl = FunctionTemplate::New(New);
+
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+  tpl->SetClassName(String::NewSymbol("CommitGraph"));
+
+  NODE_SET_PROTOTYPE_METHOD(tpl, "write", Write);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "writeBloom", WriteBloom);
+
+  constructor_template = Persistent<Function>::New(tpl->GetFunction());
+  target->Set(String::NewSymbol("CommitGraph"), constructor_template);
+}
+
+Handle<Value> GitCommitGraph::New(const Arguments& args) {
+  HandleScope scope;
+
+  GitCommitGraph *graph = new GitCommitGraph();
+  graph->Wrap(args.This());
+
+  return scope.Close(args.This());
+}
+
+Handle<Value> GitCommitGraph::Write(const Arguments& args) {
+  HandleScope scope;
+
+  if(args.Length() == 0 || !args[0]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Repo is required and must be an Object.")));
+  }
+
+  if(args.Length() == 1 || !args[1]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Callback is required and must be a Function.")));
+  }
+
+  git_repository* repo = ObjectWrap::Unwrap<GitRepo>(args[0]->ToObject())->GetValue();
+  if (repo == NULL) {
+    return ThrowException(Exception::Error(String::New("Repo must be open.")));
+  }
+
+  WriteBaton* baton = new WriteBaton;
+  baton->request.data = baton;
+  baton->error = NULL;
+  baton->rawRepo = repo;
+  baton->commits = 0;
+  baton->callback = Persistent<Function>::New(Local<Function>::Cast(args[1]));
+
+  uv_queue_work(uv_default_loop(), &baton->request, WriteWork, (uv_after_work_cb)WriteAfterWork);
+
+  return Undefined();
+}
+
+void GitCommitGraph::WriteWork(uv_work_t *req) {
+  WriteBaton *baton = static_cast<WriteBaton *>(req->data);
+
+  int returnCode = CommitGraph::Write(baton->rawRepo, &baton->commits);
+  if (returnCode != GIT_OK) {
+    baton->error = giterr_last();
+    return;
+  }
+  baton->path = CommitGraph::Path(git_repository_path(baton->rawRepo));
+}
+
+void GitCommitGraph::WriteAfterWork(uv_work_t *req) {
+  HandleScope scope;
+  WriteBaton *baton = static_cast<WriteBaton *>(req->data);
+
+  if (success(baton->error, baton->callback)) {
+    Local<Object> result = Object::New();
+    result->Set(String::NewSymbol("commits"), Number::New((double)baton->commits));
+    result->Set(String::NewSymbol("path"), String::New(baton->path.c_str()));
+
+    Handle<Value> argv[2] = {
+      Local<Value>::New(Null()),
+      result
+    };
+
+    TryCatch try_catch;
+    baton->callback->Call(Context::GetCurrent()->Global(), 2, argv);
+    if (try_catch.HasCaught()) {
+      node::FatalException(try_catch);
+    }
+  }
+
+  baton->callback.Dispose();
+  delete baton;
+}
+
+Handle<Value> GitCommitGraph::WriteBloom(const Arguments& args) {
+  HandleScope scope;
+
+  if(args.Length() == 0 || !args[0]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Repo is required and must be an Object.")));
+  }
+
+  if(args.Length() == 1 || !args[1]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Options are required and must be an Object.")));
+  }
+
+  if(args.Length() == 2 || !args[2]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Callback is required and must be a Function.")));
+  }
+
+  git_repository* repo = ObjectWrap::Unwrap<GitRepo>(args[0]->ToObject())->GetValue();
+  if (repo == NULL) {
+    return ThrowException(Exception::Error(String::New("Repo must be open.")));
+  }
+
+  WriteBloomBaton* baton = new WriteBloomBaton;
+  baton->request.data = baton;
+  baton->error = NULL;
+  baton->rawRepo = repo;
+
+  Local<Value> threads = args[1]->ToObject()->Get(String::NewSymbol("threads"));
+  baton->threads = threads->IsNumber() ? (int)threads->Int32Value() : BLOOM_DEFAULT_THREADS;
+
+  baton->added = 0;
+  baton->commits = 0;
+  baton->callback = Persistent<Function>::New(Local<Function>::Cast(args[2]));
+
+  uv_queue_work(uv_default_loop(), &baton->request, WriteBloomWork, (uv_after_work_cb)WriteBloomAfterWork);
+
+  return Undefined();
+}
+
+void GitCommitGraph::WriteBloomWork(uv_work_t *req) {
+  WriteBloomBaton *baton = static_cast<WriteBloomBaton *>(req->data);
+
+  int returnCode = BloomFilters::Write(baton->rawRepo, baton->threads, &baton->added, &baton->commits);
+  if (returnCode != GIT_OK) {
+    baton->error = giterr_last();
+    return;
+  }
+  baton->path = BloomFilters::Path(git_repository_path(baton->rawRepo));
+}
+
+void GitCommitGraph::WriteBloomAfterWork(uv_work_t *req) {
+  HandleScope scope;
+  WriteBloomBaton *baton = static_cast<WriteBloomBaton *>(req->data);
+
+  if (success(baton->error, baton->callback)) {
+    Local<Object> result = Object::New();
+    result->Set(String::NewSymbol("added"), Number::New((double)baton->added));
+    result->Set(String::NewSymbol("commits"), Number::New((double)baton->commits));
+    result->Set(String::NewSymbol("path"), String::New(baton->path.c_str()));
+
+    Handle<Value> argv[2] = {
+      Local<Value>::New(Null()),
+      result
+    };
+
+    TryCatch try_catch;
+    baton->callback->Call(Context::GetCurrent()->Global(), 2, argv);
+    if (try_catch.HasCaught()) {
+      node::FatalException(try_catch);
+    }
+  }
+
+  baton->callback.Dispose();
+  delete baton;
+}
+
+Persistent<Function> GitCommitGraph::constructor_template;
@@ -0,0 +1,301 @@
+/*
+ * Copyright 2013, Tim Branyen @tbranyen <tim@tabdeveloper.com>
+ * @author Michael Robinson @codeofinterest <mike@pagesofinterest.net>
+ *
+ * Dual licensed under the MIT and GPL licenses.
+ */
+
+#include <v8.h>
+#include <node.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <vector>
+
+#include "git2.h"
+
+#include "../include/diff_cache.h"
+
+#include "../include/functions/string.h"
+#include "../include/functions/pack.h"
+
+using namespace v8;
+using namespace node;
+
+bool GitDiffCache::Key::operator<(const Key& other) const {
+  int order = git_oid_cmp(&oldTree, &other.oldTree);
+  if (order != 0) {
+    return order < 0;
+  }
+  order = git_oid_cmp(&newTree, &other.newTree);
+  if (order != 0) {
+    return order < 0;
+  }
+  return optionsHash < other.optionsHash;
+}
+
+void GitDiffCache::Initialize(Handle<Object> target) {
+  HandleScope scope;
+
+  uv_mutex_init(&mutex);
+
+  Local<FunctionTemplate> tpl = FunctionTemplate::New(New);
+
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+  tpl->SetClassName(String::NewSymbol("DiffCache"));
+
+  NODE_SET_PROTOTYPE_METHOD(tpl, "configure", Configure);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "stats", Stats);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "clear", Clear);
+
+  constructor_template = Persistent<Function>::New(tpl->GetFunction());
+  target->Set(String::NewSymbol("DiffCache"), constructor_template);
+}
+
+Handle<Value> GitDiffCache::New(const Arguments& args) {
+  HandleScope scope;
+
+  GitDiffCache *cache = new GitDiffCache();
+  cache->Wrap(args.This());
+
+  return scope.Close(args.This());
+}
+
+Handle<Value> GitDiffCache::Configure(const Arguments& args) {
+  HandleScope scope;
+
+  if(args.Length() == 0 || !args[0]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Options are required and must be an Object.")));
+  }
+
+  Local<Object> options = args[0]->ToObject();
+  Local<Value> newMaxBytes = options->Get(String::NewSymbol("maxBytes"));
+  Local<Value> newSpillDirectory = options->Get(String::NewSymbol("spillDirectory"));
+
+  if (!newMaxBytes->IsUndefined() && !newMaxBytes->IsNumber()) {
+    return ThrowException(Exception::Error(String::New("maxBytes must be a Number.")));
+  }
+  if (!newSpillDirectory->IsUndefined() && !newSpillDirectory->IsNull() && !newSpillDirectory->IsString()) {
+    return ThrowException(Exception::Error(String::New("spillDirectory must be a String or null.")));
+  }
+
+  std::string directory;
+  if (newSpillDirectory->IsString()) {
+    directory = stringArgToString(newSpillDirectory->ToString());
+    if (mkdir(directory.c_str(), 0777) != 0 && errno != EEXIST) {
+      return ThrowException(Exception::Error(String::New("Failed to create spill directory.")));
+    }
+    if (directory[directory.length() - 1] != '/') {
+      directory += '/';
+    }
+  }
+
+  EntryList evicted;
+  uv_mutex_lock(&mutex);
+  if (newMaxBytes->IsNumber()) {
+    double requested = newMaxBytes->NumberValue();
+    maxBytes = requested > 0 ? (size_t)requested : 0;
+  }
+  if (!newSpillDirectory->IsUndefined()) {
+    spillDirectory = directory;
+  }
+  Evict(evicted);
+  std::string spillTo = spillDirectory;
+  uv_mutex_unlock(&mutex);
+
+  if (!spillTo.empty()) {
+    for (EntryList::iterator entry = evicted.begin(); entry != evicted.end(); ++entry) {
+      Spill(spillTo, *entry);
+    }
+  }
+
+  return Undefined();
+}
+
+Handle<Value> GitDiffCache::Stats(const Arguments& args) {
+  HandleScope scope;
+
+  Local<Object> stats = Object::New();
+
+  uv_mutex_lock(&mutex);
+  stats->Set(String::NewSymbol("hits"), Number::New((double)hits));
+  stats->Set(String::NewSymbol("diskHits"), Number::New((double)diskHits));
+  stats->Set(String::NewSymbol("misses"), Number::New((double)misses));
+  stats->Set(String::NewSymbol("evictions"), Number::New((double)evictions));
+  stats->Set(String::NewSymbol("entries"), Number::New((double)index.size()));
+  stats->Set(String::NewSymbol("bytes"), Number::New((double)currentBytes));
+  stats->Set(String::NewSymbol("maxBytes"), Number::New((double)maxBytes));
+  uv_mutex_unlock(&mutex);
+
+  return scope.Close(stats);
+}
+
+Handle<Value> GitDiffCache::Clear(const Arguments& args) {
+  HandleScope scope;
+
+  uv_mutex_lock(&mutex);
+  entries.clear();
+  index.clear();
+  currentBytes = 0;
+  hits = 0;
+  diskHits = 0;
+  misses = 0;
+  evictions = 0;
+  uv_mutex_unlock(&mutex);
+
+  return Undefined();
+}
+
+bool GitDiffCache::Enabled() {
+  uv_mutex_lock(&mutex);
+  bool enabled = maxBytes > 0 || !spillDirectory.empty();
+  uv_mutex_unlock(&mutex);
+  return enabled;
+}
+
+bool GitDiffCache::Get(const Key& key, std::string& patch) {
+  uv_mutex_lock(&mutex);
+  std::map<Key, EntryList::iterator>::iterator found = index.find(key);
+  if (found != index.end()) {
+    // Most recently used entries live at the front
+    entries.splice(entries.begin(), entries, found->second);
+    patch = found->second->patch;
+    hits++;
+    uv_mutex_unlock(&mutex);
+    return true;
+  }
+  std::string spillFrom = spillDirectory;
+  uv_mutex_unlock(&mutex);
+
+  if (spillFrom.empty() || !Unspill(spillFrom, key, patch)) {
+    uv_mutex_lock(&mutex);
+    misses++;
+    uv_mutex_unlock(&mutex);
+    return false;
+  }
+
+  uv_mutex_lock(&mutex);
+  hits++;
+  diskHits++;
+  uv_mutex_unlock(&mutex);
+
+  // Promote back into memory; it is already on disk, so evicting it again
+  // writes nothing
+  Insert(key, patch.data(), patch.length(), spillFrom);
+  return true;
+}
+
+void GitDiffCache::Put(const Key& key, const char* patch, size_t length) {
+  Insert(key, patch, length, std::string());
+}
+
+void GitDiffCache::Insert(const Key& key, const char* patch, size_t length, const std::string& spilledTo) {
+  EntryList evicted;
+
+  uv_mutex_lock(&mutex);
+  std::string spillTo = spillDirectory;
+  if (index.find(key) == index.end() && length <= maxBytes) {
+    Entry entry;
+    entry.key = key;
+    entry.patch.assign(patch, length);
+    entry.spilledTo = spilledTo;
+    entries.push_front(entry);
+    index[key] = entries.begin();
+    currentBytes += length;
+    Evict(evicted);
+  } else if (index.find(key) == index.end() && !spillTo.empty()) {
+    // Too large for memory, straight to disk
+    Entry entry;
+    entry.key = key;
+    entry.patch.assign(patch, length);
+    entry.spilledTo = spilledTo;
+    evicted.push_back(entry);
+  }
+  uv_mutex_unlock(&mutex);
+
+  // Disk writes happen outside the lock so lookups are never blocked on IO
+  if (!spillTo.empty()) {
+    for (EntryList::iterator entry = evicted.begin(); entry != evicted.end(); ++entry) {
+      Spill(spillTo, *entry);
+    }
+  }
+}
+
+void GitDiffCache::Evict(EntryList& evicted) {
+  while (currentBytes > maxBytes && !entries.empty()) {
+    EntryList::iterator last = --entries.end();
+    currentBytes -= last->patch.length();
+    index.erase(last->key);
+    evicted.splice(evicted.end(), entries, last);
+    evictions++;
+  }
+}
+
+std::string GitDiffCache::SpillPath(const std::string& directory, const Key& key) {
+  char oldSha[GIT_OID_HEXSZ + 1];
+  char newSha[GIT_OID_HEXSZ + 1];
+  git_oid_tostr(oldSha, sizeof(oldSha), &key.oldTree);
+  git_oid_tostr(newSha, sizeof(newSha), &key.newTree);
+
+  char hash[17];
+  snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)key.optionsHash);
+
+  return directory + oldSha + "-" + newSha + "-" + hash + ".patch";
+}
+
+void GitDiffCache::Spill(const std::string& directory, const Entry& entry) {
+  if (entry.spilledTo == directory) {
+    return;
+  }
+
+  // Write then rename, so readers never see a partial file; each writer
+  // gets its own temporary file, as several threads may spill one key
+  std::string path = SpillPath(directory, entry.key);
+  std::string temporaryPath = path + ".XXXXXX";
+  std::vector<char> pathTemplate(temporaryPath.begin(), temporaryPath.end());
+  pathTemplate.push_back('\0');
+  int fd = mkstemp(&pathTemplate[0]);
+  if (fd < 0) {
+    return;
+  }
+  temporaryPath = &pathTemplate[0];
+
+  bool written = writeFully(fd, entry.patch.data(), entry.patch.length()) && fchmod(fd, 0644) == 0;
+  written = close(fd) == 0 && written;
+  if (!written || rename(temporaryPath.c_str(), path.c_str()) != 0) {
+    unlink(temporaryPath.c_str());
+  }
+}
+
+bool GitDiffCache::Unspill(const std::string& directory, const Key& key, std::string& patch) {
+  FILE* file = fopen(SpillPath(directory, key).c_str(), "rb");
+  if (file == NULL) {
+    return false;
+  }
+
+  patch.clear();
+  char buffer[65536];
+  size_t read;
+  while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    patch.append(buffer, read);
+  }
+  bool failed = ferror(file) != 0;
+  fclose(file);
+  return !failed;
+}
+
+Persistent<Function> GitDiffCache::constructor_template;
+
+uv_mutex_t GitDiffCache::mutex;
+GitDiffCache::EntryList GitDiffCache::entries;
+std::map<GitDiffCache::Key, GitDiffCache::EntryList::iterator> GitDiffCache::index;
+size_t GitDiffCache::maxBytes = 0;
+size_t GitDiffCache::currentBytes = 0;
+std::string GitDiffCache::spillDirectory;
+uint64_t GitDiffCache::hits = 0;
+uint64_t GitDiffCache::diskHits = 0;
+uint64_t GitDiffCache::misses = 0;
+uint64_t GitDiffCache::evictions = 0;
@@ -7,10 +7,12 @@
 
 #include <v8.h>
 #include <node.h>
+#include <node_buffer.h>
 
 #include "cvv8/v8-convert.hpp"
 #include "git2.h"
 
+#include "../include/utils.h"
 #include "../include/diff_list.h"
 #include "../include/error.h"
 
@@ -35,6 +37,15 @@ void GitDiffList::Initialize(Handle<Object> target) {
   tpl->SetClassName(String::NewSymbol("DiffList"));
 
   NODE_SET_PROTOTYPE_METHOD(tpl, "treeToTree", TreeToTree);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "treeToIndex", TreeToIndex);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "indexToWorkdir", IndexToWorkdir);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "blobs", Blobs);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "blobToBuffer", BlobToBuffer);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "findSimilar", FindSimilar);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "toPatch", ToPatch);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "toPatchStream", ToPatchStream);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "stats", Stats);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "nameStatus", NameStatus);
   NODE_SET_PROTOTYPE_METHOD(tpl, "walk", Walk);
   NODE_SET_PROTOTYPE_METHOD(tpl, "free", Free);
 
@@ -108,10 +119,21 @@ void GitDiffList::SetValue(git_diff_list* diffList) {
   this->diffList = diffList;
 }
 
+git_repository* GitDiffList::GetRepo() {
+  return this->repo;
+}
+
+void GitDiffList::SetRepo(git_repository* repo) {
+  this->repo = repo;
+}
+
 Handle<Value> GitDiffList::New(const Arguments& args) {
   HandleScope scope;
 
   GitDiffList *diffList = new GitDiffList();
+  diffList->diffList = NULL;
+  diffList->repo = NULL;
+  diffList->hasCacheKey = false;
   diffList->Wrap(args.This());
 
   return scope.Close(args.This());
@@ -126,6 +148,132 @@ Handle<Value> GitDiffList::Free(const Arguments& args) {
   return scope.Close(Undefined());
 }
 
+bool GitDiffList::ParseOptions(Handle<Value> value, DiffOptions& options, std::string& error) {
+  HandleScope scope;
+
+  git_diff_options defaults = GIT_DIFF_OPTIONS_INIT;
+  options.raw = defaults;
+  options.pathspec.clear();
+  options.pathspecPointers.clear();
+
+  if (value.IsEmpty() || value->IsUndefined() || value->IsNull()) {
+    return true;
+  }
+  if (!value->IsObject()) {
+    error = "Options must be an Object.";
+    return false;
+  }
+
+  Local<Object> object = value->ToObject();
+
+  Local<Value> pathspec = object->Get(String::NewSymbol("pathspec"));
+  if (pathspec->IsString()) {
+    options.pathspec.push_back(stringArgToString(pathspec->ToString()));
+  } else if (pathspec->IsArray()) {
+    Local<Array> paths = Local<Array>::Cast(pathspec);
+    for (uint32_t i = 0; i < paths->Length(); i++) {
+      options.pathspec.push_back(stringArgToString(paths->Get(i)->ToString()));
+    }
+  } else if (!pathspec->IsUndefined()) {
+    error = "Pathspec must be a String or an Array of Strings.";
+    return false;
+  }
+
+  Local<Value> contextLines = object->Get(String::NewSymbol("contextLines"));
+  if (contextLines->IsNumber()) {
+    options.raw.context_lines = (uint16_t)contextLines->Uint32Value();
+  }
+
+  Local<Value> interhunkLines = object->Get(String::NewSymbol("interhunkLines"));
+  if (interhunkLines->IsNumber()) {
+    options.raw.interhunk_lines = (uint16_t)interhunkLines->Uint32Value();
+  }
+
+  Local<Value> maxSize = object->Get(String::NewSymbol("maxSize"));
+  if (maxSize->IsNumber()) {
+    options.raw.max_size = (git_off_t)maxSize->IntegerValue();
+  }
+
+  if (object->Get(String::NewSymbol("ignoreWhitespace"))->BooleanValue()) {
+    options.raw.flags |= GIT_DIFF_IGNORE_WHITESPACE;
+  }
+  if (object->Get(String::NewSymbol("ignoreWhitespaceChange"))->BooleanValue()) {
+    options.raw.flags |= GIT_DIFF_IGNORE_WHITESPACE_CHANGE;
+  }
+  if (object->Get(String::NewSymbol("ignoreWhitespaceEol"))->BooleanValue()) {
+    options.raw.flags |= GIT_DIFF_IGNORE_WHITESPACE_EOL;
+  }
+  if (object->Get(String::NewSymbol("reverse"))->BooleanValue()) {
+    options.raw.flags |= GIT_DIFF_REVERSE;
+  }
+
+  Local<Value> algorithm = object->Get(String::NewSymbol("algorithm"));
+  if (algorithm->IsString()) {
+    std::string name = stringArgToString(algorithm->ToString());
+    if (name == "patience") {
+      options.raw.flags |= GIT_DIFF_PATIENCE;
+    } else if (name == "histogram") {
+      error = "The histogram algorithm is not available in this version of libgit2; use myers or patience.";
+      return false;
+    } else if (name != "myers") {
+      error = "Algorithm must be one of myers or patience.";
+      return false;
+    }
+  } else if (!algorithm->IsUndefined()) {
+    error = "Algorithm must be a String.";
+    return false;
+  }
+
+  bool forceText = object->Get(String::NewSymbol("forceText"))->BooleanValue();
+  bool forceBinary = object->Get(String::NewSymbol("forceBinary"))->BooleanValue();
+  if (forceText && forceBinary) {
+    error = "forceText and forceBinary are mutually exclusive.";
+    return false;
+  }
+  if (forceText) {
+    options.raw.flags |= GIT_DIFF_FORCE_TEXT;
+  }
+  if (forceBinary) {
+    // libgit2 has no force-binary flag; anything over max_size is treated
+    // as binary without its content being loaded, so a one byte limit
+    // gives the same result
+    options.raw.max_size = 1;
+  }
+
+  return true;
+}
+
+void GitDiffList::PrepareOptions(DiffOptions& options) {
+  options.pathspecPointers.clear();
+  for (std::vector<std::string>::iterator path = options.pathspec.begin(); path != options.pathspec.end(); ++path) {
+    options.pathspecPointers.push_back(const_cast<char *>(path->c_str()));
+  }
+  options.raw.pathspec.count = options.pathspecPointers.size();
+  options.raw.pathspec.strings = options.pathspecPointers.empty() ? NULL : &options.pathspecPointers[0];
+}
+
+uint64_t GitDiffList::HashOptions(const DiffOptions& options) {
+  // FNV-1a over the option fields, then each pathspec with a separator
+  uint64_t hash = 14695981039346656037ULL;
+  uint64_t fields[4] = {
+    (uint64_t)options.raw.flags,
+    (uint64_t)options.raw.context_lines,
+    (uint64_t)options.raw.interhunk_lines,
+    (uint64_t)options.raw.max_size
+  };
+  const unsigned char* bytes = (const unsigned char*)fields;
+  for (size_t i = 0; i < sizeof(fields); i++) {
+    hash = (hash ^ bytes[i]) * 1099511628211ULL;
+  }
+  for (size_t i = 0; i < options.pathspec.size(); i++) {
+    const std::string& path = options.pathspec[i];
+    for (size_t j = 0; j <= path.length(); j++) {
+      hash = (hash ^ (unsigned char)path.c_str()[j]) * 1099511628211ULL;
+    }
+  }
+  return hash;
+}
+
 Handle<Value> GitDiffList::TreeToTree(const Arguments& args) {
   HandleScope scope;
 
@@ -141,11 +289,19 @@ Handle<Value> GitDiffList::TreeToTree(const Arguments& args) {
     return ThrowException(Exception::Error(String::New("New Oid/SHA is required and must be an Object or String")));
   }
 
-  if(args.Length() == 3 || !args[3]->IsFunction()) {
+  // Options are optional and sit before the callback
+  int callbackIndex = args.Length() > 4 ? 4 : 3;
+  if(args.Length() <= callbackIndex || !args[callbackIndex]->IsFunction()) {
     return ThrowException(Exception::Error(String::New("Callback is required and must be a Function.")));
   }
 
   TreeToTreeBaton *baton = new TreeToTreeBaton;
+  std::string optionsError;
+  if (!ParseOptions(callbackIndex == 4 ? args[3] : Handle<Value>(Undefined()), baton->options, optionsError)) {
+    delete baton;
+    return ThrowException(Exception::Error(String::New(optionsError.c_str())));
+  }
+
   baton->request.data = baton;
   baton->error = NULL;
   baton->diffList = ObjectWrap::Unwrap<GitDiffList>(args.This());
@@ -163,7 +319,7 @@ Handle<Value> GitDiffList::TreeToTree(const Arguments& args) {
     baton->newSha = stringArgToString(args[2]->ToString());
   }
 
-  baton->callback = Persistent<Function>::New(Local<Function>::Cast(args[3]));
+  baton->callback = Persistent<Function>::New(Local<Function>::Cast(args[callbackIndex]));
 
   uv_queue_work(uv_default_loop(), &baton->request, TreeToTreeWork, (uv_after_work_cb)TreeToTreeAfterWork);
 
@@ -220,8 +376,14 @@ void GitDiffList::TreeToTreeWork(uv_work_t *req) {
     return;
   }
 
+  PrepareOptions(baton->options);
+
+  git_oid_cpy(&baton->cacheKey.oldTree, git_tree_id(oldTree));
+  git_oid_cpy(&baton->cacheKey.newTree, git_tree_id(newTree));
+  baton->cacheKey.optionsHash = HashOptions(baton->options);
+
   baton->rawDiffList = NULL;
-  returnCode = git_diff_tree_to_tree(&baton->rawDiffList, baton->repo, oldTree, newTree, NULL);
+  returnCode = git_diff_tree_to_tree(&baton->rawDiffList, baton->repo, oldTree, newTree, &baton->options.raw);
   if (returnCode != GIT_OK) {
     baton->error = giterr_last();
   }
@@ -244,6 +406,9 @@ void GitDiffList::TreeToTreeAfterWork(uv_work_t *req) {
   } else {
 
     baton->diffList->SetValue(baton->rawDiffList);
+    baton->diffList->SetRepo(baton->repo);
+    baton->diffList->hasCacheKey = true;
+    baton->diffList->cacheKey = baton->cacheKey;
 
     Handle<Value> argv[2] = {
       Local<Value>::New(Null()),
@@ -259,241 +424,1453 @@ void GitDiffList::TreeToTreeAfterWork(uv_work_t *req) {
   delete req;
 }
 
-Handle<Value> GitDiffList::Walk(const Arguments& args) {
+Handle<Value> GitDiffList::TreeToIndex(const Arguments& args) {
   HandleScope scope;
 
-  GitDiffList* diffList = ObjectWrap::Unwrap<GitDiffList>(args.This());
-
-  if (diffList->GetValue() == NULL) {
-    return ThrowException(Exception::Error(String::New("No diff list to Walk.")));
-  }
-
-  if(args.Length() == 0 || !args[0]->IsFunction()) {
-    return ThrowException(Exception::Error(String::New("Diff callback is required and must be a Function.")));
+  if(args.Length() == 0 || !args[0]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Repo is required and must be an Object.")));
   }
 
-  if(args.Length() == 1 || !args[1]->IsFunction()) {
-    return ThrowException(Exception::Error(String::New("Hunk callback is required and must be a Function.")));
+  if(args.Length() == 1 || !(args[1]->IsObject() || args[1]->IsString() || args[1]->IsNull())) {
+    return ThrowException(Exception::Error(String::New("Old Oid/SHA is required and must be an Object, String or null")));
   }
 
-  if(args.Length() == 2 || !args[2]->IsFunction()) {
-    return ThrowException(Exception::Error(String::New("Line callback is required and must be a Function.")));
+  // Options are optional and sit before the callback
+  int callbackIndex = args.Length() > 3 ? 3 : 2;
+  if(args.Length() <= callbackIndex || !args[callbackIndex]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Callback is required and must be a Function.")));
   }
 
-  if(args.Length() == 3 || !args[3]->IsFunction()) {
-    return ThrowException(Exception::Error(String::New("End callback is required and must be a Function.")));
+  IndexDiffBaton *baton = new IndexDiffBaton;
+  std::string optionsError;
+  if (!ParseOptions(callbackIndex == 3 ? args[2] : Handle<Value>(Undefined()), baton->options, optionsError)) {
+    delete baton;
+    return ThrowException(Exception::Error(String::New(optionsError.c_str())));
   }
 
+  baton->request.data = baton;
+  baton->error = NULL;
+  baton->diffList = ObjectWrap::Unwrap<GitDiffList>(args.This());
+  baton->diffList->Ref();
+  baton->repo = ObjectWrap::Unwrap<GitRepo>(args[0]->ToObject())->GetValue();
+  baton->rawDiffList = NULL;
 
-  WalkBaton* baton = new WalkBaton;
-  uv_async_init(uv_default_loop(), &baton->asyncFile, WalkWorkSendFile);
-  uv_async_init(uv_default_loop(), &baton->asyncHunk, WalkWorkSendHunk);
-  uv_async_init(uv_default_loop(), &baton->asyncData, WalkWorkSendData);
-  uv_async_init(uv_default_loop(), &baton->asyncEnd, WalkWorkSendEnd);
-
-  uv_mutex_init(&baton->mutex);
+  // A null old tree diffs the index against nothing, as on an unborn branch
+  baton->hasOld = !args[1]->IsNull();
+  if (args[1]->IsObject()) {
+    baton->oldOid = ObjectWrap::Unwrap<GitOid>(args[1]->ToObject())->GetValue();
+  } else if (args[1]->IsString()) {
+    baton->oldSha = stringArgToString(args[1]->ToString());
+  }
 
-  baton->rawDiffList = diffList->GetValue();
-  diffList->Ref();
-  baton->error = NULL;
-  baton->fileCallback = Persistent<Function>::New(Local<Function>::Cast(args[0]));
-  baton->hunkCallback = Persistent<Function>::New(Local<Function>::Cast(args[1]));
-  baton->lineCallback = Persistent<Function>::New(Local<Function>::Cast(args[2]));
-  baton->endCallback = Persistent<Function>::New(Local<Function>::Cast(args[3]));
+  baton->callback = Persistent<Function>::New(Local<Function>::Cast(args[callbackIndex]));
 
-  uv_thread_create(&baton->threadId, WalkWork, baton);
+  uv_queue_work(uv_default_loop(), &baton->request, TreeToIndexWork, (uv_after_work_cb)IndexDiffAfterWork);
 
   return Undefined();
 }
-void GitDiffList::WalkWork(void *payload) {
-    WalkBaton *baton = static_cast<WalkBaton *>(payload);
+void GitDiffList::TreeToIndexWork(uv_work_t *req) {
+  IndexDiffBaton *baton = static_cast<IndexDiffBaton *>(req->data);
+
+  git_tree* oldTree = NULL;
+  if (baton->hasOld) {
+    if (!baton->oldSha.empty()) {
+      int returnCode = git_oid_fromstr(&baton->oldOid, baton->oldSha.c_str());
+      if (returnCode != GIT_OK) {
+        baton->error = giterr_last();
+        return;
+      }
+    }
 
-    int returnCode = git_diff_foreach(baton->rawDiffList, WalkWorkFile, WalkWorkHunk, WalkWorkData, payload);
+    git_commit* oldCommit = NULL;
+    int returnCode = git_commit_lookup(&oldCommit, baton->repo, &baton->oldOid);
+    if (returnCode != GIT_OK) {
+      baton->error = giterr_last();
+      return;
+    }
+    returnCode = git_commit_tree(&oldTree, oldCommit);
+    git_commit_free(oldCommit);
     if (returnCode != GIT_OK) {
       baton->error = giterr_last();
-      baton->asyncEnd.data = baton;
-      uv_async_send(&baton->asyncEnd);
       return;
     }
+  }
+
+  git_index* index = NULL;
+  int returnCode = git_repository_index(&index, baton->repo);
+  if (returnCode != GIT_OK) {
+    git_tree_free(oldTree);
+    baton->error = giterr_last();
+    return;
+  }
+
+  PrepareOptions(baton->options);
 
-    baton->asyncFile.data = baton;
-    uv_async_send(&baton->asyncFile);
+  returnCode = git_diff_tree_to_index(&baton->rawDiffList, baton->repo, oldTree, index, &baton->options.raw);
+  if (returnCode != GIT_OK) {
+    baton->error = giterr_last();
+  }
 
-    baton->asyncEnd.data = baton;
-    uv_async_send(&baton->asyncEnd);
+  git_index_free(index);
+  git_tree_free(oldTree);
 }
-int GitDiffList::WalkWorkFile(const git_diff_delta *delta, float progress,
-                                  void *payload) {
-  WalkBaton *baton = static_cast<WalkBaton *>(payload);
 
-  /*
-    diff_file_delta
-      git_diff_file old_file
-        git_oid oid
-        const char *path
-        git_off_t size
-        uint32_t flags
-        uint16_t mode
+Handle<Value> GitDiffList::IndexToWorkdir(const Arguments& args) {
+  HandleScope scope;
 
-      git_diff_file new_file
-      git_delta_t status
-      uint32_t similarity
-      uint32_t flags
-     */
+  if(args.Length() == 0 || !args[0]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Repo is required and must be an Object.")));
+  }
 
-  uv_mutex_lock(&baton->mutex);
+  // Options are optional and sit before the callback
+  int callbackIndex = args.Length() > 2 ? 2 : 1;
+  if(args.Length() <= callbackIndex || !args[callbackIndex]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Callback is required and must be a Function.")));
+  }
 
-  Delta* newDelta = new Delta;
-  newDelta->raw = (git_diff_delta*)malloc(sizeof(git_diff_delta));
-  memcpy(newDelta->raw, delta, sizeof(git_diff_delta));
+  IndexDiffBaton *baton = new IndexDiffBaton;
+  std::string optionsError;
+  if (!ParseOptions(callbackIndex == 2 ? args[1] : Handle<Value>(Undefined()), baton->options, optionsError)) {
+    delete baton;
+    return ThrowException(Exception::Error(String::New(optionsError.c_str())));
+  }
 
-  // @todo use combined OID or another less stupid way to index deltas
-  std::string key(newDelta->raw->old_file.path);
-  key.append(newDelta->raw->new_file.path);
-  baton->fileDeltas[key] = newDelta;
-  uv_mutex_unlock(&baton->mutex);
+  baton->request.data = baton;
+  baton->error = NULL;
+  baton->diffList = ObjectWrap::Unwrap<GitDiffList>(args.This());
+  baton->diffList->Ref();
+  baton->repo = ObjectWrap::Unwrap<GitRepo>(args[0]->ToObject())->GetValue();
+  baton->hasOld = false;
+  baton->rawDiffList = NULL;
+  baton->callback = Persistent<Function>::New(Local<Function>::Cast(args[callbackIndex]));
+
+  uv_queue_work(uv_default_loop(), &baton->request, IndexToWorkdirWork, (uv_after_work_cb)IndexDiffAfterWork);
+
+  return Undefined();
+}
+void GitDiffList::IndexToWorkdirWork(uv_work_t *req) {
+  IndexDiffBaton *baton = static_cast<IndexDiffBaton *>(req->data);
+
+  git_index* index = NULL;
+  int returnCode = git_repository_index(&index, baton->repo);
+  if (returnCode != GIT_OK) {
+    baton->error = giterr_last();
+    return;
+  }
 
-  if ((unsigned int)baton->fileDeltas.size() == (unsigned int)GitDiffList::WALK_DELTA_SEND_THRESHHOLD) {
-    baton->asyncFile.data = baton;
-    uv_async_send(&baton->asyncFile);
+  PrepareOptions(baton->options);
+
+  returnCode = git_diff_index_to_workdir(&baton->rawDiffList, baton->repo, index, &baton->options.raw);
+  if (returnCode != GIT_OK) {
+    baton->error = giterr_last();
   }
 
-  return GIT_OK;
+  git_index_free(index);
 }
-int GitDiffList::WalkWorkHunk(const git_diff_delta *delta, const git_diff_range *range, const char *header, size_t header_len, void *payload) {
-  return GIT_OK;
+
+void GitDiffList::IndexDiffAfterWork(uv_work_t *req) {
+  HandleScope scope;
+  IndexDiffBaton *baton = static_cast<IndexDiffBaton *>(req->data);
+
+  if (success(baton->error, baton->callback)) {
+    baton->diffList->SetValue(baton->rawDiffList);
+    baton->diffList->SetRepo(baton->repo);
+    baton->diffList->hasCacheKey = false;
+
+    Handle<Value> argv[2] = {
+      Local<Value>::New(Null()),
+      baton->diffList->handle_
+    };
+
+    TryCatch try_catch;
+    baton->callback->Call(Context::GetCurrent()->Global(), 2, argv);
+    if (try_catch.HasCaught()) {
+      node::FatalException(try_catch);
+    }
+  }
+
+  baton->diffList->Unref();
+  baton->callback.Dispose();
+  delete baton;
 }
-int GitDiffList::WalkWorkData(const git_diff_delta *delta, const git_diff_range *range,
-                                  char line_origin, const char *content, size_t content_len,
-                                  void *payload) {
-  WalkBaton *baton = static_cast<WalkBaton *>(payload);
-  uv_mutex_lock(&baton->mutex);
 
-  GitDiffList::DeltaContent *deltaContent = new GitDiffList::DeltaContent;
+static Local<Object> rangeToObject(const git_diff_range& rawRange) {
+  /*
+  int old_start
+  int old_lines
+  int new_start
+  int new_lines
+   */
+  Local<Object> range = Object::New();
+
+  Local<Object> oldRange = Object::New();
+  oldRange->Set(String::New("start"), Integer::New(rawRange.old_start));
+  oldRange->Set(String::New("lines"), Integer::New(rawRange.old_lines));
+  range->Set(String::New("old"), oldRange);
+
+  Local<Object> newRange = Object::New();
+  newRange->Set(String::New("start"), Integer::New(rawRange.new_start));
+  newRange->Set(String::New("lines"), Integer::New(rawRange.new_lines));
+  range->Set(String::New("new"), newRange);
+
+  return range;
+}
 
-  deltaContent->range = (git_diff_range*)malloc(sizeof(git_diff_range));
-  memcpy(deltaContent->range, range, sizeof(git_diff_range));
+/**
+ * Fill hasOid/oid/sha from an Oid, SHA string or null argument.
+ */
+static void blobSideFromArg(Handle<Value> value, bool& hasOid, git_oid& oid, std::string& sha) {
+  hasOid = !value->IsNull();
+  if (value->IsObject()) {
+    oid = ObjectWrap::Unwrap<GitOid>(value->ToObject())->GetValue();
+  } else if (value->IsString()) {
+    sha = stringArgToString(value->ToString());
+  }
+}
 
-  deltaContent->lineOrigin = line_origin;
+Handle<Value> GitDiffList::Blobs(const Arguments& args) {
+  HandleScope scope;
 
-  deltaContent->contentLength = content_len;
-  deltaContent->content = content;
+  if(args.Length() == 0 || !args[0]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Repo is required and must be an Object.")));
+  }
 
-  std::string key(delta->old_file.path);
-  key.append(delta->new_file.path);
-  baton->fileDeltas[key]->contents.push_back(deltaContent);
+  if(args.Length() == 1 || !(args[1]->IsObject() || args[1]->IsString() || args[1]->IsNull())) {
+    return ThrowException(Exception::Error(String::New("Old Oid/SHA is required and must be an Object, String or null")));
+  }
 
-  uv_mutex_unlock(&baton->mutex);
+  if(args.Length() == 2 || !(args[2]->IsObject() || args[2]->IsString() || args[2]->IsNull())) {
+    return ThrowException(Exception::Error(String::New("New Oid/SHA is required and must be an Object, String or null")));
+  }
 
-  return GIT_OK;
+  // Options are optional and sit before the callback
+  int callbackIndex = args.Length() > 4 ? 4 : 3;
+  if(args.Length() <= callbackIndex || !args[callbackIndex]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Callback is required and must be a Function.")));
+  }
+
+  BlobDiffBaton *baton = new BlobDiffBaton;
+  std::string optionsError;
+  if (!ParseOptions(callbackIndex == 4 ? args[3] : Handle<Value>(Undefined()), baton->options, optionsError)) {
+    delete baton;
+    return ThrowException(Exception::Error(String::New(optionsError.c_str())));
+  }
+
+  baton->request.data = baton;
+  baton->error = NULL;
+  baton->repo = ObjectWrap::Unwrap<GitRepo>(args[0]->ToObject())->GetValue();
+  blobSideFromArg(args[1], baton->hasOld, baton->oldOid, baton->oldSha);
+  blobSideFromArg(args[2], baton->hasNew, baton->newOid, baton->newSha);
+  baton->toBuffer = false;
+  baton->bufferData = NULL;
+  baton->bufferLength = 0;
+  baton->status = GIT_DELTA_UNMODIFIED;
+  baton->binary = false;
+  baton->additions = 0;
+  baton->deletions = 0;
+  baton->callback = Persistent<Function>::New(Local<Function>::Cast(args[callbackIndex]));
+
+  uv_queue_work(uv_default_loop(), &baton->request, BlobDiffWork, (uv_after_work_cb)BlobDiffAfterWork);
+
+  return Undefined();
 }
-void GitDiffList::WalkWorkSendFile(uv_async_t *handle, int status /*UNUSED*/) {
+
+Handle<Value> GitDiffList::BlobToBuffer(const Arguments& args) {
   HandleScope scope;
 
-  WalkBaton *baton = static_cast<WalkBaton *>(handle->data);
+  if(args.Length() == 0 || !args[0]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Repo is required and must be an Object.")));
+  }
 
-  uv_mutex_lock(&baton->mutex);
-  if (success(baton->error, baton->fileCallback)) {
-
-    std::vector<Local<Object> > fileDeltasArray;
-
-    for(std::map<std::string, GitDiffList::Delta* >::iterator iterator = baton->fileDeltas.begin(); iterator != baton->fileDeltas.end(); ++iterator) {
-
-      Local<Object> fileDelta = Object::New();
-      GitDiffList::Delta* delta = iterator->second;
-
-      Local<Object> oldFile = Object::New();
-      oldFile->Set(String::NewSymbol("path"), String::New(delta->raw->old_file.path));
-      fileDelta->Set(String::NewSymbol("oldFile"), oldFile);
-
-      Local<Object> newFile = Object::New();
-      newFile->Set(String::NewSymbol("path"), String::New(delta->raw->new_file.path));
-      fileDelta->Set(String::NewSymbol("newFile"), newFile);
-
-      std::vector<Local<Object> > deltaContent;
-      for(std::vector<GitDiffList::DeltaContent* >::iterator contentIterator = delta->contents.begin(); contentIterator != delta->contents.end(); ++contentIterator) {
-        DeltaContent* rawContent = (*contentIterator);
-        Local<Object> content = Object::New();
-
-        Local<Object> range = Object::New();
-        /*
-        int old_start
-        int old_lines
-        int new_start
-        int new_lines
-         */
-        Local<Object> oldRange = Object::New();
-        oldRange->Set(String::New("start"), Integer::New(rawContent->range->old_start));
-        oldRange->Set(String::New("lines"), Integer::New(rawContent->range->old_lines));
-        range->Set(String::New("old"), oldRange);
-
-        Local<Object> newRange = Object::New();
-        newRange->Set(String::New("start"), Integer::New(rawContent->range->new_start));
-        newRange->Set(String::New("lines"), Integer::New(rawContent->range->new_lines));
-        range->Set(String::New("new"), newRange);
-
-        content->Set(String::New("range"), range);
-        content->Set(String::New("content"), String::New(rawContent->content.c_str()));
-
-        // char lineOrigin[2];
-        // strncpy(lineOrigin, &rawContent->lineOrigin, 1);
-        char lineOrigin[2];
-        lineOrigin[0] = rawContent->lineOrigin;
-        lineOrigin[1] = '\0';
-        // std::string lineOrigin(rawContent->lineOrigin);
-        content->Set(String::New("lineOrigin"), String::New(lineOrigin));
-        content->Set(String::New("contentLength"), Integer::New(rawContent->contentLength));
-
-        deltaContent.push_back(content);
-      }
+  if(args.Length() == 1 || !(args[1]->IsObject() || args[1]->IsString() || args[1]->IsNull())) {
+    return ThrowException(Exception::Error(String::New("Old Oid/SHA is required and must be an Object, String or null")));
+  }
+
+  if(args.Length() == 2 || !Buffer::HasInstance(args[2])) {
+    return ThrowException(Exception::Error(String::New("Buffer is required and must be a Buffer.")));
+  }
+
+  // Options are optional and sit before the callback
+  int callbackIndex = args.Length() > 4 ? 4 : 3;
+  if(args.Length() <= callbackIndex || !args[callbackIndex]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Callback is required and must be a Function.")));
+  }
+
+  BlobDiffBaton *baton = new BlobDiffBaton;
+  std::string optionsError;
+  if (!ParseOptions(callbackIndex == 4 ? args[3] : Handle<Value>(Undefined()), baton->options, optionsError)) {
+    delete baton;
+    return ThrowException(Exception::Error(String::New(optionsError.c_str())));
+  }
+
+  baton->request.data = baton;
+  baton->error = NULL;
+  baton->repo = ObjectWrap::Unwrap<GitRepo>(args[0]->ToObject())->GetValue();
+  blobSideFromArg(args[1], baton->hasOld, baton->oldOid, baton->oldSha);
+  baton->hasNew = false;
+
+  // The worker reads the Buffer's memory in place instead of copying it
+  Local<Object> buffer = args[2]->ToObject();
+  baton->toBuffer = true;
+  baton->buffer = Persistent<Object>::New(buffer);
+  baton->bufferData = Buffer::Data(buffer);
+  baton->bufferLength = Buffer::Length(buffer);
+
+  baton->status = GIT_DELTA_UNMODIFIED;
+  baton->binary = false;
+  baton->additions = 0;
+  baton->deletions = 0;
+  baton->callback = Persistent<Function>::New(Local<Function>::Cast(args[callbackIndex]));
+
+  uv_queue_work(uv_default_loop(), &baton->request, BlobDiffWork, (uv_after_work_cb)BlobDiffAfterWork);
 
-      fileDelta->Set(String::NewSymbol("content"), cvv8::CastToJS(deltaContent));
-      fileDelta->Set(String::NewSymbol("status"), cvv8::CastToJS(delta->raw->status));
+  return Undefined();
+}
+void GitDiffList::BlobDiffWork(uv_work_t *req) {
+  BlobDiffBaton *baton = static_cast<BlobDiffBaton *>(req->data);
+
+  git_blob* oldBlob = NULL;
+  git_blob* newBlob = NULL;
+  int returnCode = GIT_OK;
+
+  if (baton->hasOld) {
+    if (!baton->oldSha.empty()) {
+      returnCode = git_oid_fromstr(&baton->oldOid, baton->oldSha.c_str());
+    }
+    if (returnCode == GIT_OK) {
+      returnCode = git_blob_lookup(&oldBlob, baton->repo, &baton->oldOid);
+    }
+  }
+  if (returnCode == GIT_OK && baton->hasNew) {
+    if (!baton->newSha.empty()) {
+      returnCode = git_oid_fromstr(&baton->newOid, baton->newSha.c_str());
+    }
+    if (returnCode == GIT_OK) {
+      returnCode = git_blob_lookup(&newBlob, baton->repo, &baton->newOid);
+    }
+  }
 
-      fileDeltasArray.push_back(fileDelta);
+  if (returnCode == GIT_OK) {
+    PrepareOptions(baton->options);
+    if (baton->toBuffer) {
+      returnCode = git_diff_blob_to_buffer(oldBlob, baton->bufferData, baton->bufferLength,
+                                           &baton->options.raw, BlobDiffWorkFile, BlobDiffWorkHunk,
+                                           BlobDiffWorkData, baton);
+    } else {
+      returnCode = git_diff_blobs(oldBlob, newBlob, &baton->options.raw, BlobDiffWorkFile,
+                                  BlobDiffWorkHunk, BlobDiffWorkData, baton);
     }
+  }
+
+  if (returnCode != GIT_OK) {
+    baton->error = giterr_last();
+  }
+
+  git_blob_free(newBlob);
+  git_blob_free(oldBlob);
+}
+int GitDiffList::BlobDiffWorkFile(const git_diff_delta *delta, float progress, void *payload) {
+  BlobDiffBaton *baton = static_cast<BlobDiffBaton *>(payload);
+  baton->status = delta->status;
+  baton->binary = (delta->flags & GIT_DIFF_FLAG_BINARY) != 0;
+  return GIT_OK;
+}
+int GitDiffList::BlobDiffWorkHunk(const git_diff_delta *delta, const git_diff_range *range,
+                                  const char *header, size_t header_len, void *payload) {
+  BlobDiffBaton *baton = static_cast<BlobDiffBaton *>(payload);
+  baton->hunks.push_back(BlobHunk());
+  BlobHunk& hunk = baton->hunks.back();
+  hunk.range = *range;
+  hunk.header.assign(header, header_len);
+  return GIT_OK;
+}
+int GitDiffList::BlobDiffWorkData(const git_diff_delta *delta, const git_diff_range *range,
+                                  char line_origin, const char *content, size_t content_len,
+                                  void *payload) {
+  BlobDiffBaton *baton = static_cast<BlobDiffBaton *>(payload);
+  if (baton->hunks.empty()) {
+    return GIT_OK;
+  }
 
-    baton->fileDeltas.clear();
+  BlobHunk& hunk = baton->hunks.back();
+  hunk.content.append(content, content_len);
+  hunk.lineOrigins.push_back(line_origin);
+  hunk.lineLengths.push_back((uint32_t)content_len);
 
+  if (line_origin == GIT_DIFF_LINE_ADDITION) {
+    baton->additions++;
+  } else if (line_origin == GIT_DIFF_LINE_DELETION) {
+    baton->deletions++;
+  }
+  return GIT_OK;
+}
+void GitDiffList::BlobDiffAfterWork(uv_work_t *req) {
+  HandleScope scope;
+  BlobDiffBaton *baton = static_cast<BlobDiffBaton *>(req->data);
+
+  if (success(baton->error, baton->callback)) {
+    std::vector<Local<Object> > hunks;
+    hunks.reserve(baton->hunks.size());
+    for (size_t i = 0; i < baton->hunks.size(); i++) {
+      BlobHunk& rawHunk = baton->hunks[i];
+      Local<Object> hunk = Object::New();
+      hunk->Set(String::NewSymbol("header"), String::New(rawHunk.header.data(), rawHunk.header.length()));
+      hunk->Set(String::NewSymbol("range"), rangeToObject(rawHunk.range));
+      hunk->Set(String::NewSymbol("content"), String::New(rawHunk.content.data(), rawHunk.content.length()));
+      hunk->Set(String::NewSymbol("lineOrigins"), String::New(rawHunk.lineOrigins.data(), rawHunk.lineOrigins.length()));
+      hunk->Set(String::NewSymbol("lineLengths"), createTypedArray("Uint32Array",
+        rawHunk.lineLengths.empty() ? NULL : &rawHunk.lineLengths[0], rawHunk.lineLengths.size(), sizeof(uint32_t)));
+      hunks.push_back(hunk);
+    }
+
+    Local<Object> result = Object::New();
+    result->Set(String::NewSymbol("status"), cvv8::CastToJS(baton->status));
+    result->Set(String::NewSymbol("binary"), Boolean::New(baton->binary));
+    result->Set(String::NewSymbol("additions"), Integer::NewFromUnsigned(baton->additions));
+    result->Set(String::NewSymbol("deletions"), Integer::NewFromUnsigned(baton->deletions));
+    result->Set(String::NewSymbol("hunks"), cvv8::CastToJS(hunks));
 
     Handle<Value> argv[2] = {
       Local<Value>::New(Null()),
-      cvv8::CastToJS(fileDeltasArray)
+      result
     };
 
     TryCatch try_catch;
-    baton->fileCallback->Call(Context::GetCurrent()->Global(), 2, argv);
+    baton->callback->Call(Context::GetCurrent()->Global(), 2, argv);
     if (try_catch.HasCaught()) {
       node::FatalException(try_catch);
     }
   }
-  uv_mutex_unlock(&baton->mutex);
-}
-void GitDiffList::WalkWorkSendHunk(uv_async_t *handle, int status /*UNUSED*/) { }
-void GitDiffList::WalkWorkSendData(uv_async_t *handle, int status /*UNUSED*/) { }
-void GitDiffList::WalkWorkSendEnd(uv_async_t *handle, int status /*UNUSED*/) {
-  WalkBaton *baton = static_cast<WalkBaton *>(handle->data);
-
-  uv_mutex_destroy(&baton->mutex);
-  uv_close((uv_handle_t*) &baton->asyncFile, NULL);
-  uv_close((uv_handle_t*) &baton->asyncHunk, NULL);
-  uv_close((uv_handle_t*) &baton->asyncData, NULL);
-  uv_close((uv_handle_t*) &baton->asyncEnd, NULL);
 
-  Local<Value> argv[1];
-  if (baton->error) {
-    argv[0] = GitError::WrapError(baton->error);
-  } else {
-    argv[0] = Local<Value>::New(Null());
+  if (baton->toBuffer) {
+    baton->buffer.Dispose();
   }
+  baton->callback.Dispose();
+  delete baton;
+}
 
-  TryCatch try_catch;
+Handle<Value> GitDiffList::FindSimilar(const Arguments& args) {
+  HandleScope scope;
 
-  baton->endCallback->Call(Context::GetCurrent()->Global(), 1, argv);
+  GitDiffList* diffList = ObjectWrap::Unwrap<GitDiffList>(args.This());
+
+  if (diffList->GetValue() == NULL) {
+    return ThrowException(Exception::Error(String::New("No diff list to find similar files in.")));
+  }
+
+  if(args.Length() == 0 || !args[0]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Options are required and must be an Object.")));
+  }
+
+  if(args.Length() == 1 || !args[1]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Callback is required and must be a Function.")));
+  }
+
+  // Rename detection rewrites the deltas, so the output no longer matches
+  // the plain diff of the two trees
+  diffList->hasCacheKey = false;
+
+  FindSimilarBaton *baton = new FindSimilarBaton;
+  baton->request.data = baton;
+  baton->error = NULL;
+  baton->diffList = diffList;
+  baton->diffList->Ref();
+  baton->rawDiffList = diffList->GetValue();
+  baton->repo = diffList->GetRepo();
+
+  git_diff_find_options defaults = GIT_DIFF_FIND_OPTIONS_INIT;
+  baton->options = defaults;
+  baton->threads = GitDiffList::FIND_SIMILAR_THREADS;
+
+  Local<Object> options = args[0]->ToObject();
+
+  Local<Value> renames = options->Get(String::NewSymbol("renames"));
+  if (renames->IsUndefined() || renames->BooleanValue()) {
+    baton->options.flags |= GIT_DIFF_FIND_RENAMES;
+  }
+  if (options->Get(String::NewSymbol("copies"))->BooleanValue()) {
+    baton->options.flags |= GIT_DIFF_FIND_COPIES;
+  }
+  if (options->Get(String::NewSymbol("copiesFromUnmodified"))->BooleanValue()) {
+    baton->options.flags |= GIT_DIFF_FIND_COPIES_FROM_UNMODIFIED;
+  }
+  if (options->Get(String::NewSymbol("renamesFromRewrites"))->BooleanValue()) {
+    baton->options.flags |= GIT_DIFF_FIND_RENAMES_FROM_REWRITES;
+  }
+  if (options->Get(String::NewSymbol("breakRewrites"))->BooleanValue()) {
+    baton->options.flags |= GIT_DIFF_FIND_AND_BREAK_REWRITES;
+  }
+
+  Local<Value> renameThreshold = options->Get(String::NewSymbol("renameThreshold"));
+  if (renameThreshold->IsNumber()) {
+    baton->options.rename_threshold = (uint16_t)renameThreshold->Uint32Value();
+  }
+  Local<Value> renameFromRewriteThreshold = options->Get(String::NewSymbol("renameFromRewriteThreshold"));
+  if (renameFromRewriteThreshold->IsNumber()) {
+    baton->options.rename_from_rewrite_threshold = (uint16_t)renameFromRewriteThreshold->Uint32Value();
+  }
+  Local<Value> copyThreshold = options->Get(String::NewSymbol("copyThreshold"));
+  if (copyThreshold->IsNumber()) {
+    baton->options.copy_threshold = (uint16_t)copyThreshold->Uint32Value();
+  }
+  Local<Value> breakRewriteThreshold = options->Get(String::NewSymbol("breakRewriteThreshold"));
+  if (breakRewriteThreshold->IsNumber()) {
+    baton->options.break_rewrite_threshold = (uint16_t)breakRewriteThreshold->Uint32Value();
+  }
+  Local<Value> targetLimit = options->Get(String::NewSymbol("targetLimit"));
+  if (targetLimit->IsNumber()) {
+    baton->options.target_limit = targetLimit->Uint32Value();
+  }
+  Local<Value> threads = options->Get(String::NewSymbol("threads"));
+  if (threads->IsNumber()) {
+    baton->threads = threads->Int32Value();
+  }
+
+  baton->callback = Persistent<Function>::New(Local<Function>::Cast(args[1]));
+
+  uv_queue_work(uv_default_loop(), &baton->request, FindSimilarWork, (uv_after_work_cb)FindSimilarAfterWork);
+
+  return Undefined();
+}
+void GitDiffList::FindSimilarWork(uv_work_t *req) {
+  FindSimilarBaton *baton = static_cast<FindSimilarBaton *>(req->data);
+
+  // Every non-empty blob on either side of a delta may be compared
+  std::vector<git_oid> candidates;
+  size_t numDeltas = git_diff_num_deltas(baton->rawDiffList);
+  for (size_t i = 0; i < numDeltas; i++) {
+    const git_diff_delta* delta = NULL;
+    if (git_diff_get_patch(NULL, &delta, baton->rawDiffList, i) != GIT_OK) {
+      baton->error = giterr_last();
+      return;
+    }
+    if (!git_oid_iszero(&delta->old_file.oid) && delta->old_file.mode != GIT_FILEMODE_COMMIT) {
+      candidates.push_back(delta->old_file.oid);
+    }
+    if (!git_oid_iszero(&delta->new_file.oid) && delta->new_file.mode != GIT_FILEMODE_COMMIT) {
+      candidates.push_back(delta->new_file.oid);
+    }
+  }
+
+  DiffSignature::Cache signatures;
+  if (baton->repo != NULL && !candidates.empty()) {
+    if (DiffSignature::ComputeAll(git_repository_path(baton->repo), candidates,
+                                  baton->threads, signatures) != GIT_OK) {
+      DiffSignature::FreeAll(signatures);
+      baton->error = giterr_last();
+      return;
+    }
+  }
+
+  git_diff_similarity_metric metric;
+  metric.file_signature = DiffSignature::MetricFileSignature;
+  metric.buffer_signature = DiffSignature::MetricBufferSignature;
+  metric.free_signature = DiffSignature::MetricFreeSignature;
+  metric.similarity = DiffSignature::MetricSimilarity;
+  metric.payload = &signatures;
+  baton->options.metric = &metric;
+
+  int returnCode = git_diff_find_similar(baton->rawDiffList, &baton->options);
+  if (returnCode != GIT_OK) {
+    baton->error = giterr_last();
+  }
+
+  DiffSignature::FreeAll(signatures);
+}
+void GitDiffList::FindSimilarAfterWork(uv_work_t *req) {
+  HandleScope scope;
+  FindSimilarBaton *baton = static_cast<FindSimilarBaton *>(req->data);
+
+  if (success(baton->error, baton->callback)) {
+    Handle<Value> argv[2] = {
+      Local<Value>::New(Null()),
+      baton->diffList->handle_
+    };
+
+    TryCatch try_catch;
+    baton->callback->Call(Context::GetCurrent()->Global(), 2, argv);
+    if (try_catch.HasCaught()) {
+      node::FatalException(try_catch);
+    }
+  }
+
+  baton->diffList->Unref();
+  baton->callback.Dispose();
+  delete baton;
+}
+
+Handle<Value> GitDiffList::Stats(const Arguments& args) {
+  HandleScope scope;
+
+  GitDiffList* diffList = ObjectWrap::Unwrap<GitDiffList>(args.This());
+
+  if (diffList->GetValue() == NULL) {
+    return ThrowException(Exception::Error(String::New("No diff list to compute stats for.")));
+  }
+
+  if(args.Length() == 0 || !args[0]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Callback is required and must be a Function.")));
+  }
+
+  StatsBaton *baton = new StatsBaton;
+  baton->request.data = baton;
+  baton->error = NULL;
+  baton->diffList = diffList;
+  baton->diffList->Ref();
+  baton->rawDiffList = diffList->GetValue();
+  baton->totalAdditions = 0;
+  baton->totalDeletions = 0;
+  baton->callback = Persistent<Function>::New(Local<Function>::Cast(args[0]));
+
+  uv_queue_work(uv_default_loop(), &baton->request, StatsWork, (uv_after_work_cb)StatsAfterWork);
+
+  return Undefined();
+}
+void GitDiffList::StatsWork(uv_work_t *req) {
+  StatsBaton *baton = static_cast<StatsBaton *>(req->data);
+
+  size_t numDeltas = git_diff_num_deltas(baton->rawDiffList);
+  baton->paths.reserve(numDeltas);
+  baton->additions.reserve(numDeltas);
+  baton->deletions.reserve(numDeltas);
+
+  int returnCode = git_diff_foreach(baton->rawDiffList, StatsWorkFile, NULL, StatsWorkData, baton);
+  if (returnCode != GIT_OK) {
+    baton->error = giterr_last();
+  }
+}
+int GitDiffList::StatsWorkFile(const git_diff_delta *delta, float progress,
+                               void *payload) {
+  StatsBaton *baton = static_cast<StatsBaton *>(payload);
+
+  baton->paths.push_back(delta->new_file.path);
+  baton->additions.push_back(0);
+  baton->deletions.push_back(0);
+
+  return GIT_OK;
+}
+int GitDiffList::StatsWorkData(const git_diff_delta *delta, const git_diff_range *range,
+                               char line_origin, const char *content, size_t content_len,
+                               void *payload) {
+  StatsBaton *baton = static_cast<StatsBaton *>(payload);
+
+  if (line_origin == GIT_DIFF_LINE_ADDITION) {
+    baton->additions.back()++;
+    baton->totalAdditions++;
+  } else if (line_origin == GIT_DIFF_LINE_DELETION) {
+    baton->deletions.back()++;
+    baton->totalDeletions++;
+  }
+
+  return GIT_OK;
+}
+void GitDiffList::StatsAfterWork(uv_work_t *req) {
+  HandleScope scope;
+  StatsBaton *baton = static_cast<StatsBaton *>(req->data);
+
+  if (success(baton->error, baton->callback)) {
+    size_t files = baton->paths.size();
+
+    Local<Object> stats = Object::New();
+    stats->Set(String::NewSymbol("files"), Integer::NewFromUnsigned(files));
+    stats->Set(String::NewSymbol("additions"), Integer::NewFromUnsigned(baton->totalAdditions));
+    stats->Set(String::NewSymbol("deletions"), Integer::NewFromUnsigned(baton->totalDeletions));
+    stats->Set(String::NewSymbol("paths"), cvv8::CastToJS(baton->paths));
+    stats->Set(String::NewSymbol("fileAdditions"), createTypedArray("Uint32Array",
+      files ? &baton->additions[0] : NULL, files, sizeof(uint32_t)));
+    stats->Set(String::NewSymbol("fileDeletions"), createTypedArray("Uint32Array",
+      files ? &baton->deletions[0] : NULL, files, sizeof(uint32_t)));
+
+    Handle<Value> argv[2] = {
+      Local<Value>::New(Null()),
+      stats
+    };
+
+    TryCatch try_catch;
+    baton->callback->Call(Context::GetCurrent()->Global(), 2, argv);
+    if (try_catch.HasCaught()) {
+      node::FatalException(try_catch);
+    }
+  }
+
+  baton->diffList->Unref();
+  baton->callback.Dispose();
+  delete baton;
+}
+
+Handle<Value> GitDiffList::NameStatus(const Arguments& args) {
+  HandleScope scope;
+
+  GitDiffList* diffList = ObjectWrap::Unwrap<GitDiffList>(args.This());
+
+  if (diffList->GetValue() == NULL) {
+    return ThrowException(Exception::Error(String::New("No diff list to read deltas from.")));
+  }
+
+  if(args.Length() == 0 || !args[0]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Callback is required and must be a Function.")));
+  }
+
+  NameStatusBaton *baton = new NameStatusBaton;
+  baton->request.data = baton;
+  baton->error = NULL;
+  baton->diffList = diffList;
+  baton->diffList->Ref();
+  baton->rawDiffList = diffList->GetValue();
+  baton->callback = Persistent<Function>::New(Local<Function>::Cast(args[0]));
+
+  uv_queue_work(uv_default_loop(), &baton->request, NameStatusWork, (uv_after_work_cb)NameStatusAfterWork);
+
+  return Undefined();
+}
+void GitDiffList::NameStatusWork(uv_work_t *req) {
+  NameStatusBaton *baton = static_cast<NameStatusBaton *>(req->data);
+
+  size_t numDeltas = git_diff_num_deltas(baton->rawDiffList);
+  baton->oldPaths.reserve(numDeltas);
+  baton->newPaths.reserve(numDeltas);
+  baton->statuses.reserve(numDeltas);
+  baton->oldModes.reserve(numDeltas);
+  baton->newModes.reserve(numDeltas);
+  baton->oldOids.reserve(numDeltas);
+  baton->newOids.reserve(numDeltas);
+
+  for (size_t i = 0; i < numDeltas; i++) {
+    const git_diff_delta* delta = NULL;
+
+    // Passing no patch pointer returns the delta alone; the text diff, and
+    // with it every blob load, is skipped entirely
+    int returnCode = git_diff_get_patch(NULL, &delta, baton->rawDiffList, i);
+    if (returnCode != GIT_OK) {
+      baton->error = giterr_last();
+      return;
+    }
+
+    baton->oldPaths.push_back(delta->old_file.path);
+    baton->newPaths.push_back(delta->new_file.path);
+    baton->statuses.push_back(delta->status);
+    baton->oldModes.push_back(delta->old_file.mode);
+    baton->newModes.push_back(delta->new_file.mode);
+    baton->oldOids.push_back(delta->old_file.oid);
+    baton->newOids.push_back(delta->new_file.oid);
+  }
+}
+void GitDiffList::NameStatusAfterWork(uv_work_t *req) {
+  HandleScope scope;
+  NameStatusBaton *baton = static_cast<NameStatusBaton *>(req->data);
+
+  if (success(baton->error, baton->callback)) {
+    size_t files = baton->statuses.size();
+
+    std::vector<std::string> oldShas;
+    std::vector<std::string> newShas;
+    oldShas.reserve(files);
+    newShas.reserve(files);
+    char sha[GIT_OID_HEXSZ + 1];
+    sha[GIT_OID_HEXSZ] = '\0';
+    for (size_t i = 0; i < files; i++) {
+      git_oid_fmt(sha, &baton->oldOids[i]);
+      oldShas.push_back(sha);
+      git_oid_fmt(sha, &baton->newOids[i]);
+      newShas.push_back(sha);
+    }
+
+    Local<Object> nameStatus = Object::New();
+    nameStatus->Set(String::NewSymbol("oldPaths"), cvv8::CastToJS(baton->oldPaths));
+    nameStatus->Set(String::NewSymbol("newPaths"), cvv8::CastToJS(baton->newPaths));
+    nameStatus->Set(String::NewSymbol("oldShas"), cvv8::CastToJS(oldShas));
+    nameStatus->Set(String::NewSymbol("newShas"), cvv8::CastToJS(newShas));
+    nameStatus->Set(String::NewSymbol("statuses"), createTypedArray("Uint8Array",
+      files ? &baton->statuses[0] : NULL, files, sizeof(uint8_t)));
+    nameStatus->Set(String::NewSymbol("oldModes"), createTypedArray("Uint16Array",
+      files ? &baton->oldModes[0] : NULL, files, sizeof(uint16_t)));
+    nameStatus->Set(String::NewSymbol("newModes"), createTypedArray("Uint16Array",
+      files ? &baton->newModes[0] : NULL, files, sizeof(uint16_t)));
+
+    Handle<Value> argv[2] = {
+      Local<Value>::New(Null()),
+      nameStatus
+    };
+
+    TryCatch try_catch;
+    baton->callback->Call(Context::GetCurrent()->Global(), 2, argv);
+    if (try_catch.HasCaught()) {
+      node::FatalException(try_catch);
+    }
+  }
+
+  baton->diffList->Unref();
+  baton->callback.Dispose();
+  delete baton;
+}
+
+bool GitDiffList::AppendPatchChunk(PatchChunk& chunk, const char* content, size_t length) {
+  if (chunk.length + length > chunk.capacity) {
+    size_t capacity = chunk.capacity ? chunk.capacity : 4096;
+    while (capacity < chunk.length + length) {
+      capacity *= 2;
+    }
+    char* data = (char*)realloc(chunk.data, capacity);
+    if (data == NULL) {
+      giterr_set_str(GITERR_NOMEMORY, "Out of memory while formatting patch");
+      return false;
+    }
+    chunk.data = data;
+    chunk.capacity = capacity;
+  }
+  memcpy(chunk.data + chunk.length, content, length);
+  chunk.length += length;
+  return true;
+}
+Local<Object> GitDiffList::PatchChunkToBuffer(PatchChunk& chunk) {
+  // The Buffer takes ownership of the chunk's memory
+  Buffer* buffer = chunk.data == NULL
+    ? Buffer::New(0)
+    : Buffer::New(chunk.data, chunk.length, FreePatchChunk, NULL);
+  chunk.data = NULL;
+  chunk.length = 0;
+  chunk.capacity = 0;
+
+  Local<Object> fastBuffer;
+  MAKE_FAST_BUFFER(buffer, fastBuffer);
+  return fastBuffer;
+}
+void GitDiffList::FreePatchChunk(char* data, void* hint) {
+  free(data);
+}
+
+Handle<Value> GitDiffList::ToPatch(const Arguments& args) {
+  HandleScope scope;
+
+  GitDiffList* diffList = ObjectWrap::Unwrap<GitDiffList>(args.This());
+
+  if (diffList->GetValue() == NULL) {
+    return ThrowException(Exception::Error(String::New("No diff list to format.")));
+  }
+
+  if(args.Length() == 0 || !args[0]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Callback is required and must be a Function.")));
+  }
+
+  ToPatchBaton *baton = new ToPatchBaton;
+  baton->request.data = baton;
+  baton->error = NULL;
+  baton->diffList = diffList;
+  baton->diffList->Ref();
+  baton->rawDiffList = diffList->GetValue();
+  baton->patch.data = NULL;
+  baton->patch.length = 0;
+  baton->patch.capacity = 0;
+  baton->cacheable = diffList->hasCacheKey && GitDiffCache::Enabled();
+  baton->cacheKey = diffList->cacheKey;
+  baton->callback = Persistent<Function>::New(Local<Function>::Cast(args[0]));
+
+  uv_queue_work(uv_default_loop(), &baton->request, ToPatchWork, (uv_after_work_cb)ToPatchAfterWork);
+
+  return Undefined();
+}
+void GitDiffList::ToPatchWork(uv_work_t *req) {
+  ToPatchBaton *baton = static_cast<ToPatchBaton *>(req->data);
+
+  if (baton->cacheable) {
+    std::string cached;
+    if (GitDiffCache::Get(baton->cacheKey, cached)) {
+      if (!cached.empty() && !AppendPatchChunk(baton->patch, cached.data(), cached.length())) {
+        baton->error = giterr_last();
+      }
+      return;
+    }
+  }
+
+  int returnCode = git_diff_print_patch(baton->rawDiffList, ToPatchWorkData, &baton->patch);
+  if (returnCode != GIT_OK) {
+    baton->error = giterr_last();
+    return;
+  }
+
+  if (baton->cacheable) {
+    GitDiffCache::Put(baton->cacheKey, baton->patch.data ? baton->patch.data : "", baton->patch.length);
+  }
+}
+int GitDiffList::ToPatchWorkData(const git_diff_delta *delta, const git_diff_range *range,
+                                 char line_origin, const char *content, size_t content_len,
+                                 void *payload) {
+  // Content arrives already formatted, including the line origin prefix
+  PatchChunk* patch = static_cast<PatchChunk *>(payload);
+  return AppendPatchChunk(*patch, content, content_len) ? GIT_OK : -1;
+}
+void GitDiffList::ToPatchAfterWork(uv_work_t *req) {
+  HandleScope scope;
+  ToPatchBaton *baton = static_cast<ToPatchBaton *>(req->data);
+
+  if (success(baton->error, baton->callback)) {
+    Handle<Value> argv[2] = {
+      Local<Value>::New(Null()),
+      PatchChunkToBuffer(baton->patch)
+    };
+
+    TryCatch try_catch;
+    baton->callback->Call(Context::GetCurrent()->Global(), 2, argv);
+    if (try_catch.HasCaught()) {
+      node::FatalException(try_catch);
+    }
+  }
+
+  free(baton->patch.data);
+  baton->diffList->Unref();
+  baton->callback.Dispose();
+  delete baton;
+}
+
+Handle<Value> GitDiffList::ToPatchStream(const Arguments& args) {
+  HandleScope scope;
+
+  GitDiffList* diffList = ObjectWrap::Unwrap<GitDiffList>(args.This());
+
+  if (diffList->GetValue() == NULL) {
+    return ThrowException(Exception::Error(String::New("No diff list to format.")));
+  }
+
+  if(args.Length() == 0 || !args[0]->IsNumber()) {
+    return ThrowException(Exception::Error(String::New("Chunk size is required and must be a Number.")));
+  }
+
+  if(args.Length() == 1 || !args[1]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Chunk callback is required and must be a Function.")));
+  }
+
+  if(args.Length() == 2 || !args[2]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("End callback is required and must be a Function.")));
+  }
+
+  ToPatchStreamBaton* baton = new ToPatchStreamBaton;
+  uv_async_init(uv_default_loop(), &baton->asyncChunk, ToPatchStreamSendChunk);
+  uv_async_init(uv_default_loop(), &baton->asyncEnd, ToPatchStreamSendEnd);
+  baton->asyncChunk.data = baton;
+  baton->asyncEnd.data = baton;
+
+  uv_mutex_init(&baton->mutex);
+  uv_sem_init(&baton->pendingSlots, GitDiffList::PATCH_MAX_PENDING_CHUNKS);
+
+  baton->diffList = diffList;
+  diffList->Ref();
+  baton->rawDiffList = diffList->GetValue();
+  baton->chunkSize = args[0]->Uint32Value();
+  if (baton->chunkSize == 0) {
+    baton->chunkSize = GitDiffList::PATCH_DEFAULT_CHUNK_SIZE;
+  }
+  baton->current.data = NULL;
+  baton->current.length = 0;
+  baton->current.capacity = 0;
+  baton->chunkCallback = Persistent<Function>::New(Local<Function>::Cast(args[1]));
+  baton->endCallback = Persistent<Function>::New(Local<Function>::Cast(args[2]));
+
+  uv_thread_create(&baton->threadId, ToPatchStreamWork, baton);
+
+  return Undefined();
+}
+void GitDiffList::ToPatchStreamWork(void *payload) {
+  ToPatchStreamBaton *baton = static_cast<ToPatchStreamBaton *>(payload);
+
+  int returnCode = git_diff_print_patch(baton->rawDiffList, ToPatchStreamWorkData, payload);
+  if (returnCode != GIT_OK) {
+    baton->error.Capture();
+  }
+
+  // Whatever is left in the current chunk is sent by the end handler
+  uv_async_send(&baton->asyncEnd);
+}
+int GitDiffList::ToPatchStreamWorkData(const git_diff_delta *delta, const git_diff_range *range,
+                                       char line_origin, const char *content, size_t content_len,
+                                       void *payload) {
+  ToPatchStreamBaton *baton = static_cast<ToPatchStreamBaton *>(payload);
+
+  if (!AppendPatchChunk(baton->current, content, content_len)) {
+    return -1;
+  }
+
+  if (baton->current.length < baton->chunkSize) {
+    return GIT_OK;
+  }
+
+  uv_sem_wait(&baton->pendingSlots);
+
+  uv_mutex_lock(&baton->mutex);
+  baton->completedChunks.push_back(baton->current);
+  uv_mutex_unlock(&baton->mutex);
+
+  baton->current.data = NULL;
+  baton->current.length = 0;
+  baton->current.capacity = 0;
+
+  uv_async_send(&baton->asyncChunk);
+
+  return GIT_OK;
+}
+void GitDiffList::ToPatchStreamSendChunk(uv_async_t *handle, int status /*UNUSED*/) {
+  HandleScope scope;
+
+  ToPatchStreamBaton *baton = static_cast<ToPatchStreamBaton *>(handle->data);
+
+  std::vector<PatchChunk> completed;
+  uv_mutex_lock(&baton->mutex);
+  completed.swap(baton->completedChunks);
+  uv_mutex_unlock(&baton->mutex);
+
+  for (size_t i = 0; i < completed.size(); i++) {
+    Handle<Value> argv[1] = {
+      PatchChunkToBuffer(completed[i])
+    };
+
+    // Let the patch thread fill another chunk
+    uv_sem_post(&baton->pendingSlots);
+
+    TryCatch try_catch;
+    baton->chunkCallback->Call(Context::GetCurrent()->Global(), 1, argv);
+    if (try_catch.HasCaught()) {
+      node::FatalException(try_catch);
+    }
+  }
+}
+void GitDiffList::ToPatchStreamSendEnd(uv_async_t *handle, int status /*UNUSED*/) {
+  HandleScope scope;
+
+  ToPatchStreamBaton *baton = static_cast<ToPatchStreamBaton *>(handle->data);
+
+  uv_thread_join(&baton->threadId);
+
+  // Async signals are coalesced and unordered between handles, so flush
+  // any chunk whose signal has not been handled yet, then the tail
+  ToPatchStreamSendChunk(&baton->asyncChunk, 0);
+  if (!baton->error.IsSet() && baton->current.length > 0) {
+    Handle<Value> argv[1] = {
+      PatchChunkToBuffer(baton->current)
+    };
+
+    TryCatch try_catch;
+    baton->chunkCallback->Call(Context::GetCurrent()->Global(), 1, argv);
+    if (try_catch.HasCaught()) {
+      node::FatalException(try_catch);
+    }
+  }
+  free(baton->current.data);
+
+  uv_mutex_destroy(&baton->mutex);
+  uv_sem_destroy(&baton->pendingSlots);
+  uv_close((uv_handle_t*) &baton->asyncChunk, NULL);
+  uv_close((uv_handle_t*) &baton->asyncEnd, ToPatchStreamFree);
+
+  Local<Value> argv[1];
+  if (baton->error.IsSet()) {
+    argv[0] = baton->error.Wrap();
+  } else {
+    argv[0] = Local<Value>::New(Null());
+  }
+
+  TryCatch try_catch;
+  baton->endCallback->Call(Context::GetCurrent()->Global(), 1, argv);
+  if (try_catch.HasCaught()) {
+    node::FatalException(try_catch);
+  }
+}
+void GitDiffList::ToPatchStreamFree(uv_handle_t *handle) {
+  ToPatchStreamBaton *baton = static_cast<ToPatchStreamBaton *>(handle->data);
+
+  baton->diffList->Unref();
+  baton->chunkCallback.Dispose();
+  baton->endCallback.Dispose();
+  delete baton;
+}
+
+Handle<Value> GitDiffList::Walk(const Arguments& args) {
+  HandleScope scope;
+
+  GitDiffList* diffList = ObjectWrap::Unwrap<GitDiffList>(args.This());
+
+  if (diffList->GetValue() == NULL) {
+    return ThrowException(Exception::Error(String::New("No diff list to Walk.")));
+  }
+
+  if(args.Length() == 0 || !args[0]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Diff callback is required and must be a Function.")));
+  }
+
+  if(args.Length() == 1 || !args[1]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Hunk callback is required and must be a Function.")));
+  }
+
+  if(args.Length() == 2 || !args[2]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("End callback is required and must be a Function.")));
+  }
+
+  WalkBaton* baton = new WalkBaton;
+  uv_async_init(uv_default_loop(), &baton->asyncFile, WalkWorkSendFile);
+  uv_async_init(uv_default_loop(), &baton->asyncHunk, WalkWorkSendHunk);
+  uv_async_init(uv_default_loop(), &baton->asyncEnd, WalkWorkSendEnd);
+  baton->asyncFile.data = baton;
+  baton->asyncHunk.data = baton;
+  baton->asyncEnd.data = baton;
+
+  uv_mutex_init(&baton->mutex);
+  uv_sem_init(&baton->pendingSlots, GitDiffList::WALK_MAX_PENDING_DELTAS);
+
+  baton->rawDiffList = diffList->GetValue();
+  baton->fileDeltas.reserve(git_diff_num_deltas(baton->rawDiffList));
+  baton->completedDeltas = 0;
+  baton->sentDeltas = 0;
+  baton->completedHunks = 0;
+  baton->sentHunks = 0;
+  baton->arenas = new WalkArenas;
+  baton->diffList = diffList;
+  diffList->Ref();
+  baton->fileCallback = Persistent<Function>::New(Local<Function>::Cast(args[0]));
+  baton->hunkCallback = Persistent<Function>::New(Local<Function>::Cast(args[1]));
+  baton->endCallback = Persistent<Function>::New(Local<Function>::Cast(args[2]));
+
+  uv_thread_create(&baton->threadId, WalkWork, baton);
+
+  return Undefined();
+}
+void GitDiffList::WalkWork(void *payload) {
+  WalkBaton *baton = static_cast<WalkBaton *>(payload);
+
+  int returnCode = git_diff_foreach(baton->rawDiffList, WalkWorkFile, WalkWorkHunk, WalkWorkData, payload);
+  if (returnCode != GIT_OK) {
+    baton->error.Capture();
+  } else {
+    WalkWorkCompleteFile(payload);
+  }
+
+  uv_async_send(&baton->asyncEnd);
+}
+void GitDiffList::WalkWorkCompleteFile(void *payload) {
+  WalkBaton *baton = static_cast<WalkBaton *>(payload);
+
+  // fileDeltas is only appended to by this thread, so reading its size
+  // without the lock is safe here
+  if (baton->completedDeltas == baton->fileDeltas.size()) {
+    return;
+  }
+
+  uv_sem_wait(&baton->pendingSlots);
+
+  // Everything allocated so far belongs to completed deltas. Small files
+  // share a set, so a walk over many of them does not allocate a block
+  // per file
+  WalkArenas* retired = NULL;
+  size_t allocated = baton->arenas->recordArena.BytesAllocated() +
+    baton->arenas->textArena.BytesAllocated() +
+    baton->arenas->originArena.BytesAllocated();
+  if (allocated >= Arena::BLOCK_SIZE) {
+    retired = baton->arenas;
+    retired->endDelta = baton->fileDeltas.size();
+    baton->arenas = new WalkArenas;
+  }
+
+  uv_mutex_lock(&baton->mutex);
+  baton->completedHunks = baton->hunks.size();
+  baton->completedDeltas = baton->fileDeltas.size();
+  if (retired != NULL) {
+    baton->retiredArenas.push_back(retired);
+  }
+  uv_mutex_unlock(&baton->mutex);
+
+  uv_async_send(&baton->asyncFile);
+}
+int GitDiffList::WalkWorkFile(const git_diff_delta *delta, float progress,
+                                  void *payload) {
+  WalkBaton *baton = static_cast<WalkBaton *>(payload);
+
+  /*
+    diff_file_delta
+      git_diff_file old_file
+        git_oid oid
+        const char *path
+        git_off_t size
+        uint32_t flags
+        uint16_t mode
+
+      git_diff_file new_file
+      git_delta_t status
+      uint32_t similarity
+      uint32_t flags
+     */
+
+  // git_diff_foreach visits deltas in order, so starting a new file means
+  // the previous one is complete and can be streamed immediately
+  WalkWorkCompleteFile(payload);
+
+  Delta* newDelta = (Delta*)baton->arenas->recordArena.Allocate(sizeof(Delta));
+  if (newDelta == NULL) {
+    giterr_set_str(GITERR_NOMEMORY, "Out of memory while walking diff");
+    return -1;
+  }
+  memcpy(&newDelta->raw, delta, sizeof(git_diff_delta));
+  newDelta->firstHunk = NULL;
+  newDelta->lastHunk = NULL;
+
+  uv_mutex_lock(&baton->mutex);
+  baton->fileDeltas.push_back(newDelta);
+  uv_mutex_unlock(&baton->mutex);
+
+  return GIT_OK;
+}
+int GitDiffList::WalkWorkHunk(const git_diff_delta *delta, const git_diff_range *range, const char *header, size_t header_len, void *payload) {
+  WalkBaton *baton = static_cast<WalkBaton *>(payload);
+
+  Hunk* hunk = (Hunk*)baton->arenas->recordArena.Allocate(sizeof(Hunk));
+  char* hunkHeader = (char*)baton->arenas->textArena.Allocate(header_len);
+  if (hunk == NULL || hunkHeader == NULL) {
+    giterr_set_str(GITERR_NOMEMORY, "Out of memory while walking diff");
+    return -1;
+  }
+  memcpy(hunkHeader, header, header_len);
+
+  hunk->oldPath = delta->old_file.path;
+  hunk->newPath = delta->new_file.path;
+  memcpy(&hunk->range, range, sizeof(git_diff_range));
+  hunk->header = hunkHeader;
+  hunk->headerLength = header_len;
+  hunk->content = NULL;
+  hunk->contentLength = 0;
+  hunk->lineOrigins = NULL;
+  hunk->lineLengths = NULL;
+  hunk->lineCount = 0;
+  hunk->next = NULL;
+
+  // Hunks are visited in order too, so every earlier hunk is now complete
+  bool hasPrevious;
+  uv_mutex_lock(&baton->mutex);
+  hasPrevious = baton->completedHunks < baton->hunks.size();
+  baton->completedHunks = baton->hunks.size();
+  baton->hunks.push_back(hunk);
+  uv_mutex_unlock(&baton->mutex);
+
+  // The delta itself is not visible to the main thread until completed
+  Delta* currentDelta = baton->fileDeltas.back();
+  if (currentDelta->lastHunk == NULL) {
+    currentDelta->firstHunk = hunk;
+  } else {
+    currentDelta->lastHunk->next = hunk;
+  }
+  currentDelta->lastHunk = hunk;
+
+  if (hasPrevious) {
+    uv_async_send(&baton->asyncHunk);
+  }
+
+  return GIT_OK;
+}
+int GitDiffList::WalkWorkData(const git_diff_delta *delta, const git_diff_range *range,
+                                  char line_origin, const char *content, size_t content_len,
+                                  void *payload) {
+  WalkBaton *baton = static_cast<WalkBaton *>(payload);
+
+  // Lines always belong to the most recent hunk of the most recently
+  // started delta, neither of which the main thread reads until completed
+  Delta* currentDelta = baton->fileDeltas.back();
+  if (currentDelta->lastHunk == NULL && WalkWorkHunk(delta, range, "", 0, payload) != GIT_OK) {
+    return -1;
+  }
+  Hunk* hunk = currentDelta->lastHunk;
+
+  // Each of these is the latest allocation in its arena for as long as the
+  // hunk is being read, so they nearly always grow in place
+  char* hunkContent = (char*)baton->arenas->textArena.Extend(hunk->content, hunk->contentLength, content_len);
+  char* lineOrigins = (char*)baton->arenas->originArena.Extend(hunk->lineOrigins, hunk->lineCount, 1);
+  uint32_t* lineLengths = (uint32_t*)baton->arenas->recordArena.Extend(hunk->lineLengths,
+    hunk->lineCount * sizeof(uint32_t), sizeof(uint32_t));
+  if (hunkContent == NULL || lineOrigins == NULL || lineLengths == NULL) {
+    giterr_set_str(GITERR_NOMEMORY, "Out of memory while walking diff");
+    return -1;
+  }
+
+  memcpy(hunkContent + hunk->contentLength, content, content_len);
+  lineOrigins[hunk->lineCount] = line_origin;
+  lineLengths[hunk->lineCount] = (uint32_t)content_len;
+
+  hunk->content = hunkContent;
+  hunk->contentLength += content_len;
+  hunk->lineOrigins = lineOrigins;
+  hunk->lineLengths = lineLengths;
+  hunk->lineCount++;
+
+  return GIT_OK;
+}
+
+void GitDiffList::WalkWorkSendFile(uv_async_t *handle, int status /*UNUSED*/) {
+  HandleScope scope;
+
+  WalkBaton *baton = static_cast<WalkBaton *>(handle->data);
+
+  std::vector<GitDiffList::Delta* > completed;
+  uv_mutex_lock(&baton->mutex);
+  completed.assign(baton->fileDeltas.begin() + baton->sentDeltas,
+                   baton->fileDeltas.begin() + baton->completedDeltas);
+  baton->sentDeltas = baton->completedDeltas;
+  uv_mutex_unlock(&baton->mutex);
+
+  // Hunks of these files must reach JS before the files themselves.
+  // Completing a file completes its hunks under the same lock, so this
+  // sends at least all of them.
+  WalkWorkSendHunk(&baton->asyncHunk, 0);
+
+  if (completed.empty()) {
+    return;
+  }
+
+  std::vector<Local<Object> > fileDeltasArray;
+
+  for(std::vector<GitDiffList::Delta* >::iterator iterator = completed.begin(); iterator != completed.end(); ++iterator) {
+
+    Local<Object> fileDelta = Object::New();
+    GitDiffList::Delta* delta = *iterator;
+
+    Local<Object> oldFile = Object::New();
+    oldFile->Set(String::NewSymbol("path"), String::New(delta->raw.old_file.path));
+    fileDelta->Set(String::NewSymbol("oldFile"), oldFile);
+
+    Local<Object> newFile = Object::New();
+    newFile->Set(String::NewSymbol("path"), String::New(delta->raw.new_file.path));
+    fileDelta->Set(String::NewSymbol("newFile"), newFile);
+
+    // The lines themselves already went out with the hunks, so only say
+    // how many of them belong to this file
+    uint32_t hunkCount = 0;
+    for (Hunk* hunk = delta->firstHunk; hunk != NULL; hunk = hunk->next) {
+      hunkCount++;
+    }
+    fileDelta->Set(String::NewSymbol("hunkCount"), Integer::NewFromUnsigned(hunkCount));
+    fileDelta->Set(String::NewSymbol("status"), cvv8::CastToJS(delta->raw.status));
+
+    fileDeltasArray.push_back(fileDelta);
+
+    // Let the walk thread queue another file
+    uv_sem_post(&baton->pendingSlots);
+  }
+
+  // Errors are reported once, through the end callback
+  Handle<Value> argv[2] = {
+    Local<Value>::New(Null()),
+    cvv8::CastToJS(fileDeltasArray)
+  };
+
+  TryCatch try_catch;
+  baton->fileCallback->Call(Context::GetCurrent()->Global(), 2, argv);
+  if (try_catch.HasCaught()) {
+    node::FatalException(try_catch);
+  }
+
+  // JS holds its own copies now, so free every set whose deltas are all sent
+  std::vector<WalkArenas* > released;
+  uv_mutex_lock(&baton->mutex);
+  while (!baton->retiredArenas.empty() && baton->retiredArenas.front()->endDelta <= baton->sentDeltas) {
+    released.push_back(baton->retiredArenas.front());
+    baton->retiredArenas.pop_front();
+  }
+  uv_mutex_unlock(&baton->mutex);
+
+  for (size_t i = 0; i < released.size(); i++) {
+    delete released[i];
+  }
+}
+void GitDiffList::WalkWorkSendHunk(uv_async_t *handle, int status /*UNUSED*/) {
+  HandleScope scope;
+
+  WalkBaton *baton = static_cast<WalkBaton *>(handle->data);
+
+  std::vector<GitDiffList::Hunk* > completed;
+  uv_mutex_lock(&baton->mutex);
+  completed.assign(baton->hunks.begin() + baton->sentHunks,
+                   baton->hunks.begin() + baton->completedHunks);
+  baton->sentHunks = baton->completedHunks;
+  uv_mutex_unlock(&baton->mutex);
+
+  if (completed.empty()) {
+    return;
+  }
+
+  std::vector<Local<Object> > hunksArray;
+  for (size_t i = 0; i < completed.size(); i++) {
+    Hunk* rawHunk = completed[i];
+    Local<Object> hunk = Object::New();
+
+    Local<Object> oldFile = Object::New();
+    oldFile->Set(String::NewSymbol("path"), String::New(rawHunk->oldPath));
+    hunk->Set(String::NewSymbol("oldFile"), oldFile);
+
+    Local<Object> newFile = Object::New();
+    newFile->Set(String::NewSymbol("path"), String::New(rawHunk->newPath));
+    hunk->Set(String::NewSymbol("newFile"), newFile);
+
+    hunk->Set(String::NewSymbol("header"), String::New(rawHunk->header, rawHunk->headerLength));
+    hunk->Set(String::NewSymbol("range"), rangeToObject(rawHunk->range));
+    hunk->Set(String::NewSymbol("content"), String::New(rawHunk->content ? rawHunk->content : "", rawHunk->contentLength));
+    hunk->Set(String::NewSymbol("lineOrigins"), String::New(rawHunk->lineOrigins ? rawHunk->lineOrigins : "", rawHunk->lineCount));
+    hunk->Set(String::NewSymbol("lineLengths"), createTypedArray("Uint32Array",
+      rawHunk->lineLengths, rawHunk->lineCount, sizeof(uint32_t)));
+
+    hunksArray.push_back(hunk);
+  }
+
+  Handle<Value> argv[2] = {
+    Local<Value>::New(Null()),
+    cvv8::CastToJS(hunksArray)
+  };
+
+  TryCatch try_catch;
+  baton->hunkCallback->Call(Context::GetCurrent()->Global(), 2, argv);
+  if (try_catch.HasCaught()) {
+    node::FatalException(try_catch);
+  }
+}
+void GitDiffList::WalkWorkSendEnd(uv_async_t *handle, int status /*UNUSED*/) {
+  HandleScope scope;
+
+  WalkBaton *baton = static_cast<WalkBaton *>(handle->data);
+
+  uv_thread_join(&baton->threadId);
+
+  // Async signals are coalesced and unordered between handles, so flush
+  // any deltas whose file signal has not been handled yet
+  WalkWorkSendFile(&baton->asyncFile, 0);
+
+  uv_mutex_destroy(&baton->mutex);
+  uv_sem_destroy(&baton->pendingSlots);
+  uv_close((uv_handle_t*) &baton->asyncFile, NULL);
+  uv_close((uv_handle_t*) &baton->asyncHunk, NULL);
+  uv_close((uv_handle_t*) &baton->asyncEnd, WalkFree);
+
+  Local<Value> argv[1];
+  if (baton->error.IsSet()) {
+    argv[0] = baton->error.Wrap();
+  } else {
+    argv[0] = Local<Value>::New(Null());
+  }
+
+  TryCatch try_catch;
+
+  baton->endCallback->Call(Context::GetCurrent()->Global(), 1, argv);
 
   if (try_catch.HasCaught()) {
       node::FatalException(try_catch);
   }
 }
+void GitDiffList::WalkFree(uv_handle_t *handle) {
+  WalkBaton *baton = static_cast<WalkBaton *>(handle->data);
+
+  // Whatever the walk still holds: the last set, and any retired set whose
+  // deltas were never sent because the walk failed
+  delete baton->arenas;
+  for (size_t i = 0; i < baton->retiredArenas.size(); i++) {
+    delete baton->retiredArenas[i];
+  }
+
+  baton->diffList->Unref();
+  baton->fileCallback.Dispose();
+  baton->hunkCallback.Dispose();
+  baton->endCallback.Dispose();
+  delete baton;
+}
 
 Persistent<Function> GitDiffList::constructor_template;
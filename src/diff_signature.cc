@@ -0,0 +1,219 @@
+/*
+ * Copyright 2013, Tim Branyen @tbranyen <tim@tabdeveloper.com>
+ * @author Michael Robinson @codeofinterest <mike@pagesofinterest.net>
+ *
+ * Dual licensed under the MIT and GPL licenses.
+ */
+
+#include <uv.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "git2.h"
+
+#include "../include/diff_signature.h"
+
+static const size_t CHUNK_MAX_BYTES = 64;
+
+/**
+ * Shared state for the signature worker threads. Workers claim blobs by
+ * bumping next under the mutex and write into their own result slot.
+ */
+struct ComputeJob {
+  uv_mutex_t mutex;
+  std::string path;
+  const std::vector<git_oid>* oids;
+  std::vector<DiffSignature*> results;
+  size_t next;
+  std::string error;
+};
+
+DiffSignature* DiffSignature::FromBuffer(const char* buffer, size_t length) {
+  DiffSignature* signature = new DiffSignature();
+  std::map<uint32_t, uint32_t> counts;
+
+  size_t position = 0;
+  while (position < length) {
+    // FNV-1a over one line, ignoring carriage returns so CRLF changes do
+    // not break similarity
+    uint32_t hash = 2166136261u;
+    size_t start = position;
+    while (position < length && position - start < CHUNK_MAX_BYTES) {
+      char byte = buffer[position++];
+      if (byte != '\r') {
+        hash = (hash ^ (unsigned char)byte) * 16777619u;
+      }
+      if (byte == '\n') {
+        break;
+      }
+    }
+    counts[hash] += position - start;
+  }
+
+  signature->chunks.assign(counts.begin(), counts.end());
+  signature->totalBytes = length;
+  return signature;
+}
+
+int DiffSignature::Similarity(const DiffSignature& other) const {
+  if (totalBytes == 0 && other.totalBytes == 0) {
+    return 100;
+  }
+
+  std::vector<std::pair<uint32_t, uint32_t> >::const_iterator a = chunks.begin();
+  std::vector<std::pair<uint32_t, uint32_t> >::const_iterator b = other.chunks.begin();
+  size_t common = 0;
+
+  // Both chunk lists are sorted by hash
+  while (a != chunks.end() && b != other.chunks.end()) {
+    if (a->first < b->first) {
+      ++a;
+    } else if (b->first < a->first) {
+      ++b;
+    } else {
+      common += std::min(a->second, b->second);
+      ++a;
+      ++b;
+    }
+  }
+
+  return (int)(common * 100 / std::max(totalBytes, other.totalBytes));
+}
+
+void DiffSignature::ComputeWork(void *payload) {
+  ComputeJob* job = static_cast<ComputeJob*>(payload);
+
+  // libgit2 objects must not be shared across threads, so every worker
+  // gets its own repository handle
+  git_repository* repo = NULL;
+  if (git_repository_open(&repo, job->path.c_str()) != GIT_OK) {
+    const git_error* error = giterr_last();
+    uv_mutex_lock(&job->mutex);
+    job->error = error ? error->message : "Failed to open repository";
+    job->next = job->oids->size();
+    uv_mutex_unlock(&job->mutex);
+    return;
+  }
+
+  while (true) {
+    uv_mutex_lock(&job->mutex);
+    size_t index = job->next++;
+    uv_mutex_unlock(&job->mutex);
+
+    if (index >= job->oids->size()) {
+      break;
+    }
+
+    git_blob* blob = NULL;
+    if (git_blob_lookup(&blob, repo, &(*job->oids)[index]) != GIT_OK) {
+      // Missing blobs simply get no signature; libgit2 will compute one
+      // itself if it ever needs it
+      continue;
+    }
+
+    job->results[index] = FromBuffer((const char*)git_blob_rawcontent(blob),
+                                     (size_t)git_blob_rawsize(blob));
+    git_blob_free(blob);
+  }
+
+  git_repository_free(repo);
+}
+
+int DiffSignature::ComputeAll(const std::string& path, const std::vector<git_oid>& oids,
+                              int threads, Cache& cache) {
+  ComputeJob job;
+  uv_mutex_init(&job.mutex);
+  job.path = path;
+  job.oids = &oids;
+  job.results.assign(oids.size(), (DiffSignature*)NULL);
+  job.next = 0;
+
+  if (threads < 1) {
+    threads = 1;
+  }
+  if ((size_t)threads > oids.size()) {
+    threads = oids.size() > 0 ? (int)oids.size() : 1;
+  }
+
+  std::vector<uv_thread_t> workers(threads);
+  for (int i = 0; i < threads; i++) {
+    uv_thread_create(&workers[i], ComputeWork, &job);
+  }
+  for (int i = 0; i < threads; i++) {
+    uv_thread_join(&workers[i]);
+  }
+  uv_mutex_destroy(&job.mutex);
+
+  for (size_t i = 0; i < oids.size(); i++) {
+    if (job.results[i] == NULL) {
+      continue;
+    }
+    job.results[i]->cached = true;
+    std::pair<Cache::iterator, bool> inserted = cache.insert(std::make_pair(oids[i], job.results[i]));
+    if (!inserted.second) {
+      delete job.results[i];
+    }
+  }
+
+  if (!job.error.empty()) {
+    giterr_set_str(GITERR_REPOSITORY, job.error.c_str());
+    return -1;
+  }
+  return GIT_OK;
+}
+
+void DiffSignature::FreeAll(Cache& cache) {
+  for (Cache::iterator entry = cache.begin(); entry != cache.end(); ++entry) {
+    delete entry->second;
+  }
+  cache.clear();
+}
+
+int DiffSignature::MetricFileSignature(void **out, const git_diff_file *file,
+                                       const char *fullpath, void *payload) {
+  FILE* handle = fopen(fullpath, "rb");
+  if (handle == NULL) {
+    giterr_set_str(GITERR_OS, "Failed to open file for similarity signature");
+    return -1;
+  }
+
+  std::string content;
+  char buffer[8192];
+  size_t read;
+  while ((read = fread(buffer, 1, sizeof(buffer), handle)) > 0) {
+    content.append(buffer, read);
+  }
+  fclose(handle);
+
+  *out = FromBuffer(content.data(), content.size());
+  return GIT_OK;
+}
+
+int DiffSignature::MetricBufferSignature(void **out, const git_diff_file *file,
+                                         const char *buffer, size_t length, void *payload) {
+  Cache* cache = static_cast<Cache*>(payload);
+
+  Cache::iterator cached = cache->find(file->oid);
+  if (cached != cache->end()) {
+    *out = cached->second;
+    return GIT_OK;
+  }
+
+  *out = FromBuffer(buffer, length);
+  return GIT_OK;
+}
+
+void DiffSignature::MetricFreeSignature(void *signature, void *payload) {
+  DiffSignature* rawSignature = static_cast<DiffSignature*>(signature);
+  if (rawSignature != NULL && !rawSignature->cached) {
+    delete rawSignature;
+  }
+}
+
+int DiffSignature::MetricSimilarity(int *score, void *signatureA, void *signatureB,
+                                    void *payload) {
+  *score = static_cast<DiffSignature*>(signatureA)->Similarity(
+    *static_cast<DiffSignature*>(signatureB));
+  return GIT_OK;
+}
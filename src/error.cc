@@ -100,6 +100,20 @@ Local<Object> GitError::WrapError(const git_error* error) {
   return gitError;
 }
 
+void ThreadError::Capture() {
+  const git_error* error = giterr_last();
+  isSet = true;
+  klass = error ? error->klass : GITERR_OS;
+  message = error ? error->message : "Unknown error";
+}
+
+Local<Object> ThreadError::Wrap() const {
+  git_error error;
+  error.message = const_cast<char*>(message.c_str());
+  error.klass = klass;
+  return GitError::WrapError(&error);
+}
+
 Handle<Value> GitError::New(const Arguments& args) {
   HandleScope scope;
 
@@ -0,0 +1,78 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/functions/arena.h"
+
+static const size_t ARENA_ALIGNMENT = sizeof(double) > sizeof(void*) ? sizeof(double) : sizeof(void*);
+
+Arena::Arena() : lastAllocation(NULL) {}
+
+Arena::~Arena() {
+  for (size_t i = 0; i < blocks.size(); i++) {
+    free(blocks[i].data);
+  }
+}
+
+bool Arena::AddBlock(size_t minimum) {
+  Block block;
+  block.capacity = minimum > BLOCK_SIZE ? minimum : BLOCK_SIZE;
+  block.data = (char*)malloc(block.capacity);
+  if (block.data == NULL) {
+    return false;
+  }
+  block.used = 0;
+  blocks.push_back(block);
+  return true;
+}
+
+void* Arena::Allocate(size_t size) {
+  if (blocks.empty() && !AddBlock(size)) {
+    return NULL;
+  }
+
+  Block* block = &blocks.back();
+  size_t start = (block->used + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+  if (start + size > block->capacity) {
+    if (!AddBlock(size)) {
+      return NULL;
+    }
+    block = &blocks.back();
+    start = 0;
+  }
+
+  block->used = start + size;
+  lastAllocation = block->data + start;
+  return lastAllocation;
+}
+
+void* Arena::Extend(void* data, size_t size, size_t additional) {
+  if (data == NULL) {
+    return Allocate(additional);
+  }
+
+  Block& block = blocks.back();
+  if (data == lastAllocation && block.used + additional <= block.capacity) {
+    block.used += additional;
+    return data;
+  }
+
+  // Double on every move so repeatedly growing one allocation stays
+  // amortized linear
+  size_t capacity = (size + additional) * 2;
+  if (!AddBlock(capacity)) {
+    return NULL;
+  }
+  Block& fresh = blocks.back();
+  memcpy(fresh.data, data, size);
+  fresh.used = size + additional;
+  lastAllocation = fresh.data;
+  return fresh.data;
+}
+
+size_t Arena::BytesAllocated() const {
+  size_t total = 0;
+  for (size_t i = 0; i < blocks.size(); i++) {
+    total += blocks[i].used;
+  }
+  return total;
+}
@@ -0,0 +1,544 @@
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <set>
+
+#include "../../include/functions/bitmap.h"
+#include "../../include/functions/graph.h"
+#include "../../include/functions/file.h"
+
+static const uint32_t BITMAP_SIGNATURE = 0x52424d50; // "RBMP"
+
+static const size_t HEADER_SIZE = 16;
+static const size_t FANOUT_SIZE = 256 * 4;
+static const size_t BITMAP_ENTRY_SIZE = 12;
+
+static const uint64_t WORD_CLEAN_ONES = ~(uint64_t)0;
+static const uint64_t RLW_RUN_MAX = 0xffffffff;
+static const uint64_t RLW_LITERALS_MAX = 0x7fffffff;
+
+const unsigned int ReachabilityBitmaps::DEFAULT_INTERVAL;
+
+static size_t popCount(uint64_t word) {
+  word = word - ((word >> 1) & 0x5555555555555555ULL);
+  word = (word & 0x3333333333333333ULL) + ((word >> 2) & 0x3333333333333333ULL);
+  word = (word + (word >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+  return (size_t)((word * 0x0101010101010101ULL) >> 56);
+}
+
+void Bitset::Set(size_t bit) {
+  if (bit / 64 >= words.size()) {
+    words.resize(bit / 64 + 1, 0);
+  }
+  words[bit / 64] |= (uint64_t)1 << (bit % 64);
+}
+
+bool Bitset::Get(size_t bit) const {
+  return bit / 64 < words.size() && (words[bit / 64] & ((uint64_t)1 << (bit % 64))) != 0;
+}
+
+void Bitset::Or(const Bitset& other) {
+  if (other.words.size() > words.size()) {
+    words.resize(other.words.size(), 0);
+  }
+  for (size_t i = 0; i < other.words.size(); i++) {
+    words[i] |= other.words[i];
+  }
+}
+
+void Bitset::AndNot(const Bitset& other) {
+  size_t shared = std::min(words.size(), other.words.size());
+  for (size_t i = 0; i < shared; i++) {
+    words[i] &= ~other.words[i];
+  }
+}
+
+size_t Bitset::Count() const {
+  size_t count = 0;
+  for (size_t i = 0; i < words.size(); i++) {
+    count += popCount(words[i]);
+  }
+  return count;
+}
+
+size_t Bitset::CountAnd(const Bitset& mask) const {
+  size_t count = 0;
+  size_t shared = std::min(words.size(), mask.words.size());
+  for (size_t i = 0; i < shared; i++) {
+    count += popCount(words[i] & mask.words[i]);
+  }
+  return count;
+}
+
+void ewahCompress(const Bitset& bits, uint32_t bitSize, std::vector<unsigned char>& out) {
+  size_t wordCount = ((size_t)bitSize + 63) / 64;
+  std::vector<uint64_t> words;
+  size_t lastRunLength = 0;
+
+  // Each run-length word covers a run of clean words (all zeros or all
+  // ones) and counts the literal words that follow it
+  size_t i = 0;
+  do {
+    lastRunLength = words.size();
+    words.push_back(0);
+
+    uint64_t runBit = 0;
+    uint64_t run = 0;
+    uint64_t literals = 0;
+    while (i < wordCount) {
+      uint64_t word = i < bits.words.size() ? bits.words[i] : 0;
+      if (i + 1 == wordCount && bitSize % 64 != 0) {
+        word &= ((uint64_t)1 << (bitSize % 64)) - 1;
+      }
+      bool clean = word == 0 || word == WORD_CLEAN_ONES;
+      if (clean && literals == 0 && run < RLW_RUN_MAX && (run == 0 || (word != 0) == (runBit != 0))) {
+        runBit = word != 0 ? 1 : 0;
+        run++;
+      } else if (!clean && literals < RLW_LITERALS_MAX) {
+        words.push_back(word);
+        literals++;
+      } else {
+        break;
+      }
+      i++;
+    }
+    words[lastRunLength] = runBit | (run << 1) | (literals << 33);
+  } while (i < wordCount);
+
+  putBigEndian32(out, bitSize);
+  putBigEndian32(out, (uint32_t)words.size());
+  for (size_t j = 0; j < words.size(); j++) {
+    putBigEndian64(out, words[j]);
+  }
+  putBigEndian32(out, (uint32_t)lastRunLength);
+}
+
+bool ewahExpand(const unsigned char* data, size_t length, Bitset& out, size_t* used) {
+  if (length < 8) {
+    return false;
+  }
+  uint32_t bitSize = getBigEndian32(data);
+  uint32_t wordCount = getBigEndian32(data + 4);
+  if (8 + (uint64_t)wordCount * 8 + 4 > length) {
+    return false;
+  }
+
+  size_t expanded = ((size_t)bitSize + 63) / 64;
+  const unsigned char* words = data + 8;
+  out.words.clear();
+  out.words.reserve(expanded);
+  for (uint32_t i = 0; i < wordCount;) {
+    uint64_t runLength = getBigEndian64(words + (size_t)i * 8);
+    uint64_t run = (runLength >> 1) & RLW_RUN_MAX;
+    uint64_t literals = runLength >> 33;
+    i++;
+    if (i + literals > wordCount || out.words.size() + run + literals > expanded) {
+      return false;
+    }
+    out.words.resize(out.words.size() + run, (runLength & 1) ? WORD_CLEAN_ONES : 0);
+    for (uint64_t j = 0; j < literals; j++, i++) {
+      out.words.push_back(getBigEndian64(words + (size_t)i * 8));
+    }
+  }
+
+  *used = 8 + (size_t)wordCount * 8 + 4;
+  return true;
+}
+
+ReachabilityBitmaps::ReachabilityBitmaps()
+  : map(NULL), mapLength(0), count(0), bitmapCount(0), fanout(NULL), oids(NULL),
+    sortedPositions(NULL), positionIndexes(NULL), bitmapTable(NULL), walked(0) {
+}
+
+ReachabilityBitmaps::~ReachabilityBitmaps() {
+  Close();
+}
+
+std::string ReachabilityBitmaps::Path(const std::string& repoPath) {
+  return repoPath + "objects/info/reachability.bitmap";
+}
+
+int ReachabilityBitmaps::Open(const std::string& repoPath) {
+  Close();
+
+  std::string path = Path(repoPath);
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    if (errno == ENOENT) {
+      return GIT_OK;
+    }
+    setOsError("Failed to open", path);
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    setOsError("Failed to stat", path);
+    close(fd);
+    return -1;
+  }
+  if ((size_t)st.st_size < HEADER_SIZE + FANOUT_SIZE + 20) {
+    close(fd);
+    giterr_set_str(GITERR_ODB, "Reachability bitmaps are too short");
+    return -1;
+  }
+
+  void* mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    setOsError("Failed to map", path);
+    return -1;
+  }
+  map = static_cast<const unsigned char*>(mapped);
+  mapLength = st.st_size;
+
+  const char* invalid = NULL;
+  size_t end = mapLength - 20;
+  count = getBigEndian32(map + 8);
+  bitmapCount = getBigEndian32(map + 12);
+  fanout = map + HEADER_SIZE;
+  size_t offset = HEADER_SIZE + FANOUT_SIZE + (size_t)count * (GIT_OID_RAWSZ + 8);
+  if (getBigEndian32(map) != BITMAP_SIGNATURE || map[4] != 1) {
+    invalid = "Not version 1 reachability bitmaps";
+  } else if (getBigEndian32(fanout + FANOUT_SIZE - 4) != count || offset > end) {
+    invalid = "Reachability bitmap object table is truncated";
+  } else if (!fanoutValid(fanout, count)) {
+    invalid = "Reachability bitmap fanout is corrupt";
+  } else {
+    oids = fanout + FANOUT_SIZE;
+    sortedPositions = oids + (size_t)count * GIT_OID_RAWSZ;
+    positionIndexes = sortedPositions + (size_t)count * 4;
+  }
+  for (uint32_t i = 0; invalid == NULL && i < count; i++) {
+    if (getBigEndian32(sortedPositions + (size_t)i * 4) >= count ||
+        getBigEndian32(positionIndexes + (size_t)i * 4) >= count) {
+      invalid = "Reachability bitmap object table is corrupt";
+    }
+  }
+
+  for (int type = 0; invalid == NULL && type < TYPE_COUNT; type++) {
+    size_t used;
+    if (!ewahExpand(map + offset, end - offset, types[type], &used)) {
+      invalid = "Reachability bitmap type index is corrupt";
+    }
+    offset += used;
+  }
+  if (invalid == NULL && offset + (size_t)bitmapCount * BITMAP_ENTRY_SIZE > end) {
+    invalid = "Reachability bitmap table is truncated";
+  }
+
+  if (invalid != NULL) {
+    Close();
+    giterr_set_str(GITERR_ODB, invalid);
+    return -1;
+  }
+  bitmapTable = map + offset;
+  return GIT_OK;
+}
+
+void ReachabilityBitmaps::Close() {
+  if (map != NULL) {
+    munmap(const_cast<unsigned char*>(map), mapLength);
+  }
+  map = NULL;
+  mapLength = 0;
+  count = 0;
+  bitmapCount = 0;
+  fanout = NULL;
+  oids = NULL;
+  sortedPositions = NULL;
+  positionIndexes = NULL;
+  bitmapTable = NULL;
+  for (int type = 0; type < TYPE_COUNT; type++) {
+    types[type].words.clear();
+  }
+  extras.clear();
+  extraPositions.clear();
+  built.clear();
+  walked = 0;
+}
+
+uint32_t ReachabilityBitmaps::Count() const {
+  return count;
+}
+
+size_t ReachabilityBitmaps::Known() const {
+  return count + extras.size();
+}
+
+uint32_t ReachabilityBitmaps::Bitmaps() const {
+  return bitmapCount + built.size();
+}
+
+size_t ReachabilityBitmaps::Walked() const {
+  return walked;
+}
+
+bool ReachabilityBitmaps::Find(const git_oid* oid, uint32_t* position) const {
+  if (count > 0) {
+    unsigned char first = oid->id[0];
+    uint32_t low = first == 0 ? 0 : getBigEndian32(fanout + (first - 1) * 4);
+    uint32_t high = getBigEndian32(fanout + first * 4);
+    while (low < high) {
+      uint32_t middle = low + (high - low) / 2;
+      int cmp = memcmp(oids + (size_t)middle * GIT_OID_RAWSZ, oid->id, GIT_OID_RAWSZ);
+      if (cmp == 0) {
+        *position = getBigEndian32(sortedPositions + (size_t)middle * 4);
+        return true;
+      } else if (cmp < 0) {
+        low = middle + 1;
+      } else {
+        high = middle;
+      }
+    }
+  }
+
+  std::map<git_oid, uint32_t, OidLess>::const_iterator extra = extraPositions.find(*oid);
+  if (extra != extraPositions.end()) {
+    *position = extra->second;
+    return true;
+  }
+  return false;
+}
+
+void ReachabilityBitmaps::Oid(uint32_t position, git_oid* out) const {
+  if (position < count) {
+    uint32_t index = getBigEndian32(positionIndexes + (size_t)position * 4);
+    git_oid_fromraw(out, oids + (size_t)index * GIT_OID_RAWSZ);
+  } else {
+    git_oid_cpy(out, &extras[position - count]);
+  }
+}
+
+void ReachabilityBitmaps::TypeMask(ObjectType type, Bitset& out) const {
+  out = types[type];
+}
+
+uint32_t ReachabilityBitmaps::FindOrAdd(const git_oid* oid, ObjectType type) {
+  uint32_t position;
+  if (!Find(oid, &position)) {
+    position = count + extras.size();
+    extras.push_back(*oid);
+    extraPositions[*oid] = position;
+    types[type].Set(position);
+  }
+  return position;
+}
+
+bool ReachabilityBitmaps::Bitmap(uint32_t position, Bitset& out) const {
+  std::map<uint32_t, std::vector<unsigned char> >::const_iterator local = built.find(position);
+  if (local != built.end()) {
+    size_t used;
+    return ewahExpand(&local->second[0], local->second.size(), out, &used);
+  }
+
+  uint32_t low = 0;
+  uint32_t high = bitmapCount;
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    const unsigned char* entry = bitmapTable + (size_t)middle * BITMAP_ENTRY_SIZE;
+    uint32_t entryPosition = getBigEndian32(entry);
+    if (entryPosition == position) {
+      uint64_t offset = getBigEndian64(entry + 4);
+      size_t used;
+      return offset < mapLength - 20 && ewahExpand(map + offset, mapLength - 20 - offset, out, &used);
+    } else if (entryPosition < position) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return false;
+}
+
+int ReachabilityBitmaps::MarkTree(git_repository* repo, const git_oid* treeOid, Bitset& out) {
+  std::vector<git_oid> stack(1, *treeOid);
+  while (!stack.empty()) {
+    git_oid oid = stack.back();
+    stack.pop_back();
+
+    // A tree that is already set has everything below it set too
+    uint32_t position = FindOrAdd(&oid, TYPE_TREE);
+    if (out.Get(position)) {
+      continue;
+    }
+
+    git_tree* tree = NULL;
+    int returnCode = git_tree_lookup(&tree, repo, &oid);
+    if (returnCode != GIT_OK) {
+      return returnCode;
+    }
+    out.Set(position);
+
+    size_t entries = git_tree_entrycount(tree);
+    for (size_t i = 0; i < entries; i++) {
+      const git_tree_entry* entry = git_tree_entry_byindex(tree, i);
+      if (git_tree_entry_type(entry) == GIT_OBJ_TREE) {
+        stack.push_back(*git_tree_entry_id(entry));
+      } else if (git_tree_entry_type(entry) == GIT_OBJ_BLOB) {
+        out.Set(FindOrAdd(git_tree_entry_id(entry), TYPE_BLOB));
+      }
+    }
+    git_tree_free(tree);
+  }
+  return GIT_OK;
+}
+
+int ReachabilityBitmaps::Reachable(git_repository* repo, const std::vector<git_oid>& tips, Bitset& out) {
+  out.words.clear();
+
+  std::vector<git_oid> stack(tips);
+  std::vector<git_oid> trees;
+  Bitset bitmap;
+  while (!stack.empty()) {
+    git_oid oid = stack.back();
+    stack.pop_back();
+
+    uint32_t position = FindOrAdd(&oid, TYPE_COMMIT);
+    if (out.Get(position)) {
+      continue;
+    }
+    if (Bitmap(position, bitmap)) {
+      out.Or(bitmap);
+      continue;
+    }
+
+    git_commit* commit = NULL;
+    int returnCode = git_commit_lookup(&commit, repo, &oid);
+    if (returnCode != GIT_OK) {
+      return returnCode;
+    }
+    out.Set(position);
+    walked++;
+
+    trees.push_back(*git_commit_tree_id(commit));
+    unsigned int parentCount = git_commit_parentcount(commit);
+    for (unsigned int i = 0; i < parentCount; i++) {
+      stack.push_back(*git_commit_parent_id(commit, i));
+    }
+    git_commit_free(commit);
+  }
+
+  // Trees go last so that those under a bitmap are skipped
+  for (size_t i = 0; i < trees.size(); i++) {
+    int returnCode = MarkTree(repo, &trees[i], out);
+    if (returnCode != GIT_OK) {
+      return returnCode;
+    }
+  }
+  return GIT_OK;
+}
+
+int ReachabilityBitmaps::Write(git_repository* repo, unsigned int interval, size_t* objects, size_t* bitmaps) {
+  std::vector<git_oid> tips;
+  int returnCode = commitTips(repo, tips);
+  if (returnCode != GIT_OK) {
+    return returnCode;
+  }
+
+  // Select oldest first, so every bitmap can start from the ones below it
+  std::vector<git_oid> selected;
+  git_revwalk* walk = NULL;
+  returnCode = git_revwalk_new(&walk, repo);
+  if (returnCode == GIT_OK) {
+    git_revwalk_sorting(walk, GIT_SORT_TOPOLOGICAL | GIT_SORT_REVERSE);
+  }
+  for (size_t i = 0; i < tips.size() && returnCode == GIT_OK; i++) {
+    returnCode = git_revwalk_push(walk, &tips[i]);
+  }
+  std::set<git_oid, OidLess> tipSet(tips.begin(), tips.end());
+  git_oid oid;
+  for (size_t walkedCount = 1; returnCode == GIT_OK && (returnCode = git_revwalk_next(&oid, walk)) == GIT_OK; walkedCount++) {
+    if ((interval > 0 && walkedCount % interval == 0) || tipSet.count(oid) > 0) {
+      selected.push_back(oid);
+    }
+  }
+  git_revwalk_free(walk);
+  if (returnCode != GIT_ITEROVER) {
+    return returnCode;
+  }
+
+  // Build in memory: every object is an extra, numbered as it is found
+  ReachabilityBitmaps index;
+  for (size_t i = 0; i < selected.size(); i++) {
+    Bitset bits;
+    returnCode = index.Reachable(repo, std::vector<git_oid>(1, selected[i]), bits);
+    if (returnCode != GIT_OK) {
+      return returnCode;
+    }
+    uint32_t position;
+    index.Find(&selected[i], &position);
+    ewahCompress(bits, (uint32_t)index.Known(), index.built[position]);
+  }
+
+  uint32_t objectCount = index.extras.size();
+  std::vector<uint32_t> sorted(objectCount);
+  for (uint32_t i = 0; i < objectCount; i++) {
+    sorted[i] = i;
+  }
+  PositionOidLess byOid = { &index.extras };
+  std::sort(sorted.begin(), sorted.end(), byOid);
+
+  std::vector<unsigned char> file;
+  putBigEndian32(file, BITMAP_SIGNATURE);
+  file.push_back(1);
+  file.push_back(0);
+  file.push_back(0);
+  file.push_back(0);
+  putBigEndian32(file, objectCount);
+  putBigEndian32(file, (uint32_t)index.built.size());
+
+  uint32_t fanoutCounts[256] = { 0 };
+  for (uint32_t i = 0; i < objectCount; i++) {
+    fanoutCounts[index.extras[i].id[0]]++;
+  }
+  uint32_t cumulative = 0;
+  for (int i = 0; i < 256; i++) {
+    cumulative += fanoutCounts[i];
+    putBigEndian32(file, cumulative);
+  }
+  for (uint32_t i = 0; i < objectCount; i++) {
+    const git_oid& sortedOid = index.extras[sorted[i]];
+    file.insert(file.end(), sortedOid.id, sortedOid.id + GIT_OID_RAWSZ);
+  }
+  std::vector<uint32_t> indexes(objectCount);
+  for (uint32_t i = 0; i < objectCount; i++) {
+    putBigEndian32(file, sorted[i]);
+    indexes[sorted[i]] = i;
+  }
+  for (uint32_t i = 0; i < objectCount; i++) {
+    putBigEndian32(file, indexes[i]);
+  }
+  for (int type = 0; type < TYPE_COUNT; type++) {
+    ewahCompress(index.types[type], objectCount, file);
+  }
+
+  uint64_t offset = file.size() + index.built.size() * BITMAP_ENTRY_SIZE;
+  std::map<uint32_t, std::vector<unsigned char> >::const_iterator entry;
+  for (entry = index.built.begin(); entry != index.built.end(); ++entry) {
+    putBigEndian32(file, entry->first);
+    putBigEndian64(file, offset);
+    offset += entry->second.size();
+  }
+  for (entry = index.built.begin(); entry != index.built.end(); ++entry) {
+    file.insert(file.end(), entry->second.begin(), entry->second.end());
+  }
+  appendChecksum(file);
+
+  std::string repoPath = git_repository_path(repo);
+  std::string path = Path(repoPath);
+  mkdir((repoPath + "objects/info").c_str(), 0777);
+  if (writeFileAtomically(path, file) != GIT_OK) {
+    return -1;
+  }
+
+  *objects = objectCount;
+  *bitmaps = index.built.size();
+  return GIT_OK;
+}
@@ -0,0 +1,508 @@
+#include <uv.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <set>
+
+#include "../../include/functions/bloom.h"
+#include "../../include/functions/graph.h"
+#include "../../include/functions/file.h"
+
+static const uint32_t BLOOM_SIGNATURE = 0x43504246; // "CPBF"
+static const uint32_t BLOOM_SEED_ONE = 0x293ae76f;
+static const uint32_t BLOOM_SEED_TWO = 0x7e646e2c;
+
+static const size_t HEADER_SIZE = 12;
+static const size_t FANOUT_SIZE = 256 * 4;
+
+const unsigned int BloomKey::HASH_COUNT;
+const uint32_t BloomFilters::BITS_PER_ENTRY;
+const size_t BloomFilters::MAX_CHANGED_PATHS;
+
+/**
+ * A filter to write: either one already in the file or a new one.
+ */
+struct BloomEntry {
+  git_oid oid;
+  const unsigned char* filter;
+  size_t length;
+};
+
+static bool entryOidLess(const BloomEntry& a, const BloomEntry& b) {
+  return git_oid_cmp(&a.oid, &b.oid) < 0;
+}
+
+/**
+ * Shared state for the filter worker threads. Workers claim commits by
+ * bumping next under the mutex and write into their own filter slot.
+ */
+struct BuildJob {
+  uv_mutex_t mutex;
+  std::string path;
+  const std::vector<git_oid>* oids;
+  std::vector<std::vector<unsigned char> > filters;
+  size_t next;
+  std::string error;
+};
+
+static uint32_t rotateLeft(uint32_t value, int bits) {
+  return (value << bits) | (value >> (32 - bits));
+}
+
+/**
+ * MurmurHash3 (x86, 32 bit), the hash git uses for changed-path filters.
+ * Path bytes are read unsigned, as in git's version 2 filters; version 1
+ * filters read them as signed char, so they differ for non-ASCII paths.
+ */
+static uint32_t murmur3(uint32_t seed, const unsigned char* data, size_t length) {
+  const uint32_t c1 = 0xcc9e2d51;
+  const uint32_t c2 = 0x1b873593;
+  uint32_t hash = seed;
+
+  size_t blocks = length / 4;
+  for (size_t i = 0; i < blocks; i++) {
+    const unsigned char* block = data + i * 4;
+    uint32_t k = (uint32_t)block[0] | ((uint32_t)block[1] << 8) |
+                 ((uint32_t)block[2] << 16) | ((uint32_t)block[3] << 24);
+    k *= c1;
+    k = rotateLeft(k, 15);
+    k *= c2;
+    hash ^= k;
+    hash = rotateLeft(hash, 13);
+    hash = hash * 5 + 0xe6546b64;
+  }
+
+  const unsigned char* tail = data + blocks * 4;
+  uint32_t k = 0;
+  switch (length & 3) {
+    case 3:
+      k ^= (uint32_t)tail[2] << 16;
+      // fallthrough
+    case 2:
+      k ^= (uint32_t)tail[1] << 8;
+      // fallthrough
+    case 1:
+      k ^= tail[0];
+      k *= c1;
+      k = rotateLeft(k, 15);
+      k *= c2;
+      hash ^= k;
+  }
+
+  hash ^= (uint32_t)length;
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6b;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35;
+  hash ^= hash >> 16;
+  return hash;
+}
+
+BloomKey::BloomKey(const std::string& path) {
+  const unsigned char* data = reinterpret_cast<const unsigned char*>(path.data());
+  uint32_t one = murmur3(BLOOM_SEED_ONE, data, path.size());
+  uint32_t two = murmur3(BLOOM_SEED_TWO, data, path.size());
+  for (unsigned int i = 0; i < HASH_COUNT; i++) {
+    hashes[i] = one + i * two;
+  }
+}
+
+BloomFilters::BloomFilters()
+  : map(NULL), mapLength(0), count(0), fanout(NULL), oids(NULL), ends(NULL), data(NULL), dataLength(0) {
+}
+
+BloomFilters::~BloomFilters() {
+  Close();
+}
+
+std::string BloomFilters::Path(const std::string& repoPath) {
+  return repoPath + "objects/info/commit-graph.bloom";
+}
+
+int BloomFilters::Open(const std::string& repoPath) {
+  Close();
+
+  std::string path = Path(repoPath);
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    if (errno == ENOENT) {
+      return GIT_OK;
+    }
+    setOsError("Failed to open", path);
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    setOsError("Failed to stat", path);
+    close(fd);
+    return -1;
+  }
+  if ((size_t)st.st_size < HEADER_SIZE + FANOUT_SIZE + 20) {
+    close(fd);
+    giterr_set_str(GITERR_ODB, "Changed-path filters are too short");
+    return -1;
+  }
+
+  void* mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    setOsError("Failed to map", path);
+    return -1;
+  }
+  map = static_cast<const unsigned char*>(mapped);
+  mapLength = st.st_size;
+
+  const char* invalid = NULL;
+  count = getBigEndian32(map + 8);
+  fanout = map + HEADER_SIZE;
+  size_t tablesEnd = HEADER_SIZE + FANOUT_SIZE + (size_t)count * (GIT_OID_RAWSZ + 4);
+  if (getBigEndian32(map) != BLOOM_SIGNATURE || map[4] != 1) {
+    invalid = "Not version 1 changed-path filters";
+  } else if (map[5] != BloomKey::HASH_COUNT || map[6] != BITS_PER_ENTRY) {
+    invalid = "Changed-path filters use unsupported hash settings";
+  } else if (getBigEndian32(fanout + FANOUT_SIZE - 4) != count || tablesEnd > mapLength - 20) {
+    invalid = "Changed-path filter table is truncated";
+  } else if (!fanoutValid(fanout, count)) {
+    invalid = "Changed-path filter fanout is corrupt";
+  } else {
+    oids = fanout + FANOUT_SIZE;
+    ends = oids + (size_t)count * GIT_OID_RAWSZ;
+    data = map + tablesEnd;
+    dataLength = mapLength - 20 - tablesEnd;
+    if (count > 0 && getBigEndian32(ends + ((size_t)count - 1) * 4) != dataLength) {
+      invalid = "Changed-path filter data is truncated";
+    }
+  }
+
+  if (invalid != NULL) {
+    Close();
+    giterr_set_str(GITERR_ODB, invalid);
+    return -1;
+  }
+  return GIT_OK;
+}
+
+void BloomFilters::Close() {
+  if (map != NULL) {
+    munmap(const_cast<unsigned char*>(map), mapLength);
+  }
+  map = NULL;
+  mapLength = 0;
+  count = 0;
+  fanout = NULL;
+  oids = NULL;
+  ends = NULL;
+  data = NULL;
+  dataLength = 0;
+}
+
+uint32_t BloomFilters::Count() const {
+  return count;
+}
+
+bool BloomFilters::Find(const git_oid* oid, uint32_t* position) const {
+  if (count == 0) {
+    return false;
+  }
+
+  unsigned char first = oid->id[0];
+  uint32_t low = first == 0 ? 0 : getBigEndian32(fanout + (first - 1) * 4);
+  uint32_t high = getBigEndian32(fanout + first * 4);
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    int cmp = memcmp(oids + (size_t)middle * GIT_OID_RAWSZ, oid->id, GIT_OID_RAWSZ);
+    if (cmp == 0) {
+      *position = middle;
+      return true;
+    } else if (cmp < 0) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return false;
+}
+
+void BloomFilters::Oid(uint32_t position, git_oid* out) const {
+  git_oid_fromraw(out, oids + (size_t)position * GIT_OID_RAWSZ);
+}
+
+bool BloomFilters::Filter(uint32_t position, const unsigned char** filter, size_t* length) const {
+  uint32_t start = position == 0 ? 0 : getBigEndian32(ends + ((size_t)position - 1) * 4);
+  uint32_t end = getBigEndian32(ends + (size_t)position * 4);
+  if (start > end || end > dataLength) {
+    return false;
+  }
+  *filter = data + start;
+  *length = end - start;
+  return true;
+}
+
+bool BloomFilters::MayChange(uint32_t position, const std::vector<BloomKey>& keys) const {
+  const unsigned char* filter;
+  size_t length;
+  if (!Filter(position, &filter, &length) || length == 0) {
+    return true;
+  }
+
+  uint64_t bits = (uint64_t)length * 8;
+  for (size_t i = 0; i < keys.size(); i++) {
+    bool present = true;
+    for (unsigned int j = 0; j < BloomKey::HASH_COUNT && present; j++) {
+      uint64_t bit = keys[i].hashes[j] % bits;
+      present = (filter[bit / 8] & (1 << (bit % 8))) != 0;
+    }
+    if (present) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static int collectPath(const git_diff_delta *delta, float progress, void *payload) {
+  std::set<std::string>* paths = static_cast<std::set<std::string> *>(payload);
+  if (delta->old_file.path != NULL) {
+    paths->insert(delta->old_file.path);
+  }
+  if (delta->new_file.path != NULL) {
+    paths->insert(delta->new_file.path);
+  }
+  return GIT_OK;
+}
+
+int BloomFilters::Compute(git_repository* repo, const git_oid* oid, std::vector<unsigned char>& filter) {
+  git_commit* commit = NULL;
+  git_commit* parent = NULL;
+  git_tree* tree = NULL;
+  git_tree* parentTree = NULL;
+  git_diff_list* diff = NULL;
+  std::set<std::string> paths;
+
+  int returnCode = git_commit_lookup(&commit, repo, oid);
+  if (returnCode == GIT_OK) {
+    returnCode = git_commit_tree(&tree, commit);
+  }
+  if (returnCode == GIT_OK && git_commit_parentcount(commit) > 0) {
+    returnCode = git_commit_parent(&parent, commit, 0);
+    if (returnCode == GIT_OK) {
+      returnCode = git_commit_tree(&parentTree, parent);
+    }
+  }
+  if (returnCode == GIT_OK) {
+    returnCode = git_diff_tree_to_tree(&diff, repo, parentTree, tree, NULL);
+  }
+  if (returnCode == GIT_OK) {
+    returnCode = git_diff_foreach(diff, collectPath, NULL, NULL, &paths);
+  }
+
+  git_diff_list_free(diff);
+  git_tree_free(parentTree);
+  git_tree_free(tree);
+  git_commit_free(parent);
+  git_commit_free(commit);
+  if (returnCode != GIT_OK) {
+    return returnCode;
+  }
+
+  // Directories are added too, so a walk limited to one only has to test
+  // a single key
+  std::set<std::string> keys;
+  for (std::set<std::string>::const_iterator path = paths.begin(); path != paths.end(); ++path) {
+    keys.insert(*path);
+    for (size_t slash = path->find('/'); slash != std::string::npos; slash = path->find('/', slash + 1)) {
+      keys.insert(path->substr(0, slash));
+    }
+  }
+
+  // One empty byte matches nothing, one full byte matches everything
+  if (keys.empty()) {
+    filter.assign(1, 0);
+    return GIT_OK;
+  }
+  if (keys.size() > MAX_CHANGED_PATHS) {
+    filter.assign(1, 0xff);
+    return GIT_OK;
+  }
+
+  filter.assign((keys.size() * BITS_PER_ENTRY + 7) / 8, 0);
+  uint64_t bits = (uint64_t)filter.size() * 8;
+  for (std::set<std::string>::const_iterator path = keys.begin(); path != keys.end(); ++path) {
+    BloomKey key(*path);
+    for (unsigned int i = 0; i < BloomKey::HASH_COUNT; i++) {
+      uint64_t bit = key.hashes[i] % bits;
+      filter[bit / 8] |= (unsigned char)(1 << (bit % 8));
+    }
+  }
+  return GIT_OK;
+}
+
+static void buildWork(void *payload) {
+  BuildJob* job = static_cast<BuildJob*>(payload);
+
+  git_repository* repo = NULL;
+  if (git_repository_open(&repo, job->path.c_str()) != GIT_OK) {
+    const git_error* error = giterr_last();
+    uv_mutex_lock(&job->mutex);
+    job->error = error ? error->message : "Failed to open repository";
+    job->next = job->oids->size();
+    uv_mutex_unlock(&job->mutex);
+    return;
+  }
+
+  while (true) {
+    uv_mutex_lock(&job->mutex);
+    size_t index = job->next++;
+    uv_mutex_unlock(&job->mutex);
+
+    if (index >= job->oids->size()) {
+      break;
+    }
+
+    if (BloomFilters::Compute(repo, &(*job->oids)[index], job->filters[index]) != GIT_OK) {
+      const git_error* error = giterr_last();
+      uv_mutex_lock(&job->mutex);
+      if (job->error.empty()) {
+        job->error = error ? error->message : "Failed to diff commit";
+      }
+      job->next = job->oids->size();
+      uv_mutex_unlock(&job->mutex);
+      break;
+    }
+  }
+
+  git_repository_free(repo);
+}
+
+int BloomFilters::Write(git_repository* repo, int threads, size_t* added, size_t* commits) {
+  std::string repoPath = git_repository_path(repo);
+
+  // Invalid filters are rebuilt from scratch
+  BloomFilters existing;
+  if (existing.Open(repoPath) != GIT_OK) {
+    giterr_clear();
+  }
+
+  std::vector<git_oid> stack;
+  int returnCode = commitTips(repo, stack);
+  if (returnCode != GIT_OK) {
+    return returnCode;
+  }
+
+  std::vector<git_oid> missing;
+  std::set<git_oid, OidLess> seen;
+  uint32_t position;
+  while (!stack.empty()) {
+    git_oid oid = stack.back();
+    stack.pop_back();
+    if (existing.Find(&oid, &position) || !seen.insert(oid).second) {
+      continue;
+    }
+    missing.push_back(oid);
+
+    git_commit* commit = NULL;
+    returnCode = git_commit_lookup(&commit, repo, &oid);
+    if (returnCode != GIT_OK) {
+      return returnCode;
+    }
+    unsigned int parentCount = git_commit_parentcount(commit);
+    for (unsigned int i = 0; i < parentCount; i++) {
+      stack.push_back(*git_commit_parent_id(commit, i));
+    }
+    git_commit_free(commit);
+  }
+
+  *added = missing.size();
+  *commits = existing.Count() + missing.size();
+  if (missing.empty() && existing.Count() > 0) {
+    return GIT_OK;
+  }
+
+  BuildJob job;
+  uv_mutex_init(&job.mutex);
+  job.path = repoPath;
+  job.oids = &missing;
+  job.filters.resize(missing.size());
+  job.next = 0;
+
+  if (threads < 1) {
+    threads = 1;
+  }
+  if ((size_t)threads > missing.size()) {
+    threads = missing.size() > 0 ? (int)missing.size() : 1;
+  }
+
+  std::vector<uv_thread_t> workers(threads);
+  for (int i = 0; i < threads; i++) {
+    uv_thread_create(&workers[i], buildWork, &job);
+  }
+  for (int i = 0; i < threads; i++) {
+    uv_thread_join(&workers[i]);
+  }
+  uv_mutex_destroy(&job.mutex);
+
+  if (!job.error.empty()) {
+    giterr_set_str(GITERR_REPOSITORY, job.error.c_str());
+    return -1;
+  }
+
+  std::vector<BloomEntry> entries;
+  entries.reserve(*commits);
+  for (uint32_t i = 0; i < existing.Count(); i++) {
+    BloomEntry entry;
+    existing.Oid(i, &entry.oid);
+    if (!existing.Filter(i, &entry.filter, &entry.length)) {
+      entry.filter = NULL;
+      entry.length = 0;
+    }
+    entries.push_back(entry);
+  }
+  for (size_t i = 0; i < missing.size(); i++) {
+    BloomEntry entry;
+    git_oid_cpy(&entry.oid, &missing[i]);
+    entry.filter = &job.filters[i][0];
+    entry.length = job.filters[i].size();
+    entries.push_back(entry);
+  }
+  std::sort(entries.begin(), entries.end(), entryOidLess);
+
+  std::vector<unsigned char> file;
+  putBigEndian32(file, BLOOM_SIGNATURE);
+  file.push_back(1);
+  file.push_back((unsigned char)BloomKey::HASH_COUNT);
+  file.push_back((unsigned char)BITS_PER_ENTRY);
+  file.push_back(0);
+  putBigEndian32(file, (uint32_t)entries.size());
+
+  uint32_t fanoutCounts[256] = { 0 };
+  for (size_t i = 0; i < entries.size(); i++) {
+    fanoutCounts[entries[i].oid.id[0]]++;
+  }
+  uint32_t cumulative = 0;
+  for (int i = 0; i < 256; i++) {
+    cumulative += fanoutCounts[i];
+    putBigEndian32(file, cumulative);
+  }
+  for (size_t i = 0; i < entries.size(); i++) {
+    file.insert(file.end(), entries[i].oid.id, entries[i].oid.id + GIT_OID_RAWSZ);
+  }
+  uint32_t end = 0;
+  for (size_t i = 0; i < entries.size(); i++) {
+    end += entries[i].length;
+    putBigEndian32(file, end);
+  }
+  for (size_t i = 0; i < entries.size(); i++) {
+    file.insert(file.end(), entries[i].filter, entries[i].filter + entries[i].length);
+  }
+  appendChecksum(file);
+
+  std::string path = Path(repoPath);
+  mkdir((repoPath + "objects/info").c_str(), 0777);
+  return writeFileAtomically(path, file);
+}
@@ -0,0 +1,82 @@
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../../include/functions/file.h"
+#include "../../include/functions/pack.h"
+#include "../../include/functions/sha1.h"
+
+uint32_t getBigEndian32(const unsigned char* in) {
+  return ((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16) | ((uint32_t)in[2] << 8) | in[3];
+}
+
+uint64_t getBigEndian64(const unsigned char* in) {
+  return ((uint64_t)getBigEndian32(in) << 32) | getBigEndian32(in + 4);
+}
+
+void putBigEndian32(std::vector<unsigned char>& out, uint32_t value) {
+  out.push_back((unsigned char)(value >> 24));
+  out.push_back((unsigned char)(value >> 16));
+  out.push_back((unsigned char)(value >> 8));
+  out.push_back((unsigned char)value);
+}
+
+void putBigEndian64(std::vector<unsigned char>& out, uint64_t value) {
+  putBigEndian32(out, (uint32_t)(value >> 32));
+  putBigEndian32(out, (uint32_t)value);
+}
+
+bool fanoutValid(const unsigned char* fanout, uint32_t count) {
+  uint32_t previous = 0;
+  for (int i = 0; i < 256; i++) {
+    uint32_t current = getBigEndian32(fanout + i * 4);
+    if (current < previous) {
+      return false;
+    }
+    previous = current;
+  }
+  return previous == count;
+}
+
+void appendChecksum(std::vector<unsigned char>& bytes) {
+  unsigned char checksum[Sha1::DIGEST_SIZE];
+  Sha1 sha1;
+  sha1.Update(&bytes[0], bytes.size());
+  sha1.Final(checksum);
+  bytes.insert(bytes.end(), checksum, checksum + Sha1::DIGEST_SIZE);
+}
+
+void setOsError(const std::string& action, const std::string& path) {
+  std::string message = action + " '" + path + "': " + strerror(errno);
+  giterr_set_str(GITERR_OS, message.c_str());
+}
+
+int writeFileAtomically(const std::string& path, const std::vector<unsigned char>& bytes) {
+  std::string temp = path + ".XXXXXX";
+  std::vector<char> pathTemplate(temp.begin(), temp.end());
+  pathTemplate.push_back('\0');
+  int fd = mkstemp(&pathTemplate[0]);
+  if (fd < 0) {
+    setOsError("Failed to create", temp);
+    return -1;
+  }
+  temp = &pathTemplate[0];
+
+  bool written = writeFully(fd, &bytes[0], bytes.size()) && fsync(fd) == 0 && fchmod(fd, 0444) == 0;
+  if (!written) {
+    setOsError("Failed to write", temp);
+  }
+  close(fd);
+  if (written && rename(temp.c_str(), path.c_str()) != 0) {
+    setOsError("Failed to rename to", path);
+    written = false;
+  }
+  if (!written) {
+    unlink(temp.c_str());
+    return -1;
+  }
+  return GIT_OK;
+}
@@ -0,0 +1,766 @@
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <queue>
+#include <set>
+
+#include "../../include/functions/graph.h"
+#include "../../include/functions/file.h"
+
+static const uint32_t GRAPH_SIGNATURE = 0x43475048; // "CGPH"
+static const uint32_t CHUNK_OID_FANOUT = 0x4f494446; // "OIDF"
+static const uint32_t CHUNK_OID_LOOKUP = 0x4f49444c; // "OIDL"
+static const uint32_t CHUNK_DATA = 0x43444154; // "CDAT"
+static const uint32_t CHUNK_EXTRA_EDGES = 0x45444745; // "EDGE"
+
+static const uint32_t PARENT_NONE = 0x70000000;
+static const uint32_t PARENT_EXTRA = 0x80000000;
+static const uint32_t PARENT_LAST = 0x80000000;
+
+static const size_t HEADER_SIZE = 8;
+static const size_t CHUNK_ENTRY_SIZE = 12;
+static const size_t FANOUT_SIZE = 256 * 4;
+static const size_t DATA_ROW_SIZE = GIT_OID_RAWSZ + 16;
+
+const uint32_t CommitGraph::NO_POSITION;
+const uint32_t CommitGraph::GENERATION_MAX;
+
+CommitGraph::CommitGraph()
+  : map(NULL), mapLength(0), count(0), fanout(NULL), oids(NULL), data(NULL), edges(NULL), edgeCount(0) {
+}
+
+CommitGraph::~CommitGraph() {
+  Close();
+}
+
+std::string CommitGraph::Path(const std::string& repoPath) {
+  return repoPath + "objects/info/commit-graph";
+}
+
+int CommitGraph::Open(const std::string& repoPath) {
+  Close();
+
+  std::string path = Path(repoPath);
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    if (errno == ENOENT) {
+      return GIT_OK;
+    }
+    setOsError("Failed to open", path);
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    setOsError("Failed to stat", path);
+    close(fd);
+    return -1;
+  }
+  if ((size_t)st.st_size < HEADER_SIZE + CHUNK_ENTRY_SIZE + 20) {
+    close(fd);
+    giterr_set_str(GITERR_ODB, "Commit graph is too short");
+    return -1;
+  }
+
+  void* mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    setOsError("Failed to map", path);
+    return -1;
+  }
+  map = static_cast<const unsigned char*>(mapped);
+  mapLength = st.st_size;
+
+  const char* invalid = NULL;
+  unsigned int chunks = map[6];
+  if (getBigEndian32(map) != GRAPH_SIGNATURE || map[4] != 1 || map[5] != 1) {
+    invalid = "Not a version 1 SHA-1 commit graph";
+  } else if (map[7] != 0) {
+    invalid = "Split commit graphs are not supported";
+  } else if (HEADER_SIZE + (chunks + 1) * CHUNK_ENTRY_SIZE > mapLength - 20) {
+    invalid = "Commit graph chunk table is truncated";
+  }
+
+  size_t oidsLength = 0;
+  size_t dataLength = 0;
+  size_t edgesLength = 0;
+  for (unsigned int i = 0; invalid == NULL && i < chunks; i++) {
+    const unsigned char* entry = map + HEADER_SIZE + i * CHUNK_ENTRY_SIZE;
+    uint32_t id = getBigEndian32(entry);
+    uint64_t offset = getBigEndian64(entry + 4);
+    uint64_t next = getBigEndian64(entry + 4 + CHUNK_ENTRY_SIZE);
+    if (offset > next || next > mapLength - 20) {
+      invalid = "Commit graph chunk is out of range";
+      break;
+    }
+
+    if (id == CHUNK_OID_FANOUT && next - offset == FANOUT_SIZE) {
+      fanout = map + offset;
+    } else if (id == CHUNK_OID_LOOKUP) {
+      oids = map + offset;
+      oidsLength = next - offset;
+    } else if (id == CHUNK_DATA) {
+      data = map + offset;
+      dataLength = next - offset;
+    } else if (id == CHUNK_EXTRA_EDGES) {
+      edges = map + offset;
+      edgesLength = next - offset;
+    }
+  }
+
+  if (invalid == NULL && (fanout == NULL || oids == NULL || data == NULL)) {
+    invalid = "Commit graph is missing a required chunk";
+  }
+  if (invalid == NULL) {
+    count = getBigEndian32(fanout + FANOUT_SIZE - 4);
+    edgeCount = edgesLength / 4;
+    if (oidsLength != (size_t)count * GIT_OID_RAWSZ || dataLength != (size_t)count * DATA_ROW_SIZE) {
+      invalid = "Commit graph chunks disagree on the number of commits";
+    } else if (!fanoutValid(fanout, count)) {
+      invalid = "Commit graph fanout is corrupt";
+    }
+  }
+
+  if (invalid != NULL) {
+    Close();
+    giterr_set_str(GITERR_ODB, invalid);
+    return -1;
+  }
+  return GIT_OK;
+}
+
+void CommitGraph::Close() {
+  if (map != NULL) {
+    munmap(const_cast<unsigned char*>(map), mapLength);
+  }
+  map = NULL;
+  mapLength = 0;
+  count = 0;
+  fanout = NULL;
+  oids = NULL;
+  data = NULL;
+  edges = NULL;
+  edgeCount = 0;
+}
+
+uint32_t CommitGraph::Count() const {
+  return count;
+}
+
+bool CommitGraph::Find(const git_oid* oid, uint32_t* position) const {
+  if (count == 0) {
+    return false;
+  }
+
+  unsigned char first = oid->id[0];
+  uint32_t low = first == 0 ? 0 : getBigEndian32(fanout + (first - 1) * 4);
+  uint32_t high = getBigEndian32(fanout + first * 4);
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    int cmp = memcmp(oids + (size_t)middle * GIT_OID_RAWSZ, oid->id, GIT_OID_RAWSZ);
+    if (cmp == 0) {
+      *position = middle;
+      return true;
+    } else if (cmp < 0) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return false;
+}
+
+void CommitGraph::Oid(uint32_t position, git_oid* out) const {
+  git_oid_fromraw(out, oids + (size_t)position * GIT_OID_RAWSZ);
+}
+
+void CommitGraph::Tree(uint32_t position, git_oid* out) const {
+  git_oid_fromraw(out, data + (size_t)position * DATA_ROW_SIZE);
+}
+
+void CommitGraph::Parents(uint32_t position, std::vector<uint32_t>& out) const {
+  const unsigned char* row = data + (size_t)position * DATA_ROW_SIZE + GIT_OID_RAWSZ;
+  out.clear();
+
+  uint32_t parent = getBigEndian32(row);
+  if (parent >= count) {
+    return;
+  }
+  out.push_back(parent);
+
+  parent = getBigEndian32(row + 4);
+  if (!(parent & PARENT_EXTRA)) {
+    if (parent < count) {
+      out.push_back(parent);
+    }
+    return;
+  }
+
+  // Octopus merges list their second and later parents in the edge chunk
+  for (size_t edge = parent & ~PARENT_EXTRA; edge < edgeCount; edge++) {
+    uint32_t value = getBigEndian32(edges + edge * 4);
+    if ((value & ~PARENT_LAST) < count) {
+      out.push_back(value & ~PARENT_LAST);
+    }
+    if (value & PARENT_LAST) {
+      break;
+    }
+  }
+}
+
+uint64_t CommitGraph::Time(uint32_t position) const {
+  const unsigned char* row = data + (size_t)position * DATA_ROW_SIZE + GIT_OID_RAWSZ + 8;
+  return ((uint64_t)(getBigEndian32(row) & 3) << 32) | getBigEndian32(row + 4);
+}
+
+uint32_t CommitGraph::Generation(uint32_t position) const {
+  return getBigEndian32(data + (size_t)position * DATA_ROW_SIZE + GIT_OID_RAWSZ + 8) >> 2;
+}
+
+struct GraphRow {
+  git_oid oid;
+  git_oid tree;
+  std::vector<git_oid> parents;
+  uint64_t time;
+  uint32_t generation;
+};
+
+static bool rowOidLess(const GraphRow& a, const GraphRow& b) {
+  return git_oid_cmp(&a.oid, &b.oid) < 0;
+}
+
+static bool rowOidFind(const GraphRow& row, const git_oid& oid) {
+  return git_oid_cmp(&row.oid, &oid) < 0;
+}
+
+static uint32_t rowPosition(const std::vector<GraphRow>& rows, const git_oid& oid) {
+  return std::lower_bound(rows.begin(), rows.end(), oid, rowOidFind) - rows.begin();
+}
+
+/**
+ * Peel a reference to the commit it points at, or return false for
+ * references to anything else.
+ */
+static bool referenceCommit(git_repository* repo, const char* name, git_oid* out) {
+  git_oid target;
+  git_object* object = NULL;
+  git_object* commit = NULL;
+  bool found = git_reference_name_to_id(&target, repo, name) == GIT_OK &&
+               git_object_lookup(&object, repo, &target, GIT_OBJ_ANY) == GIT_OK &&
+               git_object_peel(&commit, object, GIT_OBJ_COMMIT) == GIT_OK;
+  if (found) {
+    git_oid_cpy(out, git_object_id(commit));
+  }
+  git_object_free(commit);
+  git_object_free(object);
+  giterr_clear();
+  return found;
+}
+
+int commitTips(git_repository* repo, std::vector<git_oid>& tips) {
+  git_oid tip;
+  if (referenceCommit(repo, "HEAD", &tip)) {
+    tips.push_back(tip);
+  }
+
+  git_strarray references;
+  int returnCode = git_reference_list(&references, repo, GIT_REF_LISTALL);
+  if (returnCode != GIT_OK) {
+    return returnCode;
+  }
+  for (size_t i = 0; i < references.count; i++) {
+    if (referenceCommit(repo, references.strings[i], &tip)) {
+      tips.push_back(tip);
+    }
+  }
+  git_strarray_free(&references);
+  return GIT_OK;
+}
+
+int CommitGraph::Write(git_repository* repo, size_t* commits) {
+  std::vector<git_oid> stack;
+  int returnCode = commitTips(repo, stack);
+  if (returnCode != GIT_OK) {
+    return returnCode;
+  }
+
+  // Read every reachable commit once
+  std::vector<GraphRow> rows;
+  std::map<git_oid, bool, OidLess> seen;
+  while (!stack.empty()) {
+    git_oid oid = stack.back();
+    stack.pop_back();
+    if (!seen.insert(std::make_pair(oid, true)).second) {
+      continue;
+    }
+
+    git_commit* commit = NULL;
+    returnCode = git_commit_lookup(&commit, repo, &oid);
+    if (returnCode != GIT_OK) {
+      return returnCode;
+    }
+
+    GraphRow row;
+    git_oid_cpy(&row.oid, &oid);
+    git_oid_cpy(&row.tree, git_commit_tree_id(commit));
+    row.time = (uint64_t)git_commit_time(commit);
+    row.generation = 0;
+    unsigned int parentCount = git_commit_parentcount(commit);
+    for (unsigned int i = 0; i < parentCount; i++) {
+      row.parents.push_back(*git_commit_parent_id(commit, i));
+      stack.push_back(row.parents.back());
+    }
+    rows.push_back(row);
+    git_commit_free(commit);
+  }
+
+  std::sort(rows.begin(), rows.end(), rowOidLess);
+
+  // Generation is one more than the highest parent's, roots are 1
+  std::vector<uint32_t> order;
+  for (size_t i = 0; i < rows.size(); i++) {
+    order.push_back(i);
+    while (!order.empty()) {
+      GraphRow& row = rows[order.back()];
+      if (row.generation != 0) {
+        order.pop_back();
+        continue;
+      }
+      uint32_t generation = 1;
+      bool ready = true;
+      for (size_t j = 0; j < row.parents.size(); j++) {
+        const GraphRow& parent = rows[rowPosition(rows, row.parents[j])];
+        if (parent.generation == 0) {
+          order.push_back(rowPosition(rows, row.parents[j]));
+          ready = false;
+        } else {
+          generation = std::max(generation, std::min(parent.generation + 1, GENERATION_MAX));
+        }
+      }
+      if (ready) {
+        row.generation = generation;
+        order.pop_back();
+      }
+    }
+  }
+
+  std::vector<unsigned char> edgeChunk;
+  std::vector<unsigned char> dataChunk;
+  std::vector<unsigned char> oidChunk;
+  std::vector<unsigned char> fanoutChunk;
+  uint32_t fanoutCounts[256] = { 0 };
+  for (size_t i = 0; i < rows.size(); i++) {
+    const GraphRow& row = rows[i];
+    fanoutCounts[row.oid.id[0]]++;
+    oidChunk.insert(oidChunk.end(), row.oid.id, row.oid.id + GIT_OID_RAWSZ);
+
+    dataChunk.insert(dataChunk.end(), row.tree.id, row.tree.id + GIT_OID_RAWSZ);
+    putBigEndian32(dataChunk, row.parents.size() > 0 ? rowPosition(rows, row.parents[0]) : PARENT_NONE);
+    if (row.parents.size() <= 2) {
+      putBigEndian32(dataChunk, row.parents.size() == 2 ? rowPosition(rows, row.parents[1]) : PARENT_NONE);
+    } else {
+      putBigEndian32(dataChunk, PARENT_EXTRA | (uint32_t)(edgeChunk.size() / 4));
+      for (size_t j = 1; j < row.parents.size(); j++) {
+        uint32_t position = rowPosition(rows, row.parents[j]);
+        putBigEndian32(edgeChunk, j + 1 == row.parents.size() ? position | PARENT_LAST : position);
+      }
+    }
+    putBigEndian32(dataChunk, (row.generation << 2) | (uint32_t)((row.time >> 32) & 3));
+    putBigEndian32(dataChunk, (uint32_t)row.time);
+  }
+  uint32_t cumulative = 0;
+  for (int i = 0; i < 256; i++) {
+    cumulative += fanoutCounts[i];
+    putBigEndian32(fanoutChunk, cumulative);
+  }
+
+  std::vector<std::pair<uint32_t, std::vector<unsigned char>*> > chunks;
+  chunks.push_back(std::make_pair(CHUNK_OID_FANOUT, &fanoutChunk));
+  chunks.push_back(std::make_pair(CHUNK_OID_LOOKUP, &oidChunk));
+  chunks.push_back(std::make_pair(CHUNK_DATA, &dataChunk));
+  if (!edgeChunk.empty()) {
+    chunks.push_back(std::make_pair(CHUNK_EXTRA_EDGES, &edgeChunk));
+  }
+
+  std::vector<unsigned char> file;
+  putBigEndian32(file, GRAPH_SIGNATURE);
+  file.push_back(1);
+  file.push_back(1);
+  file.push_back((unsigned char)chunks.size());
+  file.push_back(0);
+  uint64_t offset = HEADER_SIZE + (chunks.size() + 1) * CHUNK_ENTRY_SIZE;
+  for (size_t i = 0; i < chunks.size(); i++) {
+    putBigEndian32(file, chunks[i].first);
+    putBigEndian64(file, offset);
+    offset += chunks[i].second->size();
+  }
+  putBigEndian32(file, 0);
+  putBigEndian64(file, offset);
+  for (size_t i = 0; i < chunks.size(); i++) {
+    file.insert(file.end(), chunks[i].second->begin(), chunks[i].second->end());
+  }
+  appendChecksum(file);
+
+  std::string repoPath = git_repository_path(repo);
+  std::string path = Path(repoPath);
+  mkdir((repoPath + "objects/info").c_str(), 0777);
+  if (writeFileAtomically(path, file) != GIT_OK) {
+    return -1;
+  }
+
+  *commits = rows.size();
+  return GIT_OK;
+}
+
+CommitNodes::CommitNodes(git_repository* repo, const CommitGraph& graph)
+  : repo(repo), graph(graph) {
+}
+
+int CommitNodes::Find(const git_oid* oid, uint32_t* id) {
+  uint32_t position;
+  if (graph.Find(oid, &position)) {
+    *id = position;
+    return GIT_OK;
+  }
+  std::map<git_oid, uint32_t, OidLess>::const_iterator known = extraIds.find(*oid);
+  if (known != extraIds.end()) {
+    *id = known->second;
+    return GIT_OK;
+  }
+
+  // Read the commit and whichever ancestors are not known yet, parents
+  // before children so generations can be computed on the way back
+  std::vector<git_oid> stack(1, *oid);
+  while (!stack.empty()) {
+    git_oid current = stack.back();
+    if (graph.Find(&current, &position) || extraIds.count(current) > 0) {
+      stack.pop_back();
+      continue;
+    }
+
+    git_commit* commit = NULL;
+    int returnCode = git_commit_lookup(&commit, repo, &current);
+    if (returnCode != GIT_OK) {
+      return returnCode;
+    }
+
+    Extra extra;
+    git_oid_cpy(&extra.oid, &current);
+    extra.time = (uint64_t)git_commit_time(commit);
+    extra.generation = 1;
+    bool ready = true;
+    unsigned int parentCount = git_commit_parentcount(commit);
+    for (unsigned int i = 0; i < parentCount; i++) {
+      const git_oid* parent = git_commit_parent_id(commit, i);
+      std::map<git_oid, uint32_t, OidLess>::const_iterator parentId = extraIds.find(*parent);
+      if (graph.Find(parent, &position)) {
+        extra.parents.push_back(position);
+      } else if (parentId != extraIds.end()) {
+        extra.parents.push_back(parentId->second);
+      } else {
+        stack.push_back(*parent);
+        ready = false;
+        continue;
+      }
+      extra.generation = std::max(extra.generation,
+                                  std::min(Generation(extra.parents.back()) + 1, CommitGraph::GENERATION_MAX));
+    }
+    git_commit_free(commit);
+
+    if (ready) {
+      stack.pop_back();
+      extraIds[current] = graph.Count() + extras.size();
+      extras.push_back(extra);
+    }
+  }
+
+  *id = extraIds[*oid];
+  return GIT_OK;
+}
+
+uint32_t CommitNodes::Count() const {
+  return graph.Count() + extras.size();
+}
+
+size_t CommitNodes::Loaded() const {
+  return extras.size();
+}
+
+void CommitNodes::Oid(uint32_t id, git_oid* out) const {
+  if (id < graph.Count()) {
+    graph.Oid(id, out);
+  } else {
+    git_oid_cpy(out, &extras[id - graph.Count()].oid);
+  }
+}
+
+void CommitNodes::Parents(uint32_t id, std::vector<uint32_t>& out) const {
+  if (id < graph.Count()) {
+    graph.Parents(id, out);
+  } else {
+    out = extras[id - graph.Count()].parents;
+  }
+}
+
+uint64_t CommitNodes::Time(uint32_t id) const {
+  return id < graph.Count() ? graph.Time(id) : extras[id - graph.Count()].time;
+}
+
+uint32_t CommitNodes::Generation(uint32_t id) const {
+  return id < graph.Count() ? graph.Generation(id) : extras[id - graph.Count()].generation;
+}
+
+/**
+ * Orders a max-heap by generation, then commit time, so a commit is only
+ * popped once all of its children have been.
+ */
+struct GenerationOrder {
+  const CommitNodes* nodes;
+
+  bool operator()(uint32_t a, uint32_t b) const {
+    uint32_t generationA = nodes->Generation(a);
+    uint32_t generationB = nodes->Generation(b);
+    if (generationA != generationB) {
+      return generationA < generationB;
+    }
+    uint64_t timeA = nodes->Time(a);
+    uint64_t timeB = nodes->Time(b);
+    if (timeA != timeB) {
+      return timeA < timeB;
+    }
+    return a > b;
+  }
+};
+
+/**
+ * Newest commit first, the order libgit2's time sorting pops them in.
+ */
+struct TimeOrder {
+  const CommitNodes* nodes;
+
+  bool operator()(uint32_t a, uint32_t b) const {
+    return nodes->Time(a) < nodes->Time(b);
+  }
+};
+
+typedef std::priority_queue<uint32_t, std::vector<uint32_t>, GenerationOrder> GenerationQueue;
+
+enum {
+  FLAG_ONE = 1,
+  FLAG_TWO = 2,
+  FLAG_STALE = 4,
+  FLAG_QUEUED = 8,
+  FLAG_RESULT = 16
+};
+
+void commitRange(CommitNodes& nodes, const std::vector<uint32_t>& include,
+                 const std::vector<uint32_t>& exclude, unsigned int sorting,
+                 std::vector<uint32_t>& out) {
+  const unsigned char INCLUDED = FLAG_ONE;
+  const unsigned char EXCLUDED = FLAG_TWO;
+
+  GenerationOrder order = { &nodes };
+  GenerationQueue queue(order);
+  std::vector<unsigned char> flags(nodes.Count(), 0);
+  std::vector<uint32_t> parents;
+  std::vector<uint32_t> found;
+
+  // Painting stops once only excluded commits are queued
+  size_t includedQueued = 0;
+  for (size_t i = 0; i < exclude.size(); i++) {
+    flags[exclude[i]] |= EXCLUDED;
+  }
+  for (size_t i = 0; i < include.size(); i++) {
+    flags[include[i]] |= INCLUDED;
+  }
+  for (size_t i = 0; i < include.size() + exclude.size(); i++) {
+    uint32_t id = i < include.size() ? include[i] : exclude[i - include.size()];
+    if (!(flags[id] & FLAG_QUEUED)) {
+      flags[id] |= FLAG_QUEUED;
+      includedQueued += flags[id] & EXCLUDED ? 0 : 1;
+      queue.push(id);
+    }
+  }
+
+  while (!queue.empty() && includedQueued > 0) {
+    uint32_t id = queue.top();
+    queue.pop();
+    unsigned char paint = flags[id] & (INCLUDED | EXCLUDED);
+    if (paint == INCLUDED) {
+      includedQueued--;
+      flags[id] |= FLAG_RESULT;
+      found.push_back(id);
+    }
+
+    nodes.Parents(id, parents);
+    for (size_t i = 0; i < parents.size(); i++) {
+      unsigned char& parentFlags = flags[parents[i]];
+      if (!(parentFlags & FLAG_QUEUED)) {
+        parentFlags |= paint | FLAG_QUEUED;
+        includedQueued += paint & EXCLUDED ? 0 : 1;
+        queue.push(parents[i]);
+      } else if ((paint & EXCLUDED) && !(parentFlags & EXCLUDED)) {
+        parentFlags |= EXCLUDED;
+        includedQueued--;
+      } else {
+        parentFlags |= paint;
+      }
+    }
+  }
+
+  out.clear();
+  if (sorting & GIT_SORT_TOPOLOGICAL) {
+    // Children before parents, and the newest ready commit first
+    std::vector<uint32_t> children(nodes.Count(), 0);
+    for (size_t i = 0; i < found.size(); i++) {
+      nodes.Parents(found[i], parents);
+      for (size_t j = 0; j < parents.size(); j++) {
+        if (flags[parents[j]] & FLAG_RESULT) {
+          children[parents[j]]++;
+        }
+      }
+    }
+
+    TimeOrder newest = { &nodes };
+    std::priority_queue<uint32_t, std::vector<uint32_t>, TimeOrder> ready(newest);
+    for (size_t i = 0; i < found.size(); i++) {
+      if (children[found[i]] == 0) {
+        ready.push(found[i]);
+      }
+    }
+    while (!ready.empty()) {
+      uint32_t id = ready.top();
+      ready.pop();
+      out.push_back(id);
+      nodes.Parents(id, parents);
+      for (size_t j = 0; j < parents.size(); j++) {
+        if ((flags[parents[j]] & FLAG_RESULT) && --children[parents[j]] == 0) {
+          ready.push(parents[j]);
+        }
+      }
+    }
+  } else {
+    out = found;
+    if (sorting & GIT_SORT_TIME) {
+      TimeOrder newest = { &nodes };
+      std::stable_sort(out.rbegin(), out.rend(), newest);
+    }
+  }
+
+  if (sorting & GIT_SORT_REVERSE) {
+    std::reverse(out.begin(), out.end());
+  }
+}
+
+bool commitMergeBase(CommitNodes& nodes, uint32_t one, uint32_t two, uint32_t* base) {
+  if (one == two) {
+    *base = one;
+    return true;
+  }
+
+  GenerationOrder order = { &nodes };
+  GenerationQueue queue(order);
+  std::vector<unsigned char> flags(nodes.Count(), 0);
+  std::vector<uint32_t> parents;
+
+  flags[one] = FLAG_ONE | FLAG_QUEUED;
+  flags[two] = FLAG_TWO | FLAG_QUEUED;
+  queue.push(one);
+  queue.push(two);
+
+  // The first commit reached from both sides has the highest generation
+  // of all common ancestors, so none of them can descend from it
+  while (!queue.empty()) {
+    uint32_t id = queue.top();
+    queue.pop();
+    unsigned char paint = flags[id] & (FLAG_ONE | FLAG_TWO);
+    if (paint == (FLAG_ONE | FLAG_TWO)) {
+      *base = id;
+      return true;
+    }
+
+    nodes.Parents(id, parents);
+    for (size_t i = 0; i < parents.size(); i++) {
+      unsigned char& parentFlags = flags[parents[i]];
+      parentFlags |= paint;
+      if (!(parentFlags & FLAG_QUEUED)) {
+        parentFlags |= FLAG_QUEUED;
+        queue.push(parents[i]);
+      }
+    }
+  }
+  return false;
+}
+
+bool commitIsAncestor(CommitNodes& nodes, uint32_t ancestor, uint32_t descendant) {
+  uint32_t generation = nodes.Generation(ancestor);
+  std::vector<bool> seen(nodes.Count(), false);
+  std::vector<uint32_t> stack(1, descendant);
+  std::vector<uint32_t> parents;
+  seen[descendant] = true;
+
+  // Nothing below the ancestor's generation can lead back up to it
+  while (!stack.empty()) {
+    uint32_t id = stack.back();
+    stack.pop_back();
+    if (id == ancestor) {
+      return true;
+    }
+
+    nodes.Parents(id, parents);
+    for (size_t i = 0; i < parents.size(); i++) {
+      if (!seen[parents[i]] && nodes.Generation(parents[i]) >= generation) {
+        seen[parents[i]] = true;
+        stack.push_back(parents[i]);
+      }
+    }
+  }
+  return false;
+}
+
+int commitReachable(git_repository* repo, const git_oid* ancestor, const git_oid* descendant, bool* found) {
+  *found = false;
+  git_commit* commit = NULL;
+  int returnCode = git_commit_lookup(&commit, repo, ancestor);
+  if (returnCode != GIT_OK) {
+    return returnCode;
+  }
+  git_time_t time = git_commit_time(commit);
+  git_commit_free(commit);
+
+  std::set<git_oid, OidLess> seen;
+  std::vector<git_oid> stack(1, *descendant);
+  seen.insert(*descendant);
+
+  // Dates stand in for generations: a commit made before the ancestor is
+  // taken not to lead back up to it, as git assumes without a graph
+  while (!stack.empty()) {
+    git_oid oid = stack.back();
+    stack.pop_back();
+    if (git_oid_cmp(&oid, ancestor) == 0) {
+      *found = true;
+      return GIT_OK;
+    }
+
+    returnCode = git_commit_lookup(&commit, repo, &oid);
+    if (returnCode != GIT_OK) {
+      return returnCode;
+    }
+    if (git_commit_time(commit) >= time) {
+      for (unsigned int i = 0; i < git_commit_parentcount(commit); i++) {
+        const git_oid* parent = git_commit_parent_id(commit, i);
+        if (seen.insert(*parent).second) {
+          stack.push_back(*parent);
+        }
+      }
+    }
+    git_commit_free(commit);
+  }
+  return GIT_OK;
+}
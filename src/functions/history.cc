@@ -0,0 +1,364 @@
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <queue>
+#include <set>
+
+#include "../../include/functions/history.h"
+#include "../../include/functions/graph.h"
+#include "../../include/functions/file.h"
+
+static const uint32_t HISTORY_SIGNATURE = 0x48495354; // "HIST"
+
+static const size_t HEADER_SIZE = 12;
+static const size_t FANOUT_SIZE = 256 * 4;
+
+/**
+ * What ordering the commits Extend has not got cached needs.
+ */
+struct CommitNode {
+  uint64_t time;
+  std::vector<git_oid> parents;
+};
+
+typedef std::map<git_oid, CommitNode, OidLess> CommitNodeMap;
+
+static std::string directory(const std::string& repoPath) {
+  return repoPath + "objects/info/history";
+}
+
+static std::string sortingSuffix(unsigned int sorting) {
+  char suffix[16];
+  snprintf(suffix, sizeof(suffix), "-%u", sorting);
+  return suffix;
+}
+
+static int readCommit(git_repository* repo, const CommitGraph& graph, const git_oid* oid,
+                      CommitNodeMap& nodes, size_t* loaded, const CommitNode** out) {
+  CommitNodeMap::iterator found = nodes.find(*oid);
+  if (found == nodes.end()) {
+    CommitNode node;
+    uint32_t position;
+    if (graph.Find(oid, &position)) {
+      std::vector<uint32_t> parents;
+      graph.Parents(position, parents);
+      node.time = graph.Time(position);
+      node.parents.resize(parents.size());
+      for (size_t i = 0; i < parents.size(); i++) {
+        graph.Oid(parents[i], &node.parents[i]);
+      }
+    } else {
+      git_commit* commit = NULL;
+      int returnCode = git_commit_lookup(&commit, repo, oid);
+      if (returnCode != GIT_OK) {
+        return returnCode;
+      }
+      node.time = (uint64_t)git_commit_time(commit);
+      for (unsigned int i = 0; i < git_commit_parentcount(commit); i++) {
+        node.parents.push_back(*git_commit_parent_id(commit, i));
+      }
+      git_commit_free(commit);
+      (*loaded)++;
+    }
+    found = nodes.insert(std::make_pair(*oid, node)).first;
+  }
+  *out = &found->second;
+  return GIT_OK;
+}
+
+HistoryCache::HistoryCache() : map(NULL), mapLength(0), count(0), fanout(NULL), oids(NULL), sortedIndexes(NULL) {
+}
+
+HistoryCache::~HistoryCache() {
+  Close();
+}
+
+bool HistoryCache::Cacheable(unsigned int sorting) {
+  return (sorting & GIT_SORT_TOPOLOGICAL) != 0 && (sorting & GIT_SORT_REVERSE) == 0;
+}
+
+std::string HistoryCache::Path(const std::string& repoPath, const git_oid* tip, unsigned int sorting) {
+  char sha[GIT_OID_HEXSZ + 1];
+  git_oid_fmt(sha, tip);
+  sha[GIT_OID_HEXSZ] = '\0';
+  return directory(repoPath) + "/" + sha + sortingSuffix(sorting);
+}
+
+int HistoryCache::Open(const std::string& repoPath, const git_oid* tip, unsigned int sorting) {
+  Close();
+
+  std::string path = Path(repoPath, tip, sorting);
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    if (errno == ENOENT) {
+      return GIT_OK;
+    }
+    setOsError("Failed to open", path);
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    setOsError("Failed to stat", path);
+    close(fd);
+    return -1;
+  }
+  if ((size_t)st.st_size < HEADER_SIZE + FANOUT_SIZE + 20) {
+    close(fd);
+    giterr_set_str(GITERR_ODB, "History cache is too short");
+    return -1;
+  }
+
+  void* mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    setOsError("Failed to map", path);
+    return -1;
+  }
+  map = static_cast<const unsigned char*>(mapped);
+  mapLength = st.st_size;
+
+  const char* invalid = NULL;
+  count = getBigEndian32(map + 8);
+  fanout = map + HEADER_SIZE;
+  if (getBigEndian32(map) != HISTORY_SIGNATURE || map[4] != 1) {
+    invalid = "Not a version 1 history cache";
+  } else if (count == 0 || getBigEndian32(fanout + FANOUT_SIZE - 4) != count ||
+             mapLength != HEADER_SIZE + FANOUT_SIZE + (size_t)count * (GIT_OID_RAWSZ + 4) + 20) {
+    invalid = "History cache is truncated";
+  } else if (!fanoutValid(fanout, count)) {
+    invalid = "History cache fanout is corrupt";
+  } else {
+    oids = fanout + FANOUT_SIZE;
+    sortedIndexes = oids + (size_t)count * GIT_OID_RAWSZ;
+    if (memcmp(oids, tip->id, GIT_OID_RAWSZ) != 0) {
+      invalid = "History cache is for another tip";
+    }
+  }
+  for (uint32_t i = 0; invalid == NULL && i < count; i++) {
+    if (getBigEndian32(sortedIndexes + (size_t)i * 4) >= count) {
+      invalid = "History cache index is corrupt";
+    }
+  }
+
+  if (invalid != NULL) {
+    Close();
+    giterr_set_str(GITERR_ODB, invalid);
+    return -1;
+  }
+  return GIT_OK;
+}
+
+void HistoryCache::Close() {
+  if (map != NULL) {
+    munmap(const_cast<unsigned char*>(map), mapLength);
+  }
+  map = NULL;
+  mapLength = 0;
+  count = 0;
+  fanout = NULL;
+  oids = NULL;
+  sortedIndexes = NULL;
+}
+
+uint32_t HistoryCache::Count() const {
+  return count;
+}
+
+void HistoryCache::Oid(uint32_t index, git_oid* out) const {
+  git_oid_fromraw(out, oids + (size_t)index * GIT_OID_RAWSZ);
+}
+
+bool HistoryCache::Contains(const git_oid* oid) const {
+  if (count == 0) {
+    return false;
+  }
+  unsigned char first = oid->id[0];
+  uint32_t low = first == 0 ? 0 : getBigEndian32(fanout + (first - 1) * 4);
+  uint32_t high = getBigEndian32(fanout + first * 4);
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    uint32_t index = getBigEndian32(sortedIndexes + (size_t)middle * 4);
+    int cmp = memcmp(oids + (size_t)index * GIT_OID_RAWSZ, oid->id, GIT_OID_RAWSZ);
+    if (cmp == 0) {
+      return true;
+    } else if (cmp < 0) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return false;
+}
+
+int HistoryCache::Extend(git_repository* repo, const CommitGraph& graph, const git_oid* tip, unsigned int sorting,
+                         std::vector<git_oid>& fresh, size_t* loaded) {
+  Close();
+  fresh.clear();
+
+  std::string repoPath = git_repository_path(repo);
+  std::string suffix = sortingSuffix(sorting);
+  std::set<git_oid, OidLess> cachedTips;
+  DIR* dir = opendir(directory(repoPath).c_str());
+  if (dir != NULL) {
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+      std::string name = entry->d_name;
+      git_oid oid;
+      if (name.size() == GIT_OID_HEXSZ + suffix.size() &&
+          name.compare(GIT_OID_HEXSZ, std::string::npos, suffix) == 0 &&
+          git_oid_fromstrn(&oid, name.c_str(), GIT_OID_HEXSZ) == GIT_OK &&
+          git_oid_cmp(&oid, tip) != 0) {
+        cachedTips.insert(oid);
+      }
+    }
+    closedir(dir);
+  }
+
+  // The nearest cached tip, breadth first. Without one this reads the
+  // whole history, which the second pass then reuses
+  CommitNodeMap nodes;
+  std::deque<git_oid> queue(1, *tip);
+  std::set<git_oid, OidLess> queued(queue.begin(), queue.end());
+  while (!queue.empty() && !cachedTips.empty()) {
+    git_oid oid = queue.front();
+    queue.pop_front();
+    if (cachedTips.count(oid) > 0) {
+      if (Open(repoPath, &oid, sorting) != GIT_OK) {
+        giterr_clear();
+        Remove(repoPath, &oid, sorting);
+        cachedTips.erase(oid);
+        continue;
+      }
+      break;
+    }
+
+    const CommitNode* node;
+    int returnCode = readCommit(repo, graph, &oid, nodes, loaded, &node);
+    if (returnCode != GIT_OK) {
+      return returnCode;
+    }
+    for (size_t i = 0; i < node->parents.size(); i++) {
+      if (queued.insert(node->parents[i]).second) {
+        queue.push_back(node->parents[i]);
+      }
+    }
+  }
+
+  // Every commit the cached walk lacks; it holds all the ancestors of
+  // those it has
+  std::vector<git_oid> members;
+  std::map<git_oid, uint32_t, OidLess> indexes;
+  std::vector<const CommitNode*> memberNodes;
+  queue.assign(1, *tip);
+  while (!queue.empty()) {
+    git_oid oid = queue.front();
+    queue.pop_front();
+    if (indexes.count(oid) > 0 || Contains(&oid)) {
+      continue;
+    }
+
+    const CommitNode* node;
+    int returnCode = readCommit(repo, graph, &oid, nodes, loaded, &node);
+    if (returnCode != GIT_OK) {
+      Close();
+      return returnCode;
+    }
+    indexes[oid] = members.size();
+    members.push_back(oid);
+    memberNodes.push_back(node);
+    queue.insert(queue.end(), node->parents.begin(), node->parents.end());
+  }
+
+  // Children before parents, newest first among the commits whose
+  // children are all out
+  std::vector<uint32_t> children(members.size(), 0);
+  std::vector<std::vector<uint32_t> > parents(members.size());
+  for (size_t i = 0; i < members.size(); i++) {
+    for (size_t j = 0; j < memberNodes[i]->parents.size(); j++) {
+      std::map<git_oid, uint32_t, OidLess>::const_iterator parent = indexes.find(memberNodes[i]->parents[j]);
+      if (parent != indexes.end()) {
+        parents[i].push_back(parent->second);
+        children[parent->second]++;
+      }
+    }
+  }
+  std::priority_queue<std::pair<uint64_t, uint32_t> > ready;
+  for (uint32_t i = 0; i < members.size(); i++) {
+    if (children[i] == 0) {
+      ready.push(std::make_pair(memberNodes[i]->time, i));
+    }
+  }
+  fresh.reserve(members.size());
+  while (!ready.empty()) {
+    uint32_t i = ready.top().second;
+    ready.pop();
+    fresh.push_back(members[i]);
+    for (size_t j = 0; j < parents[i].size(); j++) {
+      if (--children[parents[i][j]] == 0) {
+        ready.push(std::make_pair(memberNodes[parents[i][j]]->time, parents[i][j]));
+      }
+    }
+  }
+  return GIT_OK;
+}
+
+int HistoryCache::Write(const std::string& repoPath, unsigned int sorting, const std::vector<git_oid>& fresh) const {
+  std::vector<git_oid> all(fresh);
+  all.resize(fresh.size() + count);
+  for (uint32_t i = 0; i < count; i++) {
+    Oid(i, &all[fresh.size() + i]);
+  }
+  uint32_t allCount = all.size();
+
+  std::vector<uint32_t> sorted(allCount);
+  for (uint32_t i = 0; i < allCount; i++) {
+    sorted[i] = i;
+  }
+  PositionOidLess byOid = { &all };
+  std::sort(sorted.begin(), sorted.end(), byOid);
+
+  std::vector<unsigned char> file;
+  file.reserve(HEADER_SIZE + FANOUT_SIZE + (size_t)allCount * (GIT_OID_RAWSZ + 4) + 20);
+  putBigEndian32(file, HISTORY_SIGNATURE);
+  file.push_back(1);
+  file.push_back(0);
+  file.push_back(0);
+  file.push_back(0);
+  putBigEndian32(file, allCount);
+
+  uint32_t fanoutCounts[256] = { 0 };
+  for (uint32_t i = 0; i < allCount; i++) {
+    fanoutCounts[all[i].id[0]]++;
+  }
+  uint32_t cumulative = 0;
+  for (int i = 0; i < 256; i++) {
+    cumulative += fanoutCounts[i];
+    putBigEndian32(file, cumulative);
+  }
+  for (uint32_t i = 0; i < allCount; i++) {
+    file.insert(file.end(), all[i].id, all[i].id + GIT_OID_RAWSZ);
+  }
+  for (uint32_t i = 0; i < allCount; i++) {
+    putBigEndian32(file, sorted[i]);
+  }
+  appendChecksum(file);
+
+  std::string path = Path(repoPath, &all[0], sorting);
+  mkdir((repoPath + "objects/info").c_str(), 0777);
+  mkdir(directory(repoPath).c_str(), 0777);
+  return writeFileAtomically(path, file);
+}
+
+void HistoryCache::Remove(const std::string& repoPath, const git_oid* tip, unsigned int sorting) {
+  unlink(Path(repoPath, tip, sorting).c_str());
+}
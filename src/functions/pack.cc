@@ -0,0 +1,95 @@
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "../../include/functions/pack.h"
+#include "../../include/functions/file.h"
+
+static bool entryOidLess(const PackIndexEntry& a, const PackIndexEntry& b) {
+  return git_oid_cmp(&a.oid, &b.oid) < 0;
+}
+
+void packHeader(unsigned char out[12], uint32_t objectCount) {
+  memcpy(out, "PACK", 4);
+  out[4] = 0;
+  out[5] = 0;
+  out[6] = 0;
+  out[7] = 2;
+  out[8] = (unsigned char)(objectCount >> 24);
+  out[9] = (unsigned char)(objectCount >> 16);
+  out[10] = (unsigned char)(objectCount >> 8);
+  out[11] = (unsigned char)objectCount;
+}
+
+size_t packEntryHeader(unsigned char* out, git_otype type, size_t size) {
+  size_t used = 0;
+  unsigned char byte = (unsigned char)((type << 4) | (size & 0x0f));
+  size >>= 4;
+  while (size > 0) {
+    out[used++] = byte | 0x80;
+    byte = (unsigned char)(size & 0x7f);
+    size >>= 7;
+  }
+  out[used++] = byte;
+  return used;
+}
+
+void packIndex(std::vector<PackIndexEntry>& entries, const unsigned char packChecksum[20],
+               std::vector<unsigned char>& out) {
+  std::sort(entries.begin(), entries.end(), entryOidLess);
+
+  out.clear();
+  out.reserve(8 + 256 * 4 + entries.size() * 28 + 40);
+  static const unsigned char magic[8] = { 0xff, 't', 'O', 'c', 0, 0, 0, 2 };
+  out.insert(out.end(), magic, magic + 8);
+
+  size_t count = 0;
+  for (int bucket = 0; bucket < 256; bucket++) {
+    while (count < entries.size() && entries[count].oid.id[0] == bucket) {
+      count++;
+    }
+    putBigEndian32(out, (uint32_t)count);
+  }
+
+  for (size_t i = 0; i < entries.size(); i++) {
+    out.insert(out.end(), entries[i].oid.id, entries[i].oid.id + GIT_OID_RAWSZ);
+  }
+  for (size_t i = 0; i < entries.size(); i++) {
+    putBigEndian32(out, entries[i].crc);
+  }
+
+  // Offsets past 2GB go to a table of 64 bit offsets, referenced by index
+  std::vector<uint64_t> largeOffsets;
+  for (size_t i = 0; i < entries.size(); i++) {
+    if (entries[i].offset < 0x80000000ULL) {
+      putBigEndian32(out, (uint32_t)entries[i].offset);
+    } else {
+      putBigEndian32(out, 0x80000000U | (uint32_t)largeOffsets.size());
+      largeOffsets.push_back(entries[i].offset);
+    }
+  }
+  for (size_t i = 0; i < largeOffsets.size(); i++) {
+    putBigEndian32(out, (uint32_t)(largeOffsets[i] >> 32));
+    putBigEndian32(out, (uint32_t)largeOffsets[i]);
+  }
+
+  out.insert(out.end(), packChecksum, packChecksum + 20);
+  appendChecksum(out);
+}
+
+bool writeFully(int fd, const void* data, size_t length) {
+  const char* bytes = static_cast<const char*>(data);
+  while (length > 0) {
+    ssize_t written = write(fd, bytes, length);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    bytes += written;
+    length -= written;
+  }
+  return true;
+}
@@ -0,0 +1,103 @@
+#include <string.h>
+
+#include "../../include/functions/sha1.h"
+
+static inline uint32_t Rotate(uint32_t value, int bits) {
+  return (value << bits) | (value >> (32 - bits));
+}
+
+Sha1::Sha1() : length(0), buffered(0) {
+  state[0] = 0x67452301;
+  state[1] = 0xEFCDAB89;
+  state[2] = 0x98BADCFE;
+  state[3] = 0x10325476;
+  state[4] = 0xC3D2E1F0;
+}
+
+void Sha1::Transform(const unsigned char block[64]) {
+  uint32_t w[80];
+  for (int i = 0; i < 16; i++) {
+    w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) |
+           ((uint32_t)block[i * 4 + 2] << 8) | (uint32_t)block[i * 4 + 3];
+  }
+  for (int i = 16; i < 80; i++) {
+    w[i] = Rotate(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+  }
+
+  uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+  for (int i = 0; i < 80; i++) {
+    uint32_t f, k;
+    if (i < 20) {
+      f = (b & c) | (~b & d);
+      k = 0x5A827999;
+    } else if (i < 40) {
+      f = b ^ c ^ d;
+      k = 0x6ED9EBA1;
+    } else if (i < 60) {
+      f = (b & c) | (b & d) | (c & d);
+      k = 0x8F1BBCDC;
+    } else {
+      f = b ^ c ^ d;
+      k = 0xCA62C1D6;
+    }
+    uint32_t temp = Rotate(a, 5) + f + e + k + w[i];
+    e = d;
+    d = c;
+    c = Rotate(b, 30);
+    b = a;
+    a = temp;
+  }
+
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+}
+
+void Sha1::Update(const void* data, size_t size) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  length += size;
+
+  if (buffered > 0) {
+    size_t take = 64 - buffered < size ? 64 - buffered : size;
+    memcpy(buffer + buffered, bytes, take);
+    buffered += take;
+    bytes += take;
+    size -= take;
+    if (buffered < 64) {
+      return;
+    }
+    Transform(buffer);
+    buffered = 0;
+  }
+
+  while (size >= 64) {
+    Transform(bytes);
+    bytes += 64;
+    size -= 64;
+  }
+
+  memcpy(buffer, bytes, size);
+  buffered = size;
+}
+
+void Sha1::Final(unsigned char out[DIGEST_SIZE]) {
+  uint64_t bits = length * 8;
+
+  unsigned char padding[72];
+  size_t padLength = (buffered < 56 ? 56 : 120) - buffered;
+  memset(padding, 0, sizeof(padding));
+  padding[0] = 0x80;
+  for (int i = 0; i < 8; i++) {
+    padding[padLength + i] = (unsigned char)(bits >> (56 - i * 8));
+  }
+  Update(padding, padLength + 8);
+
+  for (int i = 0; i < 5; i++) {
+    out[i * 4] = (unsigned char)(state[i] >> 24);
+    out[i * 4 + 1] = (unsigned char)(state[i] >> 16);
+    out[i * 4 + 2] = (unsigned char)(state[i] >> 8);
+    out[i * 4 + 3] = (unsigned char)state[i];
+  }
+}
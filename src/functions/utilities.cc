@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include "../../include/functions/utilities.h"
 
 using namespace v8;
@@ -19,3 +21,22 @@ bool success(const git_error* error, Persistent<Function> callback) {
   }
   return true;
 }
+
+Local<Object> createTypedArray(const char* constructorName, const void* data,
+                               size_t length, size_t elementSize) {
+  HandleScope scope;
+
+  Local<Function> constructor = Local<Function>::Cast(
+    Context::GetCurrent()->Global()->Get(String::New(constructorName)));
+
+  Handle<Value> argv[1] = {
+    Integer::NewFromUnsigned(length)
+  };
+  Local<Object> array = constructor->NewInstance(1, argv);
+
+  if (length > 0 && data != NULL) {
+    memcpy(array->GetIndexedPropertiesExternalArrayData(), data, length * elementSize);
+  }
+
+  return scope.Close(array);
+}
@@ -0,0 +1,834 @@
+/*
+ * Copyright 2013, Tim Branyen @tbranyen <tim@tabdeveloper.com>
+ * @author Michael Robinson @codeofinterest <mike@pagesofinterest.net>
+ *
+ * Dual licensed under the MIT and GPL licenses.
+ */
+
+#include <v8.h>
+#include <node.h>
+#include <node_buffer.h>
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cvv8/v8-convert.hpp"
+#include "git2.h"
+
+#include "../include/utils.h"
+#include "../include/repo.h"
+#include "../include/index.h"
+#include "../include/error.h"
+
+#include "../include/functions/string.h"
+#include "../include/functions/utilities.h"
+
+#ifdef __APPLE__
+#define STAT_MTIME_NANOSECONDS(st) ((st).st_mtimespec.tv_nsec)
+#define STAT_CTIME_NANOSECONDS(st) ((st).st_ctimespec.tv_nsec)
+#else
+#define STAT_MTIME_NANOSECONDS(st) ((st).st_mtim.tv_nsec)
+#define STAT_CTIME_NANOSECONDS(st) ((st).st_ctim.tv_nsec)
+#endif
+
+using namespace v8;
+using namespace node;
+
+/**
+ * On-disk layout of an index entry, up to the flags. Everything is
+ * big-endian.
+ */
+static const size_t ENTRY_CTIME = 0;
+static const size_t ENTRY_MTIME = 8;
+static const size_t ENTRY_INODE = 20;
+static const size_t ENTRY_MODE = 24;
+static const size_t ENTRY_SIZE = 36;
+static const size_t ENTRY_OID = 40;
+static const size_t ENTRY_FLAGS = 60;
+static const size_t ENTRY_HEADER = 62;
+
+static const uint16_t FLAG_EXTENDED = 0x4000;
+static const size_t INDEX_HEADER = 12;
+static const size_t INDEX_CHECKSUM = 20;
+
+static uint32_t readUint32(const unsigned char* data) {
+  return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+         ((uint32_t)data[2] << 8) | (uint32_t)data[3];
+}
+
+static uint16_t readUint16(const unsigned char* data) {
+  return (uint16_t)((data[0] << 8) | data[1]);
+}
+
+static int corrupted() {
+  giterr_set_str(GITERR_INDEX, "Index file is corrupted");
+  return -1;
+}
+
+void GitIndex::Initialize(Handle<Object> target) {
+  HandleScope scope;
+
+  Local<FunctionTemplate> tpl = FunctionTemplate::New(New);
+
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+  tpl->SetClassName(String::NewSymbol("Index"));
+
+  NODE_SET_PROTOTYPE_METHOD(tpl, "read", Read);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "addAll", AddAll);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "find", FindPath);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "entryCount", EntryCount);
+
+  constructor_template = Persistent<Function>::New(tpl->GetFunction());
+  target->Set(String::NewSymbol("Index"), constructor_template);
+}
+
+Handle<Value> GitIndex::New(const Arguments& args) {
+  HandleScope scope;
+
+  GitIndex *index = new GitIndex();
+  index->columns.version = 2;
+  index->columns.count = 0;
+  index->columns.pathOffsets.push_back(0);
+  index->Wrap(args.This());
+
+  return scope.Close(args.This());
+}
+
+int GitIndex::ReadFile(const std::string& path, Columns& columns) {
+  columns.version = 2;
+  columns.count = 0;
+  columns.pathOffsets.clear();
+
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    if (errno == ENOENT) {
+      // Bare repositories and fresh ones have no index yet
+      columns.pathOffsets.push_back(0);
+      return GIT_OK;
+    }
+    giterr_set_str(GITERR_OS, "Failed to open index file");
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    giterr_set_str(GITERR_OS, "Failed to stat index file");
+    return -1;
+  }
+  if ((size_t)st.st_size < INDEX_HEADER + INDEX_CHECKSUM) {
+    close(fd);
+    return corrupted();
+  }
+
+  size_t length = (size_t)st.st_size;
+  void* map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    giterr_set_str(GITERR_OS, "Failed to map index file");
+    return -1;
+  }
+
+  int returnCode = Parse(static_cast<const unsigned char *>(map), length, columns);
+  munmap(map, length);
+  return returnCode;
+}
+
+/**
+ * Decode index version 2, 3 and 4 entries. Extensions and the trailing
+ * checksum are skipped.
+ */
+int GitIndex::Parse(const unsigned char* data, size_t length, Columns& columns) {
+  if (memcmp(data, "DIRC", 4) != 0) {
+    return corrupted();
+  }
+
+  columns.version = readUint32(data + 4);
+  if (columns.version < 2 || columns.version > 4) {
+    giterr_set_str(GITERR_INDEX, "Unsupported index version");
+    return -1;
+  }
+
+  size_t count = readUint32(data + 8);
+  size_t end = length - INDEX_CHECKSUM;
+  // Every entry takes at least its fixed header plus a path byte and NUL,
+  // which bounds the reservations below by the file size
+  if (count > (end - INDEX_HEADER) / (ENTRY_HEADER + 2)) {
+    return corrupted();
+  }
+
+  columns.pathTable.clear();
+  columns.pathTable.reserve(end - INDEX_HEADER - count * ENTRY_HEADER);
+  columns.pathOffsets.reserve(count + 1);
+  columns.oids.resize(count * GIT_OID_RAWSZ);
+  columns.modes.resize(count);
+  columns.stages.resize(count);
+  columns.sizes.resize(count);
+  columns.mtimeSeconds.resize(count);
+  columns.mtimeNanoseconds.resize(count);
+  columns.ctimeSeconds.resize(count);
+  columns.ctimeNanoseconds.resize(count);
+  columns.inodes.resize(count);
+
+  size_t offset = INDEX_HEADER;
+  for (size_t i = 0; i < count; i++) {
+    if (end - offset < ENTRY_HEADER) {
+      return corrupted();
+    }
+    const unsigned char* entry = data + offset;
+
+    uint16_t flags = readUint16(entry + ENTRY_FLAGS);
+    size_t cursor = offset + ENTRY_HEADER;
+    if (flags & FLAG_EXTENDED) {
+      if (columns.version < 3 || end - cursor < 2) {
+        return corrupted();
+      }
+      cursor += 2;
+    }
+
+    size_t pathStart = columns.pathTable.size();
+    if (columns.version == 4) {
+      // The path is the previous path minus a varint number of trailing
+      // bytes, followed by a NUL terminated suffix
+      if (cursor >= end) {
+        return corrupted();
+      }
+      unsigned char byte = data[cursor++];
+      size_t strip = byte & 0x7f;
+      while (byte & 0x80) {
+        if (cursor >= end) {
+          return corrupted();
+        }
+        byte = data[cursor++];
+        strip = ((strip + 1) << 7) | (byte & 0x7f);
+      }
+
+      size_t previousLength = i == 0 ? 0 : pathStart - 1 - columns.pathOffsets[i - 1];
+      if (strip > previousLength) {
+        return corrupted();
+      }
+      size_t keep = previousLength - strip;
+      if (keep > 0) {
+        columns.pathTable.resize(pathStart + keep);
+        memcpy(&columns.pathTable[pathStart], &columns.pathTable[columns.pathOffsets[i - 1]], keep);
+      }
+
+      const unsigned char* nul = (const unsigned char*)memchr(data + cursor, 0, end - cursor);
+      if (nul == NULL) {
+        return corrupted();
+      }
+      columns.pathTable.insert(columns.pathTable.end(), data + cursor, nul + 1);
+      offset = (nul + 1) - data;
+    } else {
+      const unsigned char* nul = (const unsigned char*)memchr(data + cursor, 0, end - cursor);
+      if (nul == NULL) {
+        return corrupted();
+      }
+      columns.pathTable.insert(columns.pathTable.end(), data + cursor, nul + 1);
+
+      // Entries are NUL padded to a multiple of eight bytes
+      size_t entryLength = ((cursor - offset) + (nul - (data + cursor)) + 8) & ~(size_t)7;
+      if (entryLength > end - offset) {
+        return corrupted();
+      }
+      offset += entryLength;
+    }
+
+    columns.pathOffsets.push_back((uint32_t)pathStart);
+    memcpy(&columns.oids[i * GIT_OID_RAWSZ], entry + ENTRY_OID, GIT_OID_RAWSZ);
+    columns.modes[i] = readUint32(entry + ENTRY_MODE);
+    columns.stages[i] = (uint8_t)((flags >> 12) & 0x3);
+    columns.sizes[i] = readUint32(entry + ENTRY_SIZE);
+    columns.mtimeSeconds[i] = readUint32(entry + ENTRY_MTIME);
+    columns.mtimeNanoseconds[i] = readUint32(entry + ENTRY_MTIME + 4);
+    columns.ctimeSeconds[i] = readUint32(entry + ENTRY_CTIME);
+    columns.ctimeNanoseconds[i] = readUint32(entry + ENTRY_CTIME + 4);
+    columns.inodes[i] = readUint32(entry + ENTRY_INODE);
+  }
+
+  columns.pathOffsets.push_back((uint32_t)columns.pathTable.size());
+  columns.count = count;
+  return GIT_OK;
+}
+
+int GitIndex::Find(const Columns& columns, const char* path, size_t length) {
+  // Lower bound by byte-wise path order, the order git sorts entries in
+  size_t low = 0;
+  size_t high = columns.count;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    const char* entryPath = &columns.pathTable[columns.pathOffsets[middle]];
+    size_t entryLength = columns.pathOffsets[middle + 1] - columns.pathOffsets[middle] - 1;
+    int compare = memcmp(entryPath, path, entryLength < length ? entryLength : length);
+    if (compare < 0 || (compare == 0 && entryLength < length)) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  if (low < columns.count &&
+      columns.pathOffsets[low + 1] - columns.pathOffsets[low] - 1 == length &&
+      memcmp(&columns.pathTable[columns.pathOffsets[low]], path, length) == 0) {
+    return (int)low;
+  }
+  return -1;
+}
+
+/**
+ * The JS form of columns: typed arrays and Buffers copied in one pass each.
+ */
+Local<Object> GitIndex::ColumnsToObject(const Columns& columns) {
+  HandleScope scope;
+
+  Local<Object> pathTable;
+  Buffer* pathBuffer = Buffer::New(columns.pathTable.empty() ? NULL : const_cast<char *>(&columns.pathTable[0]),
+                                   columns.pathTable.size());
+  MAKE_FAST_BUFFER(pathBuffer, pathTable);
+
+  Local<Object> oids;
+  Buffer* oidBuffer = Buffer::New(columns.oids.empty() ? NULL : (char*)&columns.oids[0],
+                                  columns.oids.size());
+  MAKE_FAST_BUFFER(oidBuffer, oids);
+
+  size_t count = columns.count;
+  Local<Object> entries = Object::New();
+  entries->Set(String::NewSymbol("version"), Integer::NewFromUnsigned(columns.version));
+  entries->Set(String::NewSymbol("count"), Integer::NewFromUnsigned(count));
+  entries->Set(String::NewSymbol("pathTable"), pathTable);
+  entries->Set(String::NewSymbol("pathOffsets"), createTypedArray("Uint32Array",
+    &columns.pathOffsets[0], count + 1, sizeof(uint32_t)));
+  entries->Set(String::NewSymbol("oids"), oids);
+  entries->Set(String::NewSymbol("modes"), createTypedArray("Uint32Array",
+    count ? &columns.modes[0] : NULL, count, sizeof(uint32_t)));
+  entries->Set(String::NewSymbol("stages"), createTypedArray("Uint8Array",
+    count ? &columns.stages[0] : NULL, count, sizeof(uint8_t)));
+  entries->Set(String::NewSymbol("sizes"), createTypedArray("Uint32Array",
+    count ? &columns.sizes[0] : NULL, count, sizeof(uint32_t)));
+  entries->Set(String::NewSymbol("mtimeSeconds"), createTypedArray("Uint32Array",
+    count ? &columns.mtimeSeconds[0] : NULL, count, sizeof(uint32_t)));
+  entries->Set(String::NewSymbol("mtimeNanoseconds"), createTypedArray("Uint32Array",
+    count ? &columns.mtimeNanoseconds[0] : NULL, count, sizeof(uint32_t)));
+
+  return scope.Close(entries);
+}
+
+Handle<Value> GitIndex::Read(const Arguments& args) {
+  HandleScope scope;
+
+  if(args.Length() == 0 || !args[0]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Repo is required and must be an Object.")));
+  }
+
+  if(args.Length() == 1 || !args[1]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Callback is required and must be a Function.")));
+  }
+
+  git_repository* repo = ObjectWrap::Unwrap<GitRepo>(args[0]->ToObject())->GetValue();
+  if (repo == NULL) {
+    return ThrowException(Exception::Error(String::New("Repo must be open.")));
+  }
+
+  ReadBaton* baton = new ReadBaton;
+  baton->request.data = baton;
+  baton->error = NULL;
+  baton->index = ObjectWrap::Unwrap<GitIndex>(args.This());
+  baton->index->Ref();
+  baton->path = std::string(git_repository_path(repo)) + "index";
+  baton->callback = Persistent<Function>::New(Local<Function>::Cast(args[1]));
+
+  uv_queue_work(uv_default_loop(), &baton->request, ReadWork, (uv_after_work_cb)ReadAfterWork);
+
+  return Undefined();
+}
+void GitIndex::ReadWork(uv_work_t *req) {
+  ReadBaton *baton = static_cast<ReadBaton *>(req->data);
+
+  if (ReadFile(baton->path, baton->columns) != GIT_OK) {
+    baton->error = giterr_last();
+  }
+}
+void GitIndex::ReadAfterWork(uv_work_t *req) {
+  HandleScope scope;
+  ReadBaton *baton = static_cast<ReadBaton *>(req->data);
+
+  if (success(baton->error, baton->callback)) {
+    GitIndex* index = baton->index;
+    std::swap(index->columns, baton->columns);
+
+    Handle<Value> argv[2] = {
+      Local<Value>::New(Null()),
+      ColumnsToObject(index->columns)
+    };
+
+    TryCatch try_catch;
+    baton->callback->Call(Context::GetCurrent()->Global(), 2, argv);
+    if (try_catch.HasCaught()) {
+      node::FatalException(try_catch);
+    }
+  }
+
+  baton->index->Unref();
+  baton->callback.Dispose();
+  delete baton;
+}
+
+Handle<Value> GitIndex::AddAll(const Arguments& args) {
+  HandleScope scope;
+
+  if(args.Length() == 0 || !args[0]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Repo is required and must be an Object.")));
+  }
+
+  if(args.Length() == 1 || !args[1]->IsArray()) {
+    return ThrowException(Exception::Error(String::New("Pathspecs are required and must be an Array.")));
+  }
+
+  if(args.Length() == 2 || !args[2]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Options are required and must be an Object.")));
+  }
+
+  if(args.Length() == 3 || !args[3]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Callback is required and must be a Function.")));
+  }
+
+  git_repository* repo = ObjectWrap::Unwrap<GitRepo>(args[0]->ToObject())->GetValue();
+  if (repo == NULL) {
+    return ThrowException(Exception::Error(String::New("Repo must be open.")));
+  }
+
+  AddAllBaton* baton = new AddAllBaton;
+  baton->request.data = baton;
+  baton->error = NULL;
+  baton->index = ObjectWrap::Unwrap<GitIndex>(args.This());
+  baton->index->Ref();
+  baton->repoPath = git_repository_path(repo);
+  baton->indexMtimeSeconds = 0;
+  baton->indexMtimeNanoseconds = 0;
+  baton->nextCandidate = 0;
+  baton->scanned = 0;
+  baton->unchanged = 0;
+  baton->removed = 0;
+
+  Local<Array> pathspecs = Local<Array>::Cast(args[1]);
+  for (uint32_t i = 0; i < pathspecs->Length(); i++) {
+    std::string pathspec = stringArgToString(pathspecs->Get(i)->ToString());
+    // "." and "dir/" name the whole tree and a directory
+    while (pathspec.length() > 1 && pathspec[pathspec.length() - 1] == '/') {
+      pathspec.erase(pathspec.length() - 1);
+    }
+    if (pathspec.empty() || pathspec == ".") {
+      baton->pathspecs.clear();
+      break;
+    }
+    baton->pathspecs.push_back(pathspec);
+  }
+
+  Local<Object> options = args[2]->ToObject();
+  Local<Value> threads = options->Get(String::NewSymbol("threads"));
+  baton->threads = threads->IsNumber() ? threads->Int32Value() : GitIndex::ADD_ALL_DEFAULT_THREADS;
+  if (baton->threads < 1) {
+    baton->threads = 1;
+  }
+
+  uv_mutex_init(&baton->mutex);
+  baton->callback = Persistent<Function>::New(Local<Function>::Cast(args[3]));
+
+  uv_queue_work(uv_default_loop(), &baton->request, AddAllWork, (uv_after_work_cb)AddAllAfterWork);
+
+  return Undefined();
+}
+
+/**
+ * An empty list matches everything. Otherwise a pathspec matches itself,
+ * everything below it, and whatever it matches as an fnmatch pattern.
+ */
+bool GitIndex::MatchesPathspec(const std::vector<std::string>& pathspecs, const std::string& path) {
+  if (pathspecs.empty()) {
+    return true;
+  }
+  for (size_t i = 0; i < pathspecs.size(); i++) {
+    const std::string& pathspec = pathspecs[i];
+    if (path.compare(0, pathspec.length(), pathspec) == 0 &&
+        (path.length() == pathspec.length() || path[pathspec.length()] == '/')) {
+      return true;
+    }
+    if (fnmatch(pathspec.c_str(), path.c_str(), 0) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Whether anything below directory (ending in a slash) can match, so
+ * directories outside every pathspec are never read.
+ */
+bool GitIndex::MayMatchBelow(const std::vector<std::string>& pathspecs, const std::string& directory) {
+  if (pathspecs.empty()) {
+    return true;
+  }
+  for (size_t i = 0; i < pathspecs.size(); i++) {
+    const std::string& pathspec = pathspecs[i];
+    if (pathspec.find_first_of("*?[") != std::string::npos) {
+      return true;
+    }
+    std::string prefix = pathspec + "/";
+    if (directory.compare(0, prefix.length(), prefix) == 0 ||
+        prefix.compare(0, directory.length(), directory) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool GitIndex::HasTrackedBelow(git_index* index, const std::string& directory) {
+  size_t low = 0;
+  size_t high = git_index_entrycount(index);
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (strcmp(git_index_get_byindex(index, middle)->path, directory.c_str()) < 0) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low < git_index_entrycount(index) &&
+    strncmp(git_index_get_byindex(index, low)->path, directory.c_str(), directory.length()) == 0;
+}
+
+/**
+ * The same stat cache check as status: unchanged only if the stat data
+ * matches and the entry was not written in the same instant as the index.
+ */
+bool GitIndex::StatMatches(AddAllBaton* baton, const git_index_entry* entry, const struct stat& st) {
+  if (git_index_entry_stage(entry) != 0) {
+    return false;
+  }
+
+  bool isLink = entry->mode == GIT_FILEMODE_LINK;
+  if (isLink != S_ISLNK(st.st_mode)) {
+    return false;
+  }
+  if (!isLink && ((st.st_mode & S_IXUSR) != 0) != (entry->mode == GIT_FILEMODE_BLOB_EXECUTABLE)) {
+    return false;
+  }
+
+  bool statClean = (git_off_t)st.st_size == entry->file_size &&
+    st.st_mtime == entry->mtime.seconds &&
+    (entry->mtime.nanoseconds == 0 || (unsigned int)STAT_MTIME_NANOSECONDS(st) == entry->mtime.nanoseconds) &&
+    st.st_ctime == entry->ctime.seconds &&
+    (unsigned int)st.st_ino == entry->ino;
+
+  bool racy = baton->indexMtimeSeconds == 0 ||
+    entry->mtime.seconds > baton->indexMtimeSeconds ||
+    (entry->mtime.seconds == baton->indexMtimeSeconds &&
+     entry->mtime.nanoseconds >= baton->indexMtimeNanoseconds);
+
+  return statClean && !racy;
+}
+
+/**
+ * Walk directory (relative to the working directory, ending in a slash
+ * unless it is the root) and queue every matching file the index does not
+ * already have with the same stat data.
+ */
+int GitIndex::AddAllWalk(AddAllBaton* baton, git_repository* repo, git_index* index,
+                         std::vector<bool>& seen, const std::string& directory) {
+  DIR* dir = opendir((baton->workdir + directory).c_str());
+  if (dir == NULL) {
+    // Unreadable directories are skipped, as git does
+    return GIT_OK;
+  }
+
+  std::vector<std::string> names;
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 ||
+        strcmp(entry->d_name, ".git") == 0) {
+      continue;
+    }
+    names.push_back(entry->d_name);
+  }
+  closedir(dir);
+
+  for (size_t i = 0; i < names.size(); i++) {
+    std::string path = directory + names[i];
+    AddCandidate candidate;
+    if (lstat((baton->workdir + path).c_str(), &candidate.st) != 0) {
+      continue;
+    }
+
+    int returnCode;
+    if (S_ISDIR(candidate.st.st_mode)) {
+      std::string subdirectory = path + "/";
+      if (!MayMatchBelow(baton->pathspecs, subdirectory)) {
+        continue;
+      }
+      // Ignored directories are only entered for the files already tracked
+      if (!HasTrackedBelow(index, subdirectory)) {
+        int ignored = 0;
+        returnCode = git_status_should_ignore(&ignored, repo, path.c_str());
+        if (returnCode != GIT_OK) {
+          return returnCode;
+        }
+        if (ignored) {
+          continue;
+        }
+      }
+      returnCode = AddAllWalk(baton, repo, index, seen, subdirectory);
+      if (returnCode != GIT_OK) {
+        return returnCode;
+      }
+      continue;
+    }
+
+    if (!(S_ISREG(candidate.st.st_mode) || S_ISLNK(candidate.st.st_mode)) ||
+        !MatchesPathspec(baton->pathspecs, path)) {
+      continue;
+    }
+    baton->scanned++;
+
+    int position = git_index_find(index, path.c_str());
+    if (position >= 0) {
+      seen[position] = true;
+      if (StatMatches(baton, git_index_get_byindex(index, position), candidate.st)) {
+        baton->unchanged++;
+        continue;
+      }
+    } else {
+      giterr_clear();
+      int ignored = 0;
+      returnCode = git_status_should_ignore(&ignored, repo, path.c_str());
+      if (returnCode != GIT_OK) {
+        return returnCode;
+      }
+      if (ignored) {
+        continue;
+      }
+    }
+
+    candidate.path = path;
+    baton->candidates.push_back(candidate);
+  }
+
+  return GIT_OK;
+}
+
+void GitIndex::AddAllWorkHash(void *payload) {
+  AddAllBaton* baton = static_cast<AddAllBaton *>(payload);
+
+  // Blobs go through the repository's filters and object database, and
+  // libgit2 objects must not be shared across threads
+  git_repository* repo = NULL;
+  if (git_repository_open(&repo, baton->repoPath.c_str()) != GIT_OK) {
+    const git_error* error = giterr_last();
+    uv_mutex_lock(&baton->mutex);
+    baton->workerError = error ? error->message : "Failed to open repository";
+    baton->nextCandidate = baton->candidates.size();
+    uv_mutex_unlock(&baton->mutex);
+    return;
+  }
+
+  while (true) {
+    uv_mutex_lock(&baton->mutex);
+    size_t start = baton->nextCandidate;
+    if (start < baton->candidates.size()) {
+      baton->nextCandidate = std::min(start + GitIndex::ADD_ALL_BATCH_SIZE, baton->candidates.size());
+    }
+    size_t end = baton->nextCandidate;
+    uv_mutex_unlock(&baton->mutex);
+
+    if (start >= end) {
+      break;
+    }
+
+    for (size_t i = start; i < end; i++) {
+      AddCandidate& candidate = baton->candidates[i];
+      if (git_blob_create_fromworkdir(&candidate.oid, repo, candidate.path.c_str()) != GIT_OK) {
+        const git_error* error = giterr_last();
+        uv_mutex_lock(&baton->mutex);
+        if (baton->workerError.empty()) {
+          baton->workerError = error ? error->message : "Failed to create blob";
+        }
+        baton->nextCandidate = baton->candidates.size();
+        uv_mutex_unlock(&baton->mutex);
+        break;
+      }
+    }
+  }
+
+  git_repository_free(repo);
+}
+
+void GitIndex::AddAllWork(uv_work_t *req) {
+  AddAllBaton* baton = static_cast<AddAllBaton *>(req->data);
+
+  git_repository* repo = NULL;
+  int returnCode = git_repository_open(&repo, baton->repoPath.c_str());
+  if (returnCode != GIT_OK) {
+    baton->error = giterr_last();
+    return;
+  }
+
+  if (git_repository_is_bare(repo)) {
+    git_repository_free(repo);
+    giterr_set_str(GITERR_REPOSITORY, "Cannot add files to a bare repository");
+    baton->error = giterr_last();
+    return;
+  }
+  baton->workdir = git_repository_workdir(repo);
+
+  git_index* index = NULL;
+  returnCode = git_repository_index(&index, repo);
+  if (returnCode != GIT_OK) {
+    git_repository_free(repo);
+    baton->error = giterr_last();
+    return;
+  }
+
+  struct stat indexStat;
+  if (stat((baton->repoPath + "index").c_str(), &indexStat) == 0) {
+    baton->indexMtimeSeconds = indexStat.st_mtime;
+    baton->indexMtimeNanoseconds = (unsigned int)STAT_MTIME_NANOSECONDS(indexStat);
+  }
+
+  std::vector<bool> seen(git_index_entrycount(index), false);
+  returnCode = AddAllWalk(baton, repo, index, seen, "");
+
+  // Tracked files under the pathspecs that are gone from the working
+  // directory are removed, like git add --all. Collected before anything
+  // is added, since adding shifts positions.
+  std::vector<std::string> removedPaths;
+  for (size_t i = 0; returnCode == GIT_OK && i < seen.size(); i++) {
+    const git_index_entry* entry = git_index_get_byindex(index, i);
+    struct stat st;
+    if (!seen[i] && git_index_entry_stage(entry) == 0 &&
+        MatchesPathspec(baton->pathspecs, entry->path) &&
+        lstat((baton->workdir + entry->path).c_str(), &st) != 0) {
+      removedPaths.push_back(entry->path);
+    }
+  }
+
+  if (returnCode == GIT_OK && !baton->candidates.empty()) {
+    int threads = std::min((size_t)baton->threads, baton->candidates.size());
+    std::vector<uv_thread_t> workers(threads);
+    for (int i = 0; i < threads; i++) {
+      uv_thread_create(&workers[i], AddAllWorkHash, baton);
+    }
+    for (int i = 0; i < threads; i++) {
+      uv_thread_join(&workers[i]);
+    }
+    if (!baton->workerError.empty()) {
+      giterr_set_str(GITERR_INDEX, baton->workerError.c_str());
+      returnCode = -1;
+    }
+  }
+
+  for (size_t i = 0; returnCode == GIT_OK && i < baton->candidates.size(); i++) {
+    const AddCandidate& candidate = baton->candidates[i];
+    const struct stat& st = candidate.st;
+
+    git_index_entry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.ctime.seconds = st.st_ctime;
+    entry.ctime.nanoseconds = (unsigned int)STAT_CTIME_NANOSECONDS(st);
+    entry.mtime.seconds = st.st_mtime;
+    entry.mtime.nanoseconds = (unsigned int)STAT_MTIME_NANOSECONDS(st);
+    entry.dev = (unsigned int)st.st_dev;
+    entry.ino = (unsigned int)st.st_ino;
+    if (S_ISLNK(st.st_mode)) {
+      entry.mode = GIT_FILEMODE_LINK;
+    } else {
+      entry.mode = (st.st_mode & S_IXUSR) ? GIT_FILEMODE_BLOB_EXECUTABLE : GIT_FILEMODE_BLOB;
+    }
+    entry.uid = (unsigned int)st.st_uid;
+    entry.gid = (unsigned int)st.st_gid;
+    entry.file_size = (git_off_t)st.st_size;
+    git_oid_cpy(&entry.oid, &candidate.oid);
+    entry.path = const_cast<char *>(candidate.path.c_str());
+
+    returnCode = git_index_add(index, &entry);
+  }
+
+  for (size_t i = 0; returnCode == GIT_OK && i < removedPaths.size(); i++) {
+    returnCode = git_index_remove(index, removedPaths[i].c_str(), 0);
+    baton->removed++;
+  }
+
+  if (returnCode == GIT_OK && (!baton->candidates.empty() || !removedPaths.empty())) {
+    returnCode = git_index_write(index);
+  }
+
+  git_index_free(index);
+  git_repository_free(repo);
+
+  // Refresh the columnar view from what was just written
+  if (returnCode == GIT_OK) {
+    returnCode = ReadFile(baton->repoPath + "index", baton->columns);
+  }
+
+  if (returnCode != GIT_OK) {
+    baton->error = giterr_last();
+  }
+}
+void GitIndex::AddAllAfterWork(uv_work_t *req) {
+  HandleScope scope;
+  AddAllBaton *baton = static_cast<AddAllBaton *>(req->data);
+
+  if (success(baton->error, baton->callback)) {
+    std::swap(baton->index->columns, baton->columns);
+
+    Local<Object> result = Object::New();
+    result->Set(String::NewSymbol("scanned"), Integer::NewFromUnsigned(baton->scanned));
+    result->Set(String::NewSymbol("unchanged"), Integer::NewFromUnsigned(baton->unchanged));
+    result->Set(String::NewSymbol("added"), Integer::NewFromUnsigned(baton->candidates.size()));
+    result->Set(String::NewSymbol("removed"), Integer::NewFromUnsigned(baton->removed));
+    result->Set(String::NewSymbol("entries"), ColumnsToObject(baton->index->columns));
+
+    Handle<Value> argv[2] = {
+      Local<Value>::New(Null()),
+      result
+    };
+
+    TryCatch try_catch;
+    baton->callback->Call(Context::GetCurrent()->Global(), 2, argv);
+    if (try_catch.HasCaught()) {
+      node::FatalException(try_catch);
+    }
+  }
+
+  uv_mutex_destroy(&baton->mutex);
+  baton->index->Unref();
+  baton->callback.Dispose();
+  delete baton;
+}
+
+Handle<Value> GitIndex::FindPath(const Arguments& args) {
+  HandleScope scope;
+
+  if(args.Length() == 0 || !args[0]->IsString()) {
+    return ThrowException(Exception::Error(String::New("Path is required and must be a String.")));
+  }
+
+  GitIndex* index = ObjectWrap::Unwrap<GitIndex>(args.This());
+  std::string path = stringArgToString(args[0]->ToString());
+
+  return scope.Close(Integer::New(Find(index->columns, path.c_str(), path.length())));
+}
+
+Handle<Value> GitIndex::EntryCount(const Arguments& args) {
+  HandleScope scope;
+
+  GitIndex* index = ObjectWrap::Unwrap<GitIndex>(args.This());
+
+  return scope.Close(Integer::NewFromUnsigned(index->columns.count));
+}
+
+Persistent<Function> GitIndex::constructor_template;
@@ -0,0 +1,967 @@
+/*
+ * Copyright 2013, Tim Branyen @tbranyen <tim@tabdeveloper.com>
+ * @author Michael Robinson @codeofinterest <mike@pagesofinterest.net>
+ *
+ * Dual licensed under the MIT and GPL licenses.
+ */
+
+#include <v8.h>
+#include <node.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "cvv8/v8-convert.hpp"
+#include "git2.h"
+
+#include "../include/repo.h"
+#include "../include/indexer.h"
+#include "../include/error.h"
+
+#include "../include/functions/file.h"
+#include "../include/functions/sha1.h"
+#include "../include/functions/string.h"
+#include "../include/functions/utilities.h"
+
+using namespace v8;
+using namespace node;
+
+void GitIndexer::Initialize(Handle<v8::Object> target) {
+  HandleScope scope;
+
+  Local<FunctionTemplate> tpl = FunctionTemplate::New(New);
+
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+  tpl->SetClassName(String::NewSymbol("Indexer"));
+
+  NODE_SET_PROTOTYPE_METHOD(tpl, "indexPack", IndexPack);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "fsck", Fsck);
+
+  constructor_template = Persistent<Function>::New(tpl->GetFunction());
+  target->Set(String::NewSymbol("Indexer"), constructor_template);
+}
+
+Handle<Value> GitIndexer::New(const Arguments& args) {
+  HandleScope scope;
+
+  GitIndexer *indexer = new GitIndexer();
+  indexer->Wrap(args.This());
+
+  return scope.Close(args.This());
+}
+
+static bool oidEdgeLess(const std::pair<git_oid, size_t>& a, const std::pair<git_oid, size_t>& b) {
+  return git_oid_cmp(&a.first, &b.first) < 0;
+}
+
+static bool entryOffsetLess(const uint64_t& offset, const PackIndexEntry& entry) {
+  return offset < entry.offset;
+}
+
+GitIndexer::VerifyBaton* GitIndexer::NewBaton(git_repository* repo, const std::string& packPath, Local<Object> options,
+                                              Local<Value> progressCallback, Local<Value> endCallback) {
+  VerifyBaton* baton = new VerifyBaton;
+  uv_async_init(uv_default_loop(), &baton->asyncProgress, VerifyWorkSendProgress);
+  uv_async_init(uv_default_loop(), &baton->asyncEnd, VerifyWorkSendEnd);
+  baton->asyncProgress.data = baton;
+  baton->asyncEnd.data = baton;
+  uv_mutex_init(&baton->mutex);
+
+  baton->repoPath = git_repository_path(repo);
+  baton->packPath = packPath;
+
+  Local<Value> threads = options->Get(String::NewSymbol("threads"));
+  baton->threads = threads->IsNumber() && threads->Int32Value() > 0 ? threads->Int32Value() : DEFAULT_THREADS;
+  Local<Value> connectivity = options->Get(String::NewSymbol("connectivity"));
+  baton->connectivity = connectivity->IsUndefined() || connectivity->BooleanValue();
+  baton->install = options->Get(String::NewSymbol("install"))->BooleanValue();
+
+  baton->stage = "";
+  baton->processed = 0;
+  baton->total = 0;
+  baton->nextWork = 0;
+  baton->pack = NULL;
+  baton->packLength = 0;
+  baton->objects = 0;
+  baton->deltas = 0;
+
+  baton->progressCallback = Persistent<Function>::New(Local<Function>::Cast(progressCallback));
+  baton->endCallback = Persistent<Function>::New(Local<Function>::Cast(endCallback));
+  return baton;
+}
+
+Handle<Value> GitIndexer::IndexPack(const Arguments& args) {
+  HandleScope scope;
+
+  if(args.Length() == 0 || !args[0]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Repo is required and must be an Object.")));
+  }
+
+  if(args.Length() == 1 || !args[1]->IsString()) {
+    return ThrowException(Exception::Error(String::New("Pack path is required and must be a String.")));
+  }
+
+  if(args.Length() == 2 || !args[2]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Options are required and must be an Object.")));
+  }
+
+  if(args.Length() == 3 || !args[3]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Progress callback is required and must be a Function.")));
+  }
+
+  if(args.Length() == 4 || !args[4]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("End callback is required and must be a Function.")));
+  }
+
+  git_repository* repo = ObjectWrap::Unwrap<GitRepo>(args[0]->ToObject())->GetValue();
+  if (repo == NULL) {
+    return ThrowException(Exception::Error(String::New("Repo must be open.")));
+  }
+
+  VerifyBaton* baton = NewBaton(repo, stringArgToString(args[1]->ToString()), args[2]->ToObject(), args[3], args[4]);
+  uv_thread_create(&baton->threadId, IndexPackWork, baton);
+
+  return Undefined();
+}
+
+Handle<Value> GitIndexer::Fsck(const Arguments& args) {
+  HandleScope scope;
+
+  if(args.Length() == 0 || !args[0]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Repo is required and must be an Object.")));
+  }
+
+  if(args.Length() == 1 || !args[1]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Options are required and must be an Object.")));
+  }
+
+  if(args.Length() == 2 || !args[2]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Progress callback is required and must be a Function.")));
+  }
+
+  if(args.Length() == 3 || !args[3]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("End callback is required and must be a Function.")));
+  }
+
+  git_repository* repo = ObjectWrap::Unwrap<GitRepo>(args[0]->ToObject())->GetValue();
+  if (repo == NULL) {
+    return ThrowException(Exception::Error(String::New("Repo must be open.")));
+  }
+
+  VerifyBaton* baton = NewBaton(repo, "", args[1]->ToObject(), args[2], args[3]);
+  uv_thread_create(&baton->threadId, FsckWork, baton);
+
+  return Undefined();
+}
+
+/**
+ * Count increment more objects towards stage, starting a new count when
+ * the stage changes.
+ */
+void GitIndexer::Progress(VerifyBaton* baton, const char* stage, size_t total, size_t increment) {
+  uv_mutex_lock(&baton->mutex);
+  bool send = baton->stage != stage;
+  if (send) {
+    baton->stage = stage;
+    baton->processed = 0;
+    baton->total = total;
+  }
+  baton->processed += increment;
+  send = send || (increment > 0 && baton->processed % PROGRESS_INTERVAL == 0);
+  uv_mutex_unlock(&baton->mutex);
+
+  if (send) {
+    uv_async_send(&baton->asyncProgress);
+  }
+}
+
+void GitIndexer::AddCorrupt(VerifyBaton* baton, const git_oid* oid, const PackEntry* entry, const std::string& reason) {
+  Problem problem;
+  problem.hasOid = oid != NULL;
+  if (oid != NULL) {
+    git_oid_cpy(&problem.oid, oid);
+  }
+  problem.hasOffset = entry != NULL;
+  problem.offset = entry != NULL ? entry->offset : 0;
+  problem.reason = reason;
+
+  uv_mutex_lock(&baton->mutex);
+  baton->corrupt.push_back(problem);
+  uv_mutex_unlock(&baton->mutex);
+}
+
+/**
+ * Append the ids a commit, tree or tag points at. Submodule commits in
+ * trees live in another repository and are skipped.
+ */
+void GitIndexer::CollectReferences(git_otype type, const unsigned char* data, size_t length,
+                                   std::vector<git_oid>& references) {
+  const char* text = reinterpret_cast<const char*>(data);
+  git_oid oid;
+
+  if (type == GIT_OBJ_COMMIT || type == GIT_OBJ_TAG) {
+    size_t position = 0;
+    while (position < length && text[position] != '\n') {
+      const char* line = text + position;
+      const char* lineEnd = static_cast<const char*>(memchr(line, '\n', length - position));
+      size_t lineLength = lineEnd ? (size_t)(lineEnd - line) : length - position;
+
+      const char* hex = NULL;
+      if (type == GIT_OBJ_COMMIT && lineLength >= 45 && memcmp(line, "tree ", 5) == 0) {
+        hex = line + 5;
+      } else if (type == GIT_OBJ_COMMIT && lineLength >= 47 && memcmp(line, "parent ", 7) == 0) {
+        hex = line + 7;
+      } else if (type == GIT_OBJ_TAG && lineLength >= 47 && memcmp(line, "object ", 7) == 0) {
+        hex = line + 7;
+      }
+      if (hex != NULL && git_oid_fromstrn(&oid, hex, GIT_OID_HEXSZ) == GIT_OK) {
+        references.push_back(oid);
+      }
+
+      position += lineLength + 1;
+    }
+  } else if (type == GIT_OBJ_TREE) {
+    size_t position = 0;
+    while (position < length) {
+      const char* nul = static_cast<const char*>(memchr(text + position, '\0', length - position));
+      if (nul == NULL || (size_t)(nul - text) + 1 + GIT_OID_RAWSZ > length) {
+        break;
+      }
+      if (strncmp(text + position, "160000 ", 7) != 0) {
+        git_oid_fromraw(&oid, reinterpret_cast<const unsigned char*>(nul + 1));
+        references.push_back(oid);
+      }
+      position = (nul - text) + 1 + GIT_OID_RAWSZ;
+    }
+  }
+}
+
+/**
+ * Every collected reference must be in known (sorted) or, when odb is
+ * given, in the object database.
+ */
+void GitIndexer::CheckConnectivity(VerifyBaton* baton, const std::vector<git_oid>& known, git_odb* odb) {
+  std::sort(baton->references.begin(), baton->references.end(), OidLess());
+  baton->references.erase(std::unique(baton->references.begin(), baton->references.end(), OidEqual()),
+                          baton->references.end());
+
+  Progress(baton, "connectivity", baton->references.size(), 0);
+  for (size_t i = 0; i < baton->references.size(); i++) {
+    const git_oid& reference = baton->references[i];
+    if (!std::binary_search(known.begin(), known.end(), reference, OidLess()) &&
+        (odb == NULL || !git_odb_exists(odb, &reference))) {
+      baton->missing.push_back(reference);
+    }
+    Progress(baton, "connectivity", 0, 1);
+  }
+}
+
+void GitIndexer::RunWorkers(VerifyBaton* baton, void (*work)(void *)) {
+  baton->nextWork = 0;
+  std::vector<uv_thread_t> threadIds(baton->threads);
+  for (int i = 0; i < baton->threads; i++) {
+    uv_thread_create(&threadIds[i], work, baton);
+  }
+  for (int i = 0; i < baton->threads; i++) {
+    uv_thread_join(&threadIds[i]);
+  }
+}
+
+/**
+ * Read the entry header at offset and inflate its data once to learn
+ * where it ends; zlib streams give no other way to skip them.
+ */
+bool GitIndexer::ParseEntry(VerifyBaton* baton, uint64_t offset, PackEntry& entry, std::string& reason) {
+  const unsigned char* pack = baton->pack;
+  uint64_t limit = baton->packLength - Sha1::DIGEST_SIZE;
+  uint64_t position = offset;
+
+  memset(&entry, 0, sizeof(entry));
+  entry.offset = offset;
+
+  if (position >= limit) {
+    reason = "Entry header is truncated";
+    return false;
+  }
+  unsigned char c = pack[position++];
+  entry.packType = (git_otype)((c >> 4) & 7);
+  uint64_t size = c & 0x0f;
+  int shift = 4;
+  while (c & 0x80) {
+    if (position >= limit || shift > 57) {
+      reason = "Entry header is truncated";
+      return false;
+    }
+    c = pack[position++];
+    size |= (uint64_t)(c & 0x7f) << shift;
+    shift += 7;
+  }
+  if (size > UINT_MAX) {
+    reason = "Objects over 4GB are not supported";
+    return false;
+  }
+  entry.size = (size_t)size;
+
+  if (entry.packType == GIT_OBJ_OFS_DELTA) {
+    if (position >= limit) {
+      reason = "Delta base offset is truncated";
+      return false;
+    }
+    c = pack[position++];
+    uint64_t distance = c & 0x7f;
+    while (c & 0x80) {
+      if (position >= limit || distance > (UINT64_MAX >> 8)) {
+        reason = "Delta base offset is truncated";
+        return false;
+      }
+      c = pack[position++];
+      distance = ((distance + 1) << 7) | (c & 0x7f);
+    }
+    if (distance == 0 || distance > offset) {
+      reason = "Delta base offset is out of range";
+      return false;
+    }
+    entry.baseOffset = offset - distance;
+  } else if (entry.packType == GIT_OBJ_REF_DELTA) {
+    if (position + GIT_OID_RAWSZ > limit) {
+      reason = "Delta base id is truncated";
+      return false;
+    }
+    git_oid_fromraw(&entry.baseOid, pack + position);
+    position += GIT_OID_RAWSZ;
+  } else if (entry.packType < GIT_OBJ_COMMIT || entry.packType > GIT_OBJ_TAG) {
+    reason = "Unknown object type";
+    return false;
+  }
+  entry.dataOffset = position;
+
+  if (!Inflate(baton, entry, NULL, &entry.end)) {
+    reason = "Data does not inflate to the recorded size";
+    return false;
+  }
+
+  entry.crc = crc32(0L, pack + entry.offset, (uInt)(entry.end - entry.offset));
+  return true;
+}
+
+/**
+ * Inflate entry's data into out, or with out NULL only count it through a
+ * small buffer. ParseEntry counts every entry first, so the size in an
+ * entry header is never allocated before its data proves it.
+ */
+bool GitIndexer::Inflate(const VerifyBaton* baton, const PackEntry& entry, std::vector<unsigned char>* out,
+                         uint64_t* end) {
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (inflateInit(&stream) != Z_OK) {
+    return false;
+  }
+
+  const unsigned char* input = baton->pack + entry.dataOffset;
+  uint64_t remaining = baton->packLength - Sha1::DIGEST_SIZE - entry.dataOffset;
+
+  unsigned char chunk[INFLATE_CHUNK_SIZE];
+  if (out != NULL) {
+    out->resize(entry.size);
+    stream.next_out = entry.size > 0 ? &(*out)[0] : chunk;
+    stream.avail_out = (uInt)entry.size;
+  }
+
+  int status = Z_OK;
+  while (status == Z_OK) {
+    if (out == NULL && stream.avail_out == 0) {
+      if (stream.total_out > entry.size) {
+        break;
+      }
+      stream.next_out = chunk;
+      stream.avail_out = sizeof(chunk);
+    }
+    if (stream.avail_in == 0) {
+      if (remaining == 0) {
+        break;
+      }
+      uInt length = remaining > (1U << 30) ? (1U << 30) : (uInt)remaining;
+      stream.next_in = const_cast<Bytef*>(input);
+      stream.avail_in = length;
+      input += length;
+      remaining -= length;
+    }
+    status = inflate(&stream, Z_NO_FLUSH);
+  }
+
+  bool inflated = status == Z_STREAM_END && stream.total_out == entry.size;
+  if (inflated && end != NULL) {
+    *end = entry.dataOffset + stream.total_in;
+  }
+  inflateEnd(&stream);
+  return inflated;
+}
+
+static bool deltaSize(const std::vector<unsigned char>& delta, size_t& position, size_t& size) {
+  size = 0;
+  int shift = 0;
+  unsigned char c;
+  do {
+    if (position >= delta.size() || shift > 57) {
+      return false;
+    }
+    c = delta[position++];
+    size |= (size_t)(c & 0x7f) << shift;
+    shift += 7;
+  } while (c & 0x80);
+  return true;
+}
+
+/**
+ * Apply a git delta: the base and result sizes, then copy instructions
+ * (a base range) and insert instructions (literal bytes).
+ */
+bool GitIndexer::ApplyDelta(const std::vector<unsigned char>& base, const std::vector<unsigned char>& delta,
+                            std::vector<unsigned char>& out) {
+  size_t position = 0;
+  size_t baseSize;
+  size_t resultSize;
+  if (!deltaSize(delta, position, baseSize) || baseSize != base.size() ||
+      !deltaSize(delta, position, resultSize)) {
+    return false;
+  }
+
+  out.resize(resultSize);
+  size_t written = 0;
+  while (position < delta.size()) {
+    unsigned char command = delta[position++];
+    if (command & 0x80) {
+      size_t copyOffset = 0;
+      size_t copySize = 0;
+      for (int i = 0; i < 4; i++) {
+        if (command & (1 << i)) {
+          if (position >= delta.size()) {
+            return false;
+          }
+          copyOffset |= (size_t)delta[position++] << (i * 8);
+        }
+      }
+      for (int i = 0; i < 3; i++) {
+        if (command & (0x10 << i)) {
+          if (position >= delta.size()) {
+            return false;
+          }
+          copySize |= (size_t)delta[position++] << (i * 8);
+        }
+      }
+      if (copySize == 0) {
+        copySize = 0x10000;
+      }
+      if (copyOffset + copySize > base.size() || written + copySize > resultSize) {
+        return false;
+      }
+      memcpy(&out[written], &base[copyOffset], copySize);
+      written += copySize;
+    } else if (command != 0) {
+      if (position + command > delta.size() || written + command > resultSize) {
+        return false;
+      }
+      memcpy(&out[written], &delta[position], command);
+      position += command;
+      written += command;
+    } else {
+      return false;
+    }
+  }
+  return written == resultSize;
+}
+
+/**
+ * Hash entry index, whose data is resolved, then resolve every delta
+ * based on it, depth first, so each base is inflated once per family.
+ */
+void GitIndexer::ResolveFamily(VerifyBaton* baton, size_t index, std::vector<unsigned char>& data,
+                               std::vector<git_oid>& references) {
+  PackEntry& entry = baton->entries[index];
+  git_odb_hash(&entry.oid, data.empty() ? NULL : &data[0], data.size(), entry.type);
+  if (baton->connectivity) {
+    CollectReferences(entry.type, data.empty() ? NULL : &data[0], data.size(), references);
+  }
+  Progress(baton, "resolving", 0, 1);
+
+  std::vector<size_t> children;
+  std::vector<std::pair<size_t, size_t> >::iterator edge =
+    std::lower_bound(baton->offsetChildren.begin(), baton->offsetChildren.end(), std::make_pair(index, (size_t)0));
+  for (; edge != baton->offsetChildren.end() && edge->first == index; ++edge) {
+    children.push_back(edge->second);
+  }
+  std::pair<std::vector<std::pair<git_oid, size_t> >::iterator, std::vector<std::pair<git_oid, size_t> >::iterator> byOid =
+    std::equal_range(baton->oidChildren.begin(), baton->oidChildren.end(), std::make_pair(entry.oid, (size_t)0), oidEdgeLess);
+  for (; byOid.first != byOid.second; ++byOid.first) {
+    children.push_back(byOid.first->second);
+  }
+
+  std::vector<unsigned char> delta;
+  std::vector<unsigned char> result;
+  for (size_t i = 0; i < children.size(); i++) {
+    PackEntry& child = baton->entries[children[i]];
+
+    // A duplicated base would offer its oid children twice
+    uv_mutex_lock(&baton->mutex);
+    bool taken = child.resolved;
+    child.resolved = true;
+    uv_mutex_unlock(&baton->mutex);
+    if (taken) {
+      continue;
+    }
+
+    if (!Inflate(baton, child, &delta, NULL) || !ApplyDelta(data, delta, result)) {
+      child.corrupt = true;
+      AddCorrupt(baton, NULL, &child, "Delta does not apply to its base");
+      continue;
+    }
+    child.type = entry.type;
+    ResolveFamily(baton, children[i], result, references);
+  }
+}
+
+void GitIndexer::IndexPackWorkResolve(void *payload) {
+  VerifyBaton* baton = static_cast<VerifyBaton *>(payload);
+  std::vector<git_oid> references;
+  std::vector<unsigned char> data;
+
+  for (;;) {
+    uv_mutex_lock(&baton->mutex);
+    size_t next = baton->nextWork++;
+    if (next < baton->roots.size()) {
+      baton->entries[baton->roots[next]].resolved = true;
+    }
+    uv_mutex_unlock(&baton->mutex);
+    if (next >= baton->roots.size()) {
+      break;
+    }
+
+    PackEntry& root = baton->entries[baton->roots[next]];
+    if (!Inflate(baton, root, &data, NULL)) {
+      root.corrupt = true;
+      AddCorrupt(baton, NULL, &root, "Data does not inflate to the recorded size");
+      continue;
+    }
+    root.type = root.packType;
+    ResolveFamily(baton, baton->roots[next], data, references);
+  }
+
+  uv_mutex_lock(&baton->mutex);
+  baton->references.insert(baton->references.end(), references.begin(), references.end());
+  uv_mutex_unlock(&baton->mutex);
+}
+
+void GitIndexer::IndexPackWork(void *payload) {
+  VerifyBaton* baton = static_cast<VerifyBaton *>(payload);
+
+  git_repository* repo = NULL;
+  git_odb* odb = NULL;
+  int fd = -1;
+  void* map = MAP_FAILED;
+  struct stat st;
+  int returnCode = git_repository_open(&repo, baton->repoPath.c_str());
+  if (returnCode == GIT_OK) {
+    returnCode = git_repository_odb(&odb, repo);
+  }
+
+  if (returnCode == GIT_OK) {
+    fd = open(baton->packPath.c_str(), O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+      setOsError("Failed to open", baton->packPath);
+      returnCode = -1;
+    } else if ((size_t)st.st_size < 12 + Sha1::DIGEST_SIZE) {
+      giterr_set_str(GITERR_INDEXER, "Pack is too short");
+      returnCode = -1;
+    } else {
+      map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (map == MAP_FAILED) {
+        setOsError("Failed to map", baton->packPath);
+        returnCode = -1;
+      }
+    }
+  }
+
+  uint32_t count = 0;
+  if (returnCode == GIT_OK) {
+    baton->pack = static_cast<const unsigned char*>(map);
+    baton->packLength = st.st_size;
+    const unsigned char* header = baton->pack;
+    uint32_t version = (header[4] << 24) | (header[5] << 16) | (header[6] << 8) | header[7];
+    count = (header[8] << 24) | (header[9] << 16) | (header[10] << 8) | header[11];
+    if (memcmp(header, "PACK", 4) != 0 || (version != 2 && version != 3)) {
+      giterr_set_str(GITERR_INDEXER, "Not a version 2 or 3 pack");
+      returnCode = -1;
+    }
+  }
+
+  const unsigned char* trailer = NULL;
+  if (returnCode == GIT_OK) {
+    Progress(baton, "checksum", baton->packLength, 0);
+    trailer = baton->pack + baton->packLength - Sha1::DIGEST_SIZE;
+    unsigned char checksum[Sha1::DIGEST_SIZE];
+    Sha1 sha1;
+    sha1.Update(baton->pack, baton->packLength - Sha1::DIGEST_SIZE);
+    sha1.Final(checksum);
+    if (memcmp(checksum, trailer, Sha1::DIGEST_SIZE) != 0) {
+      giterr_set_str(GITERR_INDEXER, "Pack checksum does not match its contents");
+      returnCode = -1;
+    }
+  }
+
+  // Entry boundaries are only known by inflating, so this pass is serial
+  if (returnCode == GIT_OK) {
+    Progress(baton, "parsing", count, 0);
+    baton->entries.resize(count);
+    uint64_t offset = 12;
+    for (uint32_t i = 0; i < count && returnCode == GIT_OK; i++) {
+      std::string reason;
+      if (!ParseEntry(baton, offset, baton->entries[i], reason)) {
+        char message[128];
+        snprintf(message, sizeof(message), "Entry at offset %llu: ", (unsigned long long)offset);
+        giterr_set_str(GITERR_INDEXER, (message + reason).c_str());
+        returnCode = -1;
+        break;
+      }
+      offset = baton->entries[i].end;
+      Progress(baton, "parsing", 0, 1);
+    }
+    if (returnCode == GIT_OK && offset != baton->packLength - Sha1::DIGEST_SIZE) {
+      giterr_set_str(GITERR_INDEXER, "Pack has data after its last entry");
+      returnCode = -1;
+    }
+  }
+
+  if (returnCode == GIT_OK) {
+    baton->objects = count;
+    std::vector<PackIndexEntry> byOffset(count);
+    for (uint32_t i = 0; i < count; i++) {
+      byOffset[i].offset = baton->entries[i].offset;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+      PackEntry& entry = baton->entries[i];
+      if (entry.packType == GIT_OBJ_OFS_DELTA) {
+        baton->deltas++;
+        std::vector<PackIndexEntry>::iterator base =
+          std::upper_bound(byOffset.begin(), byOffset.end(), entry.baseOffset, entryOffsetLess);
+        if (base == byOffset.begin() || (base - 1)->offset != entry.baseOffset) {
+          entry.corrupt = true;
+          AddCorrupt(baton, NULL, &entry, "Delta base offset is not an entry");
+          continue;
+        }
+        baton->offsetChildren.push_back(std::make_pair((size_t)(base - 1 - byOffset.begin()), (size_t)i));
+      } else if (entry.packType == GIT_OBJ_REF_DELTA) {
+        baton->deltas++;
+        baton->oidChildren.push_back(std::make_pair(entry.baseOid, (size_t)i));
+      } else {
+        baton->roots.push_back(i);
+      }
+    }
+    std::sort(baton->offsetChildren.begin(), baton->offsetChildren.end());
+    std::stable_sort(baton->oidChildren.begin(), baton->oidChildren.end(), oidEdgeLess);
+
+    Progress(baton, "resolving", count, 0);
+    RunWorkers(baton, IndexPackWorkResolve);
+
+    // Whatever was not reached has a base that is corrupt or not in the
+    // pack; thin packs are not completed from the repository
+    for (uint32_t i = 0; i < count; i++) {
+      PackEntry& entry = baton->entries[i];
+      if (entry.resolved || entry.corrupt) {
+        continue;
+      }
+      if (entry.packType == GIT_OBJ_REF_DELTA) {
+        baton->missing.push_back(entry.baseOid);
+      } else {
+        AddCorrupt(baton, NULL, &entry, "Delta base is corrupt");
+      }
+    }
+    std::sort(baton->missing.begin(), baton->missing.end(), OidLess());
+    baton->missing.erase(std::unique(baton->missing.begin(), baton->missing.end(), OidEqual()), baton->missing.end());
+  }
+
+  if (returnCode == GIT_OK && baton->corrupt.empty() && baton->missing.empty()) {
+    std::vector<git_oid> oids(count);
+    for (uint32_t i = 0; i < count; i++) {
+      oids[i] = baton->entries[i].oid;
+    }
+    std::sort(oids.begin(), oids.end(), OidLess());
+    for (uint32_t i = 1; i < count; i++) {
+      if (OidEqual()(oids[i], oids[i - 1])) {
+        AddCorrupt(baton, &oids[i], NULL, "Object is in the pack more than once");
+      }
+    }
+
+    if (baton->connectivity && baton->corrupt.empty()) {
+      CheckConnectivity(baton, oids, odb);
+    }
+  }
+
+  if (returnCode == GIT_OK && baton->corrupt.empty() && baton->missing.empty()) {
+    std::vector<PackIndexEntry> indexEntries(count);
+    for (uint32_t i = 0; i < count; i++) {
+      indexEntries[i].oid = baton->entries[i].oid;
+      indexEntries[i].crc = baton->entries[i].crc;
+      indexEntries[i].offset = baton->entries[i].offset;
+    }
+    std::vector<unsigned char> index;
+    packIndex(indexEntries, trailer, index);
+
+    git_oid packOid;
+    git_oid_fromraw(&packOid, trailer);
+    char sha[GIT_OID_HEXSZ + 1];
+    git_oid_fmt(sha, &packOid);
+    sha[GIT_OID_HEXSZ] = '\0';
+    baton->sha = sha;
+
+    std::string base = baton->packPath;
+    if (base.length() > 5 && base.compare(base.length() - 5, 5, ".pack") == 0) {
+      base.erase(base.length() - 5);
+    }
+    if (baton->install) {
+      base = baton->repoPath + "objects/pack/pack-" + baton->sha;
+    }
+    baton->indexPath = base + ".idx";
+
+    // git ignores a pack until its index exists, so an installed pack is
+    // moved first and its index appears last
+    if (baton->install) {
+      std::string packPath = base + ".pack";
+      if (rename(baton->packPath.c_str(), packPath.c_str()) != 0) {
+        setOsError("Failed to move pack to", packPath);
+        returnCode = -1;
+      } else if (writeFileAtomically(baton->indexPath, index) != GIT_OK) {
+        rename(packPath.c_str(), baton->packPath.c_str());
+        returnCode = -1;
+      } else {
+        baton->packPath = packPath;
+      }
+    } else {
+      returnCode = writeFileAtomically(baton->indexPath, index);
+    }
+    if (returnCode != GIT_OK) {
+      baton->indexPath.clear();
+    }
+  }
+
+  if (returnCode != GIT_OK) {
+    baton->error.Capture();
+  }
+
+  if (map != MAP_FAILED) {
+    munmap(map, st.st_size);
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+  baton->pack = NULL;
+  git_odb_free(odb);
+  git_repository_free(repo);
+
+  uv_async_send(&baton->asyncEnd);
+}
+
+static int collectOid(const git_oid *oid, void *payload) {
+  static_cast<std::vector<git_oid> *>(payload)->push_back(*oid);
+  return 0;
+}
+
+void GitIndexer::FsckWorkHash(void *payload) {
+  VerifyBaton* baton = static_cast<VerifyBaton *>(payload);
+  std::vector<git_oid> references;
+
+  // Each thread reads through its own repository
+  git_repository* repo = NULL;
+  git_odb* odb = NULL;
+  if (git_repository_open(&repo, baton->repoPath.c_str()) != GIT_OK ||
+      git_repository_odb(&odb, repo) != GIT_OK) {
+    const git_error* error = giterr_last();
+    AddCorrupt(baton, NULL, NULL, error ? error->message : "Failed to open repository");
+    git_repository_free(repo);
+    return;
+  }
+
+  static const size_t batchSize = 64;
+  for (;;) {
+    uv_mutex_lock(&baton->mutex);
+    size_t begin = baton->nextWork;
+    baton->nextWork += batchSize;
+    uv_mutex_unlock(&baton->mutex);
+    if (begin >= baton->oids.size()) {
+      break;
+    }
+
+    size_t end = std::min(begin + batchSize, baton->oids.size());
+    for (size_t i = begin; i < end; i++) {
+      const git_oid* oid = &baton->oids[i];
+      git_odb_object* object = NULL;
+      if (git_odb_read(&object, odb, oid) != GIT_OK) {
+        const git_error* error = giterr_last();
+        AddCorrupt(baton, oid, NULL, error ? error->message : "Object cannot be read");
+        continue;
+      }
+
+      git_oid actual;
+      const unsigned char* data = static_cast<const unsigned char*>(git_odb_object_data(object));
+      size_t size = git_odb_object_size(object);
+      git_otype type = git_odb_object_type(object);
+      if (git_odb_hash(&actual, data, size, type) != GIT_OK || !OidEqual()(actual, *oid)) {
+        AddCorrupt(baton, oid, NULL, "Contents do not match the object id");
+      } else if (baton->connectivity) {
+        CollectReferences(type, data, size, references);
+      }
+
+      git_odb_object_free(object);
+      Progress(baton, "hashing", 0, 1);
+    }
+  }
+
+  uv_mutex_lock(&baton->mutex);
+  baton->references.insert(baton->references.end(), references.begin(), references.end());
+  uv_mutex_unlock(&baton->mutex);
+
+  git_odb_free(odb);
+  git_repository_free(repo);
+}
+
+void GitIndexer::FsckWork(void *payload) {
+  VerifyBaton* baton = static_cast<VerifyBaton *>(payload);
+
+  git_repository* repo = NULL;
+  git_odb* odb = NULL;
+  int returnCode = git_repository_open(&repo, baton->repoPath.c_str());
+  if (returnCode == GIT_OK) {
+    returnCode = git_repository_odb(&odb, repo);
+  }
+  if (returnCode == GIT_OK) {
+    returnCode = git_odb_foreach(odb, collectOid, &baton->oids);
+  }
+
+  if (returnCode == GIT_OK) {
+    // Objects both loose and packed are listed twice
+    std::sort(baton->oids.begin(), baton->oids.end(), OidLess());
+    baton->oids.erase(std::unique(baton->oids.begin(), baton->oids.end(), OidEqual()), baton->oids.end());
+    baton->objects = baton->oids.size();
+
+    Progress(baton, "hashing", baton->oids.size(), 0);
+    RunWorkers(baton, FsckWorkHash);
+
+    if (baton->connectivity) {
+      CheckConnectivity(baton, baton->oids, NULL);
+    }
+  } else {
+    baton->error.Capture();
+  }
+
+  git_odb_free(odb);
+  git_repository_free(repo);
+
+  uv_async_send(&baton->asyncEnd);
+}
+
+void GitIndexer::VerifyWorkSendProgress(uv_async_t *handle, int status /*UNUSED*/) {
+  HandleScope scope;
+
+  VerifyBaton* baton = static_cast<VerifyBaton *>(handle->data);
+
+  uv_mutex_lock(&baton->mutex);
+  Local<Object> progress = Object::New();
+  progress->Set(String::NewSymbol("stage"), String::New(baton->stage.c_str()));
+  progress->Set(String::NewSymbol("processed"), Number::New((double)baton->processed));
+  progress->Set(String::NewSymbol("total"), Number::New((double)baton->total));
+  uv_mutex_unlock(&baton->mutex);
+
+  Handle<Value> argv[1] = {
+    progress
+  };
+
+  TryCatch try_catch;
+  baton->progressCallback->Call(Context::GetCurrent()->Global(), 1, argv);
+  if (try_catch.HasCaught()) {
+    node::FatalException(try_catch);
+  }
+}
+
+static Handle<Value> shaOrNull(bool has, const git_oid& oid) {
+  if (!has) {
+    return Null();
+  }
+  char sha[GIT_OID_HEXSZ + 1];
+  git_oid_fmt(sha, &oid);
+  sha[GIT_OID_HEXSZ] = '\0';
+  return String::New(sha);
+}
+
+void GitIndexer::VerifyWorkSendEnd(uv_async_t *handle, int status /*UNUSED*/) {
+  HandleScope scope;
+
+  VerifyBaton* baton = static_cast<VerifyBaton *>(handle->data);
+
+  uv_thread_join(&baton->threadId);
+
+  uv_mutex_destroy(&baton->mutex);
+  uv_close((uv_handle_t*) &baton->asyncProgress, NULL);
+  uv_close((uv_handle_t*) &baton->asyncEnd, VerifyFree);
+
+  Handle<Value> argv[2];
+  if (baton->error.IsSet()) {
+    argv[0] = baton->error.Wrap();
+    argv[1] = Local<Value>::New(Null());
+  } else {
+    std::vector<Local<Object> > corrupt;
+    for (size_t i = 0; i < baton->corrupt.size(); i++) {
+      const Problem& problem = baton->corrupt[i];
+      Local<Object> object = Object::New();
+      object->Set(String::NewSymbol("sha"), shaOrNull(problem.hasOid, problem.oid));
+      object->Set(String::NewSymbol("offset"), problem.hasOffset ? Number::New((double)problem.offset) : Null());
+      object->Set(String::NewSymbol("reason"), String::New(problem.reason.c_str()));
+      corrupt.push_back(object);
+    }
+
+    std::vector<std::string> missing;
+    for (size_t i = 0; i < baton->missing.size(); i++) {
+      char sha[GIT_OID_HEXSZ + 1];
+      git_oid_fmt(sha, &baton->missing[i]);
+      sha[GIT_OID_HEXSZ] = '\0';
+      missing.push_back(sha);
+    }
+
+    Local<Object> result = Object::New();
+    result->Set(String::NewSymbol("objects"), Number::New((double)baton->objects));
+    result->Set(String::NewSymbol("corrupt"), cvv8::CastToJS(corrupt));
+    result->Set(String::NewSymbol("missing"), cvv8::CastToJS(missing));
+    if (!baton->packPath.empty()) {
+      result->Set(String::NewSymbol("deltas"), Number::New((double)baton->deltas));
+      result->Set(String::NewSymbol("packPath"), String::New(baton->packPath.c_str()));
+      result->Set(String::NewSymbol("sha"), baton->sha.empty() ? Null() : String::New(baton->sha.c_str()));
+      result->Set(String::NewSymbol("indexPath"), baton->indexPath.empty() ? Null() : String::New(baton->indexPath.c_str()));
+    }
+
+    argv[0] = Local<Value>::New(Null());
+    argv[1] = result;
+  }
+
+  TryCatch try_catch;
+  baton->endCallback->Call(Context::GetCurrent()->Global(), 2, argv);
+  if (try_catch.HasCaught()) {
+    node::FatalException(try_catch);
+  }
+}
+
+void GitIndexer::VerifyFree(uv_handle_t *handle) {
+  VerifyBaton* baton = static_cast<VerifyBaton *>(handle->data);
+
+  baton->progressCallback.Dispose();
+  baton->endCallback.Dispose();
+  delete baton;
+}
+
+Persistent<Function> GitIndexer::constructor_template;
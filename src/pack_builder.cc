@@ -0,0 +1,511 @@
+/*
+ * Copyright 2013, Tim Branyen @tbranyen <tim@tabdeveloper.com>
+ * @author Michael Robinson @codeofinterest <mike@pagesofinterest.net>
+ *
+ * Dual licensed under the MIT and GPL licenses.
+ */
+
+#include <v8.h>
+#include <node.h>
+#include <node_buffer.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "git2.h"
+
+#include "../include/utils.h"
+#include "../include/repo.h"
+#include "../include/pack_builder.h"
+#include "../include/error.h"
+
+#include "../include/functions/pack.h"
+#include "../include/functions/string.h"
+#include "../include/functions/utilities.h"
+
+using namespace v8;
+using namespace node;
+
+void GitPackBuilder::Initialize(Handle<v8::Object> target) {
+  HandleScope scope;
+
+  Local<FunctionTemplate> tpl = FunctionTemplate::New(New);
+
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+  tpl->SetClassName(String::NewSymbol("PackBuilder"));
+
+  NODE_SET_PROTOTYPE_METHOD(tpl, "build", Build);
+
+  constructor_template = Persistent<Function>::New(tpl->GetFunction());
+  target->Set(String::NewSymbol("PackBuilder"), constructor_template);
+}
+
+Handle<Value> GitPackBuilder::New(const Arguments& args) {
+  HandleScope scope;
+
+  GitPackBuilder *builder = new GitPackBuilder();
+  builder->Wrap(args.This());
+
+  return scope.Close(args.This());
+}
+
+static void stringsFromArray(Local<Value> value, std::vector<std::string>& out) {
+  if (!value->IsArray()) {
+    return;
+  }
+  Local<Array> array = Local<Array>::Cast(value);
+  for (uint32_t i = 0; i < array->Length(); i++) {
+    out.push_back(stringArgToString(array->Get(i)->ToString()));
+  }
+}
+
+Handle<Value> GitPackBuilder::Build(const Arguments& args) {
+  HandleScope scope;
+
+  if(args.Length() == 0 || !args[0]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Repo is required and must be an Object.")));
+  }
+
+  if(args.Length() == 1 || !args[1]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Options are required and must be an Object.")));
+  }
+
+  if(args.Length() == 2 || !args[2]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Progress callback is required and must be a Function.")));
+  }
+
+  if(args.Length() == 3 || !args[3]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Data callback is required and must be a Function.")));
+  }
+
+  if(args.Length() == 4 || !args[4]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("End callback is required and must be a Function.")));
+  }
+
+  git_repository* repo = ObjectWrap::Unwrap<GitRepo>(args[0]->ToObject())->GetValue();
+  if (repo == NULL) {
+    return ThrowException(Exception::Error(String::New("Repo must be open.")));
+  }
+
+  Local<Object> options = args[1]->ToObject();
+  std::vector<std::string> include;
+  stringsFromArray(options->Get(String::NewSymbol("include")), include);
+  if (include.empty()) {
+    return ThrowException(Exception::Error(String::New("At least one commit must be included.")));
+  }
+
+  BuildBaton* baton = new BuildBaton;
+  uv_async_init(uv_default_loop(), &baton->asyncProgress, BuildWorkSendProgress);
+  uv_async_init(uv_default_loop(), &baton->asyncData, BuildWorkSendData);
+  uv_async_init(uv_default_loop(), &baton->asyncEnd, BuildWorkSendEnd);
+  baton->asyncProgress.data = baton;
+  baton->asyncData.data = baton;
+  baton->asyncEnd.data = baton;
+  uv_mutex_init(&baton->mutex);
+  uv_sem_init(&baton->pendingSlots, MAX_PENDING_CHUNKS);
+
+  baton->repoPath = git_repository_path(repo);
+  baton->include.swap(include);
+  stringsFromArray(options->Get(String::NewSymbol("exclude")), baton->exclude);
+  Local<Value> threads = options->Get(String::NewSymbol("threads"));
+  // 0 lets libgit2 use one thread per CPU
+  baton->threads = threads->IsNumber() && threads->Int32Value() > 0 ? threads->Uint32Value() : 0;
+  Local<Value> path = options->Get(String::NewSymbol("path"));
+  if (path->IsString()) {
+    baton->path = stringArgToString(path->ToString());
+  }
+
+  baton->stage = "counting";
+  baton->objects = 0;
+  baton->bytes = 0;
+  baton->packbuilder = NULL;
+  baton->repo = NULL;
+  baton->fd = -1;
+  baton->objectCount = 0;
+  baton->written = 0;
+
+  baton->progressCallback = Persistent<Function>::New(Local<Function>::Cast(args[2]));
+  baton->dataCallback = Persistent<Function>::New(Local<Function>::Cast(args[3]));
+  baton->endCallback = Persistent<Function>::New(Local<Function>::Cast(args[4]));
+
+  uv_thread_create(&baton->threadId, BuildWork, baton);
+
+  return Undefined();
+}
+
+int GitPackBuilder::ResolveCommit(git_repository* repo, const std::string& spec, git_oid* oid) {
+  git_object* object = NULL;
+  git_object* peeled = NULL;
+  int returnCode = git_revparse_single(&object, repo, spec.c_str());
+  if (returnCode == GIT_OK) {
+    returnCode = git_object_peel(&peeled, object, GIT_OBJ_COMMIT);
+  }
+  if (returnCode == GIT_OK) {
+    git_oid_cpy(oid, git_object_id(peeled));
+  }
+  git_object_free(peeled);
+  git_object_free(object);
+  return returnCode;
+}
+
+/**
+ * Record everything in treeOid as already present on the other side, so
+ * it is never inserted. Subtrees seen before are not walked again.
+ */
+int GitPackBuilder::MarkTree(BuildBaton* baton, const git_oid* treeOid) {
+  if (!baton->seen.insert(*treeOid).second) {
+    return GIT_OK;
+  }
+
+  git_tree* tree = NULL;
+  int returnCode = git_tree_lookup(&tree, baton->repo, treeOid);
+  if (returnCode != GIT_OK) {
+    return returnCode;
+  }
+
+  size_t count = git_tree_entrycount(tree);
+  for (size_t i = 0; i < count && returnCode == GIT_OK; i++) {
+    const git_tree_entry* entry = git_tree_entry_byindex(tree, i);
+    if (git_tree_entry_type(entry) == GIT_OBJ_TREE) {
+      returnCode = MarkTree(baton, git_tree_entry_id(entry));
+    } else if (git_tree_entry_type(entry) == GIT_OBJ_BLOB) {
+      baton->seen.insert(*git_tree_entry_id(entry));
+    }
+  }
+
+  git_tree_free(tree);
+  return returnCode;
+}
+
+/**
+ * Insert treeOid and everything below it that was not seen yet. Blobs are
+ * inserted with their file name, which the delta search sorts by.
+ */
+int GitPackBuilder::InsertTree(BuildBaton* baton, const git_oid* treeOid) {
+  if (!baton->seen.insert(*treeOid).second) {
+    return GIT_OK;
+  }
+
+  int returnCode = git_packbuilder_insert(baton->packbuilder, treeOid, NULL);
+  if (returnCode != GIT_OK) {
+    return returnCode;
+  }
+  Progress(baton, "counting", false);
+
+  git_tree* tree = NULL;
+  returnCode = git_tree_lookup(&tree, baton->repo, treeOid);
+  if (returnCode != GIT_OK) {
+    return returnCode;
+  }
+
+  size_t count = git_tree_entrycount(tree);
+  for (size_t i = 0; i < count && returnCode == GIT_OK; i++) {
+    const git_tree_entry* entry = git_tree_entry_byindex(tree, i);
+    if (git_tree_entry_type(entry) == GIT_OBJ_TREE) {
+      returnCode = InsertTree(baton, git_tree_entry_id(entry));
+    } else if (git_tree_entry_type(entry) == GIT_OBJ_BLOB &&
+               baton->seen.insert(*git_tree_entry_id(entry)).second) {
+      returnCode = git_packbuilder_insert(baton->packbuilder, git_tree_entry_id(entry), git_tree_entry_name(entry));
+      Progress(baton, "counting", false);
+    }
+  }
+
+  git_tree_free(tree);
+  return returnCode;
+}
+
+void GitPackBuilder::Progress(BuildBaton* baton, const char* stage, bool force) {
+  uv_mutex_lock(&baton->mutex);
+  bool changed = baton->stage != stage;
+  baton->stage = stage;
+  if (!force && !changed) {
+    baton->objects++;
+  }
+  bool send = force || changed || baton->objects % PROGRESS_INTERVAL == 0;
+  uv_mutex_unlock(&baton->mutex);
+
+  if (send) {
+    uv_async_send(&baton->asyncProgress);
+  }
+}
+
+/**
+ * Hand the pending bytes to the file or to JS.
+ */
+int GitPackBuilder::FlushChunk(BuildBaton* baton) {
+  if (baton->pending.empty()) {
+    return GIT_OK;
+  }
+
+  if (baton->fd >= 0) {
+    if (!writeFully(baton->fd, &baton->pending[0], baton->pending.size())) {
+      giterr_set_str(GITERR_OS, strerror(errno));
+      return -1;
+    }
+    uv_mutex_lock(&baton->mutex);
+    baton->bytes += baton->pending.size();
+    uv_mutex_unlock(&baton->mutex);
+    baton->pending.clear();
+  } else {
+    // Wait for the main thread to take earlier chunks, so a slow consumer
+    // never has the whole pack queued in memory
+    uv_sem_wait(&baton->pendingSlots);
+
+    uv_mutex_lock(&baton->mutex);
+    baton->bytes += baton->pending.size();
+    baton->chunks.push_back(std::vector<char>());
+    baton->chunks.back().swap(baton->pending);
+    uv_mutex_unlock(&baton->mutex);
+    uv_async_send(&baton->asyncData);
+  }
+
+  uv_async_send(&baton->asyncProgress);
+  return GIT_OK;
+}
+
+int GitPackBuilder::WriteCallback(void *data, size_t size, void *payload) {
+  BuildBaton* baton = static_cast<BuildBaton *>(payload);
+
+  // The packbuilder only starts writing once the delta search is done
+  if (baton->pending.empty() && baton->bytes == 0) {
+    Progress(baton, "writing", true);
+  }
+
+  const char* bytes = static_cast<const char *>(data);
+  baton->pending.insert(baton->pending.end(), bytes, bytes + size);
+  if (baton->pending.size() >= CHUNK_SIZE) {
+    return FlushChunk(baton);
+  }
+  return GIT_OK;
+}
+
+void GitPackBuilder::BuildWork(void *payload) {
+  BuildBaton* baton = static_cast<BuildBaton *>(payload);
+
+  git_revwalk* walk = NULL;
+  std::vector<git_oid> commits;
+  OidSet included;
+
+  int returnCode = git_repository_open(&baton->repo, baton->repoPath.c_str());
+  if (returnCode == GIT_OK) {
+    returnCode = git_packbuilder_new(&baton->packbuilder, baton->repo);
+  }
+  if (returnCode == GIT_OK) {
+    git_packbuilder_set_threads(baton->packbuilder, baton->threads);
+    returnCode = git_revwalk_new(&walk, baton->repo);
+  }
+
+  if (returnCode == GIT_OK) {
+    git_revwalk_sorting(walk, GIT_SORT_TOPOLOGICAL | GIT_SORT_TIME);
+  }
+  for (size_t i = 0; returnCode == GIT_OK && i < baton->include.size(); i++) {
+    git_oid oid;
+    returnCode = ResolveCommit(baton->repo, baton->include[i], &oid);
+    if (returnCode == GIT_OK) {
+      returnCode = git_revwalk_push(walk, &oid);
+    }
+  }
+
+  // Everything reachable from an excluded tip is assumed to be on the
+  // other side already
+  for (size_t i = 0; returnCode == GIT_OK && i < baton->exclude.size(); i++) {
+    git_oid oid;
+    git_commit* commit = NULL;
+    returnCode = ResolveCommit(baton->repo, baton->exclude[i], &oid);
+    if (returnCode == GIT_OK) {
+      returnCode = git_revwalk_hide(walk, &oid);
+    }
+    if (returnCode == GIT_OK) {
+      returnCode = git_commit_lookup(&commit, baton->repo, &oid);
+    }
+    if (returnCode == GIT_OK) {
+      returnCode = MarkTree(baton, git_commit_tree_id(commit));
+    }
+    git_commit_free(commit);
+  }
+
+  if (returnCode == GIT_OK) {
+    git_oid oid;
+    while ((returnCode = git_revwalk_next(&oid, walk)) == GIT_OK) {
+      commits.push_back(oid);
+      included.insert(oid);
+    }
+    if (returnCode == GIT_ITEROVER) {
+      returnCode = GIT_OK;
+    }
+  }
+
+  // Trees of hidden parents are on the other side too; marking them keeps
+  // unchanged subtrees and blobs out of the pack
+  for (size_t i = 0; returnCode == GIT_OK && i < commits.size(); i++) {
+    git_commit* commit = NULL;
+    returnCode = git_commit_lookup(&commit, baton->repo, &commits[i]);
+    unsigned int parentCount = returnCode == GIT_OK ? git_commit_parentcount(commit) : 0;
+    for (unsigned int p = 0; returnCode == GIT_OK && p < parentCount; p++) {
+      const git_oid* parentOid = git_commit_parent_id(commit, p);
+      if (included.count(*parentOid) > 0 || baton->exclude.empty()) {
+        continue;
+      }
+      git_commit* parent = NULL;
+      returnCode = git_commit_lookup(&parent, baton->repo, parentOid);
+      if (returnCode == GIT_OK) {
+        returnCode = MarkTree(baton, git_commit_tree_id(parent));
+      }
+      git_commit_free(parent);
+    }
+    git_commit_free(commit);
+  }
+
+  for (size_t i = 0; returnCode == GIT_OK && i < commits.size(); i++) {
+    returnCode = git_packbuilder_insert(baton->packbuilder, &commits[i], NULL);
+    Progress(baton, "counting", false);
+  }
+  for (size_t i = 0; returnCode == GIT_OK && i < commits.size(); i++) {
+    git_commit* commit = NULL;
+    returnCode = git_commit_lookup(&commit, baton->repo, &commits[i]);
+    if (returnCode == GIT_OK) {
+      returnCode = InsertTree(baton, git_commit_tree_id(commit));
+    }
+    git_commit_free(commit);
+  }
+
+  if (returnCode == GIT_OK && !baton->path.empty()) {
+    baton->fd = open(baton->path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (baton->fd < 0) {
+      giterr_set_str(GITERR_OS, strerror(errno));
+      returnCode = -1;
+    }
+  }
+
+  if (returnCode == GIT_OK) {
+    Progress(baton, "compressing", true);
+    returnCode = git_packbuilder_foreach(baton->packbuilder, WriteCallback, baton);
+  }
+  if (returnCode == GIT_OK) {
+    returnCode = FlushChunk(baton);
+  }
+  if (returnCode == GIT_OK && baton->fd >= 0 && fsync(baton->fd) != 0) {
+    giterr_set_str(GITERR_OS, strerror(errno));
+    returnCode = -1;
+  }
+  if (returnCode == GIT_OK) {
+    baton->objectCount = git_packbuilder_object_count(baton->packbuilder);
+    baton->written = git_packbuilder_written(baton->packbuilder);
+  } else {
+    baton->error.Capture();
+  }
+
+  if (baton->fd >= 0) {
+    close(baton->fd);
+    if (returnCode != GIT_OK) {
+      unlink(baton->path.c_str());
+    }
+  }
+  git_revwalk_free(walk);
+  git_packbuilder_free(baton->packbuilder);
+  git_repository_free(baton->repo);
+
+  uv_async_send(&baton->asyncEnd);
+}
+
+void GitPackBuilder::BuildWorkSendProgress(uv_async_t *handle, int status /*UNUSED*/) {
+  HandleScope scope;
+
+  BuildBaton* baton = static_cast<BuildBaton *>(handle->data);
+
+  uv_mutex_lock(&baton->mutex);
+  Local<Object> progress = Object::New();
+  progress->Set(String::NewSymbol("stage"), String::New(baton->stage.c_str()));
+  progress->Set(String::NewSymbol("objects"), Number::New((double)baton->objects));
+  progress->Set(String::NewSymbol("bytes"), Number::New((double)baton->bytes));
+  uv_mutex_unlock(&baton->mutex);
+
+  Handle<Value> argv[1] = {
+    progress
+  };
+
+  TryCatch try_catch;
+  baton->progressCallback->Call(Context::GetCurrent()->Global(), 1, argv);
+  if (try_catch.HasCaught()) {
+    node::FatalException(try_catch);
+  }
+}
+
+void GitPackBuilder::BuildWorkSendData(uv_async_t *handle, int status /*UNUSED*/) {
+  HandleScope scope;
+
+  BuildBaton* baton = static_cast<BuildBaton *>(handle->data);
+
+  std::vector<std::vector<char> > chunks;
+  uv_mutex_lock(&baton->mutex);
+  chunks.swap(baton->chunks);
+  uv_mutex_unlock(&baton->mutex);
+
+  for (size_t i = 0; i < chunks.size(); i++) {
+    Local<Object> fastBuffer;
+    Buffer* buffer = Buffer::New(&chunks[i][0], chunks[i].size());
+    MAKE_FAST_BUFFER(buffer, fastBuffer);
+
+    Handle<Value> argv[1] = {
+      fastBuffer
+    };
+
+    TryCatch try_catch;
+    baton->dataCallback->Call(Context::GetCurrent()->Global(), 1, argv);
+    if (try_catch.HasCaught()) {
+      node::FatalException(try_catch);
+    }
+
+    // Let the build thread queue another chunk
+    uv_sem_post(&baton->pendingSlots);
+  }
+}
+
+void GitPackBuilder::BuildWorkSendEnd(uv_async_t *handle, int status /*UNUSED*/) {
+  HandleScope scope;
+
+  BuildBaton* baton = static_cast<BuildBaton *>(handle->data);
+
+  uv_thread_join(&baton->threadId);
+
+  // Async signals are coalesced and unordered between handles, so flush
+  // any chunks whose signal has not been handled yet
+  BuildWorkSendData(&baton->asyncData, 0);
+
+  uv_mutex_destroy(&baton->mutex);
+  uv_sem_destroy(&baton->pendingSlots);
+  uv_close((uv_handle_t*) &baton->asyncProgress, NULL);
+  uv_close((uv_handle_t*) &baton->asyncData, NULL);
+  uv_close((uv_handle_t*) &baton->asyncEnd, BuildFree);
+
+  Handle<Value> argv[2];
+  if (baton->error.IsSet()) {
+    argv[0] = baton->error.Wrap();
+    argv[1] = Local<Value>::New(Null());
+  } else {
+    Local<Object> summary = Object::New();
+    summary->Set(String::NewSymbol("objects"), Integer::NewFromUnsigned(baton->objectCount));
+    summary->Set(String::NewSymbol("written"), Integer::NewFromUnsigned(baton->written));
+    summary->Set(String::NewSymbol("bytes"), Number::New((double)baton->bytes));
+    argv[0] = Local<Value>::New(Null());
+    argv[1] = summary;
+  }
+
+  TryCatch try_catch;
+  baton->endCallback->Call(Context::GetCurrent()->Global(), 2, argv);
+  if (try_catch.HasCaught()) {
+    node::FatalException(try_catch);
+  }
+}
+
+void GitPackBuilder::BuildFree(uv_handle_t *handle) {
+  BuildBaton* baton = static_cast<BuildBaton *>(handle->data);
+
+  baton->progressCallback.Dispose();
+  baton->dataCallback.Dispose();
+  baton->endCallback.Dispose();
+  delete baton;
+}
+
+Persistent<Function> GitPackBuilder::constructor_template;
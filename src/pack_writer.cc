@@ -0,0 +1,571 @@
+/*
+ * Copyright 2013, Tim Branyen @tbranyen <tim@tabdeveloper.com>
+ * @author Michael Robinson @codeofinterest <mike@pagesofinterest.net>
+ *
+ * Dual licensed under the MIT and GPL licenses.
+ */
+
+#include <v8.h>
+#include <node.h>
+#include <node_buffer.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "git2.h"
+
+#include "../include/repo.h"
+#include "../include/pack_writer.h"
+#include "../include/error.h"
+
+#include "../include/functions/sha1.h"
+#include "../include/functions/string.h"
+#include "../include/functions/utilities.h"
+
+using namespace v8;
+using namespace node;
+
+void GitPackWriter::Initialize(Handle<v8::Object> target) {
+  HandleScope scope;
+
+  Local<FunctionTemplate> tpl = FunctionTemplate::New(New);
+
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+  tpl->SetClassName(String::NewSymbol("PackWriter"));
+
+  NODE_SET_PROTOTYPE_METHOD(tpl, "begin", Begin);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "write", Write);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "commit", Commit);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "abort", Abort);
+
+  constructor_template = Persistent<Function>::New(tpl->GetFunction());
+  target->Set(String::NewSymbol("PackWriter"), constructor_template);
+}
+
+GitPackWriter::GitPackWriter() : repo(NULL), fd(-1), offset(0), threads(DEFAULT_THREADS),
+                                 level(Z_DEFAULT_COMPRESSION), busy(false) {}
+
+GitPackWriter::~GitPackWriter() {
+  Close();
+}
+
+/**
+ * End the session, dropping the temporary pack if it was not committed.
+ */
+void GitPackWriter::Close() {
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+  if (!tempPath.empty()) {
+    unlink(tempPath.c_str());
+    tempPath.clear();
+  }
+  git_repository_free(repo);
+  repo = NULL;
+  offset = 0;
+  entries.clear();
+  written.clear();
+}
+
+Handle<Value> GitPackWriter::New(const Arguments& args) {
+  HandleScope scope;
+
+  GitPackWriter *writer = new GitPackWriter();
+  writer->Wrap(args.This());
+
+  return scope.Close(args.This());
+}
+
+Handle<Value> GitPackWriter::Begin(const Arguments& args) {
+  HandleScope scope;
+
+  if(args.Length() == 0 || !args[0]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Repo is required and must be an Object.")));
+  }
+
+  if(args.Length() == 1 || !args[1]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Options are required and must be an Object.")));
+  }
+
+  if(args.Length() == 2 || !args[2]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Callback is required and must be a Function.")));
+  }
+
+  git_repository* repo = ObjectWrap::Unwrap<GitRepo>(args[0]->ToObject())->GetValue();
+  if (repo == NULL) {
+    return ThrowException(Exception::Error(String::New("Repo must be open.")));
+  }
+
+  GitPackWriter* writer = ObjectWrap::Unwrap<GitPackWriter>(args.This());
+  if (writer->busy || writer->fd >= 0) {
+    return ThrowException(Exception::Error(String::New("A pack is already being written.")));
+  }
+
+  Local<Object> options = args[1]->ToObject();
+  Local<Value> threads = options->Get(String::NewSymbol("threads"));
+  Local<Value> level = options->Get(String::NewSymbol("level"));
+  writer->threads = threads->IsNumber() && threads->Int32Value() > 0 ? threads->Int32Value() : DEFAULT_THREADS;
+  writer->level = level->IsNumber() ? level->Int32Value() : Z_DEFAULT_COMPRESSION;
+  if (writer->level < Z_DEFAULT_COMPRESSION || writer->level > Z_BEST_COMPRESSION) {
+    return ThrowException(Exception::Error(String::New("Level must be between -1 and 9.")));
+  }
+
+  BeginBaton* baton = new BeginBaton;
+  baton->request.data = baton;
+  baton->error = NULL;
+  baton->writer = writer;
+  baton->writer->busy = true;
+  baton->writer->Ref();
+  baton->repoPath = git_repository_path(repo);
+  baton->callback = Persistent<Function>::New(Local<Function>::Cast(args[2]));
+
+  uv_queue_work(uv_default_loop(), &baton->request, BeginWork, (uv_after_work_cb)BeginAfterWork);
+
+  return Undefined();
+}
+
+void GitPackWriter::BeginWork(uv_work_t *req) {
+  BeginBaton *baton = static_cast<BeginBaton *>(req->data);
+  GitPackWriter* writer = baton->writer;
+
+  // The session's own handle, so existence checks never share a
+  // repository with the main thread
+  if (git_repository_open(&writer->repo, baton->repoPath.c_str()) != GIT_OK) {
+    baton->error = giterr_last();
+    return;
+  }
+
+  writer->packDirectory = baton->repoPath + "objects/pack/";
+  std::string path = writer->packDirectory + "tmp_pack_XXXXXX";
+  std::vector<char> pathTemplate(path.begin(), path.end());
+  pathTemplate.push_back('\0');
+
+  writer->fd = mkstemp(&pathTemplate[0]);
+  if (writer->fd < 0) {
+    setOsError("Failed to create", path);
+    baton->error = giterr_last();
+    writer->Close();
+    return;
+  }
+  writer->tempPath = &pathTemplate[0];
+
+  // The object count is filled in on commit
+  unsigned char header[12];
+  packHeader(header, 0);
+  if (!writeFully(writer->fd, header, sizeof(header))) {
+    setOsError("Failed to write", writer->tempPath);
+    baton->error = giterr_last();
+    writer->Close();
+    return;
+  }
+  writer->offset = sizeof(header);
+}
+
+void GitPackWriter::BeginAfterWork(uv_work_t *req) {
+  HandleScope scope;
+  BeginBaton *baton = static_cast<BeginBaton *>(req->data);
+
+  baton->writer->busy = false;
+
+  if (success(baton->error, baton->callback)) {
+    Handle<Value> argv[1] = {
+      Local<Value>::New(Null())
+    };
+
+    TryCatch try_catch;
+    baton->callback->Call(Context::GetCurrent()->Global(), 1, argv);
+    if (try_catch.HasCaught()) {
+      node::FatalException(try_catch);
+    }
+  }
+
+  baton->writer->Unref();
+  baton->callback.Dispose();
+  delete baton;
+}
+
+Handle<Value> GitPackWriter::Write(const Arguments& args) {
+  HandleScope scope;
+
+  if(args.Length() == 0 || !args[0]->IsArray()) {
+    return ThrowException(Exception::Error(String::New("Objects are required and must be an Array.")));
+  }
+
+  if(args.Length() == 1 || !args[1]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Callback is required and must be a Function.")));
+  }
+
+  GitPackWriter* writer = ObjectWrap::Unwrap<GitPackWriter>(args.This());
+  if (writer->busy || writer->fd < 0) {
+    return ThrowException(Exception::Error(String::New("Begin must complete before writing, and writes may not overlap.")));
+  }
+
+  Local<Array> objectArray = Local<Array>::Cast(args[0]);
+  std::vector<PackObject> objects(objectArray->Length());
+  for (uint32_t i = 0; i < objectArray->Length(); i++) {
+    if (!objectArray->Get(i)->IsObject()) {
+      return ThrowException(Exception::Error(String::New("Each object must be an Object.")));
+    }
+    Local<Object> object = objectArray->Get(i)->ToObject();
+
+    std::string type = stringArgToString(object->Get(String::NewSymbol("type"))->ToString());
+    objects[i].type = git_object_string2type(type.c_str());
+    if (objects[i].type < GIT_OBJ_COMMIT || objects[i].type > GIT_OBJ_TAG) {
+      return ThrowException(Exception::Error(String::New("Object type must be 'blob', 'tree', 'commit' or 'tag'.")));
+    }
+
+    Local<Value> data = object->Get(String::NewSymbol("data"));
+    if (!Buffer::HasInstance(data)) {
+      return ThrowException(Exception::Error(String::New("Object data must be a Buffer.")));
+    }
+    objects[i].data = Buffer::Data(data->ToObject());
+    objects[i].length = Buffer::Length(data->ToObject());
+  }
+
+  WriteBaton* baton = new WriteBaton;
+  baton->request.data = baton;
+  baton->error = NULL;
+  baton->writer = writer;
+  baton->writer->busy = true;
+  baton->writer->Ref();
+  baton->objects.swap(objects);
+  baton->nextObject = 0;
+  baton->existing = 0;
+  uv_mutex_init(&baton->mutex);
+  // Keeps the Buffers alive while worker threads read them
+  baton->buffers = Persistent<Array>::New(objectArray);
+  baton->callback = Persistent<Function>::New(Local<Function>::Cast(args[1]));
+
+  uv_queue_work(uv_default_loop(), &baton->request, WriteWork, (uv_after_work_cb)WriteAfterWork);
+
+  return Undefined();
+}
+
+/**
+ * Hash and deflate objects until none are left.
+ */
+void GitPackWriter::WriteWorkDeflate(void *payload) {
+  WriteBaton *baton = static_cast<WriteBaton *>(payload);
+  int level = baton->writer->level;
+
+  for (;;) {
+    uv_mutex_lock(&baton->mutex);
+    size_t next = baton->nextObject++;
+    bool failed = !baton->workerError.empty();
+    uv_mutex_unlock(&baton->mutex);
+    if (next >= baton->objects.size() || failed) {
+      return;
+    }
+
+    PackObject& object = baton->objects[next];
+    int returnCode = git_odb_hash(&object.oid, object.data, object.length, object.type);
+
+    uLongf deflatedLength = compressBound(object.length);
+    object.deflated.resize(deflatedLength);
+    if (returnCode == GIT_OK &&
+        compress2(&object.deflated[0], &deflatedLength, (const Bytef*)object.data, object.length, level) == Z_OK) {
+      object.deflated.resize(deflatedLength);
+      continue;
+    }
+
+    uv_mutex_lock(&baton->mutex);
+    baton->workerError = returnCode == GIT_OK ? "Failed to compress object" : "Failed to hash object";
+    uv_mutex_unlock(&baton->mutex);
+  }
+}
+
+void GitPackWriter::WriteWork(uv_work_t *req) {
+  WriteBaton *baton = static_cast<WriteBaton *>(req->data);
+  GitPackWriter* writer = baton->writer;
+
+  size_t threadCount = (size_t)writer->threads < baton->objects.size() ? (size_t)writer->threads : baton->objects.size();
+  std::vector<uv_thread_t> threadIds(threadCount);
+  for (size_t i = 0; i < threadCount; i++) {
+    uv_thread_create(&threadIds[i], WriteWorkDeflate, baton);
+  }
+  for (size_t i = 0; i < threadCount; i++) {
+    uv_thread_join(&threadIds[i]);
+  }
+  if (!baton->workerError.empty()) {
+    giterr_set_str(GITERR_ZLIB, baton->workerError.c_str());
+    baton->error = giterr_last();
+    return;
+  }
+
+  git_odb* odb = NULL;
+  if (git_repository_odb(&odb, writer->repo) != GIT_OK) {
+    baton->error = giterr_last();
+    return;
+  }
+
+  // Appended in the order given, skipping anything already stored
+  for (size_t i = 0; i < baton->objects.size(); i++) {
+    PackObject& object = baton->objects[i];
+    if (writer->written.count(object.oid) > 0 || git_odb_exists(odb, &object.oid)) {
+      baton->existing++;
+      continue;
+    }
+
+    unsigned char header[10];
+    size_t headerLength = packEntryHeader(header, object.type, object.length);
+
+    PackIndexEntry entry;
+    git_oid_cpy(&entry.oid, &object.oid);
+    entry.offset = writer->offset;
+    entry.crc = crc32(0L, header, headerLength);
+    entry.crc = crc32(entry.crc, &object.deflated[0], object.deflated.size());
+
+    if (!writeFully(writer->fd, header, headerLength) ||
+        !writeFully(writer->fd, &object.deflated[0], object.deflated.size())) {
+      setOsError("Failed to write", writer->tempPath);
+      baton->error = giterr_last();
+      break;
+    }
+
+    writer->offset += headerLength + object.deflated.size();
+    writer->entries.push_back(entry);
+    writer->written.insert(object.oid);
+    std::vector<unsigned char>().swap(object.deflated);
+  }
+
+  git_odb_free(odb);
+
+  // Part of an entry may already be in the file, past what the index
+  // records, so nothing written after it could be trusted
+  if (baton->error != NULL) {
+    writer->Close();
+  }
+}
+
+void GitPackWriter::WriteAfterWork(uv_work_t *req) {
+  HandleScope scope;
+  WriteBaton *baton = static_cast<WriteBaton *>(req->data);
+
+  baton->writer->busy = false;
+
+  if (success(baton->error, baton->callback)) {
+    Local<Array> shas = Array::New(baton->objects.size());
+    char sha[GIT_OID_HEXSZ + 1];
+    sha[GIT_OID_HEXSZ] = '\0';
+    for (size_t i = 0; i < baton->objects.size(); i++) {
+      git_oid_fmt(sha, &baton->objects[i].oid);
+      shas->Set(i, String::New(sha, GIT_OID_HEXSZ));
+    }
+
+    Handle<Value> argv[3] = {
+      Local<Value>::New(Null()),
+      shas,
+      Integer::NewFromUnsigned(baton->existing)
+    };
+
+    TryCatch try_catch;
+    baton->callback->Call(Context::GetCurrent()->Global(), 3, argv);
+    if (try_catch.HasCaught()) {
+      node::FatalException(try_catch);
+    }
+  }
+
+  uv_mutex_destroy(&baton->mutex);
+  baton->writer->Unref();
+  baton->buffers.Dispose();
+  baton->callback.Dispose();
+  delete baton;
+}
+
+Handle<Value> GitPackWriter::Commit(const Arguments& args) {
+  HandleScope scope;
+
+  if(args.Length() == 0 || !args[0]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Callback is required and must be a Function.")));
+  }
+
+  GitPackWriter* writer = ObjectWrap::Unwrap<GitPackWriter>(args.This());
+  if (writer->busy || writer->fd < 0) {
+    return ThrowException(Exception::Error(String::New("No pack is being written, or a write is still in flight.")));
+  }
+
+  CommitBaton* baton = new CommitBaton;
+  baton->request.data = baton;
+  baton->error = NULL;
+  baton->writer = writer;
+  baton->writer->busy = true;
+  baton->writer->Ref();
+  baton->objectCount = 0;
+  baton->callback = Persistent<Function>::New(Local<Function>::Cast(args[0]));
+
+  uv_queue_work(uv_default_loop(), &baton->request, CommitWork, (uv_after_work_cb)CommitAfterWork);
+
+  return Undefined();
+}
+
+/**
+ * Patch the object count into the header, checksum the pack, write the
+ * index next to it and only then give both their final names. A reader
+ * never sees a pack without its index, and a crash leaves only tmp_ files.
+ */
+void GitPackWriter::CommitWork(uv_work_t *req) {
+  CommitBaton *baton = static_cast<CommitBaton *>(req->data);
+  GitPackWriter* writer = baton->writer;
+
+  baton->objectCount = writer->entries.size();
+  if (baton->objectCount == 0) {
+    writer->Close();
+    return;
+  }
+
+  unsigned char header[12];
+  packHeader(header, (uint32_t)baton->objectCount);
+  if (pwrite(writer->fd, header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+    setOsError("Failed to write", writer->tempPath);
+    baton->error = giterr_last();
+    writer->Close();
+    return;
+  }
+
+  Sha1 sha1;
+  std::vector<unsigned char> chunk(1024 * 1024);
+  for (uint64_t position = 0; position < writer->offset;) {
+    size_t want = writer->offset - position < chunk.size() ? (size_t)(writer->offset - position) : chunk.size();
+    ssize_t got = pread(writer->fd, &chunk[0], want, position);
+    if (got <= 0) {
+      if (got < 0 && errno == EINTR) {
+        continue;
+      }
+      setOsError("Failed to read back", writer->tempPath);
+      baton->error = giterr_last();
+      writer->Close();
+      return;
+    }
+    sha1.Update(&chunk[0], got);
+    position += got;
+  }
+  unsigned char checksum[Sha1::DIGEST_SIZE];
+  sha1.Final(checksum);
+
+  if (!writeFully(writer->fd, checksum, sizeof(checksum)) || fsync(writer->fd) != 0) {
+    setOsError("Failed to write", writer->tempPath);
+    baton->error = giterr_last();
+    writer->Close();
+    return;
+  }
+  fchmod(writer->fd, 0444);
+  close(writer->fd);
+  writer->fd = -1;
+
+  git_oid packOid;
+  git_oid_fromraw(&packOid, checksum);
+  char sha[GIT_OID_HEXSZ + 1];
+  git_oid_fmt(sha, &packOid);
+  sha[GIT_OID_HEXSZ] = '\0';
+  baton->sha = sha;
+  baton->packPath = writer->packDirectory + "pack-" + baton->sha + ".pack";
+  baton->indexPath = writer->packDirectory + "pack-" + baton->sha + ".idx";
+
+  std::vector<unsigned char> index;
+  packIndex(writer->entries, checksum, index);
+
+  // The pack goes first, so the index never names a missing pack
+  if (rename(writer->tempPath.c_str(), baton->packPath.c_str()) != 0) {
+    setOsError("Failed to move pack to", baton->packPath);
+    baton->error = giterr_last();
+    writer->Close();
+    return;
+  }
+  writer->tempPath.clear();
+
+  if (writeFileAtomically(baton->indexPath, index) != GIT_OK) {
+    baton->error = giterr_last();
+    unlink(baton->packPath.c_str());
+  }
+
+  writer->Close();
+}
+
+void GitPackWriter::CommitAfterWork(uv_work_t *req) {
+  HandleScope scope;
+  CommitBaton *baton = static_cast<CommitBaton *>(req->data);
+
+  baton->writer->busy = false;
+
+  if (success(baton->error, baton->callback)) {
+    Local<Object> result = Object::New();
+    result->Set(String::NewSymbol("objects"), Integer::NewFromUnsigned(baton->objectCount));
+    if (baton->objectCount > 0) {
+      result->Set(String::NewSymbol("sha"), String::New(baton->sha.c_str()));
+      result->Set(String::NewSymbol("packPath"), String::New(baton->packPath.c_str()));
+      result->Set(String::NewSymbol("indexPath"), String::New(baton->indexPath.c_str()));
+    }
+
+    Handle<Value> argv[2] = {
+      Local<Value>::New(Null()),
+      result
+    };
+
+    TryCatch try_catch;
+    baton->callback->Call(Context::GetCurrent()->Global(), 2, argv);
+    if (try_catch.HasCaught()) {
+      node::FatalException(try_catch);
+    }
+  }
+
+  baton->writer->Unref();
+  baton->callback.Dispose();
+  delete baton;
+}
+
+Handle<Value> GitPackWriter::Abort(const Arguments& args) {
+  HandleScope scope;
+
+  if(args.Length() == 0 || !args[0]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Callback is required and must be a Function.")));
+  }
+
+  GitPackWriter* writer = ObjectWrap::Unwrap<GitPackWriter>(args.This());
+  if (writer->busy) {
+    return ThrowException(Exception::Error(String::New("A write is still in flight.")));
+  }
+
+  AbortBaton* baton = new AbortBaton;
+  baton->request.data = baton;
+  baton->writer = writer;
+  baton->writer->busy = true;
+  baton->writer->Ref();
+  baton->callback = Persistent<Function>::New(Local<Function>::Cast(args[0]));
+
+  uv_queue_work(uv_default_loop(), &baton->request, AbortWork, (uv_after_work_cb)AbortAfterWork);
+
+  return Undefined();
+}
+
+void GitPackWriter::AbortWork(uv_work_t *req) {
+  AbortBaton *baton = static_cast<AbortBaton *>(req->data);
+
+  baton->writer->Close();
+}
+
+void GitPackWriter::AbortAfterWork(uv_work_t *req) {
+  HandleScope scope;
+  AbortBaton *baton = static_cast<AbortBaton *>(req->data);
+
+  baton->writer->busy = false;
+
+  Handle<Value> argv[1] = {
+    Local<Value>::New(Null())
+  };
+
+  TryCatch try_catch;
+  baton->callback->Call(Context::GetCurrent()->Global(), 1, argv);
+  if (try_catch.HasCaught()) {
+    node::FatalException(try_catch);
+  }
+
+  baton->writer->Unref();
+  baton->callback.Dispose();
+  delete baton;
+}
+
+Persistent<Function> GitPackWriter::constructor_template;
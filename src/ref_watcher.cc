@@ -0,0 +1,433 @@
+/*
+ * Copyright 2013, Tim Branyen @tbranyen <tim@tabdeveloper.com>
+ * @author Michael Robinson @codeofinterest <mike@pagesofinterest.net>
+ *
+ * Dual licensed under the MIT and GPL licenses.
+ */
+
+#include <v8.h>
+#include <node.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include "cvv8/v8-convert.hpp"
+#include "git2.h"
+
+#include "../include/repo.h"
+#include "../include/oid.h"
+#include "../include/ref_watcher.h"
+#include "../include/error.h"
+
+#include "../include/functions/utilities.h"
+
+using namespace v8;
+using namespace node;
+using namespace cvv8;
+
+void GitRefWatcher::Initialize(Handle<Object> target) {
+  HandleScope scope;
+
+  Local<FunctionTemplate> tpl = FunctionTemplate::New(New);
+
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+  tpl->SetClassName(String::NewSymbol("RefWatcher"));
+
+  NODE_SET_PROTOTYPE_METHOD(tpl, "start", Start);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "stop", Stop);
+
+  constructor_template = Persistent<Function>::New(tpl->GetFunction());
+  target->Set(String::NewSymbol("RefWatcher"), constructor_template);
+}
+
+Handle<Value> GitRefWatcher::New(const Arguments& args) {
+  HandleScope scope;
+
+  GitRefWatcher *watcher = new GitRefWatcher();
+  watcher->baton = NULL;
+  watcher->Wrap(args.This());
+
+  return scope.Close(args.This());
+}
+
+/**
+ * Resolve every ref plus HEAD. A fresh repository is opened per snapshot so
+ * that libgit2's packed-refs cache, which is keyed on mtime, can never hide a
+ * rewrite that happened within the same second.
+ */
+int GitRefWatcher::Snapshot(const std::string& path, RefSnapshot& refs) {
+  git_repository* repo = NULL;
+  int returnCode = git_repository_open(&repo, path.c_str());
+  if (returnCode != GIT_OK) {
+    return returnCode;
+  }
+
+  git_strarray names;
+  returnCode = git_reference_list(&names, repo, GIT_REF_LISTALL);
+  if (returnCode != GIT_OK) {
+    git_repository_free(repo);
+    return returnCode;
+  }
+
+  refs.clear();
+  for (size_t i = 0; i < names.count; i++) {
+    git_oid oid;
+    if (git_reference_name_to_id(&oid, repo, names.strings[i]) == GIT_OK) {
+      refs[names.strings[i]] = oid;
+    }
+  }
+
+  git_oid head;
+  if (git_reference_name_to_id(&head, repo, "HEAD") == GIT_OK) {
+    refs["HEAD"] = head;
+  }
+
+  git_strarray_free(&names);
+  git_repository_free(repo);
+  return GIT_OK;
+}
+
+void GitRefWatcher::Compare(const RefSnapshot& before, const RefSnapshot& after,
+                            std::vector<RefChange>& changes) {
+  RefSnapshot::const_iterator oldRef = before.begin();
+  RefSnapshot::const_iterator newRef = after.begin();
+
+  // Both maps are sorted by name, so a single merge pass finds every change
+  while (oldRef != before.end() || newRef != after.end()) {
+    RefChange change;
+    int order;
+    if (oldRef == before.end()) {
+      order = 1;
+    } else if (newRef == after.end()) {
+      order = -1;
+    } else {
+      order = oldRef->first.compare(newRef->first);
+    }
+
+    if (order < 0) {
+      change.name = oldRef->first;
+      change.hadOld = true;
+      change.oldOid = oldRef->second;
+      change.hasNew = false;
+      changes.push_back(change);
+      ++oldRef;
+    } else if (order > 0) {
+      change.name = newRef->first;
+      change.hadOld = false;
+      change.hasNew = true;
+      change.newOid = newRef->second;
+      changes.push_back(change);
+      ++newRef;
+    } else {
+      if (git_oid_cmp(&oldRef->second, &newRef->second) != 0) {
+        change.name = oldRef->first;
+        change.hadOld = true;
+        change.oldOid = oldRef->second;
+        change.hasNew = true;
+        change.newOid = newRef->second;
+        changes.push_back(change);
+      }
+      ++oldRef;
+      ++newRef;
+    }
+  }
+}
+
+#ifdef __linux__
+static const uint32_t REF_WATCH_MASK = IN_CREATE | IN_DELETE | IN_MOVED_TO |
+                                       IN_MOVED_FROM | IN_CLOSE_WRITE | IN_ONLYDIR;
+
+/**
+ * inotify is not recursive, so every directory below refs/ gets its own
+ * watch. Re-adding an existing watch is a no-op, which lets this run after
+ * every burst to pick up newly created namespaces.
+ */
+static void watchDirectory(int inotifyFd, const std::string& path) {
+  if (inotify_add_watch(inotifyFd, path.c_str(), REF_WATCH_MASK) < 0) {
+    return;
+  }
+
+  DIR* directory = opendir(path.c_str());
+  if (directory == NULL) {
+    return;
+  }
+
+  struct dirent* entry;
+  while ((entry = readdir(directory)) != NULL) {
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+    std::string child = path + "/" + entry->d_name;
+    struct stat info;
+    if (lstat(child.c_str(), &info) == 0 && S_ISDIR(info.st_mode)) {
+      watchDirectory(inotifyFd, child);
+    }
+  }
+  closedir(directory);
+}
+
+static void drainEvents(int inotifyFd) {
+  char buffer[4096];
+  while (read(inotifyFd, buffer, sizeof(buffer)) > 0);
+}
+#endif
+
+Handle<Value> GitRefWatcher::Start(const Arguments& args) {
+  HandleScope scope;
+
+  GitRefWatcher* watcher = ObjectWrap::Unwrap<GitRefWatcher>(args.This());
+
+  if (watcher->baton != NULL) {
+    return ThrowException(Exception::Error(String::New("Watcher is already running.")));
+  }
+
+  if(args.Length() == 0 || !args[0]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Repo is required and must be an Object.")));
+  }
+
+  if(args.Length() == 1 || !args[1]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Change callback is required and must be a Function.")));
+  }
+
+  if(args.Length() == 2 || !args[2]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("End callback is required and must be a Function.")));
+  }
+
+  WatchBaton* baton = new WatchBaton;
+  if (pipe(baton->stopPipe) < 0) {
+    delete baton;
+    return ThrowException(Exception::Error(String::New("Unable to create watcher stop pipe.")));
+  }
+
+  uv_async_init(uv_default_loop(), &baton->asyncChanges, StartWorkSendChanges);
+  uv_async_init(uv_default_loop(), &baton->asyncEnd, StartWorkSendEnd);
+  baton->asyncChanges.data = baton;
+  baton->asyncEnd.data = baton;
+
+  uv_mutex_init(&baton->mutex);
+
+  baton->watcher = watcher;
+  baton->path = git_repository_path(ObjectWrap::Unwrap<GitRepo>(args[0]->ToObject())->GetValue());
+  baton->changeCallback = Persistent<Function>::New(Local<Function>::Cast(args[1]));
+  baton->endCallback = Persistent<Function>::New(Local<Function>::Cast(args[2]));
+
+  watcher->baton = baton;
+  watcher->Ref();
+
+  uv_thread_create(&baton->threadId, StartWork, baton);
+
+  return Undefined();
+}
+void GitRefWatcher::StartWork(void *payload) {
+  WatchBaton *baton = static_cast<WatchBaton *>(payload);
+
+  RefSnapshot current;
+  if (Snapshot(baton->path, current) != GIT_OK) {
+    baton->error.Capture();
+    uv_async_send(&baton->asyncEnd);
+    return;
+  }
+
+  struct pollfd fds[2];
+  int timeout = POLL_MILLISECONDS;
+  fds[0].fd = baton->stopPipe[0];
+  fds[0].events = POLLIN;
+  fds[1].fd = -1;
+  fds[1].events = POLLIN;
+
+#ifdef __linux__
+  int inotifyFd = inotify_init();
+  if (inotifyFd >= 0) {
+    fcntl(inotifyFd, F_SETFL, fcntl(inotifyFd, F_GETFL) | O_NONBLOCK);
+
+    // HEAD and packed-refs are replaced by rename, so watch their directory
+    inotify_add_watch(inotifyFd, baton->path.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE);
+    watchDirectory(inotifyFd, baton->path + "refs");
+
+    fds[1].fd = inotifyFd;
+    timeout = -1;
+  }
+#endif
+
+  while (true) {
+    fds[0].revents = fds[1].revents = 0;
+    int ready = poll(fds, 2, timeout);
+    if (ready < 0 && errno != EINTR) {
+      giterr_set_str(GITERR_OS, "Failed to wait for ref changes");
+      baton->error.Capture();
+      break;
+    }
+    if (fds[0].revents & POLLIN) {
+      break;
+    }
+
+#ifdef __linux__
+    if (fds[1].fd >= 0) {
+      if (!(fds[1].revents & POLLIN)) {
+        continue;
+      }
+
+      // Coalesce the burst: keep draining until the tree has been quiet
+      // for a full window, so a push touching many refs is one snapshot,
+      // but no longer than the maximum delay
+      bool stopping = false;
+      uint64_t deadline = uv_hrtime() + (uint64_t)COALESCE_MAX_MILLISECONDS * 1000000;
+      do {
+        drainEvents(inotifyFd);
+        uint64_t now = uv_hrtime();
+        if (now >= deadline) {
+          break;
+        }
+        int window = std::min((uint64_t)COALESCE_MILLISECONDS, (deadline - now + 999999) / 1000000);
+        fds[0].revents = fds[1].revents = 0;
+        ready = poll(fds, 2, window);
+        stopping = ready > 0 && (fds[0].revents & POLLIN);
+      } while (ready > 0 && !stopping);
+      if (stopping) {
+        break;
+      }
+
+      watchDirectory(inotifyFd, baton->path + "refs");
+    }
+#endif
+
+    RefSnapshot next;
+    if (Snapshot(baton->path, next) != GIT_OK) {
+      // Refs can be caught mid-rename; try again on the next event
+      continue;
+    }
+
+    std::vector<RefChange> changes;
+    Compare(current, next, changes);
+    current.swap(next);
+
+    if (!changes.empty()) {
+      uv_mutex_lock(&baton->mutex);
+      baton->changes.insert(baton->changes.end(), changes.begin(), changes.end());
+      uv_mutex_unlock(&baton->mutex);
+
+      uv_async_send(&baton->asyncChanges);
+    }
+  }
+
+#ifdef __linux__
+  if (inotifyFd >= 0) {
+    close(inotifyFd);
+  }
+#endif
+
+  uv_async_send(&baton->asyncEnd);
+}
+void GitRefWatcher::StartWorkSendChanges(uv_async_t *handle, int status /*UNUSED*/) {
+  HandleScope scope;
+
+  WatchBaton *baton = static_cast<WatchBaton *>(handle->data);
+
+  std::vector<RefChange> changes;
+  uv_mutex_lock(&baton->mutex);
+  changes.swap(baton->changes);
+  uv_mutex_unlock(&baton->mutex);
+
+  if (changes.empty()) {
+    return;
+  }
+
+  std::vector<Local<Object> > changesArray;
+  for (std::vector<RefChange>::iterator change = changes.begin(); change != changes.end(); ++change) {
+    Local<Object> changeObject = Object::New();
+    changeObject->Set(String::NewSymbol("name"), String::New(change->name.c_str()));
+
+    if (change->hadOld) {
+      Local<Object> oid = GitOid::constructor_template->NewInstance();
+      ObjectWrap::Unwrap<GitOid>(oid)->SetValue(change->oldOid);
+      changeObject->Set(String::NewSymbol("oldOid"), oid);
+    } else {
+      changeObject->Set(String::NewSymbol("oldOid"), Null());
+    }
+
+    if (change->hasNew) {
+      Local<Object> oid = GitOid::constructor_template->NewInstance();
+      ObjectWrap::Unwrap<GitOid>(oid)->SetValue(change->newOid);
+      changeObject->Set(String::NewSymbol("newOid"), oid);
+    } else {
+      changeObject->Set(String::NewSymbol("newOid"), Null());
+    }
+
+    changesArray.push_back(changeObject);
+  }
+
+  Handle<Value> argv[2] = {
+    Local<Value>::New(Null()),
+    CastToJS(changesArray)
+  };
+
+  TryCatch try_catch;
+  baton->changeCallback->Call(Context::GetCurrent()->Global(), 2, argv);
+  if (try_catch.HasCaught()) {
+    node::FatalException(try_catch);
+  }
+}
+void GitRefWatcher::StartWorkSendEnd(uv_async_t *handle, int status /*UNUSED*/) {
+  HandleScope scope;
+
+  WatchBaton *baton = static_cast<WatchBaton *>(handle->data);
+
+  uv_thread_join(&baton->threadId);
+
+  // Flush anything queued between the last change signal and shutdown
+  StartWorkSendChanges(&baton->asyncChanges, 0);
+
+  uv_mutex_destroy(&baton->mutex);
+  uv_close((uv_handle_t*) &baton->asyncChanges, NULL);
+  uv_close((uv_handle_t*) &baton->asyncEnd, FreeBaton);
+  close(baton->stopPipe[0]);
+  close(baton->stopPipe[1]);
+
+  baton->watcher->baton = NULL;
+  baton->watcher->Unref();
+
+  Local<Value> argv[1];
+  if (baton->error.IsSet()) {
+    argv[0] = baton->error.Wrap();
+  } else {
+    argv[0] = Local<Value>::New(Null());
+  }
+
+  TryCatch try_catch;
+  baton->endCallback->Call(Context::GetCurrent()->Global(), 1, argv);
+  if (try_catch.HasCaught()) {
+    node::FatalException(try_catch);
+  }
+}
+void GitRefWatcher::FreeBaton(uv_handle_t *handle) {
+  WatchBaton *baton = static_cast<WatchBaton *>(handle->data);
+
+  baton->changeCallback.Dispose();
+  baton->endCallback.Dispose();
+  delete baton;
+}
+
+Handle<Value> GitRefWatcher::Stop(const Arguments& args) {
+  HandleScope scope;
+
+  GitRefWatcher* watcher = ObjectWrap::Unwrap<GitRefWatcher>(args.This());
+  if (watcher->baton != NULL) {
+    char stop = 1;
+    if (write(watcher->baton->stopPipe[1], &stop, 1) < 0) {
+      return ThrowException(Exception::Error(String::New("Unable to signal watcher to stop.")));
+    }
+  }
+
+  return Undefined();
+}
+
+Persistent<Function> GitRefWatcher::constructor_template;
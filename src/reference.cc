@@ -8,6 +8,13 @@
 #include <v8.h>
 #include <node.h>
 #include <string>
+#include <set>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "git2.h"
 
@@ -19,6 +26,8 @@
 #include "../include/functions/string.h"
 #include "../include/functions/utilities.h"
 
+#define MAX_SYMREF_DEPTH 5
+
 using namespace v8;
 using namespace node;
 
@@ -32,6 +41,7 @@ void GitReference::Initialize(Handle<Object> target) {
 
   NODE_SET_PROTOTYPE_METHOD(tpl, "oid", Oid);
   NODE_SET_PROTOTYPE_METHOD(tpl, "lookup", Lookup);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "transaction", Transaction);
 
   constructor_template = Persistent<Function>::New(tpl->GetFunction());
   target->Set(String::NewSymbol("Reference"), constructor_template);
@@ -177,4 +187,342 @@ void GitReference::LookupAfterWork(uv_work_t *req) {
   delete req;
 }
 
+/**
+ * Follow name through any symbolic references to the reference that holds
+ * an oid, the way git update-ref does without --no-deref. A dangling target
+ * (an unborn branch) is returned as is.
+ */
+static int resolveSymbolicName(git_repository* repo, std::string& name) {
+  for (int depth = 0; depth < MAX_SYMREF_DEPTH; depth++) {
+    git_reference* ref = NULL;
+    int returnCode = git_reference_lookup(&ref, repo, name.c_str());
+    if (returnCode == GIT_ENOTFOUND) {
+      return GIT_OK;
+    }
+    if (returnCode != GIT_OK) {
+      return returnCode;
+    }
+    if (git_reference_type(ref) != GIT_REF_SYMBOLIC) {
+      git_reference_free(ref);
+      return GIT_OK;
+    }
+    name = git_reference_symbolic_target(ref);
+    git_reference_free(ref);
+  }
+  giterr_set_str(GITERR_REFERENCE, ("Too many levels of symbolic references at '" + name + "'").c_str());
+  return GIT_ERROR;
+}
+
+/**
+ * Create every missing directory leading up to path, relative to base.
+ */
+static int makeRefDirectories(const std::string& base, const std::string& name) {
+  size_t position = 0;
+  while ((position = name.find('/', position)) != std::string::npos) {
+    std::string directory = base + name.substr(0, position);
+    if (mkdir(directory.c_str(), 0777) < 0 && errno != EEXIST) {
+      return -1;
+    }
+    position++;
+  }
+  return 0;
+}
+
+static int writeAll(int fd, const char* data, size_t length) {
+  while (length > 0) {
+    ssize_t written = write(fd, data, length);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    data += written;
+    length -= written;
+  }
+  return 0;
+}
+
+/**
+ * Copy packed-refs into the already open lock file, dropping any entry (and
+ * its peeled "^" line) whose name is in removed.
+ */
+static int rewritePackedRefs(const std::string& packedPath, int lockFd,
+                             const std::set<std::string>& removed) {
+  FILE* packed = fopen(packedPath.c_str(), "r");
+  if (packed == NULL) {
+    return errno == ENOENT ? 0 : -1;
+  }
+
+  char line[4096];
+  bool skipPeeled = false;
+  int result = 0;
+  while (fgets(line, sizeof(line), packed) != NULL) {
+    if (line[0] == '^') {
+      if (skipPeeled) {
+        continue;
+      }
+    } else if (line[0] != '#' && strlen(line) > GIT_OID_HEXSZ + 1) {
+      std::string name(line + GIT_OID_HEXSZ + 1);
+      name.erase(name.find_last_not_of("\r\n") + 1);
+      skipPeeled = removed.count(name) > 0;
+      if (skipPeeled) {
+        continue;
+      }
+    }
+    if (writeAll(lockFd, line, strlen(line)) < 0) {
+      result = -1;
+      break;
+    }
+  }
+
+  fclose(packed);
+  return result;
+}
+
+Handle<Value> GitReference::Transaction(const Arguments& args) {
+  HandleScope scope;
+
+  if(args.Length() == 0 || !args[0]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Repo is required and must be a Object.")));
+  }
+
+  if(args.Length() == 1 || !args[1]->IsArray()) {
+    return ThrowException(Exception::Error(String::New("Updates are required and must be an Array.")));
+  }
+
+  if(args.Length() == 2 || !args[2]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Callback is required and must be a Function.")));
+  }
+
+  TransactionBaton *baton = new TransactionBaton;
+  baton->request.data = baton;
+  baton->error = NULL;
+  baton->rawRepo = ObjectWrap::Unwrap<GitRepo>(args[0]->ToObject())->GetValue();
+
+  Local<Array> updates = Local<Array>::Cast(args[1]);
+  for (uint32_t i = 0; i < updates->Length(); i++) {
+    Local<Object> update = updates->Get(i)->ToObject();
+    Local<Value> oldSha = update->Get(String::NewSymbol("oldSha"));
+    Local<Value> newSha = update->Get(String::NewSymbol("newSha"));
+
+    TransactionUpdate rawUpdate;
+    rawUpdate.name = stringArgToString(update->Get(String::NewSymbol("name"))->ToString());
+    rawUpdate.checkOld = oldSha->IsString();
+    rawUpdate.mustNotExist = oldSha->IsNull();
+    rawUpdate.isDelete = !newSha->IsString();
+    if (rawUpdate.checkOld) {
+      rawUpdate.oldSha = stringArgToString(oldSha->ToString());
+    }
+    if (!rawUpdate.isDelete) {
+      rawUpdate.newSha = stringArgToString(newSha->ToString());
+    }
+    rawUpdate.lockFd = -1;
+    rawUpdate.locked = false;
+
+    baton->updates.push_back(rawUpdate);
+  }
+
+  baton->callback = Persistent<Function>::New(Local<Function>::Cast(args[2]));
+
+  uv_queue_work(uv_default_loop(), &baton->request, TransactionWork, (uv_after_work_cb)TransactionAfterWork);
+
+  return Undefined();
+}
+void GitReference::TransactionWork(uv_work_t* req) {
+  TransactionBaton *baton = static_cast<TransactionBaton *>(req->data);
+
+  std::string gitDir(git_repository_path(baton->rawRepo));
+  std::string packedPath = gitDir + "packed-refs";
+  std::string packedLockPath = packedPath + ".lock";
+  std::set<std::string> removed;
+  std::set<std::string> targets;
+  int packedLockFd = -1;
+  bool packedLocked = false;
+  std::vector<std::string> committed;
+  std::vector<TransactionUpdate>::iterator update;
+
+  // Validate every update before touching the filesystem
+  for (update = baton->updates.begin(); update != baton->updates.end(); ++update) {
+    if (!git_reference_is_valid_name(update->name.c_str())) {
+      giterr_set_str(GITERR_REFERENCE, ("Invalid reference name '" + update->name + "'").c_str());
+      baton->error = giterr_last();
+      return;
+    }
+    // Symbolic refs such as HEAD are updated through to what they point at
+    if (resolveSymbolicName(baton->rawRepo, update->name) != GIT_OK) {
+      baton->error = giterr_last();
+      return;
+    }
+    if (!targets.insert(update->name).second) {
+      giterr_set_str(GITERR_REFERENCE, ("Reference '" + update->name + "' is updated more than once").c_str());
+      baton->error = giterr_last();
+      return;
+    }
+    if (update->checkOld && git_oid_fromstr(&update->oldOid, update->oldSha.c_str()) != GIT_OK) {
+      baton->error = giterr_last();
+      return;
+    }
+    if (!update->isDelete && git_oid_fromstr(&update->newOid, update->newSha.c_str()) != GIT_OK) {
+      baton->error = giterr_last();
+      return;
+    }
+    if (update->isDelete) {
+      removed.insert(update->name);
+    }
+  }
+
+  // Take every lock up front, the same way git's lockfiles work
+  for (update = baton->updates.begin(); update != baton->updates.end(); ++update) {
+    update->lockPath = gitDir + update->name + ".lock";
+    if (makeRefDirectories(gitDir, update->name) < 0) {
+      giterr_set_str(GITERR_OS, ("Failed to create directory for '" + update->name + "'").c_str());
+      baton->error = giterr_last();
+      goto rollback;
+    }
+    update->lockFd = open(update->lockPath.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+    if (update->lockFd < 0) {
+      giterr_set_str(GITERR_REFERENCE, ("Failed to lock '" + update->name + "'").c_str());
+      baton->error = giterr_last();
+      goto rollback;
+    }
+    update->locked = true;
+  }
+
+  if (!removed.empty()) {
+    packedLockFd = open(packedLockPath.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+    if (packedLockFd < 0) {
+      giterr_set_str(GITERR_REFERENCE, "Failed to lock packed-refs");
+      baton->error = giterr_last();
+      goto rollback;
+    }
+    packedLocked = true;
+  }
+
+  // Verify expected old values while holding the locks
+  for (update = baton->updates.begin(); update != baton->updates.end(); ++update) {
+    git_oid current;
+    int returnCode = git_reference_name_to_id(&current, baton->rawRepo, update->name.c_str());
+    if (returnCode != GIT_OK && returnCode != GIT_ENOTFOUND) {
+      baton->error = giterr_last();
+      goto rollback;
+    }
+
+    bool exists = returnCode == GIT_OK;
+    if (update->mustNotExist && exists) {
+      giterr_set_str(GITERR_REFERENCE, ("Reference '" + update->name + "' already exists").c_str());
+      baton->error = giterr_last();
+      goto rollback;
+    }
+    if (update->checkOld && (!exists || git_oid_cmp(&current, &update->oldOid) != 0)) {
+      giterr_set_str(GITERR_REFERENCE, ("Reference '" + update->name + "' is not at the expected old value").c_str());
+      baton->error = giterr_last();
+      goto rollback;
+    }
+    if (update->isDelete && !exists) {
+      giterr_set_str(GITERR_REFERENCE, ("Reference '" + update->name + "' does not exist").c_str());
+      baton->error = giterr_last();
+      goto rollback;
+    }
+  }
+
+  // Stage new values in the lock files
+  for (update = baton->updates.begin(); update != baton->updates.end(); ++update) {
+    if (update->isDelete) {
+      continue;
+    }
+    char sha[GIT_OID_HEXSZ + 1];
+    git_oid_fmt(sha, &update->newOid);
+    sha[GIT_OID_HEXSZ] = '\n';
+    if (writeAll(update->lockFd, sha, sizeof(sha)) < 0) {
+      giterr_set_str(GITERR_OS, ("Failed to write '" + update->name + "'").c_str());
+      baton->error = giterr_last();
+      goto rollback;
+    }
+  }
+
+  if (packedLockFd >= 0 && rewritePackedRefs(packedPath, packedLockFd, removed) < 0) {
+    giterr_set_str(GITERR_OS, "Failed to rewrite packed-refs");
+    baton->error = giterr_last();
+    goto rollback;
+  }
+
+  // Commit: packed-refs first, so deleted refs never resurrect from it.
+  // Each lock stays held until its own rename succeeds
+  if (packedLocked) {
+    close(packedLockFd);
+    packedLockFd = -1;
+    if (rename(packedLockPath.c_str(), packedPath.c_str()) < 0) {
+      giterr_set_str(GITERR_OS, "Failed to commit packed-refs");
+      baton->error = giterr_last();
+      goto rollback;
+    }
+    packedLocked = false;
+    committed.push_back("packed-refs");
+  }
+
+  for (update = baton->updates.begin(); update != baton->updates.end(); ++update) {
+    close(update->lockFd);
+    update->lockFd = -1;
+
+    std::string refPath = gitDir + update->name;
+    if (update->isDelete) {
+      unlink(refPath.c_str());
+      unlink(update->lockPath.c_str());
+    } else if (rename(update->lockPath.c_str(), refPath.c_str()) < 0) {
+      giterr_set_str(GITERR_OS, ("Failed to commit '" + update->name + "'").c_str());
+      baton->error = giterr_last();
+      goto rollback;
+    }
+    update->locked = false;
+    committed.push_back(update->name);
+  }
+  return;
+
+rollback:
+  if (packedLockFd >= 0) {
+    close(packedLockFd);
+  }
+  if (packedLocked) {
+    unlink(packedLockPath.c_str());
+  }
+  for (update = baton->updates.begin(); update != baton->updates.end(); ++update) {
+    if (update->lockFd >= 0) {
+      close(update->lockFd);
+    }
+    if (update->locked) {
+      unlink(update->lockPath.c_str());
+    }
+  }
+
+  // Renames cannot be undone, so say which ones already happened
+  if (!committed.empty()) {
+    std::string message = std::string(baton->error->message) + "; transaction partially applied, already committed:";
+    for (size_t i = 0; i < committed.size(); i++) {
+      message += (i == 0 ? " " : ", ") + committed[i];
+    }
+    giterr_set_str(GITERR_REFERENCE, message.c_str());
+    baton->error = giterr_last();
+  }
+}
+void GitReference::TransactionAfterWork(uv_work_t* req) {
+  HandleScope scope;
+  TransactionBaton *baton = static_cast<TransactionBaton *>(req->data);
+
+  Local<Value> argv[1];
+  if (baton->error) {
+    argv[0] = GitError::WrapError(baton->error);
+  } else {
+    argv[0] = Local<Value>::New(Null());
+  }
+
+  TryCatch try_catch;
+  baton->callback->Call(Context::GetCurrent()->Global(), 1, argv);
+  if (try_catch.HasCaught()) {
+    node::FatalException(try_catch);
+  }
+  baton->callback.Dispose();
+  delete baton;
+}
+
 Persistent<Function> GitReference::constructor_template;
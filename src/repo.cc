@@ -30,6 +30,7 @@ void GitRepo::Initialize(Handle<Object> target) {
   NODE_SET_PROTOTYPE_METHOD(tpl, "open", Open);
   NODE_SET_PROTOTYPE_METHOD(tpl, "free", Free);
   NODE_SET_PROTOTYPE_METHOD(tpl, "init", Init);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "path", Path);
 
   constructor_template = Persistent<Function>::New(tpl->GetFunction());
   target->Set(String::NewSymbol("Repo"), constructor_template);
@@ -60,6 +61,16 @@ Handle<Value> GitRepo::Free(const Arguments& args) {
   return scope.Close( Undefined() );
 }
 
+Handle<Value> GitRepo::Path(const Arguments& args) {
+  HandleScope scope;
+
+  GitRepo *repo = ObjectWrap::Unwrap<GitRepo>(args.This());
+  if (repo->repo == NULL) {
+    return ThrowException(Exception::Error(String::New("Repo must be open.")));
+  }
+
+  return scope.Close(String::New(git_repository_path(repo->repo)));
+}
 
 Handle<Value> GitRepo::Open(const Arguments& args) {
   HandleScope scope;
@@ -7,14 +7,23 @@
 
 #include <v8.h>
 #include <node.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
 
+#include "cvv8/v8-convert.hpp"
 #include "git2.h"
 
 #include "../include/revwalk.h"
 #include "../include/repo.h"
 #include "../include/commit.h"
+#include "../include/tree_builder.h"
 #include "../include/error.h"
 
+#include "../include/functions/bloom.h"
+#include "../include/functions/graph.h"
+#include "../include/functions/history.h"
+#include "../include/functions/string.h"
 #include "../include/functions/utilities.h"
 
 using namespace v8;
@@ -33,6 +42,10 @@ void GitRevWalk::Initialize(Handle<Object> target) {
   NODE_SET_PROTOTYPE_METHOD(tpl, "push", Push);
   NODE_SET_PROTOTYPE_METHOD(tpl, "next", Next);
   NODE_SET_PROTOTYPE_METHOD(tpl, "free", Free);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "churn", Churn);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "commits", Commits);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "mergeBase", MergeBase);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "isAncestor", IsAncestor);
 
   // Local<Object> sort = Object::New();
 
@@ -254,4 +267,968 @@ void GitRevWalk::NextAfterWork(uv_work_t *req) {
   delete req;
 }
 
+/**
+ * Line counts for one commit, accumulated by the diff callbacks.
+ */
+struct ChurnCounts {
+  size_t files;
+  size_t additions;
+  size_t deletions;
+};
+
+Handle<Value> GitRevWalk::Churn(const Arguments& args) {
+  HandleScope scope;
+
+  GitRevWalk* revwalk = ObjectWrap::Unwrap<GitRevWalk>(args.This());
+
+  if(args.Length() == 0 || !args[0]->IsString()) {
+    return ThrowException(Exception::Error(String::New("Range is required and must be a String.")));
+  }
+
+  if(args.Length() == 1 || !args[1]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Options are required and must be an Object.")));
+  }
+
+  if(args.Length() == 2 || !args[2]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Records callback is required and must be a Function.")));
+  }
+
+  if(args.Length() == 3 || !args[3]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("End callback is required and must be a Function.")));
+  }
+
+  if (revwalk->GetRepo() == NULL) {
+    return ThrowException(Exception::Error(String::New("Repo must be open.")));
+  }
+
+  ChurnBaton* baton = new ChurnBaton;
+  uv_async_init(uv_default_loop(), &baton->asyncRecords, ChurnWorkSendRecords);
+  uv_async_init(uv_default_loop(), &baton->asyncEnd, ChurnWorkSendEnd);
+  baton->asyncRecords.data = baton;
+  baton->asyncEnd.data = baton;
+
+  uv_mutex_init(&baton->mutex);
+  uv_cond_init(&baton->queued);
+  uv_sem_init(&baton->inFlight, GitRevWalk::CHURN_MAX_IN_FLIGHT);
+
+  baton->revwalk = revwalk;
+  revwalk->Ref();
+  baton->repoPath = git_repository_path(revwalk->GetRepo());
+  baton->range = stringArgToString(args[0]->ToString());
+
+  Local<Object> options = args[1]->ToObject();
+  Local<Value> sorting = options->Get(String::NewSymbol("sorting"));
+  baton->sorting = sorting->IsNumber() ? sorting->Uint32Value() : GIT_SORT_TOPOLOGICAL | GIT_SORT_TIME;
+  Local<Value> threads = options->Get(String::NewSymbol("threads"));
+  baton->threads = threads->IsNumber() ? threads->Int32Value() : GitRevWalk::CHURN_DEFAULT_THREADS;
+  if (baton->threads < 1) {
+    baton->threads = 1;
+  }
+
+  baton->pendingBase = 0;
+  baton->walked = 0;
+  baton->nextToDiff = 0;
+  baton->sent = 0;
+  baton->walkDone = false;
+  baton->aborted = false;
+
+  baton->recordsCallback = Persistent<Function>::New(Local<Function>::Cast(args[2]));
+  baton->endCallback = Persistent<Function>::New(Local<Function>::Cast(args[3]));
+
+  uv_thread_create(&baton->threadId, ChurnWork, baton);
+
+  return Undefined();
+}
+void GitRevWalk::ChurnWork(void *payload) {
+  ChurnBaton* baton = static_cast<ChurnBaton *>(payload);
+
+  std::vector<uv_thread_t> workers(baton->threads);
+  for (int i = 0; i < baton->threads; i++) {
+    uv_thread_create(&workers[i], ChurnWorkDiff, baton);
+  }
+
+  // The walk gets its own repository handle, as does every diff thread
+  git_repository* repo = NULL;
+  git_revwalk* walk = NULL;
+  int returnCode = git_repository_open(&repo, baton->repoPath.c_str());
+  if (returnCode == GIT_OK) {
+    returnCode = git_revwalk_new(&walk, repo);
+  }
+  if (returnCode == GIT_OK) {
+    git_revwalk_sorting(walk, baton->sorting);
+    if (baton->range.find("..") != std::string::npos) {
+      returnCode = git_revwalk_push_range(walk, baton->range.c_str());
+    } else {
+      git_object* tip = NULL;
+      returnCode = git_revparse_single(&tip, repo, baton->range.c_str());
+      if (returnCode == GIT_OK) {
+        returnCode = git_revwalk_push(walk, git_object_id(tip));
+        git_object_free(tip);
+      }
+    }
+  }
+
+  git_oid oid;
+  while (returnCode == GIT_OK && (returnCode = git_revwalk_next(&oid, walk)) == GIT_OK) {
+    // Blocks while CHURN_MAX_IN_FLIGHT commits are waiting on diffs or JS
+    uv_sem_wait(&baton->inFlight);
+
+    uv_mutex_lock(&baton->mutex);
+    if (baton->aborted) {
+      uv_mutex_unlock(&baton->mutex);
+      break;
+    }
+    ChurnRecord record;
+    git_oid_cpy(&record.oid, &oid);
+    record.parentCount = 0;
+    record.files = 0;
+    record.additions = 0;
+    record.deletions = 0;
+    record.done = false;
+    baton->pending.push_back(record);
+    baton->walked++;
+    uv_cond_signal(&baton->queued);
+    uv_mutex_unlock(&baton->mutex);
+  }
+
+  if (returnCode != GIT_OK && returnCode != GIT_ITEROVER) {
+    baton->error.Capture();
+  }
+
+  uv_mutex_lock(&baton->mutex);
+  baton->walkDone = true;
+  if (baton->error.IsSet()) {
+    baton->aborted = true;
+  }
+  uv_cond_broadcast(&baton->queued);
+  uv_mutex_unlock(&baton->mutex);
+
+  for (int i = 0; i < baton->threads; i++) {
+    uv_thread_join(&workers[i]);
+  }
+
+  if (!baton->error.IsSet() && !baton->workerError.empty()) {
+    giterr_set_str(GITERR_REPOSITORY, baton->workerError.c_str());
+    baton->error.Capture();
+  }
+
+  git_revwalk_free(walk);
+  git_repository_free(repo);
+
+  uv_async_send(&baton->asyncEnd);
+}
+void GitRevWalk::ChurnWorkDiff(void *payload) {
+  ChurnBaton* baton = static_cast<ChurnBaton *>(payload);
+
+  git_repository* repo = NULL;
+  if (git_repository_open(&repo, baton->repoPath.c_str()) != GIT_OK) {
+    const git_error* error = giterr_last();
+    uv_mutex_lock(&baton->mutex);
+    baton->workerError = error ? error->message : "Failed to open repository";
+    baton->aborted = true;
+    uv_cond_broadcast(&baton->queued);
+    uv_mutex_unlock(&baton->mutex);
+    // Wake the walk thread in case it is waiting for a slot
+    uv_sem_post(&baton->inFlight);
+    return;
+  }
+
+  while (true) {
+    uv_mutex_lock(&baton->mutex);
+    while (baton->nextToDiff == baton->walked && !baton->walkDone && !baton->aborted) {
+      uv_cond_wait(&baton->queued, &baton->mutex);
+    }
+    if (baton->nextToDiff == baton->walked || baton->aborted) {
+      uv_mutex_unlock(&baton->mutex);
+      break;
+    }
+    // deque references stay valid while other records are added or removed
+    ChurnRecord& record = baton->pending[baton->nextToDiff - baton->pendingBase];
+    baton->nextToDiff++;
+    uv_mutex_unlock(&baton->mutex);
+
+    ChurnCounts counts = { 0, 0, 0 };
+    unsigned int parentCount = 0;
+    git_commit* commit = NULL;
+    git_commit* parent = NULL;
+    git_tree* tree = NULL;
+    git_tree* parentTree = NULL;
+    git_diff_list* diff = NULL;
+
+    int returnCode = git_commit_lookup(&commit, repo, &record.oid);
+    if (returnCode == GIT_OK) {
+      parentCount = git_commit_parentcount(commit);
+      returnCode = git_commit_tree(&tree, commit);
+    }
+    if (returnCode == GIT_OK && parentCount > 0) {
+      returnCode = git_commit_parent(&parent, commit, 0);
+      if (returnCode == GIT_OK) {
+        returnCode = git_commit_tree(&parentTree, parent);
+      }
+    }
+    if (returnCode == GIT_OK) {
+      returnCode = git_diff_tree_to_tree(&diff, repo, parentTree, tree, NULL);
+    }
+    if (returnCode == GIT_OK) {
+      returnCode = git_diff_foreach(diff, ChurnWorkFile, NULL, ChurnWorkData, &counts);
+    }
+
+    // Copied now: the error lives in this thread's storage
+    std::string error;
+    if (returnCode != GIT_OK) {
+      const git_error* lastError = giterr_last();
+      error = lastError ? lastError->message : "Failed to diff commit";
+    }
+
+    git_diff_list_free(diff);
+    git_tree_free(parentTree);
+    git_tree_free(tree);
+    git_commit_free(parent);
+    git_commit_free(commit);
+
+    uv_mutex_lock(&baton->mutex);
+    record.parentCount = parentCount;
+    record.files = counts.files;
+    record.additions = counts.additions;
+    record.deletions = counts.deletions;
+    // Failed records are still marked done so the main thread keeps
+    // draining and the walk thread never stays blocked on inFlight
+    record.done = true;
+    bool abortWalk = false;
+    if (!error.empty() && baton->workerError.empty()) {
+      baton->workerError = error;
+      baton->aborted = true;
+      abortWalk = true;
+      uv_cond_broadcast(&baton->queued);
+    }
+    uv_mutex_unlock(&baton->mutex);
+
+    if (abortWalk) {
+      // Records behind this one may never finish, so the walk thread could
+      // otherwise wait for a slot forever
+      uv_sem_post(&baton->inFlight);
+    }
+
+    uv_async_send(&baton->asyncRecords);
+  }
+
+  git_repository_free(repo);
+}
+int GitRevWalk::ChurnWorkFile(const git_diff_delta *delta, float progress, void *payload) {
+  static_cast<ChurnCounts *>(payload)->files++;
+  return GIT_OK;
+}
+int GitRevWalk::ChurnWorkData(const git_diff_delta *delta, const git_diff_range *range,
+                              char line_origin, const char *content, size_t content_len,
+                              void *payload) {
+  ChurnCounts* counts = static_cast<ChurnCounts *>(payload);
+  if (line_origin == GIT_DIFF_LINE_ADDITION) {
+    counts->additions++;
+  } else if (line_origin == GIT_DIFF_LINE_DELETION) {
+    counts->deletions++;
+  }
+  return GIT_OK;
+}
+void GitRevWalk::ChurnWorkSendRecords(uv_async_t *handle, int status /*UNUSED*/) {
+  HandleScope scope;
+
+  ChurnBaton* baton = static_cast<ChurnBaton *>(handle->data);
+
+  // Only the finished prefix is sent, which keeps records in walk order
+  std::vector<ChurnRecord> finished;
+  uv_mutex_lock(&baton->mutex);
+  while (!baton->pending.empty() && baton->pending.front().done) {
+    finished.push_back(baton->pending.front());
+    baton->pending.pop_front();
+    baton->pendingBase++;
+  }
+  bool aborted = baton->aborted;
+  uv_mutex_unlock(&baton->mutex);
+
+  for (size_t i = 0; i < finished.size(); i++) {
+    uv_sem_post(&baton->inFlight);
+  }
+
+  if (finished.empty() || aborted) {
+    return;
+  }
+
+  std::vector<Local<Object> > records;
+  records.reserve(finished.size());
+  for (size_t i = 0; i < finished.size(); i++) {
+    char sha[GIT_OID_HEXSZ + 1];
+    git_oid_fmt(sha, &finished[i].oid);
+    sha[GIT_OID_HEXSZ] = '\0';
+
+    Local<Object> record = Object::New();
+    record->Set(String::NewSymbol("sha"), String::New(sha));
+    record->Set(String::NewSymbol("parentCount"), Integer::NewFromUnsigned(finished[i].parentCount));
+    record->Set(String::NewSymbol("files"), Integer::NewFromUnsigned(finished[i].files));
+    record->Set(String::NewSymbol("additions"), Integer::NewFromUnsigned(finished[i].additions));
+    record->Set(String::NewSymbol("deletions"), Integer::NewFromUnsigned(finished[i].deletions));
+    records.push_back(record);
+  }
+  baton->sent += finished.size();
+
+  Handle<Value> argv[1] = {
+    cvv8::CastToJS(records)
+  };
+
+  TryCatch try_catch;
+  baton->recordsCallback->Call(Context::GetCurrent()->Global(), 1, argv);
+  if (try_catch.HasCaught()) {
+    node::FatalException(try_catch);
+  }
+}
+void GitRevWalk::ChurnWorkSendEnd(uv_async_t *handle, int status /*UNUSED*/) {
+  HandleScope scope;
+
+  ChurnBaton* baton = static_cast<ChurnBaton *>(handle->data);
+
+  uv_thread_join(&baton->threadId);
+
+  // Async signals are coalesced and unordered between handles, so flush
+  // any records whose signal has not been handled yet
+  ChurnWorkSendRecords(&baton->asyncRecords, 0);
+
+  uv_mutex_destroy(&baton->mutex);
+  uv_cond_destroy(&baton->queued);
+  uv_sem_destroy(&baton->inFlight);
+  uv_close((uv_handle_t*) &baton->asyncRecords, NULL);
+  uv_close((uv_handle_t*) &baton->asyncEnd, ChurnFree);
+
+  Handle<Value> argv[2];
+  if (baton->error.IsSet()) {
+    argv[0] = baton->error.Wrap();
+  } else {
+    argv[0] = Local<Value>::New(Null());
+  }
+  argv[1] = Integer::NewFromUnsigned(baton->sent);
+
+  TryCatch try_catch;
+  baton->endCallback->Call(Context::GetCurrent()->Global(), 2, argv);
+  if (try_catch.HasCaught()) {
+    node::FatalException(try_catch);
+  }
+}
+void GitRevWalk::ChurnFree(uv_handle_t *handle) {
+  ChurnBaton* baton = static_cast<ChurnBaton *>(handle->data);
+
+  baton->revwalk->Unref();
+  baton->recordsCallback.Dispose();
+  baton->endCallback.Dispose();
+  delete baton;
+}
+
+/**
+ * Split "from..to" into the commits to exclude and include; a single
+ * revision is included alone. Either side may be any revision that peels
+ * to a commit.
+ */
+int GitRevWalk::ResolveRange(git_repository* repo, const std::string& range,
+                             std::vector<git_oid>& include, std::vector<git_oid>& exclude) {
+  if (range.find("...") != std::string::npos) {
+    giterr_set_str(GITERR_INVALID, "Symmetric difference ranges are not supported");
+    return -1;
+  }
+
+  std::vector<std::string> specs;
+  size_t dots = range.find("..");
+  if (dots == std::string::npos) {
+    specs.push_back(range);
+  } else {
+    specs.push_back(range.substr(dots + 2));
+    specs.push_back(range.substr(0, dots));
+  }
+
+  for (size_t i = 0; i < specs.size(); i++) {
+    git_object* object = NULL;
+    git_object* commit = NULL;
+    int returnCode = git_revparse_single(&object, repo, specs[i].empty() ? "HEAD" : specs[i].c_str());
+    if (returnCode == GIT_OK) {
+      returnCode = git_object_peel(&commit, object, GIT_OBJ_COMMIT);
+    }
+    if (returnCode == GIT_OK) {
+      (i == 0 ? include : exclude).push_back(*git_object_id(commit));
+    }
+    git_object_free(commit);
+    git_object_free(object);
+    if (returnCode != GIT_OK) {
+      return returnCode;
+    }
+  }
+  return GIT_OK;
+}
+
+Handle<Value> GitRevWalk::Commits(const Arguments& args) {
+  HandleScope scope;
+
+  GitRevWalk* revwalk = ObjectWrap::Unwrap<GitRevWalk>(args.This());
+
+  if(args.Length() == 0 || !args[0]->IsString()) {
+    return ThrowException(Exception::Error(String::New("Range is required and must be a String.")));
+  }
+
+  if(args.Length() == 1 || !args[1]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Options are required and must be an Object.")));
+  }
+
+  if(args.Length() == 2 || !args[2]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Batch callback is required and must be a Function.")));
+  }
+
+  if(args.Length() == 3 || !args[3]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("End callback is required and must be a Function.")));
+  }
+
+  if (revwalk->GetRepo() == NULL) {
+    return ThrowException(Exception::Error(String::New("Repo must be open.")));
+  }
+
+  CommitsBaton* baton = new CommitsBaton;
+  uv_async_init(uv_default_loop(), &baton->asyncBatch, CommitsWorkSendBatch);
+  uv_async_init(uv_default_loop(), &baton->asyncEnd, CommitsWorkSendEnd);
+  baton->asyncBatch.data = baton;
+  baton->asyncEnd.data = baton;
+  uv_mutex_init(&baton->mutex);
+  uv_sem_init(&baton->inFlight, GitRevWalk::COMMITS_MAX_IN_FLIGHT);
+
+  baton->revwalk = revwalk;
+  revwalk->Ref();
+  baton->repoPath = git_repository_path(revwalk->GetRepo());
+  baton->range = stringArgToString(args[0]->ToString());
+
+  Local<Value> sorting = args[1]->ToObject()->Get(String::NewSymbol("sorting"));
+  baton->sorting = sorting->IsNumber() ? sorting->Uint32Value() : GIT_SORT_TOPOLOGICAL | GIT_SORT_TIME;
+
+  Local<Value> paths = args[1]->ToObject()->Get(String::NewSymbol("paths"));
+  if (paths->IsArray()) {
+    Local<Array> pathArray = Local<Array>::Cast(paths);
+    for (uint32_t i = 0; i < pathArray->Length(); i++) {
+      baton->paths.push_back(stringArgToString(pathArray->Get(i)->ToString()));
+    }
+  }
+
+  Local<Value> cache = args[1]->ToObject()->Get(String::NewSymbol("cache"));
+  baton->cache = cache->IsBoolean() && cache->BooleanValue();
+
+  baton->pendingBatches = 0;
+  baton->sent = 0;
+  baton->graph = false;
+  baton->loaded = 0;
+  baton->cached = 0;
+  baton->filtered = 0;
+  baton->diffed = 0;
+
+  baton->batchCallback = Persistent<Function>::New(Local<Function>::Cast(args[2]));
+  baton->endCallback = Persistent<Function>::New(Local<Function>::Cast(args[3]));
+
+  uv_thread_create(&baton->threadId, CommitsWork, baton);
+
+  return Undefined();
+}
+void GitRevWalk::CommitsWork(void *payload) {
+  CommitsBaton* baton = static_cast<CommitsBaton *>(payload);
+
+  std::vector<git_oid> include;
+  std::vector<git_oid> exclude;
+  git_repository* repo = NULL;
+  int returnCode = git_repository_open(&repo, baton->repoPath.c_str());
+  if (returnCode == GIT_OK) {
+    returnCode = ResolveRange(repo, baton->range, include, exclude);
+  }
+
+  // A graph or filters that cannot be read are ignored, as git does
+  CommitGraph graph;
+  if (returnCode == GIT_OK && graph.Open(baton->repoPath) != GIT_OK) {
+    giterr_clear();
+  }
+  BloomFilters filters;
+  std::vector<BloomKey> keys;
+  if (returnCode == GIT_OK && !baton->paths.empty()) {
+    if (filters.Open(baton->repoPath) != GIT_OK) {
+      giterr_clear();
+    }
+    for (size_t i = 0; i < baton->paths.size(); i++) {
+      std::string path = baton->paths[i];
+      while (path.size() > 1 && path[path.size() - 1] == '/') {
+        path.erase(path.size() - 1);
+      }
+      keys.push_back(BloomKey(path));
+    }
+  }
+
+  if (returnCode == GIT_OK && baton->cache && exclude.empty() && HistoryCache::Cacheable(baton->sorting)) {
+    returnCode = CommitsWorkCached(baton, repo, graph, &include[0], filters, keys);
+  } else if (returnCode == GIT_OK && graph.Count() > 0) {
+    CommitNodes nodes(repo, graph);
+    std::vector<uint32_t> includeIds(include.size());
+    std::vector<uint32_t> excludeIds(exclude.size());
+    for (size_t i = 0; i < include.size() && returnCode == GIT_OK; i++) {
+      returnCode = nodes.Find(&include[i], &includeIds[i]);
+    }
+    for (size_t i = 0; i < exclude.size() && returnCode == GIT_OK; i++) {
+      returnCode = nodes.Find(&exclude[i], &excludeIds[i]);
+    }
+
+    if (returnCode == GIT_OK) {
+      std::vector<uint32_t> ids;
+      commitRange(nodes, includeIds, excludeIds, baton->sorting, ids);
+
+      for (size_t begin = 0; begin < ids.size() && returnCode == GIT_OK; begin += COMMITS_BATCH_SIZE) {
+        size_t end = std::min(begin + COMMITS_BATCH_SIZE, ids.size());
+        std::vector<git_oid> batch(end - begin);
+        for (size_t i = begin; i < end; i++) {
+          nodes.Oid(ids[i], &batch[i - begin]);
+        }
+        returnCode = CommitsWorkLimit(baton, repo, filters, keys, batch);
+        if (returnCode == GIT_OK) {
+          CommitsWorkSend(baton, batch);
+        }
+      }
+    }
+    baton->graph = true;
+    baton->loaded = nodes.Loaded();
+  } else if (returnCode == GIT_OK) {
+    git_revwalk* walk = NULL;
+    returnCode = git_revwalk_new(&walk, repo);
+    if (returnCode == GIT_OK) {
+      git_revwalk_sorting(walk, baton->sorting);
+    }
+    for (size_t i = 0; i < include.size() && returnCode == GIT_OK; i++) {
+      returnCode = git_revwalk_push(walk, &include[i]);
+    }
+    for (size_t i = 0; i < exclude.size() && returnCode == GIT_OK; i++) {
+      returnCode = git_revwalk_hide(walk, &exclude[i]);
+    }
+
+    std::vector<git_oid> batch;
+    git_oid oid;
+    while (returnCode == GIT_OK && (returnCode = git_revwalk_next(&oid, walk)) == GIT_OK) {
+      batch.push_back(oid);
+      baton->loaded++;
+      if (batch.size() == COMMITS_BATCH_SIZE) {
+        returnCode = CommitsWorkLimit(baton, repo, filters, keys, batch);
+        if (returnCode == GIT_OK) {
+          CommitsWorkSend(baton, batch);
+        }
+        batch.clear();
+      }
+    }
+    if (returnCode == GIT_ITEROVER) {
+      returnCode = CommitsWorkLimit(baton, repo, filters, keys, batch);
+    }
+
+    if (returnCode == GIT_OK) {
+      CommitsWorkSend(baton, batch);
+    }
+
+    git_revwalk_free(walk);
+  }
+
+  if (returnCode != GIT_OK) {
+    baton->error.Capture();
+  }
+
+  git_repository_free(repo);
+
+  uv_async_send(&baton->asyncEnd);
+}
+/**
+ * Walk from tip through the history cache. A cached walk is sent straight
+ * from its file; otherwise only the commits the walk from the nearest
+ * cached ancestor lacks are read, and they are sent ahead of it and cached
+ * as the walk from tip. Caching is best effort: a walk that cannot be
+ * written is still sent.
+ */
+int GitRevWalk::CommitsWorkCached(CommitsBaton* baton, git_repository* repo, const CommitGraph& graph,
+                                  const git_oid* tip, const BloomFilters& filters,
+                                  const std::vector<BloomKey>& keys) {
+  HistoryCache cache;
+  std::vector<git_oid> fresh;
+  int returnCode = GIT_OK;
+  if (cache.Open(baton->repoPath, tip, baton->sorting) != GIT_OK) {
+    giterr_clear();
+  }
+  if (cache.Count() == 0) {
+    returnCode = cache.Extend(repo, graph, tip, baton->sorting, fresh, &baton->loaded);
+    if (returnCode != GIT_OK) {
+      return returnCode;
+    }
+    baton->graph = graph.Count() > 0;
+
+    std::vector<git_oid> tips;
+    if (cache.Write(baton->repoPath, baton->sorting, fresh) != GIT_OK || commitTips(repo, tips) != GIT_OK) {
+      giterr_clear();
+    } else if (cache.Count() > 0) {
+      // The walk spliced onto is superseded unless a reference still
+      // points at its tip
+      git_oid base;
+      cache.Oid(0, &base);
+      bool referenced = false;
+      for (size_t i = 0; i < tips.size() && !referenced; i++) {
+        referenced = git_oid_cmp(&tips[i], &base) == 0;
+      }
+      if (!referenced) {
+        HistoryCache::Remove(baton->repoPath, &base, baton->sorting);
+      }
+    }
+  }
+  baton->cached = cache.Count();
+
+  size_t total = fresh.size() + cache.Count();
+  for (size_t begin = 0; begin < total && returnCode == GIT_OK; begin += COMMITS_BATCH_SIZE) {
+    size_t end = std::min(begin + COMMITS_BATCH_SIZE, total);
+    std::vector<git_oid> batch(end - begin);
+    for (size_t i = begin; i < end; i++) {
+      if (i < fresh.size()) {
+        batch[i - begin] = fresh[i];
+      } else {
+        cache.Oid(i - fresh.size(), &batch[i - begin]);
+      }
+    }
+    returnCode = CommitsWorkLimit(baton, repo, filters, keys, batch);
+    if (returnCode == GIT_OK) {
+      CommitsWorkSend(baton, batch);
+    }
+  }
+  return returnCode;
+}
+/**
+ * Drop the commits in batch that do not touch baton->paths. Commits whose
+ * filter rules every path out are dropped without loading their trees;
+ * the rest are diffed against their first parent, limited to the paths.
+ */
+int GitRevWalk::CommitsWorkLimit(CommitsBaton* baton, git_repository* repo, const BloomFilters& filters,
+                                 const std::vector<BloomKey>& keys, std::vector<git_oid>& batch) {
+  if (baton->paths.empty()) {
+    return GIT_OK;
+  }
+
+  // Filters only hold literal paths, so patterns always need a diff
+  bool literal = true;
+  std::vector<char*> pathspecPointers;
+  for (size_t i = 0; i < baton->paths.size(); i++) {
+    literal = literal && baton->paths[i].find_first_of("*?[") == std::string::npos;
+    pathspecPointers.push_back(const_cast<char*>(baton->paths[i].c_str()));
+  }
+  git_diff_options options = GIT_DIFF_OPTIONS_INIT;
+  options.pathspec.strings = &pathspecPointers[0];
+  options.pathspec.count = pathspecPointers.size();
+
+  size_t kept = 0;
+  for (size_t i = 0; i < batch.size(); i++) {
+    uint32_t position;
+    if (literal && filters.Find(&batch[i], &position) && !filters.MayChange(position, keys)) {
+      baton->filtered++;
+      continue;
+    }
+
+    git_commit* commit = NULL;
+    git_commit* parent = NULL;
+    git_tree* tree = NULL;
+    git_tree* parentTree = NULL;
+    git_diff_list* diff = NULL;
+
+    int returnCode = git_commit_lookup(&commit, repo, &batch[i]);
+    if (returnCode == GIT_OK) {
+      returnCode = git_commit_tree(&tree, commit);
+    }
+    if (returnCode == GIT_OK && git_commit_parentcount(commit) > 0) {
+      returnCode = git_commit_parent(&parent, commit, 0);
+      if (returnCode == GIT_OK) {
+        returnCode = git_commit_tree(&parentTree, parent);
+      }
+    }
+    if (returnCode == GIT_OK) {
+      returnCode = git_diff_tree_to_tree(&diff, repo, parentTree, tree, &options);
+    }
+    bool changed = returnCode == GIT_OK && git_diff_num_deltas(diff) > 0;
+
+    git_diff_list_free(diff);
+    git_tree_free(parentTree);
+    git_tree_free(tree);
+    git_commit_free(parent);
+    git_commit_free(commit);
+
+    if (returnCode != GIT_OK) {
+      batch.resize(kept);
+      return returnCode;
+    }
+    baton->diffed++;
+    if (changed) {
+      batch[kept++] = batch[i];
+    }
+  }
+  batch.resize(kept);
+  return GIT_OK;
+}
+/**
+ * Queue batch for JS, blocking while COMMITS_MAX_IN_FLIGHT batches are
+ * still waiting to be handed over.
+ */
+void GitRevWalk::CommitsWorkSend(CommitsBaton* baton, const std::vector<git_oid>& batch) {
+  if (batch.empty()) {
+    return;
+  }
+  uv_sem_wait(&baton->inFlight);
+  uv_mutex_lock(&baton->mutex);
+  baton->pending.insert(baton->pending.end(), batch.begin(), batch.end());
+  baton->pendingBatches++;
+  uv_mutex_unlock(&baton->mutex);
+  uv_async_send(&baton->asyncBatch);
+}
+void GitRevWalk::CommitsWorkSendBatch(uv_async_t *handle, int status /*UNUSED*/) {
+  HandleScope scope;
+
+  CommitsBaton* baton = static_cast<CommitsBaton *>(handle->data);
+
+  std::vector<git_oid> batch;
+  uv_mutex_lock(&baton->mutex);
+  batch.swap(baton->pending);
+  int batches = baton->pendingBatches;
+  baton->pendingBatches = 0;
+  uv_mutex_unlock(&baton->mutex);
+
+  for (int i = 0; i < batches; i++) {
+    uv_sem_post(&baton->inFlight);
+  }
+
+  if (batch.empty()) {
+    return;
+  }
+
+  std::vector<std::string> shas;
+  shas.reserve(batch.size());
+  for (size_t i = 0; i < batch.size(); i++) {
+    char sha[GIT_OID_HEXSZ + 1];
+    git_oid_fmt(sha, &batch[i]);
+    sha[GIT_OID_HEXSZ] = '\0';
+    shas.push_back(sha);
+  }
+  baton->sent += batch.size();
+
+  Handle<Value> argv[1] = {
+    cvv8::CastToJS(shas)
+  };
+
+  TryCatch try_catch;
+  baton->batchCallback->Call(Context::GetCurrent()->Global(), 1, argv);
+  if (try_catch.HasCaught()) {
+    node::FatalException(try_catch);
+  }
+}
+void GitRevWalk::CommitsWorkSendEnd(uv_async_t *handle, int status /*UNUSED*/) {
+  HandleScope scope;
+
+  CommitsBaton* baton = static_cast<CommitsBaton *>(handle->data);
+
+  uv_thread_join(&baton->threadId);
+
+  // Async signals are coalesced and unordered between handles, so flush
+  // any batch whose signal has not been handled yet
+  if (!baton->error.IsSet()) {
+    CommitsWorkSendBatch(&baton->asyncBatch, 0);
+  }
+
+  uv_mutex_destroy(&baton->mutex);
+  uv_sem_destroy(&baton->inFlight);
+  uv_close((uv_handle_t*) &baton->asyncBatch, NULL);
+  uv_close((uv_handle_t*) &baton->asyncEnd, CommitsFree);
+
+  Handle<Value> argv[2];
+  if (baton->error.IsSet()) {
+    argv[0] = baton->error.Wrap();
+    argv[1] = Local<Value>::New(Null());
+  } else {
+    Local<Object> summary = Object::New();
+    summary->Set(String::NewSymbol("count"), Number::New((double)baton->sent));
+    summary->Set(String::NewSymbol("graph"), Boolean::New(baton->graph));
+    summary->Set(String::NewSymbol("loaded"), Number::New((double)baton->loaded));
+    summary->Set(String::NewSymbol("cached"), Number::New((double)baton->cached));
+    summary->Set(String::NewSymbol("filtered"), Number::New((double)baton->filtered));
+    summary->Set(String::NewSymbol("diffed"), Number::New((double)baton->diffed));
+
+    argv[0] = Local<Value>::New(Null());
+    argv[1] = summary;
+  }
+
+  TryCatch try_catch;
+  baton->endCallback->Call(Context::GetCurrent()->Global(), 2, argv);
+  if (try_catch.HasCaught()) {
+    node::FatalException(try_catch);
+  }
+}
+void GitRevWalk::CommitsFree(uv_handle_t *handle) {
+  CommitsBaton* baton = static_cast<CommitsBaton *>(handle->data);
+
+  baton->revwalk->Unref();
+  baton->batchCallback.Dispose();
+  baton->endCallback.Dispose();
+  delete baton;
+}
+
+Handle<Value> GitRevWalk::QueueAncestry(const Arguments& args, const char* oneName, const char* twoName,
+                                        uv_work_cb work, uv_after_work_cb afterWork) {
+  HandleScope scope;
+
+  GitRevWalk* revwalk = ObjectWrap::Unwrap<GitRevWalk>(args.This());
+
+  AncestryBaton* baton = new AncestryBaton;
+  if(args.Length() == 0 || !GitTreeBuilder::OidFromValue(args[0], &baton->one)) {
+    delete baton;
+    return ThrowException(Exception::Error(String::New((std::string(oneName) + " is required and must be an Oid or a 40 character SHA.").c_str())));
+  }
+
+  if(args.Length() == 1 || !GitTreeBuilder::OidFromValue(args[1], &baton->two)) {
+    delete baton;
+    return ThrowException(Exception::Error(String::New((std::string(twoName) + " is required and must be an Oid or a 40 character SHA.").c_str())));
+  }
+
+  if(args.Length() == 2 || !args[2]->IsFunction()) {
+    delete baton;
+    return ThrowException(Exception::Error(String::New("Callback is required and must be a Function.")));
+  }
+
+  if (revwalk->GetRepo() == NULL) {
+    delete baton;
+    return ThrowException(Exception::Error(String::New("Repo must be open.")));
+  }
+
+  baton->request.data = baton;
+  baton->error = NULL;
+  baton->revwalk = revwalk;
+  revwalk->Ref();
+  baton->rawRepo = revwalk->GetRepo();
+  baton->found = false;
+  baton->callback = Persistent<Function>::New(Local<Function>::Cast(args[2]));
+
+  uv_queue_work(uv_default_loop(), &baton->request, work, afterWork);
+
+  return Undefined();
+}
+
+Handle<Value> GitRevWalk::MergeBase(const Arguments& args) {
+  return QueueAncestry(args, "One", "Two", MergeBaseWork, (uv_after_work_cb)MergeBaseAfterWork);
+}
+void GitRevWalk::MergeBaseWork(uv_work_t *req) {
+  AncestryBaton *baton = static_cast<AncestryBaton *>(req->data);
+
+  CommitGraph graph;
+  if (graph.Open(git_repository_path(baton->rawRepo)) != GIT_OK) {
+    giterr_clear();
+  }
+
+  int returnCode = GIT_OK;
+  if (graph.Count() > 0) {
+    CommitNodes nodes(baton->rawRepo, graph);
+    uint32_t one;
+    uint32_t two;
+    uint32_t base;
+    returnCode = nodes.Find(&baton->one, &one);
+    if (returnCode == GIT_OK) {
+      returnCode = nodes.Find(&baton->two, &two);
+    }
+    if (returnCode == GIT_OK) {
+      baton->found = commitMergeBase(nodes, one, two, &base);
+      if (baton->found) {
+        nodes.Oid(base, &baton->base);
+      }
+    }
+  } else {
+    returnCode = git_merge_base(&baton->base, baton->rawRepo, &baton->one, &baton->two);
+    baton->found = returnCode == GIT_OK;
+    if (returnCode == GIT_ENOTFOUND) {
+      giterr_clear();
+      returnCode = GIT_OK;
+    }
+  }
+
+  if (returnCode != GIT_OK) {
+    baton->error = giterr_last();
+  }
+}
+void GitRevWalk::MergeBaseAfterWork(uv_work_t *req) {
+  HandleScope scope;
+  AncestryBaton *baton = static_cast<AncestryBaton *>(req->data);
+
+  if (success(baton->error, baton->callback)) {
+    Handle<Value> base = Null();
+    if (baton->found) {
+      char sha[GIT_OID_HEXSZ + 1];
+      git_oid_fmt(sha, &baton->base);
+      sha[GIT_OID_HEXSZ] = '\0';
+      base = String::New(sha);
+    }
+
+    Handle<Value> argv[2] = {
+      Local<Value>::New(Null()),
+      base
+    };
+
+    TryCatch try_catch;
+    baton->callback->Call(Context::GetCurrent()->Global(), 2, argv);
+    if (try_catch.HasCaught()) {
+      node::FatalException(try_catch);
+    }
+  }
+
+  baton->revwalk->Unref();
+  baton->callback.Dispose();
+  delete baton;
+}
+
+Handle<Value> GitRevWalk::IsAncestor(const Arguments& args) {
+  return QueueAncestry(args, "Ancestor", "Descendant", IsAncestorWork, (uv_after_work_cb)IsAncestorAfterWork);
+}
+void GitRevWalk::IsAncestorWork(uv_work_t *req) {
+  AncestryBaton *baton = static_cast<AncestryBaton *>(req->data);
+
+  CommitGraph graph;
+  if (graph.Open(git_repository_path(baton->rawRepo)) != GIT_OK) {
+    giterr_clear();
+  }
+
+  int returnCode = GIT_OK;
+  if (graph.Count() > 0) {
+    CommitNodes nodes(baton->rawRepo, graph);
+    uint32_t ancestor;
+    uint32_t descendant;
+    returnCode = nodes.Find(&baton->one, &ancestor);
+    if (returnCode == GIT_OK) {
+      returnCode = nodes.Find(&baton->two, &descendant);
+    }
+    if (returnCode == GIT_OK) {
+      baton->found = commitIsAncestor(nodes, ancestor, descendant);
+    }
+  } else {
+    returnCode = commitReachable(baton->rawRepo, &baton->one, &baton->two, &baton->found);
+  }
+
+  if (returnCode != GIT_OK) {
+    baton->error = giterr_last();
+  }
+}
+void GitRevWalk::IsAncestorAfterWork(uv_work_t *req) {
+  HandleScope scope;
+  AncestryBaton *baton = static_cast<AncestryBaton *>(req->data);
+
+  if (success(baton->error, baton->callback)) {
+    Handle<Value> argv[2] = {
+      Local<Value>::New(Null()),
+      Boolean::New(baton->found)
+    };
+
+    TryCatch try_catch;
+    baton->callback->Call(Context::GetCurrent()->Global(), 2, argv);
+    if (try_catch.HasCaught()) {
+      node::FatalException(try_catch);
+    }
+  }
+
+  baton->revwalk->Unref();
+  baton->callback.Dispose();
+  delete baton;
+}
+
 Persistent<Function> GitRevWalk::constructor_template;
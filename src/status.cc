@@ -0,0 +1,595 @@
+/*
+ * Copyright 2013, Tim Branyen @tbranyen <tim@tabdeveloper.com>
+ * @author Michael Robinson @codeofinterest <mike@pagesofinterest.net>
+ *
+ * Dual licensed under the MIT and GPL licenses.
+ */
+
+#include <v8.h>
+#include <node.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+#include "cvv8/v8-convert.hpp"
+#include "git2.h"
+
+#include "../include/repo.h"
+#include "../include/status.h"
+#include "../include/error.h"
+
+#include "../include/functions/utilities.h"
+
+#ifdef __APPLE__
+#define STAT_MTIME_NANOSECONDS(st) ((st).st_mtimespec.tv_nsec)
+#else
+#define STAT_MTIME_NANOSECONDS(st) ((st).st_mtim.tv_nsec)
+#endif
+
+using namespace v8;
+using namespace node;
+using namespace cvv8;
+
+void GitStatus::Initialize(Handle<Object> target) {
+  HandleScope scope;
+
+  Local<FunctionTemplate> tpl = FunctionTemplate::New(New);
+
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+  tpl->SetClassName(String::NewSymbol("Status"));
+
+  NODE_SET_PROTOTYPE_METHOD(tpl, "scan", Scan);
+
+  constructor_template = Persistent<Function>::New(tpl->GetFunction());
+  target->Set(String::NewSymbol("Status"), constructor_template);
+}
+
+Handle<Value> GitStatus::New(const Arguments& args) {
+  HandleScope scope;
+
+  GitStatus *status = new GitStatus();
+  status->Wrap(args.This());
+
+  return scope.Close(args.This());
+}
+
+Handle<Value> GitStatus::Scan(const Arguments& args) {
+  HandleScope scope;
+
+  if(args.Length() == 0 || !args[0]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Repo is required and must be an Object.")));
+  }
+
+  if(args.Length() == 1 || !args[1]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Options are required and must be an Object.")));
+  }
+
+  if(args.Length() == 2 || !args[2]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Progress callback is required and must be a Function.")));
+  }
+
+  if(args.Length() == 3 || !args[3]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Callback is required and must be a Function.")));
+  }
+
+  git_repository* repo = ObjectWrap::Unwrap<GitRepo>(args[0]->ToObject())->GetValue();
+  if (repo == NULL) {
+    return ThrowException(Exception::Error(String::New("Repo must be open.")));
+  }
+
+  ScanBaton* baton = new ScanBaton;
+  baton->request.data = baton;
+  baton->error = NULL;
+  baton->repoPath = git_repository_path(repo);
+  baton->indexMtimeSeconds = 0;
+  baton->indexMtimeNanoseconds = 0;
+  baton->nextEntry = 0;
+  baton->processedEntries = 0;
+  baton->hashedEntries = 0;
+
+  Local<Object> options = args[1]->ToObject();
+  Local<Value> untracked = options->Get(String::NewSymbol("untracked"));
+  baton->includeUntracked = untracked->IsUndefined() || untracked->BooleanValue();
+  baton->recurseUntracked = options->Get(String::NewSymbol("recurseUntracked"))->BooleanValue();
+  Local<Value> threads = options->Get(String::NewSymbol("threads"));
+  baton->threads = threads->IsNumber() ? threads->Int32Value() : GitStatus::DEFAULT_THREADS;
+  if (baton->threads < 1) {
+    baton->threads = 1;
+  }
+
+  uv_mutex_init(&baton->mutex);
+  uv_async_init(uv_default_loop(), &baton->asyncProgress, ScanWorkSendProgress);
+  baton->asyncProgress.data = baton;
+
+  baton->progressCallback = Persistent<Function>::New(Local<Function>::Cast(args[2]));
+  baton->callback = Persistent<Function>::New(Local<Function>::Cast(args[3]));
+
+  uv_queue_work(uv_default_loop(), &baton->request, ScanWork, (uv_after_work_cb)ScanAfterWork);
+
+  return Undefined();
+}
+
+/**
+ * Everything staged: HEAD's tree against the index. On an unborn branch
+ * every index entry counts as added.
+ */
+int GitStatus::ScanStaged(ScanBaton* baton, git_repository* repo, git_index* index) {
+  git_tree* headTree = NULL;
+  git_oid headOid;
+  if (git_reference_name_to_id(&headOid, repo, "HEAD") == GIT_OK) {
+    git_commit* head = NULL;
+    int returnCode = git_commit_lookup(&head, repo, &headOid);
+    if (returnCode != GIT_OK) {
+      return returnCode;
+    }
+    returnCode = git_commit_tree(&headTree, head);
+    git_commit_free(head);
+    if (returnCode != GIT_OK) {
+      return returnCode;
+    }
+  } else {
+    giterr_clear();
+  }
+
+  git_diff_list* diff = NULL;
+  int returnCode = git_diff_tree_to_index(&diff, repo, headTree, index, NULL);
+  git_tree_free(headTree);
+  if (returnCode != GIT_OK) {
+    return returnCode;
+  }
+
+  size_t numDeltas = git_diff_num_deltas(diff);
+  baton->stagedPaths.reserve(numDeltas);
+  baton->stagedStatuses.reserve(numDeltas);
+  for (size_t i = 0; i < numDeltas; i++) {
+    const git_diff_delta* delta = NULL;
+    returnCode = git_diff_get_patch(NULL, &delta, diff, i);
+    if (returnCode != GIT_OK) {
+      git_diff_list_free(diff);
+      return returnCode;
+    }
+    baton->stagedPaths.push_back(delta->new_file.path);
+    baton->stagedStatuses.push_back((uint8_t)delta->status);
+  }
+
+  git_diff_list_free(diff);
+  return GIT_OK;
+}
+
+/**
+ * Decide whether one index entry differs from the working directory. The
+ * file is only hashed when its stat data differs from the index or the
+ * entry is racy, i.e. the file may have changed within the same timestamp
+ * granularity as the index was written.
+ */
+git_delta_t GitStatus::CheckEntry(ScanBaton* baton, git_repository* repo, const Entry& entry, bool& hashed) {
+  if (entry.conflicted) {
+    return GIT_DELTA_MODIFIED;
+  }
+
+  std::string fullPath = baton->workdir + entry.path;
+  struct stat st;
+  if (lstat(fullPath.c_str(), &st) != 0) {
+    return GIT_DELTA_DELETED;
+  }
+
+  // Submodule contents are not inspected, only that they are still a directory
+  if (entry.mode == GIT_FILEMODE_COMMIT) {
+    return S_ISDIR(st.st_mode) ? GIT_DELTA_UNMODIFIED : GIT_DELTA_TYPECHANGE;
+  }
+
+  bool isLink = entry.mode == GIT_FILEMODE_LINK;
+  if (isLink != S_ISLNK(st.st_mode) || !(S_ISREG(st.st_mode) || S_ISLNK(st.st_mode))) {
+    return GIT_DELTA_TYPECHANGE;
+  }
+  if (!isLink && ((st.st_mode & S_IXUSR) != 0) != (entry.mode == GIT_FILEMODE_BLOB_EXECUTABLE)) {
+    return GIT_DELTA_MODIFIED;
+  }
+  if ((uint32_t)st.st_size != entry.fileSize) {
+    return GIT_DELTA_MODIFIED;
+  }
+
+  bool statClean = st.st_mtime == entry.mtimeSeconds &&
+    (entry.mtimeNanoseconds == 0 || (unsigned int)STAT_MTIME_NANOSECONDS(st) == entry.mtimeNanoseconds) &&
+    st.st_ctime == entry.ctimeSeconds &&
+    (unsigned int)st.st_ino == entry.ino;
+
+  bool racy = baton->indexMtimeSeconds == 0 ||
+    entry.mtimeSeconds > baton->indexMtimeSeconds ||
+    (entry.mtimeSeconds == baton->indexMtimeSeconds &&
+     entry.mtimeNanoseconds >= baton->indexMtimeNanoseconds);
+
+  if (statClean && !racy) {
+    return GIT_DELTA_UNMODIFIED;
+  }
+
+  hashed = true;
+  git_oid oid;
+  if (isLink) {
+    char target[4096];
+    ssize_t length = readlink(fullPath.c_str(), target, sizeof(target));
+    if (length < 0 || git_odb_hash(&oid, target, (size_t)length, GIT_OBJ_BLOB) != GIT_OK) {
+      giterr_clear();
+      return GIT_DELTA_MODIFIED;
+    }
+  } else if (git_repository_hashfile(&oid, repo, fullPath.c_str(), GIT_OBJ_BLOB, entry.path.c_str()) != GIT_OK) {
+    giterr_clear();
+    return GIT_DELTA_MODIFIED;
+  }
+
+  return git_oid_cmp(&oid, &entry.oid) == 0 ? GIT_DELTA_UNMODIFIED : GIT_DELTA_MODIFIED;
+}
+
+void GitStatus::ScanWorkEntries(void *payload) {
+  ScanBaton* baton = static_cast<ScanBaton *>(payload);
+
+  // Filters are looked up through the repository, and libgit2 objects must
+  // not be shared across threads, so every worker opens its own handle
+  git_repository* repo = NULL;
+  if (git_repository_open(&repo, baton->repoPath.c_str()) != GIT_OK) {
+    const git_error* error = giterr_last();
+    uv_mutex_lock(&baton->mutex);
+    baton->workerError = error ? error->message : "Failed to open repository";
+    baton->nextEntry = baton->entries.size();
+    uv_mutex_unlock(&baton->mutex);
+    return;
+  }
+
+  while (true) {
+    uv_mutex_lock(&baton->mutex);
+    size_t start = baton->nextEntry;
+    if (start < baton->entries.size()) {
+      baton->nextEntry = std::min(start + GitStatus::BATCH_SIZE, baton->entries.size());
+    }
+    size_t end = baton->nextEntry;
+    uv_mutex_unlock(&baton->mutex);
+
+    if (start >= end) {
+      break;
+    }
+
+    size_t hashed = 0;
+    for (size_t i = start; i < end; i++) {
+      bool entryHashed = false;
+      baton->entries[i].status = CheckEntry(baton, repo, baton->entries[i], entryHashed);
+      if (entryHashed) {
+        hashed++;
+      }
+    }
+
+    uv_mutex_lock(&baton->mutex);
+    baton->processedEntries += end - start;
+    baton->hashedEntries += hashed;
+    uv_mutex_unlock(&baton->mutex);
+
+    uv_async_send(&baton->asyncProgress);
+  }
+
+  git_repository_free(repo);
+}
+
+/**
+ * Whether directory, which holds no tracked files, contains at least one
+ * file that is not ignored. git status hides untracked directories that
+ * are empty or only hold ignored files. A nested repository counts as
+ * content, as it does for git.
+ */
+int GitStatus::HasUntrackedContent(ScanBaton* baton, git_repository* repo,
+                                   const std::string& directory, bool& found) {
+  DIR* dir = opendir((baton->workdir + directory).c_str());
+  if (dir == NULL) {
+    return GIT_OK;
+  }
+
+  std::vector<std::string> subdirectories;
+  int returnCode = GIT_OK;
+  struct dirent* entry;
+  while (!found && (entry = readdir(dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+      continue;
+    }
+    if (strcmp(entry->d_name, ".git") == 0) {
+      found = true;
+      break;
+    }
+
+    std::string path = directory + entry->d_name;
+    struct stat st;
+    if (lstat((baton->workdir + path).c_str(), &st) != 0) {
+      continue;
+    }
+
+    int ignored = 0;
+    returnCode = git_status_should_ignore(&ignored, repo, path.c_str());
+    if (returnCode != GIT_OK) {
+      break;
+    }
+    if (ignored) {
+      continue;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+      subdirectories.push_back(path + "/");
+    } else {
+      found = true;
+    }
+  }
+  closedir(dir);
+
+  // Files at this level are cheaper to find than anything below it
+  for (size_t i = 0; returnCode == GIT_OK && !found && i < subdirectories.size(); i++) {
+    returnCode = HasUntrackedContent(baton, repo, subdirectories[i], found);
+  }
+  return returnCode;
+}
+
+/**
+ * Walk directory, relative to the working directory and ending in a slash
+ * unless it is the root. Directories without tracked files are reported as
+ * a whole, like git status does, unless recurseUntracked is set. Empty
+ * directories and those holding only ignored files are left out.
+ */
+int GitStatus::ScanUntracked(ScanBaton* baton, git_repository* repo,
+                             const std::vector<std::string>& trackedPaths, const std::string& directory) {
+  DIR* dir = opendir((baton->workdir + directory).c_str());
+  if (dir == NULL) {
+    // Unreadable directories are skipped, as git does
+    return GIT_OK;
+  }
+
+  std::vector<std::string> names;
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 ||
+        strcmp(entry->d_name, ".git") == 0) {
+      continue;
+    }
+    names.push_back(entry->d_name);
+  }
+  closedir(dir);
+  std::sort(names.begin(), names.end());
+
+  for (size_t i = 0; i < names.size(); i++) {
+    std::string path = directory + names[i];
+    struct stat st;
+    if (lstat((baton->workdir + path).c_str(), &st) != 0) {
+      continue;
+    }
+
+    if (std::binary_search(trackedPaths.begin(), trackedPaths.end(), path)) {
+      continue;
+    }
+
+    int returnCode;
+    if (S_ISDIR(st.st_mode)) {
+      std::string subdirectory = path + "/";
+      std::vector<std::string>::const_iterator tracked =
+        std::lower_bound(trackedPaths.begin(), trackedPaths.end(), subdirectory);
+      if (tracked != trackedPaths.end() && tracked->compare(0, subdirectory.size(), subdirectory) == 0) {
+        returnCode = ScanUntracked(baton, repo, trackedPaths, subdirectory);
+        if (returnCode != GIT_OK) {
+          return returnCode;
+        }
+        continue;
+      }
+
+      int ignored = 0;
+      returnCode = git_status_should_ignore(&ignored, repo, path.c_str());
+      if (returnCode != GIT_OK) {
+        return returnCode;
+      }
+      if (ignored) {
+        continue;
+      }
+
+      if (baton->recurseUntracked) {
+        returnCode = ScanUntracked(baton, repo, trackedPaths, subdirectory);
+        if (returnCode != GIT_OK) {
+          return returnCode;
+        }
+      } else {
+        bool found = false;
+        returnCode = HasUntrackedContent(baton, repo, subdirectory, found);
+        if (returnCode != GIT_OK) {
+          return returnCode;
+        }
+        if (found) {
+          baton->untrackedPaths.push_back(subdirectory);
+        }
+      }
+    } else {
+      int ignored = 0;
+      returnCode = git_status_should_ignore(&ignored, repo, path.c_str());
+      if (returnCode != GIT_OK) {
+        return returnCode;
+      }
+      if (!ignored) {
+        baton->untrackedPaths.push_back(path);
+      }
+    }
+  }
+
+  return GIT_OK;
+}
+
+void GitStatus::ScanWork(uv_work_t *req) {
+  ScanBaton* baton = static_cast<ScanBaton *>(req->data);
+
+  git_repository* repo = NULL;
+  int returnCode = git_repository_open(&repo, baton->repoPath.c_str());
+  if (returnCode != GIT_OK) {
+    baton->error = giterr_last();
+    return;
+  }
+
+  if (git_repository_is_bare(repo)) {
+    git_repository_free(repo);
+    giterr_set_str(GITERR_REPOSITORY, "Cannot get the status of a bare repository");
+    baton->error = giterr_last();
+    return;
+  }
+  baton->workdir = git_repository_workdir(repo);
+
+  git_index* index = NULL;
+  returnCode = git_repository_index(&index, repo);
+  if (returnCode != GIT_OK) {
+    git_repository_free(repo);
+    baton->error = giterr_last();
+    return;
+  }
+
+  returnCode = ScanStaged(baton, repo, index);
+  if (returnCode != GIT_OK) {
+    git_index_free(index);
+    git_repository_free(repo);
+    baton->error = giterr_last();
+    return;
+  }
+
+  struct stat indexStat;
+  if (stat((baton->repoPath + "index").c_str(), &indexStat) == 0) {
+    baton->indexMtimeSeconds = indexStat.st_mtime;
+    baton->indexMtimeNanoseconds = (unsigned int)STAT_MTIME_NANOSECONDS(indexStat);
+  }
+
+  // Copy what the workers need so they never touch the git_index. Entries
+  // are sorted by path then stage, so conflict stages are adjacent.
+  size_t entryCount = git_index_entrycount(index);
+  baton->entries.reserve(entryCount);
+  for (size_t i = 0; i < entryCount; i++) {
+    const git_index_entry* indexEntry = git_index_get_byindex(index, i);
+    bool conflicted = git_index_entry_stage(indexEntry) > 0;
+
+    if (!baton->entries.empty() && baton->entries.back().path == indexEntry->path) {
+      baton->entries.back().conflicted |= conflicted;
+      continue;
+    }
+
+    Entry entry;
+    entry.path = indexEntry->path;
+    git_oid_cpy(&entry.oid, &indexEntry->oid);
+    entry.mode = indexEntry->mode;
+    entry.ino = indexEntry->ino;
+    entry.fileSize = (uint32_t)indexEntry->file_size;
+    entry.mtimeSeconds = indexEntry->mtime.seconds;
+    entry.mtimeNanoseconds = indexEntry->mtime.nanoseconds;
+    entry.ctimeSeconds = indexEntry->ctime.seconds;
+    entry.conflicted = conflicted;
+    entry.status = GIT_DELTA_UNMODIFIED;
+    baton->entries.push_back(entry);
+  }
+
+  size_t batches = (baton->entries.size() + GitStatus::BATCH_SIZE - 1) / GitStatus::BATCH_SIZE;
+  int threads = std::max(1, (int)std::min((size_t)baton->threads, batches));
+  std::vector<uv_thread_t> workers(threads);
+  for (int i = 0; i < threads; i++) {
+    uv_thread_create(&workers[i], ScanWorkEntries, baton);
+  }
+  for (int i = 0; i < threads; i++) {
+    uv_thread_join(&workers[i]);
+  }
+
+  if (!baton->workerError.empty()) {
+    git_index_free(index);
+    git_repository_free(repo);
+    giterr_set_str(GITERR_REPOSITORY, baton->workerError.c_str());
+    baton->error = giterr_last();
+    return;
+  }
+
+  if (baton->includeUntracked) {
+    std::vector<std::string> trackedPaths;
+    trackedPaths.reserve(baton->entries.size());
+    for (size_t i = 0; i < baton->entries.size(); i++) {
+      trackedPaths.push_back(baton->entries[i].path);
+    }
+
+    returnCode = ScanUntracked(baton, repo, trackedPaths, "");
+    if (returnCode != GIT_OK) {
+      baton->error = giterr_last();
+    }
+  }
+
+  git_index_free(index);
+  git_repository_free(repo);
+}
+
+void GitStatus::ScanWorkSendProgress(uv_async_t *handle, int status /*UNUSED*/) {
+  HandleScope scope;
+
+  ScanBaton* baton = static_cast<ScanBaton *>(handle->data);
+
+  uv_mutex_lock(&baton->mutex);
+  size_t processed = baton->processedEntries;
+  size_t total = baton->entries.size();
+  uv_mutex_unlock(&baton->mutex);
+
+  Handle<Value> argv[2] = {
+    Integer::NewFromUnsigned(processed),
+    Integer::NewFromUnsigned(total)
+  };
+
+  TryCatch try_catch;
+  baton->progressCallback->Call(Context::GetCurrent()->Global(), 2, argv);
+  if (try_catch.HasCaught()) {
+    node::FatalException(try_catch);
+  }
+}
+
+void GitStatus::ScanAfterWork(uv_work_t *req) {
+  HandleScope scope;
+  ScanBaton* baton = static_cast<ScanBaton *>(req->data);
+
+  if (success(baton->error, baton->callback)) {
+    std::vector<std::string> unstagedPaths;
+    std::vector<uint8_t> unstagedStatuses;
+    for (size_t i = 0; i < baton->entries.size(); i++) {
+      if (baton->entries[i].status != GIT_DELTA_UNMODIFIED) {
+        unstagedPaths.push_back(baton->entries[i].path);
+        unstagedStatuses.push_back((uint8_t)baton->entries[i].status);
+      }
+    }
+
+    Local<Object> staged = Object::New();
+    staged->Set(String::NewSymbol("paths"), cvv8::CastToJS(baton->stagedPaths));
+    staged->Set(String::NewSymbol("statuses"), createTypedArray("Uint8Array",
+      baton->stagedStatuses.empty() ? NULL : &baton->stagedStatuses[0], baton->stagedStatuses.size(), 1));
+
+    Local<Object> unstaged = Object::New();
+    unstaged->Set(String::NewSymbol("paths"), cvv8::CastToJS(unstagedPaths));
+    unstaged->Set(String::NewSymbol("statuses"), createTypedArray("Uint8Array",
+      unstagedStatuses.empty() ? NULL : &unstagedStatuses[0], unstagedStatuses.size(), 1));
+
+    Local<Object> result = Object::New();
+    result->Set(String::NewSymbol("staged"), staged);
+    result->Set(String::NewSymbol("unstaged"), unstaged);
+    result->Set(String::NewSymbol("untracked"), cvv8::CastToJS(baton->untrackedPaths));
+    result->Set(String::NewSymbol("hashed"), Integer::NewFromUnsigned(baton->hashedEntries));
+
+    Handle<Value> argv[2] = {
+      Local<Value>::New(Null()),
+      result
+    };
+
+    TryCatch try_catch;
+    baton->callback->Call(Context::GetCurrent()->Global(), 2, argv);
+    if (try_catch.HasCaught()) {
+      node::FatalException(try_catch);
+    }
+  }
+
+  uv_close((uv_handle_t*) &baton->asyncProgress, ScanFree);
+}
+
+void GitStatus::ScanFree(uv_handle_t *handle) {
+  ScanBaton* baton = static_cast<ScanBaton *>(handle->data);
+
+  uv_mutex_destroy(&baton->mutex);
+  baton->progressCallback.Dispose();
+  baton->callback.Dispose();
+  delete baton;
+}
+
+Persistent<Function> GitStatus::constructor_template;
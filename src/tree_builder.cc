@@ -0,0 +1,306 @@
+/*
+ * Copyright 2013, Tim Branyen @tbranyen <tim@tabdeveloper.com>
+ * @author Michael Robinson @codeofinterest <mike@pagesofinterest.net>
+ *
+ * Dual licensed under the MIT and GPL licenses.
+ */
+
+#include <v8.h>
+#include <node.h>
+#include <string.h>
+#include <algorithm>
+#include <set>
+
+#include "git2.h"
+
+#include "../include/repo.h"
+#include "../include/oid.h"
+#include "../include/tree_builder.h"
+#include "../include/error.h"
+
+#include "../include/functions/string.h"
+#include "../include/functions/utilities.h"
+
+using namespace v8;
+using namespace node;
+
+void GitTreeBuilder::Initialize(Handle<v8::Object> target) {
+  HandleScope scope;
+
+  Local<FunctionTemplate> tpl = FunctionTemplate::New(New);
+
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+  tpl->SetClassName(String::NewSymbol("TreeBuilder"));
+
+  NODE_SET_PROTOTYPE_METHOD(tpl, "write", Write);
+
+  constructor_template = Persistent<Function>::New(tpl->GetFunction());
+  target->Set(String::NewSymbol("TreeBuilder"), constructor_template);
+}
+
+Handle<Value> GitTreeBuilder::New(const Arguments& args) {
+  HandleScope scope;
+
+  GitTreeBuilder *builder = new GitTreeBuilder();
+  builder->Wrap(args.This());
+
+  return scope.Close(args.This());
+}
+
+bool GitTreeBuilder::OidFromValue(Handle<Value> value, git_oid* oid) {
+  if (value->IsString()) {
+    std::string sha = stringArgToString(value->ToString());
+    return sha.length() == GIT_OID_HEXSZ && git_oid_fromstr(oid, sha.c_str()) == GIT_OK;
+  }
+  if (value->IsObject() && value->ToObject()->InternalFieldCount() > 0) {
+    *oid = ObjectWrap::Unwrap<GitOid>(value->ToObject())->GetValue();
+    return true;
+  }
+  return false;
+}
+
+/**
+ * Paths are relative, '/' separated, and may not contain empty, ".", ".."
+ * or ".git" components.
+ */
+bool GitTreeBuilder::ValidPath(const std::string& path) {
+  size_t start = 0;
+  while (start <= path.length()) {
+    size_t slash = path.find('/', start);
+    if (slash == std::string::npos) {
+      slash = path.length();
+    }
+    std::string component = path.substr(start, slash - start);
+    if (component.empty() || component == "." || component == ".." || component == ".git") {
+      return false;
+    }
+    start = slash + 1;
+  }
+  return true;
+}
+
+Handle<Value> GitTreeBuilder::Write(const Arguments& args) {
+  HandleScope scope;
+
+  if(args.Length() == 0 || !args[0]->IsObject()) {
+    return ThrowException(Exception::Error(String::New("Repo is required and must be an Object.")));
+  }
+
+  if(args.Length() == 1 || !(args[1]->IsNull() || args[1]->IsObject() || args[1]->IsString())) {
+    return ThrowException(Exception::Error(String::New("Base tree is required and must be an Oid, a String or null.")));
+  }
+
+  if(args.Length() == 2 || !args[2]->IsArray()) {
+    return ThrowException(Exception::Error(String::New("Updates are required and must be an Array.")));
+  }
+
+  if(args.Length() == 3 || !args[3]->IsFunction()) {
+    return ThrowException(Exception::Error(String::New("Callback is required and must be a Function.")));
+  }
+
+  git_repository* repo = ObjectWrap::Unwrap<GitRepo>(args[0]->ToObject())->GetValue();
+  if (repo == NULL) {
+    return ThrowException(Exception::Error(String::New("Repo must be open.")));
+  }
+
+  git_oid base;
+  bool hasBase = !args[1]->IsNull();
+  if (hasBase && !OidFromValue(args[1], &base)) {
+    return ThrowException(Exception::Error(String::New("Base tree must be an Oid or a 40 character SHA.")));
+  }
+
+  std::vector<TreeUpdate> updates;
+  Local<Array> updateArray = Local<Array>::Cast(args[2]);
+  for (uint32_t i = 0; i < updateArray->Length(); i++) {
+    if (!updateArray->Get(i)->IsObject()) {
+      return ThrowException(Exception::Error(String::New("Each update must be an Object.")));
+    }
+    Local<Object> updateObject = updateArray->Get(i)->ToObject();
+
+    TreeUpdate update;
+    update.path = stringArgToString(updateObject->Get(String::NewSymbol("path"))->ToString());
+    if (!ValidPath(update.path)) {
+      return ThrowException(Exception::Error(String::New("Update paths must be relative paths without empty, '.', '..' or '.git' components.")));
+    }
+
+    Local<Value> oid = updateObject->Get(String::NewSymbol("oid"));
+    update.remove = oid->IsNull() || oid->IsUndefined();
+    if (!update.remove && !OidFromValue(oid, &update.oid)) {
+      return ThrowException(Exception::Error(String::New("Update oids must be an Oid, a 40 character SHA or null.")));
+    }
+
+    Local<Value> mode = updateObject->Get(String::NewSymbol("mode"));
+    update.mode = mode->IsNumber() ? (git_filemode_t)mode->Uint32Value() : GIT_FILEMODE_BLOB;
+
+    updates.push_back(update);
+  }
+
+  WriteBaton* baton = new WriteBaton;
+  baton->request.data = baton;
+  baton->error = NULL;
+  baton->rawRepo = repo;
+  baton->hasBase = hasBase;
+  baton->base = base;
+  baton->updates.swap(updates);
+  baton->written = 0;
+  baton->callback = Persistent<Function>::New(Local<Function>::Cast(args[3]));
+
+  uv_queue_work(uv_default_loop(), &baton->request, WriteWork, (uv_after_work_cb)WriteAfterWork);
+
+  return Undefined();
+}
+
+bool GitTreeBuilder::UpdatePathLess(const TreeUpdate& a, const TreeUpdate& b) {
+  return a.path < b.path;
+}
+
+int GitTreeBuilder::CountEntry(const git_tree_entry* entry, void* payload) {
+  (*static_cast<size_t*>(payload))++;
+  return 0;
+}
+
+/**
+ * Apply updates[begin, end), whose paths all start with the same
+ * prefixLength bytes, to base and write the result. Updates below a
+ * directory are grouped and applied to that directory's tree first.
+ * Sorting keeps every group contiguous: anything between "a/b" and "a/c"
+ * starts with "a/". A subtree left without entries is dropped from its
+ * parent instead of being written.
+ */
+int GitTreeBuilder::WriteLevel(WriteBaton* baton, const git_tree* base, size_t begin, size_t end,
+                               size_t prefixLength, git_oid* out, bool& empty) {
+  git_treebuilder* builder = NULL;
+  int returnCode = git_treebuilder_create(&builder, base);
+  if (returnCode != GIT_OK) {
+    return returnCode;
+  }
+
+  // "a" sorts before "a/...", so a file is always seen before a directory of the same name
+  std::set<std::string> files;
+
+  size_t i = begin;
+  while (i < end && returnCode == GIT_OK) {
+    const TreeUpdate& update = baton->updates[i];
+    size_t slash = update.path.find('/', prefixLength);
+
+    if (slash == std::string::npos) {
+      std::string name = update.path.substr(prefixLength);
+      files.insert(name);
+      if (!update.remove) {
+        returnCode = git_treebuilder_insert(NULL, builder, name.c_str(), &update.oid, update.mode);
+      } else if (git_treebuilder_get(builder, name.c_str()) != NULL) {
+        returnCode = git_treebuilder_remove(builder, name.c_str());
+      }
+      i++;
+      continue;
+    }
+
+    std::string directory = update.path.substr(prefixLength, slash - prefixLength);
+    if (files.count(directory) > 0) {
+      giterr_set_str(GITERR_INVALID, "An update replaces a path that another update uses as a directory");
+      returnCode = -1;
+      break;
+    }
+
+    size_t groupEnd = i + 1;
+    while (groupEnd < end && baton->updates[groupEnd].path.compare(0, slash + 1, update.path, 0, slash + 1) == 0) {
+      groupEnd++;
+    }
+
+    git_tree* subtree = NULL;
+    const git_tree_entry* entry = git_treebuilder_get(builder, directory.c_str());
+    bool exists = entry != NULL;
+    if (exists && git_tree_entry_type(entry) == GIT_OBJ_TREE) {
+      returnCode = git_tree_lookup(&subtree, baton->rawRepo, git_tree_entry_id(entry));
+    }
+
+    if (returnCode == GIT_OK) {
+      git_oid subtreeOid;
+      bool subtreeEmpty = false;
+      returnCode = WriteLevel(baton, subtree, i, groupEnd, slash + 1, &subtreeOid, subtreeEmpty);
+      if (returnCode == GIT_OK) {
+        if (!subtreeEmpty) {
+          returnCode = git_treebuilder_insert(NULL, builder, directory.c_str(), &subtreeOid, GIT_FILEMODE_TREE);
+        } else if (exists) {
+          returnCode = git_treebuilder_remove(builder, directory.c_str());
+        }
+      }
+    }
+    git_tree_free(subtree);
+
+    i = groupEnd;
+  }
+
+  if (returnCode == GIT_OK) {
+    size_t count = 0;
+    git_treebuilder_filter(builder, CountEntry, &count);
+    empty = count == 0;
+
+    // The root is always written, even when empty
+    if (!empty || prefixLength == 0) {
+      returnCode = git_treebuilder_write(out, baton->rawRepo, builder);
+      baton->written++;
+    }
+  }
+
+  git_treebuilder_free(builder);
+  return returnCode;
+}
+
+void GitTreeBuilder::WriteWork(uv_work_t *req) {
+  WriteBaton *baton = static_cast<WriteBaton *>(req->data);
+
+  std::stable_sort(baton->updates.begin(), baton->updates.end(), UpdatePathLess);
+  for (size_t i = 1; i < baton->updates.size(); i++) {
+    if (baton->updates[i].path == baton->updates[i - 1].path) {
+      giterr_set_str(GITERR_INVALID, "A path is updated more than once");
+      baton->error = giterr_last();
+      return;
+    }
+  }
+
+  git_tree* base = NULL;
+  if (baton->hasBase) {
+    int returnCode = git_tree_lookup(&base, baton->rawRepo, &baton->base);
+    if (returnCode != GIT_OK) {
+      baton->error = giterr_last();
+      return;
+    }
+  }
+
+  bool empty = false;
+  int returnCode = WriteLevel(baton, base, 0, baton->updates.size(), 0, &baton->rawOid, empty);
+  if (returnCode != GIT_OK) {
+    baton->error = giterr_last();
+  }
+
+  git_tree_free(base);
+}
+
+void GitTreeBuilder::WriteAfterWork(uv_work_t *req) {
+  HandleScope scope;
+  WriteBaton *baton = static_cast<WriteBaton *>(req->data);
+
+  if (success(baton->error, baton->callback)) {
+    Local<Object> oid = GitOid::constructor_template->NewInstance();
+    GitOid *oidInstance = ObjectWrap::Unwrap<GitOid>(oid);
+    oidInstance->SetValue(baton->rawOid);
+
+    Handle<Value> argv[3] = {
+      Local<Value>::New(Null()),
+      oid,
+      Integer::NewFromUnsigned(baton->written)
+    };
+
+    TryCatch try_catch;
+    baton->callback->Call(Context::GetCurrent()->Global(), 3, argv);
+    if (try_catch.HasCaught()) {
+      node::FatalException(try_catch);
+    }
+  }
+
+  baton->callback.Dispose();
+  delete baton;
+}
+
+Persistent<Function> GitTreeBuilder::constructor_template;
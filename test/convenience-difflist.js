@@ -1,5 +1,7 @@
 var git = require('../'),
     rimraf = require('rimraf'),
+    crypto = require('crypto'),
+    path = require('path'),
     fs = require( 'fs' );
 
 var historyCountKnownSHA = 'fce88902e66c72b5b93e75bdb5ae717038b221f6';
@@ -94,6 +96,352 @@ exports.walkingEnd = function(test) {
   });
 };
 
+exports.stats = function(test) {
+  test.expect(7);
+  git.repo('../.git', function(error, repository) {
+    repository.commit(historyCountKnownSHA, function(error, commit) {
+      commit.parents(function(error, parents) {
+        parents[0].sha(function(error, parentSha) {
+          (new git.diffList(commit.rawRepo)).treeToTree(parentSha, historyCountKnownSHA, function(error, diffList) {
+            diffList.stats(function(error, stats) {
+              test.equal(null, error, 'Should not error');
+              test.equal(stats.files, 1, 'File count should match known value');
+              test.equal(stats.additions, 1, 'Total additions should match known value');
+              test.equal(stats.deletions, 1, 'Total deletions should match known value');
+              test.equal(stats.paths[0], 'README.md', 'Path should match expected');
+              test.equal(stats.fileAdditions[0], 1, 'File additions should match known value');
+              test.equal(stats.fileDeletions[0], 1, 'File deletions should match known value');
+              test.done();
+            });
+          });
+        });
+      });
+    });
+  });
+};
+
+exports.nameStatus = function(test) {
+  test.expect(5);
+  git.repo('../.git', function(error, repository) {
+    repository.commit(historyCountKnownSHA, function(error, commit) {
+      commit.parents(function(error, parents) {
+        parents[0].sha(function(error, parentSha) {
+          (new git.diffList(commit.rawRepo)).treeToTree(parentSha, historyCountKnownSHA, function(error, diffList) {
+            diffList.nameStatus(function(error, nameStatus) {
+              test.equal(null, error, 'Should not error');
+              test.equal(nameStatus.statuses.length, 1, 'Delta count should match known value');
+              test.equal(nameStatus.newPaths[0], 'README.md', 'Path should match expected');
+              test.equal(nameStatus.statuses[0], diffList.deltaTypes.GIT_DELTA_MODIFIED, 'Status should be known type');
+              test.notEqual(nameStatus.oldShas[0], nameStatus.newShas[0], 'Blob SHAs should differ');
+              test.done();
+            });
+          });
+        });
+      });
+    });
+  });
+};
+
+exports.treeToTreeOptions = function(test) {
+  test.expect(4);
+  git.repo('../.git', function(error, repository) {
+    repository.commit(historyCountKnownSHA, function(error, commit) {
+      commit.parents(function(error, parents) {
+        parents[0].sha(function(error, parentSha) {
+          (new git.diffList(commit.rawRepo)).treeToTree(parentSha, historyCountKnownSHA, { pathspec: ['lib/*'] }, function(error, diffList) {
+            test.equal(null, error, 'Should not error');
+            diffList.nameStatus(function(error, nameStatus) {
+              test.equal(nameStatus.statuses.length, 0, 'Pathspec should exclude README.md');
+              (new git.diffList(commit.rawRepo)).treeToTree(parentSha, historyCountKnownSHA, { contextLines: 0 }, function(error, diffList) {
+                diffList.walk().on('delta', function(error, delta) {
+                  test.equal(null, error, 'Should not error');
+                  test.equal(delta.content.length, 2, 'Without context only the changed lines should remain');
+                  test.done();
+                });
+              });
+            });
+          });
+        });
+      });
+    });
+  });
+};
+
+exports.walkHunks = function(test) {
+  test.expect(5);
+  git.repo('../.git', function(error, repository) {
+    repository.commit(historyCountKnownSHA, function(error, commit) {
+      commit.parents(function(error, parents) {
+        parents[0].sha(function(error, parentSha) {
+          (new git.diffList(commit.rawRepo)).treeToTree(parentSha, historyCountKnownSHA, function(error, diffList) {
+            var hunks = [];
+            diffList.walk().on('hunk', function(error, hunk) {
+              hunks.push(hunk);
+            }).on('delta', function(error, delta) {
+              test.equal(hunks.length, 1, 'Hunk should be emitted before its delta');
+            }).on('end', function(error) {
+              test.equal(hunks[0].header.indexOf('@@'), 0, 'Hunk header should be included');
+              test.equal(hunks[0].lineLengths.length, 5, 'Line count should match known value');
+              test.equal(hunks[0].lineOrigins.length, 5, 'Line origins should align with lines');
+              var total = 0;
+              for (var i = 0; i < hunks[0].lineLengths.length; i++) {
+                total += hunks[0].lineLengths[i];
+              }
+              test.equal(total, hunks[0].content.length, 'Line lengths should cover the hunk content');
+              test.done();
+            });
+          });
+        });
+      });
+    });
+  });
+};
+
+exports.indexDiffs = function(test) {
+  test.expect(3);
+  git.repo('../.git', function(error, repository) {
+    (new git.diffList(repository.rawRepo)).treeToIndex(null, function(error, diffList) {
+      test.equal(null, error, 'Should not error');
+      diffList.nameStatus(function(error, nameStatus) {
+        test.ok(nameStatus.statuses.length > 0, 'Every indexed file should be added against an empty tree');
+        (new git.diffList(repository.rawRepo)).indexToWorkdir({ pathspec: 'README.md' }, function(error, diffList) {
+          test.equal(null, error, 'Should not error');
+          test.done();
+        });
+      });
+    });
+  });
+};
+
+exports.toPatch = function(test) {
+  test.expect(5);
+  git.repo('../.git', function(error, repository) {
+    repository.commit(historyCountKnownSHA, function(error, commit) {
+      commit.parents(function(error, parents) {
+        parents[0].sha(function(error, parentSha) {
+          (new git.diffList(commit.rawRepo)).treeToTree(parentSha, historyCountKnownSHA, function(error, diffList) {
+            diffList.toPatch(function(error, patch) {
+              test.equal(null, error, 'Should not error');
+              test.ok(Buffer.isBuffer(patch), 'Patch should be a Buffer');
+              test.equal(patch.toString().indexOf('diff --git a/README.md b/README.md'), 0, 'Patch should start with the file header');
+              var chunks = [];
+              diffList.patchStream(16).on('data', function(chunk) {
+                chunks.push(chunk);
+              }).on('end', function(error) {
+                test.equal(null, error, 'Should not error');
+                test.equal(Buffer.concat(chunks).toString(), patch.toString(), 'Streamed patch should match the single Buffer');
+                test.done();
+              });
+            });
+          });
+        });
+      });
+    });
+  });
+};
+
+exports.blobs = function(test) {
+  test.expect(7);
+  git.repo('../.git', function(error, repository) {
+    repository.commit(historyCountKnownSHA, function(error, commit) {
+      commit.parents(function(error, parents) {
+        parents[0].sha(function(error, parentSha) {
+          (new git.diffList(commit.rawRepo)).treeToTree(parentSha, historyCountKnownSHA, function(error, diffList) {
+            diffList.nameStatus(function(error, nameStatus) {
+              diffList.blobs(nameStatus.oldShas[0], nameStatus.newShas[0], { algorithm: 'patience' }, function(error, diff) {
+                test.equals(error, null, 'Blob diff should not error');
+                test.equals(diff.additions, 1, 'Blob diff should have one addition');
+                test.equals(diff.deletions, 1, 'Blob diff should have one deletion');
+                test.equals(diff.hunks.length, 1, 'Blob diff should have one hunk');
+                test.throws(function() {
+                  diffList.blobs(nameStatus.oldShas[0], nameStatus.newShas[0], { algorithm: 'histogram' }, function() {});
+                }, 'Histogram diffs should be rejected rather than run as another algorithm');
+                diffList.blobToBuffer(null, new Buffer('first\nsecond\n'), function(error, diff) {
+                  test.equals(diff.status, git.diffList.prototype.deltaTypes.GIT_DELTA_ADDED, 'Buffer against nothing should be an addition');
+                  test.equals(diff.additions, 2, 'Every buffer line should be added');
+                  test.done();
+                });
+              });
+            });
+          });
+        });
+      });
+    });
+  });
+};
+
+exports.cache = function(test) {
+  test.expect(4);
+  git.diffList.cache.configure({ maxBytes: 1024 * 1024 });
+  git.diffList.cache.clear();
+  git.repo('../.git', function(error, repository) {
+    repository.commit(historyCountKnownSHA, function(error, commit) {
+      commit.parents(function(error, parents) {
+        parents[0].sha(function(error, parentSha) {
+          (new git.diffList(commit.rawRepo)).treeToTree(parentSha, historyCountKnownSHA, function(error, diffList) {
+            diffList.toPatch(function(error, firstPatch) {
+              (new git.diffList(commit.rawRepo)).treeToTree(parentSha, historyCountKnownSHA, function(error, diffList) {
+                diffList.toPatch(function(error, secondPatch) {
+                  var stats = git.diffList.cache.stats();
+                  test.equal(stats.misses, 1, 'First patch should miss');
+                  test.equal(stats.hits, 1, 'Second patch should hit');
+                  test.equal(stats.entries, 1, 'One patch should be cached');
+                  test.equal(secondPatch.toString(), firstPatch.toString(), 'Cached patch should match');
+                  git.diffList.cache.configure({ maxBytes: 0 });
+                  git.diffList.cache.clear();
+                  test.done();
+                });
+              });
+            });
+          });
+        });
+      });
+    });
+  });
+};
+
+exports.findSimilar = function(test) {
+  test.expect(3);
+  git.repo('../.git', function(error, repository) {
+    repository.commit(historyCountKnownSHA, function(error, commit) {
+      commit.parents(function(error, parents) {
+        parents[0].sha(function(error, parentSha) {
+          (new git.diffList(commit.rawRepo)).treeToTree(parentSha, historyCountKnownSHA, function(error, diffList) {
+            diffList.findSimilar({ copies: true, renameThreshold: 40, threads: 2 }, function(error, diffList) {
+              test.equal(null, error, 'Should not error');
+              diffList.nameStatus(function(error, nameStatus) {
+                test.equal(nameStatus.statuses.length, 1, 'Delta count should be unchanged');
+                test.equal(nameStatus.statuses[0], diffList.deltaTypes.GIT_DELTA_MODIFIED, 'Modification should not become a rename');
+                test.done();
+              });
+            });
+          });
+        });
+      });
+    });
+  });
+};
+
+/**
+ * Commit files (path to content) on top of parent, moving master.
+ */
+var commitFiles = function(rawRepo, files, parent, callback) {
+  var updates = [],
+      paths = Object.keys(files);
+  var next = function(i) {
+    if (i === paths.length) {
+      var author = { name: 'A U Thor', email: 'author@example.com', time: 1234567890, offset: 0 };
+      (new git.raw.TreeBuilder()).write(rawRepo, null, updates, function(error, tree) {
+        var options = { tree: tree, author: author, message: 'Change\n', updateRef: 'refs/heads/master' };
+        if (parent) {
+          options.parents = [parent];
+        }
+        (new git.raw.Commit()).create(rawRepo, options, function(error, commit) {
+          callback(commit);
+        });
+      });
+      return;
+    }
+    var content = new Buffer(files[paths[i]]);
+    (new git.raw.Blob()).createFromBuffer(rawRepo, content, function() {
+      var sha = crypto.createHash('sha1').update('blob ' + content.length + '\0').update(content).digest('hex');
+      updates.push({ path: paths[i], oid: sha });
+      next(i + 1);
+    });
+  };
+  next(0);
+};
+
+var lines = function(prefix, count) {
+  var text = '';
+  for (var i = 0; i < count; i++) {
+    text += prefix + ' line ' + i + '\n';
+  }
+  return text;
+};
+
+exports.findSimilarRenamesAndCopies = function(test) {
+  test.expect(5);
+  var moved = lines('moved', 20),
+      kept = lines('kept', 20);
+  rimraf('./test-find-similar', function() {
+    var rawRepo = new git.raw.Repo();
+    rawRepo.init('./test-find-similar', true, function() {
+      rawRepo.open(path.resolve('./test-find-similar'), function() {
+        commitFiles(rawRepo, { 'a.txt': moved, 'keep.txt': kept }, null, function(first) {
+          // a.txt moves to b.txt with one line changed; keep.txt changes and is copied to copy.txt
+          var files = {
+            'b.txt': moved.replace('moved line 7', 'changed line 7'),
+            'keep.txt': kept + 'one more line\n',
+            'copy.txt': kept
+          };
+          commitFiles(rawRepo, files, first, function(second) {
+            (new git.diffList(rawRepo)).treeToTree(first.sha(), second.sha(), function(error, diffList) {
+              diffList.findSimilar({ copies: true, threads: 2 }, function(error, diffList) {
+                test.equal(null, error, 'Should not error');
+                diffList.nameStatus(function(error, nameStatus) {
+                  var renamed = nameStatus.newPaths.indexOf('b.txt'),
+                      copied = nameStatus.newPaths.indexOf('copy.txt');
+                  test.equal(nameStatus.statuses[renamed], diffList.deltaTypes.GIT_DELTA_RENAMED, 'Moved file should be a rename');
+                  test.equal(nameStatus.oldPaths[renamed], 'a.txt', 'Rename should come from the old path');
+                  test.equal(nameStatus.statuses[copied], diffList.deltaTypes.GIT_DELTA_COPIED, 'Duplicated file should be a copy');
+                  test.equal(nameStatus.oldPaths[copied], 'keep.txt', 'Copy should come from its source');
+                  rimraf('./test-find-similar', test.done);
+                });
+              });
+            });
+          });
+        });
+      });
+    });
+  });
+};
+
+exports.walkingManyDeltas = function(test) {
+  // More deltas than may be queued for the main thread at once, and more
+  // text than one arena block holds
+  var fileCount = 48,
+      lineCount = 200,
+      before = {},
+      after = {};
+  for (var i = 0; i < fileCount; i++) {
+    var name = 'file' + (i < 10 ? '0' + i : i) + '.txt';
+    before[name] = lines(name, lineCount);
+    after[name] = lines(name + ' changed', lineCount);
+  }
+
+  test.expect(5);
+  rimraf('./test-walk-many', function() {
+    var rawRepo = new git.raw.Repo();
+    rawRepo.init('./test-walk-many', true, function() {
+      rawRepo.open(path.resolve('./test-walk-many'), function() {
+        commitFiles(rawRepo, before, null, function(first) {
+          commitFiles(rawRepo, after, first, function(second) {
+            (new git.diffList(rawRepo)).treeToTree(first.sha(), second.sha(), function(error, diffList) {
+              var paths = [],
+                  intact = true;
+              diffList.walk().on('delta', function(error, delta) {
+                paths.push(delta.newFile.path);
+                var expected = lines(delta.newFile.path, lineCount).split('\n')[lineCount - 1] + '\n';
+                if (delta.content.length !== lineCount * 2 || delta.content[lineCount - 1].content !== expected) {
+                  intact = false;
+                }
+              }).on('end', function(error, diffs) {
+                test.equal(null, error, 'Should not error');
+                test.equal(paths.length, fileCount, 'Every delta should be emitted');
+                test.equal(diffs.length, fileCount, 'Every delta should be passed to end');
+                test.deepEqual(paths, Object.keys(before), 'Deltas should be emitted in diff order');
+                test.ok(intact, 'Every line should be read back unchanged');
+                rimraf('./test-walk-many', test.done);
+              });
+            });
+          });
+        });
+      });
+    });
+  });
+};
+
 exports.deltaTypes = function(test) {
   test.expect(9);
   var diffList = new git.diffList((new git.repo()).rawRepo);
@@ -83,3 +83,46 @@ exports.init = function(test) {
     });
   });
 };
+
+/**
+ * Ensure watch reports a ref created after it started, with its name and
+ * new oid.
+ */
+exports.watch = function(test) {
+  var author = { name: 'A U Thor', email: 'author@example.com', time: 1234567890, offset: 0 };
+
+  test.expect(4);
+
+  rimraf('./test-watch.git', function() {
+    git.repo().init('./test-watch.git', true, function(error, repo) {
+      (new git.raw.TreeBuilder()).write(repo.rawRepo, null, [], function(error, tree) {
+        (new git.raw.Commit()).create(repo.rawRepo, { tree: tree, author: author, message: 'Watched\n' }, function(error, commit) {
+          var watcher = repo.watch(),
+              seen = false;
+
+          watcher.on('change', function(error, name, oldOid, newOid) {
+            if (seen) {
+              return;
+            }
+            seen = true;
+            test.equals(name, 'refs/heads/watched', 'The change should name the created ref');
+            test.equals(oldOid, null, 'A created ref should have no old oid');
+            newOid.sha(function(error, sha) {
+              test.equals(sha, commit.sha(), 'The change should carry the new oid');
+              watcher.stop();
+            });
+          });
+          watcher.on('end', function(error) {
+            test.equals(null, error, 'The watch should end cleanly');
+            rimraf('./test-watch.git', test.done);
+          });
+
+          // Let the watcher take its first snapshot before moving the ref
+          setTimeout(function() {
+            (new git.raw.Reference()).transaction(repo.rawRepo, [{ name: 'refs/heads/watched', oldSha: null, newSha: commit.sha() }], function() {});
+          }, 200);
+        });
+      });
+    });
+  });
+};
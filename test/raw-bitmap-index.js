@@ -0,0 +1,142 @@
+var git = require('../').raw,
+    fs = require('fs'),
+    path = require('path'),
+    rimraf = require('rimraf');
+
+// Helper functions
+var helper = {
+  // Test if obj is a true function
+  testFunction: function(test, obj, label) {
+    // The object reports itself as a function
+    test(typeof obj, 'function', label +' reports as a function.');
+    // This ensures the repo is actually a derivative of the Function [[Class]]
+    test(toString.call(obj), '[object Function]', label +' [[Class]] is of type function.');
+  },
+  // Test code and handle exception thrown
+  testException: function(test, fun, label) {
+    try {
+      fun();
+      test(false, label);
+    }
+    catch (ex) {
+      test(true, label);
+    }
+  }
+};
+
+var firstBlob = 'e69de29bb2d1d6434b8b29ae775ad8c2e48c5391',
+    secondBlob = 'd00491fd7e5bb6fa28c517a0bb32b8b506539d4d';
+
+/**
+ * Commit updates on top of base (a tree) and parent, moving master.
+ */
+var commitChange = function(repo, base, updates, parent, callback) {
+  var author = { name: 'A U Thor', email: 'author@example.com', time: 1234567890, offset: 0 };
+  (new git.TreeBuilder()).write(repo, base, updates, function(error, tree) {
+    var options = { tree: tree, author: author, message: 'Change\n', updateRef: 'refs/heads/master' };
+    if (parent) {
+      options.parents = [parent];
+    }
+    (new git.Commit()).create(repo, options, function(error, commit) {
+      callback(tree, commit);
+    });
+  });
+};
+
+/**
+ * BitmapIndex
+ */
+exports.constructor = function(test){
+  test.expect(3);
+
+  // Test for function
+  helper.testFunction(test.equals, git.BitmapIndex, 'BitmapIndex');
+
+  // Ensure we get an instance of BitmapIndex
+  test.ok(new git.BitmapIndex() instanceof git.BitmapIndex, 'Invocation returns an instance of BitmapIndex');
+
+  test.done();
+};
+
+/**
+ * BitmapIndex::Write, and counts and listings that read the bitmaps
+ */
+exports.write = function(test) {
+  var index = new git.BitmapIndex();
+
+  test.expect(21);
+
+  // Test for function
+  helper.testFunction(test.equals, index.write, 'BitmapIndex::Write');
+
+  // Test repo argument existence
+  helper.testException(test.ok, function() {
+    index.write();
+  }, 'Throw an exception if no repo');
+
+  // Test options argument existence
+  helper.testException(test.ok, function() {
+    index.write(new git.Repo());
+  }, 'Throw an exception if no options');
+
+  // Test callback argument existence
+  helper.testException(test.ok, function() {
+    index.write(new git.Repo(), {});
+  }, 'Throw an exception if no callback');
+
+  // Test include option existence
+  helper.testException(test.ok, function() {
+    index.count(new git.Repo(), {}, function() {});
+  }, 'Throw an exception if nothing is included');
+
+  rimraf('./test-bitmap-index', function() {
+    var bitmapRepo = new git.Repo();
+    bitmapRepo.init('./test-bitmap-index', true, function() {
+      bitmapRepo.open(path.resolve('./test-bitmap-index'), function() {
+        // A root tree with src/ and doc/, then one change to each
+        commitChange(bitmapRepo, null, [{ path: 'src/a.txt', oid: firstBlob }, { path: 'doc/readme', oid: firstBlob }], null, function(tree, first) {
+          commitChange(bitmapRepo, tree, [{ path: 'src/a.txt', oid: secondBlob }], first, function(tree, second) {
+            commitChange(bitmapRepo, tree, [{ path: 'doc/readme', oid: secondBlob }], second, function(tree, third) {
+              index.write(bitmapRepo, { interval: 1 }, function(error, summary) {
+                test.equals(null, error, 'Writing the bitmaps should not error');
+                test.equals(summary.objects, 12, 'Every reachable object should be numbered');
+                test.equals(summary.bitmaps, 3, 'Every commit should have a bitmap');
+                test.ok(fs.existsSync(summary.path), 'The bitmap file should exist');
+
+                index.count(bitmapRepo, { include: ['master'] }, function(error, counts) {
+                  test.equals(counts.objects, 12, 'Every object should be reachable from master');
+                  test.ok(counts.commits === 3 && counts.trees === 7 && counts.blobs === 2, 'Objects should be counted by type');
+                  test.ok(counts.bitmaps && counts.walked === 0, 'No commit should be read');
+
+                  index.count(bitmapRepo, { include: ['master'], exclude: [first.sha()] }, function(error, counts) {
+                    test.equals(counts.objects, 7, 'Objects of the first commit should be left out');
+                    test.equals(counts.blobs, 1, 'A blob of the first commit should be left out');
+
+                    var shas = [];
+                    index.objects(bitmapRepo, { include: ['master'], exclude: [first.sha()] }, function(batch) {
+                      shas = shas.concat(batch);
+                    }, function(error, counts) {
+                      test.equals(null, error, 'Listing objects should not error');
+                      test.equals(shas.length, counts.objects, 'Every counted object should be listed');
+                      test.ok(shas.indexOf(third.sha()) !== -1 && shas.indexOf(secondBlob) !== -1, 'Selected objects should be listed');
+                      test.equals(shas.indexOf(first.sha()), -1, 'Excluded objects should not be listed');
+
+                      // Commits made after the bitmaps are walked from the object database
+                      commitChange(bitmapRepo, tree, [{ path: 'src/a.txt', oid: firstBlob }], third, function(tree, fourth) {
+                        index.count(bitmapRepo, { include: ['master'], exclude: [third.sha()] }, function(error, counts) {
+                          test.equals(counts.objects, 2, 'The new commit and its root tree should be selected');
+                          test.equals(counts.walked, 1, 'Only the new commit should be read');
+                          rimraf('./test-bitmap-index', test.done);
+                        });
+                      });
+                    });
+                  });
+                });
+              });
+            });
+          });
+        });
+      });
+    });
+  });
+};
@@ -0,0 +1,139 @@
+var git = require('../').raw,
+    exec = require('child_process').exec,
+    path = require('path');
+
+var historyCountKnownSHA = 'fce88902e66c72b5b93e75bdb5ae717038b221f6';
+
+// Helper functions
+var helper = {
+  // Test if obj is a true function
+  testFunction: function(test, obj, label) {
+    // The object reports itself as a function
+    test(typeof obj, 'function', label +' reports as a function.');
+    // This ensures the repo is actually a derivative of the Function [[Class]]
+    test(toString.call(obj), '[object Function]', label +' [[Class]] is of type function.');
+  },
+  // Test code and handle exception thrown
+  testException: function(test, fun, label) {
+    try {
+      fun();
+      test(false, label);
+    }
+    catch (ex) {
+      test(true, label);
+    }
+  }
+};
+
+/**
+ * Blame
+ */
+exports.constructor = function(test){
+  test.expect(3);
+
+  // Test for function
+  helper.testFunction(test.equals, git.Blame, 'Blame');
+
+  // Ensure we get an instance of Blame
+  test.ok(new git.Blame() instanceof git.Blame, 'Invocation returns an instance of Blame');
+
+  test.done();
+};
+
+/**
+ * Blame::File
+ */
+exports.file = function(test) {
+  var testRepo = new git.Repo(),
+      blame = new git.Blame();
+
+  test.expect(12);
+
+  // Test for function
+  helper.testFunction(test.equals, blame.file, 'Blame::File');
+
+  // Test repo argument existence
+  helper.testException(test.ok, function() {
+    blame.file();
+  }, 'Throw an exception if no repo');
+
+  // Test path argument existence
+  helper.testException(test.ok, function() {
+    blame.file(testRepo);
+  }, 'Throw an exception if no path');
+
+  // Test options argument existence
+  helper.testException(test.ok, function() {
+    blame.file(testRepo, 'README.md');
+  }, 'Throw an exception if no options');
+
+  // Test hunks callback argument existence
+  helper.testException(test.ok, function() {
+    blame.file(testRepo, 'README.md', {});
+  }, 'Throw an exception if no hunks callback');
+
+  // Test end callback argument existence
+  helper.testException(test.ok, function() {
+    blame.file(testRepo, 'README.md', {}, function() {});
+  }, 'Throw an exception if no end callback');
+
+  testRepo.open(path.resolve('../.git'), function() {
+    var lines = 0,
+        inRange = true,
+        attributed = {};
+    blame.file(testRepo, 'README.md', { newest: historyCountKnownSHA, minLine: 3, maxLine: 7 }, function(hunks) {
+      hunks.forEach(function(hunk) {
+        lines += hunk.lines;
+        if (hunk.finalStartLine < 3 || hunk.finalStartLine + hunk.lines - 1 > 7) {
+          inRange = false;
+        }
+        for (var i = 0; i < hunk.lines; i++) {
+          attributed[hunk.finalStartLine + i] = hunk.sha;
+        }
+      });
+    }, function(error, summary) {
+      test.equals(null, error, 'Blame should not error');
+      test.equals(lines, 5, 'Hunks should cover exactly the requested lines');
+      test.ok(inRange, 'Hunks should stay within the requested lines');
+      test.equals(summary.attributedLines, 5, 'Summary should count the requested lines');
+
+      // Every group in porcelain output starts with "<sha> <source line> <final line> <lines>"
+      exec('git blame --porcelain -L 3,7 ' + historyCountKnownSHA + ' -- README.md', { cwd: '..' }, function(error, stdout) {
+        var expected = {};
+        stdout.split('\n').forEach(function(line) {
+          var group = line.match(/^([0-9a-f]{40}) \d+ (\d+) (\d+)$/);
+          if (group) {
+            for (var i = 0; i < Number(group[3]); i++) {
+              expected[Number(group[2]) + i] = group[1];
+            }
+          }
+        });
+        test.deepEqual(attributed, expected, 'Each line should be attributed to the same commit as git blame does');
+        test.done();
+      });
+    });
+  });
+};
+
+/**
+ * Blame::File with a commit range
+ */
+exports.fileBoundary = function(test) {
+  var testRepo = new git.Repo();
+
+  test.expect(3);
+
+  testRepo.open(path.resolve('../.git'), function() {
+    var shas = {};
+    (new git.Blame()).file(testRepo, 'README.md', { newest: historyCountKnownSHA, oldest: historyCountKnownSHA + '^' }, function(hunks) {
+      hunks.forEach(function(hunk) {
+        shas[hunk.sha] = hunk.boundary;
+      });
+    }, function(error, summary) {
+      test.equals(null, error, 'Blame should not error');
+      test.equals(shas[historyCountKnownSHA], false, 'The only commit in range should not be a boundary');
+      test.equals(summary.attributedLines, summary.totalLines, 'Every line should be attributed');
+      test.done();
+    });
+  });
+};
@@ -0,0 +1,231 @@
+var git = require('../').raw,
+    fs = require('fs'),
+    path = require('path'),
+    rimraf = require('rimraf');
+
+// Helper functions
+var helper = {
+  // Test if obj is a true function
+  testFunction: function(test, obj, label) {
+    // The object reports itself as a function
+    test(typeof obj, 'function', label +' reports as a function.');
+    // This ensures the repo is actually a derivative of the Function [[Class]]
+    test(toString.call(obj), '[object Function]', label +' [[Class]] is of type function.');
+  },
+  // Test code and handle exception thrown
+  testException: function(test, fun, label) {
+    try {
+      fun();
+      test(false, label);
+    }
+    catch (ex) {
+      test(true, label);
+    }
+  }
+};
+
+/**
+ * Build root <- one, root <- two, and a merge of one and two on master.
+ */
+var createDiamond = function(repo, callback) {
+  var commit = new git.Commit(),
+      author = { name: 'A U Thor', email: 'author@example.com', time: 1234567890, offset: 0 };
+  (new git.TreeBuilder()).write(repo, null, [], function(error, tree) {
+    commit.create(repo, { tree: tree, author: author, message: 'Root\n' }, function(error, root) {
+      commit.create(repo, { tree: tree, parents: [root], author: author, message: 'One\n' }, function(error, one) {
+        commit.create(repo, { tree: tree, parents: [root], author: author, message: 'Two\n' }, function(error, two) {
+          commit.create(repo, {
+            tree: tree,
+            parents: [one, two],
+            author: author,
+            message: 'Merge\n',
+            updateRef: 'refs/heads/master'
+          }, function(error, merge) {
+            callback(tree, root.sha(), one.sha(), two.sha(), merge.sha());
+          });
+        });
+      });
+    });
+  });
+};
+
+/**
+ * CommitGraph
+ */
+exports.constructor = function(test){
+  test.expect(3);
+
+  // Test for function
+  helper.testFunction(test.equals, git.CommitGraph, 'CommitGraph');
+
+  // Ensure we get an instance of CommitGraph
+  test.ok(new git.CommitGraph() instanceof git.CommitGraph, 'Invocation returns an instance of CommitGraph');
+
+  test.done();
+};
+
+/**
+ * CommitGraph::Write, and walks that read the graph
+ */
+exports.write = function(test) {
+  var graph = new git.CommitGraph();
+
+  test.expect(15);
+
+  // Test for function
+  helper.testFunction(test.equals, graph.write, 'CommitGraph::Write');
+
+  // Test repo argument existence
+  helper.testException(test.ok, function() {
+    graph.write();
+  }, 'Throw an exception if no repo');
+
+  // Test callback argument existence
+  helper.testException(test.ok, function() {
+    graph.write(new git.Repo());
+  }, 'Throw an exception if no callback');
+
+  rimraf('./test-commit-graph', function() {
+    var graphRepo = new git.Repo();
+    graphRepo.init('./test-commit-graph', true, function() {
+      graphRepo.open(path.resolve('./test-commit-graph'), function() {
+        createDiamond(graphRepo, function(tree, root, one, two, merge) {
+          graph.write(graphRepo, function(error, summary) {
+            test.equals(null, error, 'Writing the graph should not error');
+            test.equals(summary.commits, 4, 'Every reachable commit should be in the graph');
+            test.ok(fs.existsSync(summary.path), 'The graph file should exist');
+
+            var revwalk = new git.RevWalk(graphRepo);
+            revwalk.mergeBase(one, two, function(error, base) {
+              test.equals(base, root, 'The merge base of two siblings is their parent');
+              revwalk.isAncestor(root, merge, function(error, isAncestor) {
+                test.equals(isAncestor, true, 'The root is an ancestor of the merge');
+                revwalk.isAncestor(one, two, function(error, isAncestor) {
+                  test.equals(isAncestor, false, 'A sibling is not an ancestor');
+
+                  var shas = [];
+                  revwalk.commits('master', {}, function(batch) {
+                    shas = shas.concat(batch);
+                  }, function(error, summary) {
+                    test.equals(shas[0], merge, 'The walk should start at the tip');
+                    test.equals(shas[3], root, 'Parents should follow their children');
+                    test.ok(summary.graph && summary.loaded === 0, 'Every commit should come from the graph');
+
+                    // Commits made after the graph are read from the object database
+                    (new git.Commit()).create(graphRepo, {
+                      tree: tree,
+                      parents: [merge],
+                      author: { name: 'A U Thor', email: 'author@example.com' },
+                      message: 'After\n',
+                      updateRef: 'refs/heads/master'
+                    }, function(error, after) {
+                      revwalk.commits(one + '..master', {}, function() {}, function(error, summary) {
+                        test.equals(summary.count, 3, 'The range should hold the new commit, the merge and two');
+                        test.equals(summary.loaded, 1, 'Only the new commit should be parsed');
+                        rimraf('./test-commit-graph', test.done);
+                      });
+                    });
+                  });
+                });
+              });
+            });
+          });
+        });
+      });
+    });
+  });
+};
+
+var firstBlob = 'e69de29bb2d1d6434b8b29ae775ad8c2e48c5391',
+    secondBlob = 'd00491fd7e5bb6fa28c517a0bb32b8b506539d4d';
+
+/**
+ * Commit updates on top of base (a tree) and parent, moving master.
+ */
+var commitChange = function(repo, base, updates, parent, callback) {
+  var author = { name: 'A U Thor', email: 'author@example.com', time: 1234567890, offset: 0 };
+  (new git.TreeBuilder()).write(repo, base, updates, function(error, tree) {
+    var options = { tree: tree, author: author, message: 'Change\n', updateRef: 'refs/heads/master' };
+    if (parent) {
+      options.parents = [parent];
+    }
+    (new git.Commit()).create(repo, options, function(error, commit) {
+      callback(tree, commit);
+    });
+  });
+};
+
+/**
+ * CommitGraph::WriteBloom, and path-limited walks that read the filters
+ */
+exports.writeBloom = function(test) {
+  var graph = new git.CommitGraph();
+
+  test.expect(16);
+
+  // Test for function
+  helper.testFunction(test.equals, graph.writeBloom, 'CommitGraph::WriteBloom');
+
+  // Test repo argument existence
+  helper.testException(test.ok, function() {
+    graph.writeBloom();
+  }, 'Throw an exception if no repo');
+
+  // Test options argument existence
+  helper.testException(test.ok, function() {
+    graph.writeBloom(new git.Repo());
+  }, 'Throw an exception if no options');
+
+  // Test callback argument existence
+  helper.testException(test.ok, function() {
+    graph.writeBloom(new git.Repo(), {});
+  }, 'Throw an exception if no callback');
+
+  rimraf('./test-commit-graph-bloom', function() {
+    var bloomRepo = new git.Repo();
+    bloomRepo.init('./test-commit-graph-bloom', true, function() {
+      bloomRepo.open(path.resolve('./test-commit-graph-bloom'), function() {
+        commitChange(bloomRepo, null, [{ path: 'src/a.txt', oid: firstBlob }, { path: 'doc/readme', oid: firstBlob }], null, function(tree, first) {
+          commitChange(bloomRepo, tree, [{ path: 'src/a.txt', oid: secondBlob }], first, function(tree, second) {
+            commitChange(bloomRepo, tree, [{ path: 'doc/readme', oid: secondBlob }], second, function(tree, third) {
+              commitChange(bloomRepo, tree, [{ path: 'doc/readme', oid: firstBlob }], third, function(tree, fourth) {
+                // Changes nothing, so its filter rules out every path
+                commitChange(bloomRepo, tree, [], fourth, function(tree, fifth) {
+                  graph.writeBloom(bloomRepo, { threads: 2 }, function(error, summary) {
+                    test.equals(null, error, 'Writing the filters should not error');
+                    test.equals(summary.added, 5, 'Every reachable commit should get a filter');
+                    test.equals(summary.commits, 5, 'Every reachable commit should have a filter');
+                    test.ok(fs.existsSync(summary.path), 'The filter file should exist');
+
+                    var revwalk = new git.RevWalk(bloomRepo),
+                        shas = [];
+                    revwalk.commits('master', { paths: ['src'] }, function(batch) {
+                      shas = shas.concat(batch);
+                    }, function(error, summary) {
+                      test.equals(summary.count, 2, 'Only the commits touching src should be emitted');
+                      test.equals(shas[0], second.sha(), 'The newest commit touching src should come first');
+                      test.ok(summary.filtered >= 1, 'An unchanged commit should be ruled out by its filter');
+                      test.equals(summary.filtered + summary.diffed, 5, 'Every other commit should be diffed');
+
+                      // Only commits made since the last call are diffed
+                      commitChange(bloomRepo, tree, [{ path: 'src/a.txt', oid: firstBlob }], fifth, function(tree, sixth) {
+                        graph.writeBloom(bloomRepo, {}, function(error, summary) {
+                          test.equals(summary.added, 1, 'Only the new commit should get a filter');
+                          test.equals(summary.commits, 6, 'The old filters should be kept');
+                          revwalk.commits('master', { paths: ['src/a.txt'] }, function() {}, function(error, summary) {
+                            test.equals(summary.count, 3, 'The new commit should be found by path');
+                            rimraf('./test-commit-graph-bloom', test.done);
+                          });
+                        });
+                      });
+                    });
+                  });
+                });
+              });
+            });
+          });
+        });
+      });
+    });
+  });
+};
@@ -1,4 +1,6 @@
-var git = require('../').raw;
+var git = require('../').raw,
+    path = require('path'),
+    rimraf = require('rimraf');
 
 var testRepo = new git.Repo();
 
@@ -84,3 +86,68 @@ exports.lookup = function(test) {
     });
   });
 };
+
+/**
+ * Commit::Create
+ */
+exports.create = function(test) {
+  test.expect(10);
+
+  var testCommit = new git.Commit(),
+      author = { name: 'A U Thor', email: 'author@example.com', time: 1234567890, offset: 60 };
+
+  // Test for function
+  helper.testFunction(test.equals, testCommit.create, 'Commit::Create');
+
+  // Test repo argument existence
+  helper.testException(test.ok, function() {
+    testCommit.create();
+  }, 'Throw an exception if no repo');
+
+  // Test options argument existence
+  helper.testException(test.ok, function() {
+    testCommit.create(new git.Repo());
+  }, 'Throw an exception if no options');
+
+  // Test callback argument existence
+  helper.testException(test.ok, function() {
+    testCommit.create(new git.Repo(), {});
+  }, 'Throw an exception if no callback');
+
+  rimraf('./test-commit-create', function() {
+    var createRepo = new git.Repo();
+    createRepo.init('./test-commit-create', true, function() {
+      createRepo.open(path.resolve('./test-commit-create'), function() {
+        (new git.TreeBuilder()).write(createRepo, null, [], function(error, tree) {
+          testCommit.create(createRepo, {
+            tree: tree,
+            author: author,
+            message: 'Initial\n',
+            updateRef: 'refs/heads/master'
+          }, function(error, oid) {
+            test.equals(null, error, 'Creating a root commit should not error');
+            test.equals(oid.sha(), 'b9aea42414aa15644cbdd47a55cd89319ac064b5', 'The commit should match git commit-tree');
+
+            testCommit.create(createRepo, {
+              tree: tree.sha(),
+              parents: [oid],
+              author: author,
+              message: 'Second\n'
+            }, function(error, child) {
+              testCommit.lookup(createRepo, child, function(error, commit) {
+                commit.message(function(error, message) {
+                  test.equals(message, 'Second\n', 'The message should be kept');
+                  commit.parents(function(error, parents) {
+                    test.equals(parents.length, 1, 'The commit should have one parent');
+                    test.equals(parents[0].oid().sha(), oid.sha(), 'The parent should be the root commit');
+                    rimraf('./test-commit-create', test.done);
+                  });
+                });
+              });
+            });
+          });
+        });
+      });
+    });
+  });
+};
@@ -0,0 +1,145 @@
+var git = require('../').raw,
+    path = require('path'),
+    fs = require('fs'),
+    rimraf = require('rimraf');
+
+// Helper functions
+var helper = {
+  // Test if obj is a true function
+  testFunction: function(test, obj, label) {
+    // The object reports itself as a function
+    test(typeof obj, 'function', label +' reports as a function.');
+    // This ensures the repo is actually a derivative of the Function [[Class]]
+    test(toString.call(obj), '[object Function]', label +' [[Class]] is of type function.');
+  },
+  // Test code and handle exception thrown
+  testException: function(test, fun, label) {
+    try {
+      fun();
+      test(false, label);
+    }
+    catch (ex) {
+      test(true, label);
+    }
+  }
+};
+
+/**
+ * Index
+ */
+exports.constructor = function(test){
+  test.expect(3);
+
+  // Test for function
+  helper.testFunction(test.equals, git.Index, 'Index');
+
+  // Ensure we get an instance of Index
+  test.ok(new git.Index() instanceof git.Index, 'Invocation returns an instance of Index');
+
+  test.done();
+};
+
+/**
+ * Index::Read
+ */
+exports.read = function(test) {
+  var testRepo = new git.Repo(),
+      index = new git.Index();
+
+  test.expect(12);
+
+  // Test for function
+  helper.testFunction(test.equals, index.read, 'Index::Read');
+
+  // Test repo argument existence
+  helper.testException(test.ok, function() {
+    index.read();
+  }, 'Throw an exception if no repo');
+
+  // Test callback argument existence
+  helper.testException(test.ok, function() {
+    index.read(testRepo);
+  }, 'Throw an exception if no callback');
+
+  testRepo.open(path.resolve('../.git'), function() {
+    index.read(testRepo, function(error, entries) {
+      test.equals(null, error, 'Read should not error');
+      test.ok(entries.count > 0, 'Index should have entries');
+      test.equals(index.entryCount(), entries.count, 'Entry count should match');
+      test.equals(entries.pathOffsets.length, entries.count + 1, 'Path offsets should have one extra end offset');
+      test.equals(entries.oids.length, entries.count * 20, 'Every entry should have a raw oid');
+
+      var position = index.find('README.md');
+      test.ok(position >= 0, 'README.md should be found');
+      test.equals(entries.pathTable.toString('utf8', entries.pathOffsets[position], entries.pathOffsets[position + 1] - 1),
+        'README.md', 'Found position should hold README.md');
+      test.equals(index.find('does/not/exist'), -1, 'Missing paths should not be found');
+      test.done();
+    });
+  });
+};
+
+/**
+ * Index::AddAll
+ */
+exports.addAll = function(test) {
+  var index = new git.Index();
+
+  test.expect(13);
+
+  // Test for function
+  helper.testFunction(test.equals, index.addAll, 'Index::AddAll');
+
+  // Test repo argument existence
+  helper.testException(test.ok, function() {
+    index.addAll();
+  }, 'Throw an exception if no repo');
+
+  // Test pathspecs argument existence
+  helper.testException(test.ok, function() {
+    index.addAll(new git.Repo());
+  }, 'Throw an exception if no pathspecs');
+
+  // Test options argument existence
+  helper.testException(test.ok, function() {
+    index.addAll(new git.Repo(), [], function() {});
+  }, 'Throw an exception if no options');
+
+  // Test callback argument existence
+  helper.testException(test.ok, function() {
+    index.addAll(new git.Repo(), [], {});
+  }, 'Throw an exception if no callback');
+
+  rimraf('./test-index', function() {
+    var testRepo = new git.Repo();
+    testRepo.init('./test-index', false, function() {
+      fs.mkdirSync('./test-index/dir');
+      fs.writeFileSync('./test-index/first.txt', 'first\n');
+      fs.writeFileSync('./test-index/dir/second.txt', 'second\n');
+      // Old timestamps keep the entries from being racy on the second pass
+      var past = new Date(Date.now() - 60000);
+      fs.utimesSync('./test-index/first.txt', past, past);
+      fs.utimesSync('./test-index/dir/second.txt', past, past);
+
+      testRepo.open(path.resolve('./test-index/.git'), function() {
+        index.addAll(testRepo, ['.'], { threads: 2 }, function(error, result) {
+          test.equals(null, error, 'AddAll should not error');
+          test.equals(result.added, 2, 'Both files should be added');
+          test.equals(result.entries.count, 2, 'The index should hold both files');
+
+          index.addAll(testRepo, [], {}, function(error, result) {
+            test.equals(result.unchanged, 2, 'Unchanged files should be skipped');
+            test.equals(result.added, 0, 'Nothing should be written again');
+
+            fs.unlinkSync('./test-index/dir/second.txt');
+            index.addAll(testRepo, ['dir'], {}, function(error, result) {
+              test.equals(result.removed, 1, 'Deleted files should be removed');
+              test.equals(index.find('dir/second.txt'), -1, 'Removed files should not be found');
+              rimraf('./test-index', test.done);
+            });
+          });
+        });
+      });
+    });
+  });
+};
@@ -0,0 +1,138 @@
+var git = require('../').raw,
+    fs = require('fs');
+
+// Helper functions
+var helper = {
+  // Test if obj is a true function
+  testFunction: function(test, obj, label) {
+    // The object reports itself as a function
+    test(typeof obj, 'function', label +' reports as a function.');
+    // This ensures the repo is actually a derivative of the Function [[Class]]
+    test(toString.call(obj), '[object Function]', label +' [[Class]] is of type function.');
+  },
+  // Test code and handle exception thrown
+  testException: function(test, fun, label) {
+    try {
+      fun();
+      test(false, label);
+    }
+    catch (ex) {
+      test(true, label);
+    }
+  }
+};
+
+/**
+ * Indexer
+ */
+exports.constructor = function(test){
+  test.expect(3);
+
+  // Test for function
+  helper.testFunction(test.equals, git.Indexer, 'Indexer');
+
+  // Ensure we get an instance of Indexer
+  test.ok(new git.Indexer() instanceof git.Indexer, 'Invocation returns an instance of Indexer');
+
+  test.done();
+};
+
+/**
+ * Indexer::IndexPack
+ */
+exports.indexPack = function(test) {
+  var indexer = new git.Indexer();
+
+  test.expect(12);
+
+  // Test for function
+  helper.testFunction(test.equals, indexer.indexPack, 'Indexer::IndexPack');
+
+  // Test repo argument existence
+  helper.testException(test.ok, function() {
+    indexer.indexPack();
+  }, 'Throw an exception if no repo');
+
+  // Test pack path argument existence
+  helper.testException(test.ok, function() {
+    indexer.indexPack(new git.Repo());
+  }, 'Throw an exception if no pack path');
+
+  // Test options argument existence
+  helper.testException(test.ok, function() {
+    indexer.indexPack(new git.Repo(), './test-indexer.pack');
+  }, 'Throw an exception if no options');
+
+  // Test end callback argument existence
+  helper.testException(test.ok, function() {
+    indexer.indexPack(new git.Repo(), './test-indexer.pack', {}, function() {});
+  }, 'Throw an exception if no end callback');
+
+  var testRepo = new git.Repo();
+  testRepo.open('../.git', function() {
+    (new git.PackBuilder()).build(testRepo, { include: ['HEAD'], path: './test-indexer.pack' }, function() {}, function() {}, function(error, summary) {
+      indexer.indexPack(testRepo, './test-indexer.pack', { threads: 3 }, function() {}, function(error, result) {
+        test.equals(null, error, 'Indexing a pack should not error');
+        test.equals(result.objects, summary.objects, 'Every object in the pack should be indexed');
+        test.equals(result.corrupt.length, 0, 'Nothing in a fresh pack should be corrupt');
+        test.equals(result.missing.length, 0, 'A full history pack should be connected');
+        test.ok(fs.existsSync('./test-indexer.idx'), 'The index should be written next to the pack');
+
+        // Flip a byte in the middle of the pack
+        var pack = fs.readFileSync('./test-indexer.pack');
+        pack[pack.length >> 1] ^= 0xff;
+        fs.unlinkSync('./test-indexer.idx');
+        fs.chmodSync('./test-indexer.pack', parseInt('0644', 8));
+        fs.writeFileSync('./test-indexer.pack', pack);
+
+        indexer.indexPack(testRepo, './test-indexer.pack', {}, function() {}, function(error, result) {
+          test.notEqual(null, error, 'A damaged pack should fail its checksum');
+          fs.unlinkSync('./test-indexer.pack');
+          test.done();
+        });
+      });
+    });
+  });
+};
+
+/**
+ * Indexer::Fsck
+ */
+exports.fsck = function(test) {
+  var indexer = new git.Indexer();
+
+  test.expect(10);
+
+  // Test for function
+  helper.testFunction(test.equals, indexer.fsck, 'Indexer::Fsck');
+
+  // Test repo argument existence
+  helper.testException(test.ok, function() {
+    indexer.fsck();
+  }, 'Throw an exception if no repo');
+
+  // Test options argument existence
+  helper.testException(test.ok, function() {
+    indexer.fsck(new git.Repo());
+  }, 'Throw an exception if no options');
+
+  // Test end callback argument existence
+  helper.testException(test.ok, function() {
+    indexer.fsck(new git.Repo(), {}, function() {});
+  }, 'Throw an exception if no end callback');
+
+  var testRepo = new git.Repo();
+  testRepo.open('../.git', function() {
+    var stages = {};
+    indexer.fsck(testRepo, { threads: 2 }, function(progress) {
+      stages[progress.stage] = true;
+    }, function(error, result) {
+      test.equals(null, error, 'Checking the repository should not error');
+      test.ok(result.objects > 0, 'Every object should be checked');
+      test.equals(result.corrupt.length, 0, 'Nothing should be corrupt');
+      test.equals(result.missing.length, 0, 'Every referenced object should exist');
+      test.ok(stages.hashing && stages.connectivity, 'Progress should cover hashing and connectivity');
+      test.done();
+    });
+  });
+};
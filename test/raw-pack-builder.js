@@ -0,0 +1,90 @@
+var git = require('../').raw;
+
+// Helper functions
+var helper = {
+  // Test if obj is a true function
+  testFunction: function(test, obj, label) {
+    // The object reports itself as a function
+    test(typeof obj, 'function', label +' reports as a function.');
+    // This ensures the repo is actually a derivative of the Function [[Class]]
+    test(toString.call(obj), '[object Function]', label +' [[Class]] is of type function.');
+  },
+  // Test code and handle exception thrown
+  testException: function(test, fun, label) {
+    try {
+      fun();
+      test(false, label);
+    }
+    catch (ex) {
+      test(true, label);
+    }
+  }
+};
+
+/**
+ * PackBuilder
+ */
+exports.constructor = function(test){
+  test.expect(3);
+
+  // Test for function
+  helper.testFunction(test.equals, git.PackBuilder, 'PackBuilder');
+
+  // Ensure we get an instance of PackBuilder
+  test.ok(new git.PackBuilder() instanceof git.PackBuilder, 'Invocation returns an instance of PackBuilder');
+
+  test.done();
+};
+
+/**
+ * PackBuilder::Build
+ */
+exports.build = function(test) {
+  var builder = new git.PackBuilder();
+
+  test.expect(12);
+
+  // Test for function
+  helper.testFunction(test.equals, builder.build, 'PackBuilder::Build');
+
+  // Test repo argument existence
+  helper.testException(test.ok, function() {
+    builder.build();
+  }, 'Throw an exception if no repo');
+
+  // Test options argument existence
+  helper.testException(test.ok, function() {
+    builder.build(new git.Repo());
+  }, 'Throw an exception if no options');
+
+  // Test end callback argument existence
+  helper.testException(test.ok, function() {
+    builder.build(new git.Repo(), { include: ['HEAD'] }, function() {}, function() {});
+  }, 'Throw an exception if no end callback');
+
+  var testRepo = new git.Repo();
+  testRepo.open('../.git', function() {
+    // Test include existence
+    helper.testException(test.ok, function() {
+      builder.build(testRepo, {}, function() {}, function() {}, function() {});
+    }, 'Throw an exception if nothing is included');
+
+    var chunks = [],
+        stages = {};
+    builder.build(testRepo, { include: ['HEAD'], exclude: ['HEAD~1'], threads: 2 }, function(progress) {
+      stages[progress.stage] = true;
+    }, function(data) {
+      chunks.push(data);
+    }, function(error, summary) {
+      var pack = Buffer.concat(chunks);
+
+      test.equals(null, error, 'Building a pack should not error');
+      test.ok(summary.objects > 0, 'The pack should hold the new commit and its changes');
+      test.equals(summary.written, summary.objects, 'Every object should be written');
+      test.equals(pack.length, summary.bytes, 'Every byte should be emitted');
+      test.equals(pack.toString('ascii', 0, 4), 'PACK', 'The data should be a pack');
+      test.ok(stages.counting && stages.writing, 'Progress should cover counting and writing');
+      test.done();
+    });
+  });
+};
@@ -0,0 +1,132 @@
+var git = require('../').raw,
+    path = require('path'),
+    fs = require('fs'),
+    rimraf = require('rimraf');
+
+// Helper functions
+var helper = {
+  // Test if obj is a true function
+  testFunction: function(test, obj, label) {
+    // The object reports itself as a function
+    test(typeof obj, 'function', label +' reports as a function.');
+    // This ensures the repo is actually a derivative of the Function [[Class]]
+    test(toString.call(obj), '[object Function]', label +' [[Class]] is of type function.');
+  },
+  // Test code and handle exception thrown
+  testException: function(test, fun, label) {
+    try {
+      fun();
+      test(false, label);
+    }
+    catch (ex) {
+      test(true, label);
+    }
+  }
+};
+
+/**
+ * PackWriter
+ */
+exports.constructor = function(test){
+  test.expect(3);
+
+  // Test for function
+  helper.testFunction(test.equals, git.PackWriter, 'PackWriter');
+
+  // Ensure we get an instance of PackWriter
+  test.ok(new git.PackWriter() instanceof git.PackWriter, 'Invocation returns an instance of PackWriter');
+
+  test.done();
+};
+
+/**
+ * PackWriter::Begin, PackWriter::Write, PackWriter::Commit
+ */
+exports.commit = function(test) {
+  var writer = new git.PackWriter();
+
+  test.expect(13);
+
+  // Test for function
+  helper.testFunction(test.equals, writer.begin, 'PackWriter::Begin');
+
+  // Test repo argument existence
+  helper.testException(test.ok, function() {
+    writer.begin();
+  }, 'Throw an exception if no repo');
+
+  // Test callback argument existence
+  helper.testException(test.ok, function() {
+    writer.begin(new git.Repo(), {});
+  }, 'Throw an exception if no callback');
+
+  // Test writing outside of a session
+  helper.testException(test.ok, function() {
+    writer.write([], function() {});
+  }, 'Throw an exception if writing before begin');
+
+  rimraf('./test-pack-writer', function() {
+    var testRepo = new git.Repo();
+    testRepo.init('./test-pack-writer', true, function() {
+      testRepo.open(path.resolve('./test-pack-writer'), function() {
+        writer.begin(testRepo, { threads: 2 }, function(error) {
+          test.equals(null, error, 'Begin should not error');
+
+          var objects = [
+            { type: 'blob', data: new Buffer('hello\n') },
+            { type: 'blob', data: new Buffer('hello\n') },
+            { type: 'blob', data: new Buffer('') }
+          ];
+          writer.write(objects, function(error, shas, existing) {
+            test.equals(null, error, 'Write should not error');
+            test.equals(shas[0], 'ce013625030ba8dba906f756967f9e9ca394464a', 'Blobs should hash like git');
+            test.equals(shas[2], 'e69de29bb2d1d6434b8b29ae775ad8c2e48c5391', 'Empty blobs should hash like git');
+            test.equals(existing, 1, 'The duplicate should be skipped');
+
+            writer.commit(function(error, result) {
+              test.equals(result.objects, 2, 'The pack should hold both blobs');
+              test.ok(fs.existsSync(result.packPath) && fs.existsSync(result.indexPath), 'The pack and index should be in place');
+
+              var oid = new git.Oid();
+              oid.fromString(shas[0], function(error, oid) {
+                (new git.Blob()).lookup(testRepo, oid, function(error) {
+                  test.equals(null, error, 'Objects should be readable from the new pack');
+                  rimraf('./test-pack-writer', test.done);
+                });
+              });
+            });
+          });
+        });
+      });
+    });
+  });
+};
+
+/**
+ * PackWriter::Abort
+ */
+exports.abort = function(test) {
+  var writer = new git.PackWriter();
+
+  test.expect(3);
+
+  // Test for function
+  helper.testFunction(test.equals, writer.abort, 'PackWriter::Abort');
+
+  rimraf('./test-pack-writer-abort', function() {
+    var testRepo = new git.Repo();
+    testRepo.init('./test-pack-writer-abort', true, function() {
+      testRepo.open(path.resolve('./test-pack-writer-abort'), function() {
+        writer.begin(testRepo, {}, function() {
+          writer.write([{ type: 'blob', data: new Buffer('aborted\n') }], function() {
+            writer.abort(function() {
+              var packs = fs.readdirSync('./test-pack-writer-abort/objects/pack');
+              test.equals(packs.length, 0, 'Nothing should be left behind');
+              rimraf('./test-pack-writer-abort', test.done);
+            });
+          });
+        });
+      });
+    });
+  });
+};
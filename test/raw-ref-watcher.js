@@ -0,0 +1,74 @@
+var git = require('../').raw,
+    path = require('path');
+
+// Helper functions
+var helper = {
+  // Test if obj is a true function
+  testFunction: function(test, obj, label) {
+    // The object reports itself as a function
+    test(typeof obj, 'function', label +' reports as a function.');
+    // This ensures the repo is actually a derivative of the Function [[Class]]
+    test(toString.call(obj), '[object Function]', label +' [[Class]] is of type function.');
+  },
+  // Test code and handle exception thrown
+  testException: function(test, fun, label) {
+    try {
+      fun();
+      test(false, label);
+    }
+    catch (ex) {
+      test(true, label);
+    }
+  }
+};
+
+/**
+ * RefWatcher
+ */
+exports.constructor = function(test){
+  test.expect(3);
+
+  // Test for function
+  helper.testFunction(test.equals, git.RefWatcher, 'RefWatcher');
+
+  // Ensure we get an instance of RefWatcher
+  test.ok(new git.RefWatcher() instanceof git.RefWatcher, 'Invocation returns an instance of RefWatcher');
+
+  test.done();
+};
+
+/**
+ * RefWatcher::Start
+ */
+exports.start = function(test) {
+  var testRepo = new git.Repo(),
+      watcher = new git.RefWatcher();
+
+  test.expect(6);
+
+  // Test for function
+  helper.testFunction(test.equals, watcher.start, 'RefWatcher::Start');
+
+  // Test repo argument existence
+  helper.testException(test.ok, function() {
+    watcher.start();
+  }, 'Throw an exception if no repo');
+
+  // Test change callback argument existence
+  helper.testException(test.ok, function() {
+    watcher.start(testRepo);
+  }, 'Throw an exception if no change callback');
+
+  // Test end callback argument existence
+  helper.testException(test.ok, function() {
+    watcher.start(testRepo, function() {});
+  }, 'Throw an exception if no end callback');
+
+  testRepo.open(path.resolve('../.git'), function() {
+    watcher.start(testRepo, function() {}, function(error) {
+      test.equals(null, error, 'Watcher should end cleanly when stopped');
+      test.done();
+    });
+    watcher.stop();
+  });
+};
@@ -1,4 +1,6 @@
 var git = require('../').raw,
+    fs = require('fs'),
+    path = require('path'),
     rimraf = require('rimraf');
 
 // Helper functions
@@ -81,3 +83,100 @@ exports.lookup = function(test) {
   //  });
   });
 };
+
+// Ref::Transaction
+exports.transaction = function(test) {
+
+  var testRepo = new git.Repo(),
+      master = new git.Reference();
+
+  test.expect(5);
+
+  // Test for function
+  helper.testFunction(test.equals, master.transaction, 'Ref::Transaction');
+
+  // Test repo argument existence
+  helper.testException(test.ok, function() {
+    master.transaction();
+  }, 'Throw an exception if no repo');
+
+  // Test updates argument existence
+  helper.testException(test.ok, function() {
+    master.transaction(testRepo);
+  }, 'Throw an exception if no updates');
+
+  // Test callback argument existence
+  helper.testException(test.ok, function() {
+    master.transaction(testRepo, []);
+  }, 'Throw an exception if no callback');
+
+  test.done();
+};
+
+/**
+ * Ref::Transaction against a fresh repository: create, compare-and-swap
+ * updates, deleting a packed ref and updating through HEAD.
+ */
+exports.transactionUpdates = function(test) {
+  var reference = new git.Reference(),
+      author = { name: 'A U Thor', email: 'author@example.com', time: 1234567890, offset: 0 };
+
+  test.expect(12);
+
+  rimraf('./test-transaction', function() {
+    var transactionRepo = new git.Repo();
+    transactionRepo.init('./test-transaction', true, function() {
+      var gitDir = path.resolve('./test-transaction');
+      transactionRepo.open(gitDir, function() {
+        (new git.TreeBuilder()).write(transactionRepo, null, [], function(error, tree) {
+          (new git.Commit()).create(transactionRepo, { tree: tree, author: author, message: 'One\n' }, function(error, one) {
+            (new git.Commit()).create(transactionRepo, { tree: tree, parents: [one], author: author, message: 'Two\n' }, function(error, two) {
+              var topic = path.join(gitDir, 'refs/heads/topic');
+
+              reference.transaction(transactionRepo, [{ name: 'refs/heads/topic', oldSha: null, newSha: one.sha() }], function(error) {
+                test.equals(null, error, 'Creating a reference should not error');
+                test.equals(fs.readFileSync(topic, 'utf8'), one.sha() + '\n', 'The reference should point at the new value');
+
+                reference.transaction(transactionRepo, [{ name: 'refs/heads/topic', oldSha: one.sha(), newSha: two.sha() }], function(error) {
+                  test.equals(null, error, 'Updating from the expected old value should not error');
+                  test.equals(fs.readFileSync(topic, 'utf8'), two.sha() + '\n', 'The reference should be updated');
+
+                  reference.transaction(transactionRepo, [{ name: 'refs/heads/topic', oldSha: one.sha(), newSha: one.sha() }], function(error) {
+                    test.ok(error, 'Updating from a stale old value should error');
+                    test.ok(fs.readFileSync(topic, 'utf8') === two.sha() + '\n' && !fs.existsSync(topic + '.lock'),
+                            'A failed update should leave the reference and no lock behind');
+
+                    var packedRefs = path.join(gitDir, 'packed-refs');
+                    fs.writeFileSync(packedRefs, '# pack-refs with: peeled \n' +
+                                                 one.sha() + ' refs/heads/old\n' +
+                                                 two.sha() + ' refs/tags/kept\n');
+                    reference.transaction(transactionRepo, [{ name: 'refs/heads/old', oldSha: one.sha() }], function(error) {
+                      test.equals(null, error, 'Deleting a packed reference should not error');
+                      var packed = fs.readFileSync(packedRefs, 'utf8');
+                      test.ok(packed.indexOf('refs/heads/old') === -1 && packed.indexOf('refs/tags/kept') !== -1,
+                              'packed-refs should be rewritten without the deleted reference');
+                      test.ok(!fs.existsSync(packedRefs + '.lock'), 'The packed-refs lock should be released');
+
+                      reference.transaction(transactionRepo, [{ name: 'HEAD', oldSha: null, newSha: one.sha() }], function(error) {
+                        test.equals(null, error, 'Updating HEAD should not error');
+                        test.ok(fs.readFileSync(path.join(gitDir, 'HEAD'), 'utf8') === 'ref: refs/heads/master\n' &&
+                                fs.readFileSync(path.join(gitDir, 'refs/heads/master'), 'utf8') === one.sha() + '\n',
+                                'Updating HEAD should write through to the branch it points at');
+
+                        reference.transaction(transactionRepo, [{ name: 'HEAD', oldSha: one.sha(), newSha: two.sha() },
+                                                                { name: 'refs/heads/master', oldSha: one.sha(), newSha: two.sha() }], function(error) {
+                          test.ok(error, 'Updating a branch both directly and through HEAD should error');
+                          rimraf('./test-transaction', test.done);
+                        });
+                      });
+                    });
+                  });
+                });
+              });
+            });
+          });
+        });
+      });
+    });
+  });
+};
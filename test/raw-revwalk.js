@@ -40,3 +40,196 @@ exports.constructor = function(test){
     test.done();
   });
 };
+
+/**
+ * RevWalk::Churn
+ */
+exports.churn = function(test) {
+  var knownSha = 'fce88902e66c72b5b93e75bdb5ae717038b221f6';
+
+  test.expect(11);
+
+  testRepo.open('../.git', function(error, repository) {
+    var revwalk = new git.RevWalk(repository);
+
+    // Test for function
+    helper.testFunction(test.equals, revwalk.churn, 'RevWalk::Churn');
+
+    // Test range argument existence
+    helper.testException(test.ok, function() {
+      revwalk.churn();
+    }, 'Throw an exception if no range');
+
+    // Test options argument existence
+    helper.testException(test.ok, function() {
+      revwalk.churn(knownSha);
+    }, 'Throw an exception if no options');
+
+    // Test records callback argument existence
+    helper.testException(test.ok, function() {
+      revwalk.churn(knownSha, {});
+    }, 'Throw an exception if no records callback');
+
+    // Test end callback argument existence
+    helper.testException(test.ok, function() {
+      revwalk.churn(knownSha, {}, function() {});
+    }, 'Throw an exception if no end callback');
+
+    var records = [];
+    revwalk.churn(knownSha + '^..' + knownSha, { threads: 2 }, function(batch) {
+      records = records.concat(batch);
+    }, function(error, count) {
+      test.equals(null, error, 'Churn should not error');
+      test.equals(count, 1, 'Range should contain a single commit');
+      test.equals(records.length, count, 'Every record should arrive before the end callback');
+      test.equals(records[0].sha, knownSha, 'Record should be for the known commit');
+      test.equals(records[0].additions, 1, 'Additions should match known value');
+      test.done();
+    });
+  });
+};
+
+/**
+ * RevWalk::Commits
+ */
+exports.commits = function(test) {
+  var knownSha = 'fce88902e66c72b5b93e75bdb5ae717038b221f6';
+
+  test.expect(8);
+
+  testRepo.open('../.git', function(error, repository) {
+    var revwalk = new git.RevWalk(repository);
+
+    // Test for function
+    helper.testFunction(test.equals, revwalk.commits, 'RevWalk::Commits');
+
+    // Test range argument existence
+    helper.testException(test.ok, function() {
+      revwalk.commits();
+    }, 'Throw an exception if no range');
+
+    // Test options argument existence
+    helper.testException(test.ok, function() {
+      revwalk.commits(knownSha);
+    }, 'Throw an exception if no options');
+
+    // Test end callback argument existence
+    helper.testException(test.ok, function() {
+      revwalk.commits(knownSha, {}, function() {});
+    }, 'Throw an exception if no end callback');
+
+    var shas = [];
+    revwalk.commits(knownSha + '^..' + knownSha, {}, function(batch) {
+      shas = shas.concat(batch);
+    }, function(error, summary) {
+      test.equals(null, error, 'Walking a range should not error');
+      test.equals(summary.count, 1, 'Range should contain a single commit');
+      test.deepEqual(shas, [knownSha], 'The batch should hold the known commit');
+      test.done();
+    });
+  });
+};
+
+/**
+ * Commit a chain of count empty commits on top of parent, moving master.
+ */
+var commitChain = function(repo, tree, parent, count, callback) {
+  if (count === 0) {
+    return callback(parent);
+  }
+  var options = {
+    tree: tree,
+    author: { name: 'A U Thor', email: 'author@example.com', time: 1234567890, offset: 0 },
+    message: 'Commit ' + count + '\n',
+    updateRef: 'refs/heads/master'
+  };
+  if (parent) {
+    options.parents = [parent];
+  }
+  (new git.Commit()).create(repo, options, function(error, commit) {
+    commitChain(repo, tree, commit, count - 1, callback);
+  });
+};
+
+/**
+ * RevWalk::Commits through the history cache
+ */
+exports.commitsCache = function(test) {
+  test.expect(8);
+
+  rimraf('./test-history-cache', function() {
+    var cacheRepo = new git.Repo();
+    cacheRepo.init('./test-history-cache', true, function() {
+      cacheRepo.open(path.resolve('./test-history-cache'), function() {
+        (new git.TreeBuilder()).write(cacheRepo, null, [], function(error, tree) {
+          commitChain(cacheRepo, tree, null, 3, function(third) {
+            var revwalk = new git.RevWalk(cacheRepo),
+                walked = [];
+            revwalk.commits('master', { cache: true }, function(batch) {
+              walked = walked.concat(batch);
+            }, function(error, summary) {
+              test.equals(null, error, 'Walking through the cache should not error');
+              test.ok(summary.loaded === 3 && summary.cached === 0, 'An uncached walk should read every commit');
+
+              var cachedWalk = [];
+              revwalk.commits('master', { cache: true }, function(batch) {
+                cachedWalk = cachedWalk.concat(batch);
+              }, function(error, summary) {
+                test.ok(summary.loaded === 0 && summary.cached === 3, 'A cached walk should read no commit');
+                test.deepEqual(cachedWalk, walked, 'A cached walk should be the walk it cached');
+
+                commitChain(cacheRepo, tree, third, 1, function(fourth) {
+                  var extendedWalk = [];
+                  revwalk.commits('master', { cache: true }, function(batch) {
+                    extendedWalk = extendedWalk.concat(batch);
+                  }, function(error, summary) {
+                    test.equals(summary.count, 4, 'The walk should hold the new commit');
+                    test.ok(summary.loaded === 1 && summary.cached === 3, 'Only the new commit should be read');
+                    test.equals(extendedWalk[0], fourth.sha(), 'The new commit should come first');
+                    test.deepEqual(extendedWalk.slice(1), walked, 'The cached walk should follow it');
+                    rimraf('./test-history-cache', test.done);
+                  });
+                });
+              });
+            });
+          });
+        });
+      });
+    });
+  });
+};
+
+/**
+ * RevWalk::MergeBase and RevWalk::IsAncestor
+ */
+exports.ancestry = function(test) {
+  var knownSha = 'fce88902e66c72b5b93e75bdb5ae717038b221f6';
+
+  test.expect(8);
+
+  testRepo.open('../.git', function(error, repository) {
+    var revwalk = new git.RevWalk(repository);
+
+    // Test for functions
+    helper.testFunction(test.equals, revwalk.mergeBase, 'RevWalk::MergeBase');
+    helper.testFunction(test.equals, revwalk.isAncestor, 'RevWalk::IsAncestor');
+
+    // Test oid argument validity
+    helper.testException(test.ok, function() {
+      revwalk.mergeBase(knownSha, 'not a sha', function() {});
+    }, 'Throw an exception if an oid is invalid');
+
+    // Test callback argument existence
+    helper.testException(test.ok, function() {
+      revwalk.isAncestor(knownSha, knownSha);
+    }, 'Throw an exception if no callback');
+
+    revwalk.mergeBase(knownSha, knownSha, function(error, base) {
+      test.equals(base, knownSha, 'A commit is its own merge base');
+      revwalk.isAncestor(knownSha, knownSha, function(error, isAncestor) {
+        test.equals(isAncestor, true, 'A commit is its own ancestor');
+        test.done();
+      });
+    });
+  });
+};
@@ -0,0 +1,123 @@
+var git = require('../').raw,
+    rimraf = require('rimraf'),
+    fs = require('fs'),
+    path = require('path');
+
+// Helper functions
+var helper = {
+  // Test if obj is a true function
+  testFunction: function(test, obj, label) {
+    // The object reports itself as a function
+    test(typeof obj, 'function', label +' reports as a function.');
+    // This ensures the repo is actually a derivative of the Function [[Class]]
+    test(toString.call(obj), '[object Function]', label +' [[Class]] is of type function.');
+  },
+  // Test code and handle exception thrown
+  testException: function(test, fun, label) {
+    try {
+      fun();
+      test(false, label);
+    }
+    catch (ex) {
+      test(true, label);
+    }
+  }
+};
+
+/**
+ * Status
+ */
+exports.constructor = function(test){
+  test.expect(3);
+
+  // Test for function
+  helper.testFunction(test.equals, git.Status, 'Status');
+
+  // Ensure we get an instance of Status
+  test.ok(new git.Status() instanceof git.Status, 'Invocation returns an instance of Status');
+
+  test.done();
+};
+
+/**
+ * Status::Scan
+ */
+exports.scan = function(test) {
+  var testRepo = new git.Repo(),
+      status = new git.Status();
+
+  test.expect(9);
+
+  // Test for function
+  helper.testFunction(test.equals, status.scan, 'Status::Scan');
+
+  // Test repo argument existence
+  helper.testException(test.ok, function() {
+    status.scan();
+  }, 'Throw an exception if no repo');
+
+  // Test options argument existence
+  helper.testException(test.ok, function() {
+    status.scan(testRepo);
+  }, 'Throw an exception if no options');
+
+  // Test progress callback argument existence
+  helper.testException(test.ok, function() {
+    status.scan(testRepo, {});
+  }, 'Throw an exception if no progress callback');
+
+  // Test callback argument existence
+  helper.testException(test.ok, function() {
+    status.scan(testRepo, {}, function() {});
+  }, 'Throw an exception if no callback');
+
+  testRepo.open(path.resolve('../.git'), function() {
+    status.scan(testRepo, { untracked: false, threads: 2 }, function() {}, function(error, result) {
+      test.equals(null, error, 'Scan should not error');
+      test.equals(result.unstaged.paths.length, result.unstaged.statuses.length, 'Unstaged paths and statuses should align');
+      test.equals(result.untracked.length, 0, 'Untracked files should not be listed when disabled');
+      test.done();
+    });
+  });
+};
+
+/**
+ * Status::Scan against a fresh working directory: a modified tracked file,
+ * an untracked file and directory, and directories git status would hide.
+ */
+exports.scanWorkingDirectory = function(test) {
+  var index = new git.Index(),
+      status = new git.Status();
+
+  test.expect(5);
+
+  rimraf('./test-status', function() {
+    var testRepo = new git.Repo();
+    testRepo.init('./test-status', false, function() {
+      fs.writeFileSync('./test-status/tracked.txt', 'tracked\n');
+      fs.writeFileSync('./test-status/.gitignore', '*.log\n');
+
+      testRepo.open(path.resolve('./test-status/.git'), function() {
+        index.addAll(testRepo, ['.'], {}, function(error) {
+          fs.writeFileSync('./test-status/tracked.txt', 'tracked and modified\n');
+          fs.writeFileSync('./test-status/untracked.txt', 'untracked\n');
+          fs.mkdirSync('./test-status/fresh');
+          fs.writeFileSync('./test-status/fresh/new.txt', 'new\n');
+          fs.mkdirSync('./test-status/empty');
+          fs.mkdirSync('./test-status/logs');
+          fs.writeFileSync('./test-status/logs/build.log', 'ignored\n');
+
+          status.scan(testRepo, { threads: 2 }, function() {}, function(error, result) {
+            test.equals(null, error, 'Scan should not error');
+            test.deepEqual(result.unstaged.paths, ['tracked.txt'], 'The modified file should be unstaged');
+            test.equals(result.unstaged.statuses[0], git.DiffList.deltaTypes.GIT_DELTA_MODIFIED, 'The file should be reported as modified');
+            test.deepEqual(result.untracked, ['fresh/', 'untracked.txt'], 'Untracked files and directories should be listed');
+            test.ok(result.untracked.indexOf('empty/') === -1 && result.untracked.indexOf('logs/') === -1,
+                    'Empty directories and those holding only ignored files should not be listed');
+            rimraf('./test-status', test.done);
+          });
+        });
+      });
+    });
+  });
+};
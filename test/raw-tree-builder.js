@@ -0,0 +1,114 @@
+var git = require('../').raw,
+    path = require('path'),
+    rimraf = require('rimraf');
+
+// Helper functions
+var helper = {
+  // Test if obj is a true function
+  testFunction: function(test, obj, label) {
+    // The object reports itself as a function
+    test(typeof obj, 'function', label +' reports as a function.');
+    // This ensures the repo is actually a derivative of the Function [[Class]]
+    test(toString.call(obj), '[object Function]', label +' [[Class]] is of type function.');
+  },
+  // Test code and handle exception thrown
+  testException: function(test, fun, label) {
+    try {
+      fun();
+      test(false, label);
+    }
+    catch (ex) {
+      test(true, label);
+    }
+  }
+};
+
+// Tree entries only need well formed oids, the objects need not exist
+var firstBlob = 'e69de29bb2d1d6434b8b29ae775ad8c2e48c5391',
+    secondBlob = 'd00491fd7e5bb6fa28c517a0bb32b8b506539d4d';
+
+/**
+ * TreeBuilder
+ */
+exports.constructor = function(test){
+  test.expect(3);
+
+  // Test for function
+  helper.testFunction(test.equals, git.TreeBuilder, 'TreeBuilder');
+
+  // Ensure we get an instance of TreeBuilder
+  test.ok(new git.TreeBuilder() instanceof git.TreeBuilder, 'Invocation returns an instance of TreeBuilder');
+
+  test.done();
+};
+
+/**
+ * TreeBuilder::Write
+ */
+exports.write = function(test) {
+  var builder = new git.TreeBuilder();
+
+  test.expect(14);
+
+  // Test for function
+  helper.testFunction(test.equals, builder.write, 'TreeBuilder::Write');
+
+  // Test repo argument existence
+  helper.testException(test.ok, function() {
+    builder.write();
+  }, 'Throw an exception if no repo');
+
+  // Test base argument existence
+  helper.testException(test.ok, function() {
+    builder.write(new git.Repo());
+  }, 'Throw an exception if no base');
+
+  // Test updates argument existence
+  helper.testException(test.ok, function() {
+    builder.write(new git.Repo(), null);
+  }, 'Throw an exception if no updates');
+
+  // Test callback argument existence
+  helper.testException(test.ok, function() {
+    builder.write(new git.Repo(), null, []);
+  }, 'Throw an exception if no callback');
+
+  rimraf('./test-tree-builder', function() {
+    var testRepo = new git.Repo();
+    testRepo.init('./test-tree-builder', true, function() {
+      testRepo.open(path.resolve('./test-tree-builder'), function() {
+        var updates = [
+          { path: 'dir/sub/third.txt', oid: firstBlob },
+          { path: 'first.txt', oid: firstBlob },
+          { path: 'dir/second.txt', oid: firstBlob, mode: parseInt('100755', 8) }
+        ];
+        builder.write(testRepo, null, updates, function(error, oid, written) {
+          test.equals(null, error, 'Writing from an empty base should not error');
+          test.equals(written, 3, 'The root and both directories should be written');
+
+          builder.write(testRepo, oid, [{ path: 'dir/second.txt', oid: secondBlob }], function(error, updated, written) {
+            test.equals(written, 2, 'Only the root and the updated directory should be written');
+            test.notEqual(updated.sha(), oid.sha(), 'The root should change');
+
+            builder.write(testRepo, updated, [{ path: 'dir/sub/third.txt', oid: null }], function(error, removed, written) {
+              test.equals(written, 2, 'The emptied directory should not be written');
+
+              builder.write(testRepo, removed, [{ path: 'dir/sub/third.txt', oid: firstBlob }, { path: 'dir/second.txt', oid: firstBlob, mode: parseInt('100755', 8) }], function(error, restored) {
+                test.equals(restored.sha(), oid.sha(), 'Restoring every path should give the original tree');
+
+                builder.write(testRepo, null, [{ path: 'dir', oid: firstBlob }, { path: 'dir/second.txt', oid: firstBlob }], function(error) {
+                  test.notEqual(null, error, 'A path used as both a file and a directory should error');
+
+                  builder.write(testRepo, null, [{ path: 'first.txt', oid: firstBlob }, { path: 'first.txt', oid: secondBlob }], function(error) {
+                    test.notEqual(null, error, 'A path updated twice should error');
+                    rimraf('./test-tree-builder', test.done);
+                  });
+                });
+              });
+            });
+          });
+        });
+      });
+    });
+  });
+};